@@ -0,0 +1,156 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "decimal128.h"
+
+/*
+ * Decimal128 conversions and arithmetic on prices: parsing and formatting
+ * against strtod() and snprintf() of doubles, addition and comparison.
+ * Usage: bench_decimal128 [iterations]
+ */
+
+#define NPRICES     4096
+
+static uint64_t s_seed = 0x5eed;
+
+static uint64_t next_random()
+{
+    uint64_t z = (s_seed += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static char s_text[NPRICES][48];
+static size_t s_len[NPRICES];
+static bson_decimal128_t s_dec[NPRICES];
+static double s_dbl[NPRICES];
+
+/* Prices with 2 to 6 decimals, some with long coefficients */
+static void make_prices()
+{
+    static const uint64_t pow10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+    for (int i = 0; i < NPRICES; ++i)
+    {
+        const uint64_t r = next_random();
+        const int scale = 2 + (int)(r % 5);
+        const uint64_t units = i % 64 == 0 ? next_random() % 10000000000000000ull : (r >> 8) % 1000000;
+        const uint64_t frac = next_random() % pow10[scale];
+        s_len[i] = sprintf(s_text[i], "%s%llu.%0*llu", r & 0x80 ? "-" : "", (unsigned long long)units,
+                           scale, (unsigned long long)frac);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    long iterations = argc > 1 ? strtol(argv[1], 0, 10) : 500;
+    make_prices();
+    
+    /* Round trip must reproduce the text */
+    char buffer[bson_decimal128_string_size];
+    for (int i = 0; i < NPRICES; ++i)
+    {
+        if(bson_decimal128_from_string(&s_dec[i], s_text[i], s_len[i]) ||
+           bson_decimal128_to_string(&s_dec[i], buffer) != s_len[i] || memcmp(buffer, s_text[i], s_len[i]))
+        {
+            fprintf(stderr, "round trip failed: %s\n", s_text[i]);
+            return EXIT_FAILURE;
+        }
+        s_dbl[i] = strtod(s_text[i], 0);
+    }
+    
+    const double ops = (double)iterations * NPRICES;
+    uint64_t check = 0;
+    
+    double t = now_sec();
+    for (long it = 0; it < iterations; ++it)
+        for (int i = 0; i < NPRICES; ++i)
+        {
+            bson_decimal128_from_string(&s_dec[i], s_text[i], s_len[i]);
+            check += s_dec[i].low;
+        }
+    const double t_parse = (now_sec() - t) / ops;
+    
+    t = now_sec();
+    for (long it = 0; it < iterations; ++it)
+        for (int i = 0; i < NPRICES; ++i)
+        {
+            s_dbl[i] = strtod(s_text[i], 0);
+            check += (uint64_t)s_dbl[i];
+        }
+    const double t_strtod = (now_sec() - t) / ops;
+    
+    t = now_sec();
+    for (long it = 0; it < iterations; ++it)
+        for (int i = 0; i < NPRICES; ++i)
+        {
+            check += bson_decimal128_to_string(&s_dec[i], buffer);
+        }
+    const double t_format = (now_sec() - t) / ops;
+    
+    t = now_sec();
+    for (long it = 0; it < iterations; ++it)
+        for (int i = 0; i < NPRICES; ++i)
+        {
+            check += snprintf(buffer, sizeof(buffer), "%.6f", s_dbl[i]);
+        }
+    const double t_snprintf = (now_sec() - t) / ops;
+    
+    bson_decimal128_t sum = BSON_DECIMAL128_INITIALIZER;
+    t = now_sec();
+    for (long it = 0; it < iterations; ++it)
+        for (int i = 0; i < NPRICES; ++i)
+        {
+            bson_decimal128_add(&sum, &sum, &s_dec[i]);
+        }
+    const double t_add = (now_sec() - t) / ops;
+    
+    int order = 0;
+    t = now_sec();
+    for (long it = 0; it < iterations; ++it)
+        for (int i = 1; i < NPRICES; ++i)
+        {
+            order += bson_decimal128_compare(&s_dec[i - 1], &s_dec[i]);
+        }
+    const double t_compare = (now_sec() - t) / ops;
+    
+    bson_decimal128_to_string(&sum, buffer);
+    printf("from_string  %6.1f ns/op  (strtod   %6.1f ns/op)\n", t_parse * 1e9, t_strtod * 1e9);
+    printf("to_string    %6.1f ns/op  (snprintf %6.1f ns/op)\n", t_format * 1e9, t_snprintf * 1e9);
+    printf("add          %6.1f ns/op\n", t_add * 1e9);
+    printf("compare      %6.1f ns/op\n", t_compare * 1e9);
+    printf("sum=%s order=%d check=%llu\n", buffer, order, (unsigned long long)check);
+    return EXIT_SUCCESS;
+}
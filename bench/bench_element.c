@@ -0,0 +1,305 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "documentbuilder.h"
+#include "iterator.h"
+
+/*
+ * Table-driven value sizes against the former switch, and the iterator
+ * with cached key length against the former iterator and element
+ * accessors, on documents with a typical mix of types.
+ * Usage: bench_element [iterations]
+ */
+
+#define NDOCS       256
+#define NFIELDS     24
+
+static uint64_t s_seed = 0x5eed;
+
+static uint64_t next_random()
+{
+    uint64_t z = (s_seed += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* The switch bson_value_size() used to be */
+static size_t switch_value_size(bson_type_t type, const char* __restrict value)
+{
+    size_t size = 0;
+    switch (type) {
+        case bson_type_date:
+        case bson_type_long:
+        case bson_type_float:
+        case bson_type_timestamp:
+            size = 8;
+            break;
+        case bson_type_code:
+        case bson_type_symbol:
+        case bson_type_string:
+            size = sizeof(int32_t) + *(int32_t*)value;
+            break;
+        case bson_type_array:
+        case bson_type_document:
+            size = *(int32_t*)value;
+            break;
+        case bson_type_bindata:
+            size = sizeof(int32_t) + 1 + *(int32_t*)value;
+            break;
+        case bson_type_oid:
+            size = bson_oid_size;
+            break;
+        case bson_type_bool:
+            size = 1;
+            break;
+        case bson_type_regex:
+        {
+            size_t pattern_len = strlen(value) + 1;
+            size = pattern_len + strlen(value + pattern_len) + 1;
+            break;
+        }
+        case bson_type_int:
+            size = 4;
+            break;
+        case bson_type_undefined:
+        case bson_type_null:
+        case bson_type_minkey:
+        case bson_type_maxkey:
+            break;
+        default:
+            assert(0);
+            break;
+    }
+    return size;
+}
+
+/* Element size as computed before: the key is measured twice */
+static size_t switch_element_size(bson_element_ref e)
+{
+    return 1 + bson_element_key_size(e) + switch_value_size(bson_element_type(e), bson_element_value(e));
+}
+
+static bson_document_ref make_document(int depth)
+{
+    static const char* const words[] = { "alpha", "status", "pending", "description of the item", "" };
+    bson_document_builder_ref b = bson_document_builder_create();
+    bson_oid_t oid;
+    char key[24];
+    for (int i = 0; i < NFIELDS; ++i)
+    {
+        int n = snprintf(key, sizeof(key), "field%d", i);
+        unsigned r = next_random() % 100;
+        if(r < 25)
+        {
+            bson_document_builder_append_i_n(b, key, n, (int32_t)next_random());
+        }
+        else if(r < 50)
+        {
+            const char* w = words[next_random() % 5];
+            bson_document_builder_append_str_n(b, key, n, w, strlen(w));
+        }
+        else if(r < 65)
+        {
+            bson_document_builder_append_d_n(b, key, n, (double)next_random() / 3);
+        }
+        else if(r < 75)
+        {
+            bson_document_builder_append_b_n(b, key, n, r & 1);
+        }
+        else if(r < 83)
+        {
+            bson_document_builder_append_date_n(b, key, n, 1388534400000ll + (int64_t)(next_random() % 100000000));
+        }
+        else if(r < 90)
+        {
+            bson_oid_init_sequential(&oid);
+            bson_document_builder_append_oid_n(b, key, n, &oid);
+        }
+        else if(r < 95)
+        {
+            bson_document_builder_append_l_n(b, key, n, (int64_t)next_random());
+        }
+        else if(r < 98 || depth > 1)
+        {
+            bson_document_builder_append_null_n(b, key, n);
+        }
+        else
+        {
+            bson_document_ref child = make_document(depth + 1);
+            bson_document_builder_append_doc_n(b, key, n, child);
+            bson_document_destroy(child);
+        }
+    }
+    return bson_document_builder_finalize(b);
+}
+
+static uint64_t walk_switch(bson_document_ref doc)
+{
+    uint64_t n = 0;
+    const char* p = doc->data + 4;
+    while(*p != bson_type_eoo)
+    {
+        bson_element_ref el = bson_element_create_with_data(p);
+        size_t size = switch_element_size(el);
+        n += size;
+        p += size;
+    }
+    return n;
+}
+
+static uint64_t walk_table(bson_document_ref doc)
+{
+    uint64_t n = 0;
+    const char* p = doc->data + 4;
+    while(*p != bson_type_eoo)
+    {
+        bson_element_ref el = bson_element_create_with_data(p);
+        size_t size = bson_element_size(el);
+        n += size;
+        p += size;
+    }
+    return n;
+}
+
+/* The iterator as it was: out of line, measuring keys twice per step */
+static __attribute__((noinline)) bson_element_ref old_iterator_next(bson_iterator_ref __restrict i)
+{
+    if(i->next_off == 0)
+        return 0;
+    i->curr_off = i->next_off;
+    bson_element_ref el = bson_element_create_with_data(i->d->data + i->curr_off);
+    if(bson_element_type(el) == bson_type_eoo)
+    {
+        i->next_off = 0;
+    }
+    else
+    {
+        i->next_off = i->curr_off + switch_element_size(el);
+    }
+    return el;
+}
+
+/* Reads key and value of every element through element accessors */
+static uint64_t iterate_accessors(bson_document_ref doc)
+{
+    uint64_t n = 0;
+    bson_iterator_t iter;
+    bson_element_ref el;
+    iter.d = doc;
+    iter.next_off = 4;
+    for (el = old_iterator_next(&iter); !bson_iterator_end(&iter); el = old_iterator_next(&iter))
+    {
+        const char* key = bson_element_fieldname(el);
+        n += strlen(key) + key[0] + (unsigned char)*bson_element_value(el);
+    }
+    return n;
+}
+
+/* The same through the cached key length and value */
+static uint64_t iterate_cached(bson_document_ref doc)
+{
+    uint64_t n = 0;
+    bson_iterator_t iter;
+    for (bson_iterator_init(&iter, doc); !bson_iterator_end(&iter); bson_iterator_next(&iter))
+    {
+        const char* key = bson_iterator_key(&iter);
+        n += bson_iterator_key_len(&iter) + key[0] + (unsigned char)*bson_iterator_value(&iter);
+    }
+    return n;
+}
+
+static double measure(uint64_t (*fn)(bson_document_ref), bson_document_ref* docs, long iterations,
+                      uint64_t* result)
+{
+    uint64_t n = 0;
+    double best = 1e30;
+    for (int r = 0; r < 3; ++r)
+    {
+        n = 0;
+        double t = now_sec();
+        for (long i = 0; i < iterations; ++i)
+        {
+            for (int d = 0; d < NDOCS; ++d)
+            {
+                n += fn(docs[d]);
+            }
+        }
+        t = now_sec() - t;
+        if(t < best)
+        {
+            best = t;
+        }
+    }
+    *result = n;
+    return best / iterations / NDOCS;
+}
+
+int main(int argc, char* argv[])
+{
+    long iterations = argc > 1 ? strtol(argv[1], 0, 10) : 2000;
+    bson_document_ref docs[NDOCS];
+    for (int d = 0; d < NDOCS; ++d)
+    {
+        docs[d] = make_document(0);
+    }
+
+    uint64_t a, b;
+    double t_switch = measure(walk_switch, docs, iterations, &a);
+    double t_table = measure(walk_table, docs, iterations, &b);
+    if(a != b)
+    {
+        fprintf(stderr, "sizes differ\n");
+        return EXIT_FAILURE;
+    }
+    printf("element size  switch=%7.1f ns/doc  table=%7.1f ns/doc  speedup=%.2f\n",
+           t_switch * 1e9, t_table * 1e9, t_switch / t_table);
+
+    double t_accessors = measure(iterate_accessors, docs, iterations, &a);
+    double t_cached = measure(iterate_cached, docs, iterations, &b);
+    if(a != b)
+    {
+        fprintf(stderr, "iterators differ\n");
+        return EXIT_FAILURE;
+    }
+    printf("iterator      former=%7.1f ns/doc  cached=%7.1f ns/doc  speedup=%.2f\n",
+           t_accessors * 1e9, t_cached * 1e9, t_accessors / t_cached);
+
+    for (int d = 0; d < NDOCS; ++d)
+    {
+        bson_document_destroy(docs[d]);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,213 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cpu.h"
+#include "cursor.h"
+#include "documentbuilder.h"
+#include "findkey.h"
+
+/*
+ * Key search: bson_cursor_find() against the portable, SSE4.2 and AVX2
+ * kernels of bson_document_find_key() on documents with many short keys.
+ * Usage: bench_findkey [iterations]
+ */
+
+#define NDOCS       64
+#define NFIELDS     64
+#define NLOOKUPS    16
+
+static uint64_t s_seed = 0x5eed;
+
+static uint64_t next_random()
+{
+    uint64_t z = (s_seed += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bson_document_ref make_document()
+{
+    bson_document_builder_ref b = bson_document_builder_create();
+    char key[48];
+    for (int i = 0; i < NFIELDS; ++i)
+    {
+        /* Mostly short keys, a few longer than a vector */
+        int n = i % 16 == 15 ? sprintf(key, "a_rather_long_field_name_number_%d", i) : sprintf(key, "f%d", i);
+        if(next_random() & 1)
+        {
+            bson_document_builder_append_i_n(b, key, n, (int32_t)next_random());
+        }
+        else
+        {
+            bson_document_builder_append_str_n(b, key, n, "value", 5);
+        }
+    }
+    return bson_document_builder_finalize(b);
+}
+
+static char s_keys[NLOOKUPS][48];
+static size_t s_nkeys[NLOOKUPS];
+
+static void make_keys()
+{
+    for (int i = 0; i < NLOOKUPS; ++i)
+    {
+        /* Hits spread over the document and a few misses */
+        int field = (int)(next_random() % (NFIELDS + NFIELDS / 4));
+        if(field >= NFIELDS)
+            s_nkeys[i] = sprintf(s_keys[i], "missing%d", field);
+        else if(field % 16 == 15)
+            s_nkeys[i] = sprintf(s_keys[i], "a_rather_long_field_name_number_%d", field);
+        else
+            s_nkeys[i] = sprintf(s_keys[i], "f%d", field);
+    }
+}
+
+static uint64_t find_cursor(bson_document_ref doc)
+{
+    uint64_t n = 0;
+    for (int i = 0; i < NLOOKUPS; ++i)
+    {
+        bson_cursor_t c;
+        bson_cursor_init(&c, doc);
+        if(bson_cursor_find(&c, s_keys[i]))
+        {
+            n += (uint64_t)(c.value - doc->data);
+        }
+    }
+    return n;
+}
+
+static bson_find_key_kernel_t s_kernel;
+
+static uint64_t find_kernel(bson_document_ref doc)
+{
+    uint64_t n = 0;
+    for (int i = 0; i < NLOOKUPS; ++i)
+    {
+        const char* e = s_kernel(doc->data, s_keys[i], s_nkeys[i]);
+        if(e)
+        {
+            n += (uint64_t)(e + 2 + s_nkeys[i] - doc->data);
+        }
+    }
+    return n;
+}
+
+static double measure(uint64_t (*fn)(bson_document_ref), bson_document_ref* docs, long iterations,
+                      uint64_t* result)
+{
+    uint64_t n = 0;
+    double best = 1e30;
+    for (int r = 0; r < 3; ++r)
+    {
+        n = 0;
+        double t = now_sec();
+        for (long i = 0; i < iterations; ++i)
+        {
+            for (int d = 0; d < NDOCS; ++d)
+            {
+                n += fn(docs[d]);
+            }
+        }
+        t = now_sec() - t;
+        if(t < best)
+        {
+            best = t;
+        }
+    }
+    *result = n;
+    return best / iterations / NDOCS / NLOOKUPS;
+}
+
+int main(int argc, char* argv[])
+{
+    long iterations = argc > 1 ? strtol(argv[1], 0, 10) : 2000;
+    bson_document_ref docs[NDOCS];
+    for (int d = 0; d < NDOCS; ++d)
+    {
+        docs[d] = make_document();
+    }
+    make_keys();
+
+    uint64_t expected, n;
+    double t_cursor = measure(find_cursor, docs, iterations, &expected);
+    printf("cursor    %7.1f ns/lookup\n", t_cursor * 1e9);
+
+    static const struct
+    {
+        const char* name;
+        bson_find_key_kernel_t kernel;
+        uint32_t feature;
+    } kernels[] = {
+        { "portable", bson_find_key_portable, 0 },
+#ifdef BSON_HAVE_X86_SIMD
+        { "sse42", bson_find_key_sse42, BSON_CPU_SSE42 },
+        { "avx2", bson_find_key_avx2, BSON_CPU_AVX2 },
+#endif
+    };
+
+    int rc = EXIT_SUCCESS;
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k)
+    {
+        if(kernels[k].feature && !bson_cpu_has(kernels[k].feature))
+        {
+            continue;
+        }
+        s_kernel = kernels[k].kernel;
+        double t = measure(find_kernel, docs, iterations, &n);
+        if(n != expected)
+        {
+            fprintf(stderr, "%s: results differ\n", kernels[k].name);
+            rc = EXIT_FAILURE;
+        }
+        printf("%-9s %7.1f ns/lookup  speedup=%.2f\n", kernels[k].name, t * 1e9, t_cursor / t);
+    }
+
+    /* The public entry point agrees with the kernels */
+    bson_element_ref e = bson_document_find_key(docs[0], s_keys[0], s_nkeys[0]);
+    if((const char*)e != bson_find_key_portable(docs[0]->data, s_keys[0], s_nkeys[0]))
+    {
+        fprintf(stderr, "bson_document_find_key: result differs\n");
+        rc = EXIT_FAILURE;
+    }
+
+    for (int d = 0; d < NDOCS; ++d)
+    {
+        bson_document_destroy(docs[d]);
+    }
+    return rc;
+}
@@ -0,0 +1,135 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "documentbuilder.h"
+#include "handle.h"
+
+/*
+ * Sharing a document with reader threads: deep copy per reader against
+ * retain and release of a handle.
+ * Usage: bench_handle [shares per thread] [threads]
+ */
+
+struct bench_reader
+{
+    bson_handle_ref     handle;
+    long                count;
+    int                 copy;
+    int64_t             sum;
+};
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void* bench_share(void* arg)
+{
+    struct bench_reader* r = (struct bench_reader *)arg;
+    bson_document_ref shared = bson_handle_document(r->handle);
+    const int32_t size = bson_document_size(shared);
+    for (long i = 0; i < r->count; ++i)
+    {
+        if(r->copy)
+        {
+            bson_document_ref doc = malloc(size);
+            memcpy((char *)doc->data, shared->data, size);
+            r->sum += doc->data[size / 2];
+            bson_document_destroy(doc);
+        }
+        else
+        {
+            bson_handle_ref h = bson_handle_retain(r->handle);
+            r->sum += bson_handle_document(h)->data[size / 2];
+            bson_handle_release(h);
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    long count = argc > 1 ? strtol(argv[1], 0, 10) : 200000;
+    int nthreads = argc > 2 ? atoi(argv[2]) : 4;
+    if(nthreads < 1)
+    {
+        nthreads = 1;
+    }
+    
+    pthread_t* threads = malloc(nthreads * sizeof(pthread_t));
+    struct bench_reader* readers = malloc(nthreads * sizeof(struct bench_reader));
+    static const int fields[] = { 4, 64, 1024 };
+    int rc = EXIT_SUCCESS;
+    for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); ++f)
+    {
+        bson_document_builder_ref b = bson_document_builder_create();
+        char key[24];
+        for (int i = 0; i < fields[f]; ++i)
+        {
+            snprintf(key, sizeof(key), "field_%d", i);
+            bson_document_builder_append_str(b, key, "a value of moderate length");
+        }
+        bson_document_ref doc = bson_document_builder_finalize(b);
+        const int32_t size = bson_document_size(doc);
+        bson_handle_ref h = bson_handle_create(doc);
+        
+        double ns[2];
+        int64_t sums[2] = { 0, 0 };
+        for (int copy = 1; copy >= 0; --copy)
+        {
+            double t = now_sec();
+            for (int i = 0; i < nthreads; ++i)
+            {
+                readers[i].handle = h;
+                readers[i].count = count;
+                readers[i].copy = copy;
+                readers[i].sum = 0;
+                pthread_create(&threads[i], 0, bench_share, &readers[i]);
+            }
+            for (int i = 0; i < nthreads; ++i)
+            {
+                pthread_join(threads[i], 0);
+                sums[copy] += readers[i].sum;
+            }
+            ns[copy] = (now_sec() - t) / count / nthreads * 1e9;
+        }
+        if(sums[0] != sums[1] || bson_handle_refs(h) != 1)
+        {
+            rc = EXIT_FAILURE;
+        }
+        printf("%6d bytes, %d threads: copy %7.1f ns, handle %6.1f ns%s\n", size, nthreads, ns[1], ns[0],
+               rc ? " FAILED" : "");
+        bson_handle_release(h);
+    }
+    free(readers);
+    free(threads);
+    return rc;
+}
@@ -0,0 +1,114 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "documentbuilder.h"
+#include "hash.h"
+
+/*
+ * Hashing of whole documents in both modes and of one path across
+ * a batch of documents.
+ * Usage: bench_hash [iterations]
+ */
+
+#define NDOCS       10000
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bson_document_ref make_document(int i)
+{
+    bson_document_builder_ref address = bson_document_builder_create();
+    bson_document_builder_append_str(address, "street", "1 Main Street");
+    bson_document_builder_append_str(address, "city", i & 1 ? "Springfield" : "Shelbyville");
+    bson_document_builder_append_i(address, "zip", 10000 + i % 900);
+    bson_document_ref a = bson_document_builder_finalize(address);
+    
+    bson_document_builder_ref b = bson_document_builder_create();
+    bson_oid_t oid;
+    bson_oid_init_sequential(&oid);
+    bson_document_builder_append_oid(b, "_id", &oid);
+    bson_document_builder_append_l(b, "customer", i * 7919ll);
+    bson_document_builder_append_d(b, "total", i * 0.25);
+    bson_document_builder_append_str(b, "status", "shipped");
+    bson_document_builder_append_doc(b, "address", a);
+    bson_document_builder_append_date(b, "created", 1388534400000ll + i);
+    bson_document_destroy(a);
+    return bson_document_builder_finalize(b);
+}
+
+int main(int argc, char* argv[])
+{
+    long iterations = argc > 1 ? strtol(argv[1], 0, 10) : 50;
+    static bson_document_ref docs[NDOCS];
+    static uint64_t hashes[NDOCS];
+    uint64_t bytes = 0, sum = 0;
+    for (int i = 0; i < NDOCS; ++i)
+    {
+        docs[i] = make_document(i);
+        int32_t size = bson_document_size(docs[i]);
+        bytes += size;
+    }
+    
+    static const char* const modes[] = { "raw", "semantic" };
+    for (int mode = bson_hash_raw; mode <= bson_hash_semantic; ++mode)
+    {
+        double t = now_sec();
+        for (long it = 0; it < iterations; ++it)
+        {
+            for (int i = 0; i < NDOCS; ++i)
+            {
+                sum += bson_hash_document(docs[i], mode, BSON_HASH_SEED);
+            }
+        }
+        t = now_sec() - t;
+        printf("document %-8s %7.1f ns/doc %8.1f MB/s\n", modes[mode], t / iterations / NDOCS * 1e9,
+               bytes * iterations / t / 1e6);
+    }
+    
+    static const char* const paths[] = { "_id", "customer", "address.city" };
+    for (int p = 0; p < 3; ++p)
+    {
+        double t = now_sec();
+        for (long it = 0; it < iterations; ++it)
+        {
+            bson_hash_path(docs, NDOCS, paths[p], bson_hash_semantic, BSON_HASH_SEED, hashes);
+            sum += hashes[it % NDOCS];
+        }
+        t = now_sec() - t;
+        printf("path %-12s %7.1f ns/doc\n", paths[p], t / iterations / NDOCS * 1e9);
+    }
+    
+    for (int i = 0; i < NDOCS; ++i)
+    {
+        bson_document_destroy(docs[i]);
+    }
+    return sum == 0;
+}
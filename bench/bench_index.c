@@ -0,0 +1,175 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "batch.h"
+#include "documentbuilder.h"
+#include "findkey.h"
+#include "index.h"
+
+/*
+ * Secondary index on "user.age" against full scans: bulk build, point
+ * lookups and a narrow range, checking that both find the same documents.
+ * Usage: bench_index [documents] [lookups]
+ */
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t s_seed = 0x1dea;
+
+static uint64_t next_random()
+{
+    uint64_t z = (s_seed += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/* Documents with age in [lo, hi] found by a full scan */
+static size_t scan_range(bson_batch_ref b, int32_t lo, int32_t hi)
+{
+    size_t found = 0;
+    for (size_t i = 0; i < bson_batch_count(b); ++i)
+    {
+        bson_element_ref e = bson_document_find_path(bson_batch_get(b, i), "user.age", 8);
+        if(e && bson_element_type(e) == bson_type_int)
+        {
+            int32_t v;
+            memcpy(&v, bson_element_value(e), sizeof(v));
+            found += v >= lo && v <= hi;
+        }
+    }
+    return found;
+}
+
+int main(int argc, char* argv[])
+{
+    long ndocs = argc > 1 ? strtol(argv[1], 0, 10) : 1000000;
+    long nlookups = argc > 2 ? strtol(argv[2], 0, 10) : 100000;
+    const int32_t nvalues = (int32_t)(ndocs / 4 + 1);
+    
+    bson_batch_t b = BSON_BATCH_INITIALIZER;
+    for (long i = 0; i < ndocs; ++i)
+    {
+        bson_document_builder_ref user = bson_document_builder_create();
+        bson_document_builder_append_str(user, "name", "somebody");
+        bson_document_builder_append_i(user, "age", (int32_t)(next_random() % nvalues));
+        bson_document_ref u = bson_document_builder_finalize(user);
+        bson_document_builder_ref d = bson_document_builder_create();
+        bson_document_builder_append_l(d, "_id", i);
+        bson_document_builder_append_doc(d, "user", u);
+        bson_document_builder_append_str(d, "note", "text of the document");
+        bson_document_ref doc = bson_document_builder_finalize(d);
+        bson_batch_append(&b, doc);
+        bson_document_destroy(doc);
+        bson_document_destroy(u);
+    }
+    
+    char name[] = "/tmp/bench_index_XXXXXX";
+    int fd = mkstemp(name);
+    if(fd < 0)
+    {
+        perror("mkstemp");
+        return EXIT_FAILURE;
+    }
+    unlink(name);
+    
+    double t = now_sec();
+    if(bson_index_build(fd, bson_batch_data(&b), bson_batch_size(&b), "user.age"))
+    {
+        fprintf(stderr, "build failed\n");
+        return EXIT_FAILURE;
+    }
+    const double build = now_sec() - t;
+    bson_index_ref idx = bson_index_open(fd);
+    if(!idx)
+    {
+        fprintf(stderr, "open failed\n");
+        return EXIT_FAILURE;
+    }
+    printf("build %ld documents: %.1f ms, %.1f ns/doc, %lld KB\n", ndocs, build * 1e3, build / ndocs * 1e9,
+           (long long)lseek(fd, 0, SEEK_END) / 1024);
+    
+    int rc = EXIT_SUCCESS;
+    size_t found = 0;
+    t = now_sec();
+    for (long i = 0; i < nlookups; ++i)
+    {
+        int32_t v = (int32_t)(next_random() % nvalues);
+        bson_index_cursor_t c;
+        uint64_t offset;
+        bson_index_find(idx, bson_type_int, (const char *)&v, &c);
+        while(bson_index_cursor_next(&c, &offset))
+        {
+            bson_document_ref doc = (bson_document_ref)(bson_batch_data(&b) + offset);
+            bson_element_ref e = bson_document_find_path(doc, "user.age", 8);
+            if(memcmp(bson_element_value(e), &v, sizeof(v)) != 0)
+            {
+                rc = EXIT_FAILURE;
+            }
+            found++;
+        }
+    }
+    t = now_sec() - t;
+    printf("point lookups: %.1f ns/lookup, %.2f documents/lookup\n", t / nlookups * 1e9, (double)found / nlookups);
+    
+    /* Range of about 1000 documents */
+    const int32_t lo = nvalues / 2, hi = lo + 249;
+    char klo[BSON_INDEX_KEY_SIZE], khi[BSON_INDEX_KEY_SIZE];
+    size_t nlo = bson_index_key(bson_type_int, (const char *)&lo, klo);
+    size_t nhi = bson_index_key(bson_type_int, (const char *)&hi, khi);
+    t = now_sec();
+    bson_index_cursor_t c;
+    uint64_t offset;
+    size_t in_range = 0;
+    bson_index_range(idx, klo, nlo, khi, nhi, &c);
+    while(bson_index_cursor_next(&c, &offset))
+    {
+        in_range++;
+    }
+    const double range = now_sec() - t;
+    t = now_sec();
+    size_t scanned = scan_range(&b, lo, hi);
+    const double scan = now_sec() - t;
+    printf("range of %zu documents: index %.1f us, full scan %.1f us\n", in_range, range * 1e6, scan * 1e6);
+    if(in_range != scanned)
+    {
+        fprintf(stderr, "range found %zu documents, scan %zu\n", in_range, scanned);
+        rc = EXIT_FAILURE;
+    }
+    
+    bson_index_close(idx);
+    close(fd);
+    bson_batch_deinit(&b);
+    return rc;
+}
@@ -0,0 +1,120 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hash.h"
+#include "jsoncache.h"
+#include "jsonparser.h"
+
+/*
+ * Repeated conversion of configuration-like JSON blobs: json2bson() on
+ * every call against the cache, and the hash alone.
+ * Usage: bench_jsoncache [iterations]
+ */
+
+#define NBLOBS      64
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static size_t make_blob(char* json, int index, int fields)
+{
+    size_t n = sprintf(json, "{\"template\": %d", index);
+    for (int i = 0; i < fields; ++i)
+    {
+        n += sprintf(json + n, ", \"option_%d\": {\"enabled\": %s, \"limit\": %d, \"label\": \"value %d of %d\"}",
+                     i, i & 1 ? "true" : "false", i * 37, i, index);
+    }
+    json[n++] = '}';
+    json[n] = '\0';
+    return n;
+}
+
+int main(int argc, char* argv[])
+{
+    long iterations = argc > 1 ? strtol(argv[1], 0, 10) : 200;
+    static const int fields[] = { 4, 32, 256 };
+    
+    for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); ++f)
+    {
+        char* blobs[NBLOBS];
+        size_t sizes[NBLOBS];
+        for (int i = 0; i < NBLOBS; ++i)
+        {
+            blobs[i] = malloc(64 + fields[f] * 96);
+            sizes[i] = make_blob(blobs[i], i, fields[f]);
+        }
+        
+        double t = now_sec();
+        for (long it = 0; it < iterations; ++it)
+        {
+            for (int i = 0; i < NBLOBS; ++i)
+            {
+                bson_document_destroy(json2bson(blobs[i], sizes[i]));
+            }
+        }
+        const double parse = (now_sec() - t) / iterations / NBLOBS * 1e9;
+        
+        bson_json_cache_ref cache = bson_json_cache_create(64 << 20);
+        t = now_sec();
+        for (long it = 0; it < iterations; ++it)
+        {
+            for (int i = 0; i < NBLOBS; ++i)
+            {
+                bson_handle_release(bson_json_cache_get(cache, blobs[i], sizes[i]));
+            }
+        }
+        const double cached = (now_sec() - t) / iterations / NBLOBS * 1e9;
+        
+        uint64_t sum = 0;
+        t = now_sec();
+        for (long it = 0; it < iterations; ++it)
+        {
+            for (int i = 0; i < NBLOBS; ++i)
+            {
+                sum += bson_hash_bytes(blobs[i], sizes[i], BSON_HASH_SEED);
+            }
+        }
+        const double hash = (now_sec() - t) / iterations / NBLOBS * 1e9;
+        
+        struct bson_json_cache_stats stats;
+        bson_json_cache_stats(cache, &stats);
+        printf("%6zu bytes: json2bson %9.1f ns, cache %7.1f ns (hits %llu, misses %llu), hash %6.1f ns [%llx]\n",
+               sizes[0], parse, cached, (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+               hash, (unsigned long long)(sum & 0xf));
+        bson_json_cache_destroy(cache);
+        for (int i = 0; i < NBLOBS; ++i)
+        {
+            free(blobs[i]);
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,191 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cpu.h"
+#include "documentbuilder.h"
+#include "jsonwriter.h"
+
+/*
+ * BSON to JSON streaming of a result set: escape scanning kernels on
+ * the strings of the documents, and the whole writer into a sink that
+ * only counts bytes.
+ * Usage: bench_jsonwriter [iterations]
+ */
+
+#define NDOCS       2000
+
+static uint64_t s_seed = 0x5eed;
+
+static uint64_t next_random()
+{
+    uint64_t z = (s_seed += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static const char* const s_words[] = {
+    "order", "shipped", "pending", "customer", "address", "warehouse", "priority", "express"
+};
+
+/* Text of words, rarely with a quote or a newline */
+static size_t make_text(char* text, size_t words)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < words; ++i)
+    {
+        const char* w = s_words[next_random() % 8];
+        n += sprintf(text + n, i ? " %s" : "%s", w);
+        if(next_random() % 64 == 0)
+        {
+            text[n++] = next_random() & 1 ? '"' : '\n';
+        }
+    }
+    text[n] = '\0';
+    return n;
+}
+
+static bson_document_ref make_document(int i)
+{
+    char text[512];
+    bson_document_builder_ref b = bson_document_builder_create();
+    bson_oid_t oid;
+    bson_oid_init_sequential(&oid);
+    bson_document_builder_append_oid(b, "_id", &oid);
+    bson_document_builder_append_i(b, "n", i);
+    make_text(text, 3);
+    bson_document_builder_append_str(b, "status", text);
+    make_text(text, 12);
+    bson_document_builder_append_str(b, "title", text);
+    make_text(text, 40);
+    bson_document_builder_append_str(b, "description", text);
+    bson_document_builder_append_d(b, "price", (double)(next_random() % 100000) / 100);
+    bson_document_builder_append_date(b, "created", 1388534400000ll + (int64_t)(next_random() % 100000000000ull));
+    return bson_document_builder_finalize(b);
+}
+
+static int count_sink(void* ctx, const char* data, size_t size)
+{
+    *(uint64_t *)ctx += size + (unsigned char)data[0];
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    long iterations = argc > 1 ? strtol(argv[1], 0, 10) : 20;
+    bson_document_ref docs[NDOCS];
+    for (int i = 0; i < NDOCS; ++i)
+    {
+        docs[i] = make_document(i);
+    }
+    
+    /* Escape kernels over a long text, scanning from each special byte on */
+    static char text[1 << 16];
+    size_t n = 0;
+    while(n + 600 < sizeof(text))
+    {
+        n += make_text(text + n, 40);
+    }
+    
+    static const struct
+    {
+        const char* name;
+        bson_json_escape_kernel_t kernel;
+        uint32_t feature;
+    } kernels[] = {
+        { "portable", bson_json_escape_scan_portable, 0 },
+#ifdef BSON_HAVE_X86_SIMD
+        { "sse42", bson_json_escape_scan_sse42, BSON_CPU_SSE42 },
+        { "avx2", bson_json_escape_scan_avx2, BSON_CPU_AVX2 },
+#endif
+    };
+    
+    int rc = EXIT_SUCCESS;
+    size_t expected = 0;
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k)
+    {
+        if(kernels[k].feature && !bson_cpu_has(kernels[k].feature))
+        {
+            continue;
+        }
+        size_t specials = 0;
+        double t = now_sec();
+        for (long it = 0; it < iterations * 10; ++it)
+        {
+            specials = 0;
+            for (size_t pos = 0; (pos += kernels[k].kernel(text + pos, n - pos)) < n; ++pos)
+            {
+                specials++;
+            }
+        }
+        t = now_sec() - t;
+        if(k == 0)
+        {
+            expected = specials;
+        }
+        else if(specials != expected)
+        {
+            fprintf(stderr, "%s: found %zu specials, expected %zu\n", kernels[k].name, specials, expected);
+            rc = EXIT_FAILURE;
+        }
+        printf("escape scan %-9s %8.1f MB/s\n", kernels[k].name, (double)n * iterations * 10 / t / 1e6);
+    }
+    
+    uint64_t bytes = 0;
+    bson_json_writer_t w;
+    bson_json_writer_init(&w, 0, count_sink, &bytes);
+    double t = now_sec();
+    for (long it = 0; it < iterations; ++it)
+    {
+        bson_json_writer_documents(&w, docs, NDOCS);
+        bson_json_writer_flush(&w);
+    }
+    t = now_sec() - t;
+    bson_json_writer_deinit(&w);
+    
+    uint64_t input = 0;
+    for (int i = 0; i < NDOCS; ++i)
+    {
+        input += bson_document_size(docs[i]);
+    }
+    printf("writer %d documents: %8.1f MB/s of BSON, %8.1f ns/doc, chunk %d bytes\n", NDOCS,
+           (double)input * iterations / t / 1e6, t / iterations / NDOCS * 1e9, BSON_JSON_WRITER_CHUNK_SIZE);
+    
+    for (int i = 0; i < NDOCS; ++i)
+    {
+        bson_document_destroy(docs[i]);
+    }
+    return rc;
+}
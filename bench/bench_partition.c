@@ -0,0 +1,117 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "documentbuilder.h"
+#include "hash.h"
+#include "partition.h"
+
+/*
+ * Hash-partitioned shuffle of a batch by _id into P batches, checking that
+ * every document lands in the partition of its key.
+ * Usage: bench_partition [documents] [threads]
+ */
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char* argv[])
+{
+    long ndocs = argc > 1 ? strtol(argv[1], 0, 10) : 200000;
+    unsigned nthreads = argc > 2 ? (unsigned)strtoul(argv[2], 0, 10) : 0;
+    
+    bson_batch_t in = BSON_BATCH_INITIALIZER;
+    for (long i = 0; i < ndocs; ++i)
+    {
+        bson_document_builder_ref b = bson_document_builder_create();
+        bson_oid_t oid;
+        bson_oid_init_sequential(&oid);
+        bson_document_builder_append_oid(b, "_id", &oid);
+        bson_document_builder_append_i(b, "n", (int32_t)i);
+        bson_document_builder_append_str(b, "payload", i % 3 ? "short" : "a somewhat longer string value of the document");
+        bson_document_ref doc = bson_document_builder_finalize(b);
+        bson_batch_append(&in, doc);
+        bson_document_destroy(doc);
+    }
+    
+    bson_scan_pool_ref pool = bson_scan_pool_create(nthreads);
+    static const unsigned partitions[] = { 4, 16, 64, 256, 1024 };
+    bson_batch_t out[1024];
+    for (int p = 0; p < 1024; ++p)
+    {
+        bson_batch_init(&out[p]);
+    }
+    
+    int rc = EXIT_SUCCESS;
+    for (size_t k = 0; k < sizeof(partitions) / sizeof(partitions[0]); ++k)
+    {
+        const unsigned np = partitions[k];
+        bson_partition(pool, &in, "_id", np, out);
+        double t = now_sec();
+        if(bson_partition(pool, &in, "_id", np, out))
+        {
+            fprintf(stderr, "partitioning failed\n");
+            return EXIT_FAILURE;
+        }
+        t = now_sec() - t;
+        
+        size_t count = 0, size = 0;
+        for (unsigned p = 0; p < np; ++p)
+        {
+            bson_document_ref* docs = bson_batch_documents(&out[p]);
+            uint64_t* hashes = malloc((bson_batch_count(&out[p]) + 1) * sizeof(uint64_t));
+            bson_hash_path(docs, bson_batch_count(&out[p]), "_id", bson_hash_semantic, BSON_HASH_SEED, hashes);
+            for (size_t i = 0; i < bson_batch_count(&out[p]); ++i)
+            {
+                if(bson_partition_of(hashes[i], np) != p)
+                {
+                    rc = EXIT_FAILURE;
+                }
+            }
+            free(hashes);
+            count += bson_batch_count(&out[p]);
+            size += bson_batch_size(&out[p]);
+        }
+        if(count != bson_batch_count(&in) || size != bson_batch_size(&in))
+        {
+            rc = EXIT_FAILURE;
+        }
+        printf("%4u partitions, %u threads: %7.1f ns/doc %8.1f MB/s%s\n", np, bson_scan_pool_size(pool),
+               t / ndocs * 1e9, bson_batch_size(&in) / t / 1e6, rc ? " FAILED" : "");
+    }
+    
+    for (int p = 0; p < 1024; ++p)
+    {
+        bson_batch_deinit(&out[p]);
+    }
+    bson_scan_pool_destroy(pool);
+    bson_batch_deinit(&in);
+    return rc;
+}
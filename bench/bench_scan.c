@@ -0,0 +1,132 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "documentbuilder.h"
+#include "iterator.h"
+#include "scan.h"
+
+/*
+ * Scaling of the parallel scan on 1..64 workers.
+ * Usage: bench_scan [number of documents]
+ */
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Selects documents where "n" is divisible by 7 */
+static int filter_n(void *ctx, size_t index, bson_document_ref doc)
+{
+    bson_iterator_t iter;
+    bson_element_ref el;
+    for (el = bson_iterator_init(&iter, doc); !bson_iterator_end(&iter); el = bson_iterator_next(&iter))
+    {
+        if(bson_element_type(el) == bson_type_long && strcmp(bson_element_fieldname(el), "n") == 0)
+        {
+            return *(const int64_t *)bson_element_value(el) % 7 == 0;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t ndocs = argc > 1 ? strtoul(argv[1], 0, 10) : 1000000;
+
+    bson_document_ref* docs = (bson_document_ref *)malloc(ndocs * sizeof(bson_document_ref));
+    bson_oid_t oid;
+    for (size_t i = 0; i < ndocs; ++i)
+    {
+        bson_document_builder_ref b = bson_document_builder_create();
+        bson_oid_init_sequential(&oid);
+        bson_document_builder_append_oid(b, "_id", &oid);
+        bson_document_builder_append_i(b, "shard", (int32_t)(i & 15));
+        bson_document_builder_append_d(b, "price", i * 0.25);
+        bson_document_builder_append_b(b, "active", i & 1);
+        bson_document_builder_append_date(b, "created", 1388534400000ll + i);
+        bson_document_builder_append_l(b, "n", (int64_t)i);
+        docs[i] = bson_document_builder_finalize(b);
+    }
+
+    printf("%8s %12s %14s %10s %12s\n", "threads", "time, ms", "docs/s", "speedup", "selected");
+
+    double base = 0;
+    for (unsigned nthreads = 1; nthreads <= 64; nthreads *= 2)
+    {
+        bson_scan_pool_ref pool = bson_scan_pool_create(nthreads);
+        struct bson_scan_stats* stats = (struct bson_scan_stats *)calloc(nthreads, sizeof(struct bson_scan_stats));
+        bson_selection_t sel;
+
+        /* warm up */
+        bson_scan(pool, docs, ndocs, 0, filter_n, 0, &sel, stats);
+        bson_selection_deinit(&sel);
+
+        double best = 1e30;
+        for (int run = 0; run < 5; ++run)
+        {
+            double t = now_sec();
+            bson_scan(pool, docs, ndocs, 0, filter_n, 0, &sel, stats);
+            t = now_sec() - t;
+            if(t < best)
+            {
+                best = t;
+            }
+            if(run != 4)
+            {
+                bson_selection_deinit(&sel);
+            }
+        }
+
+        if(nthreads == 1)
+        {
+            base = best;
+        }
+
+        printf("%8u %12.2f %14.0f %10.2f %12zu\n", nthreads, best * 1e3, ndocs / best, base / best, sel.count);
+        for (unsigned w = 0; w < nthreads; ++w)
+        {
+            double secs = stats[w].nanoseconds * 1e-9;
+            printf("    worker %2u: morsels=%zu docs=%zu MB/s=%.1f\n", w, stats[w].morsels, stats[w].documents,
+                   secs > 0 ? stats[w].bytes / secs / 1e6 : 0.0);
+        }
+
+        bson_selection_deinit(&sel);
+        free(stats);
+        bson_scan_pool_destroy(pool);
+    }
+
+    for (size_t i = 0; i < ndocs; ++i)
+    {
+        bson_document_destroy(docs[i]);
+    }
+    free(docs);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,220 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "documentbuilder.h"
+#include "iterator.h"
+#include "schema.h"
+
+/*
+ * Generated schema encoder/decoder against hand-written builder calls
+ * and iterator-based decoding.
+ * Usage: bench_schema [iterations]
+ */
+
+#define MESSAGE_FIELDS(X)   \
+    X(oid, _id)             \
+    X(i, shard)             \
+    X(d, price)             \
+    X(b, active)            \
+    X(date, created)        \
+    X(l, n)                 \
+    X(str, title)
+
+BSON_SCHEMA_DECLARE(message, MESSAGE_FIELDS)
+BSON_SCHEMA_DEFINE(message, MESSAGE_FIELDS)
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bson_document_ref encode_builder(const struct message* m)
+{
+    bson_document_builder_ref b = bson_document_builder_create();
+    bson_document_builder_append_oid(b, "_id", (bson_oid_ref)&m->_id);
+    bson_document_builder_append_i(b, "shard", m->shard);
+    bson_document_builder_append_d(b, "price", m->price);
+    bson_document_builder_append_b(b, "active", m->active);
+    bson_document_builder_append_date(b, "created", m->created);
+    bson_document_builder_append_l(b, "n", m->n);
+    bson_document_builder_append_str(b, "title", m->title.data);
+    return bson_document_builder_finalize(b);
+}
+
+/* Same fields in reverse order, to exercise the name scan */
+static bson_document_ref encode_reversed(const struct message* m)
+{
+    bson_document_builder_ref b = bson_document_builder_create();
+    bson_document_builder_append_str(b, "title", m->title.data);
+    bson_document_builder_append_l(b, "n", m->n);
+    bson_document_builder_append_date(b, "created", m->created);
+    bson_document_builder_append_b(b, "active", m->active);
+    bson_document_builder_append_d(b, "price", m->price);
+    bson_document_builder_append_i(b, "shard", m->shard);
+    bson_document_builder_append_oid(b, "_id", (bson_oid_ref)&m->_id);
+    return bson_document_builder_finalize(b);
+}
+
+static int decode_iterator(struct message* m, bson_document_ref doc)
+{
+    bson_iterator_t iter;
+    bson_element_ref el;
+    int found = 0;
+    for (el = bson_iterator_init(&iter, doc); !bson_iterator_end(&iter); el = bson_iterator_next(&iter))
+    {
+        const char* k = bson_element_fieldname(el);
+        const char* v = bson_element_value(el);
+        bson_type_t t = bson_element_type(el);
+        if(strcmp(k, "_id") == 0 && t == bson_type_oid)
+        {
+            memcpy(&m->_id, v, sizeof(m->_id));
+        }
+        else if(strcmp(k, "shard") == 0 && t == bson_type_int)
+        {
+            memcpy(&m->shard, v, sizeof(m->shard));
+        }
+        else if(strcmp(k, "price") == 0 && t == bson_type_float)
+        {
+            memcpy(&m->price, v, sizeof(m->price));
+        }
+        else if(strcmp(k, "active") == 0 && t == bson_type_bool)
+        {
+            m->active = *v;
+        }
+        else if(strcmp(k, "created") == 0 && t == bson_type_date)
+        {
+            memcpy(&m->created, v, sizeof(m->created));
+        }
+        else if(strcmp(k, "n") == 0 && t == bson_type_long)
+        {
+            memcpy(&m->n, v, sizeof(m->n));
+        }
+        else if(strcmp(k, "title") == 0 && t == bson_type_string)
+        {
+            m->title.data = v + 4;
+            m->title.size = *(const int32_t *)v - 1;
+        }
+        else
+        {
+            continue;
+        }
+        ++found;
+    }
+    return found != 7;
+}
+
+static void fill(struct message* m, long i)
+{
+    bson_oid_init_sequential(&m->_id);
+    m->shard = (int32_t)(i & 15);
+    m->price = i * 0.25;
+    m->active = i & 1;
+    m->created = 1388534400000ll + i;
+    m->n = i;
+    m->title.data = "quarterly report";
+    m->title.size = strlen(m->title.data);
+}
+
+int main(int argc, char* argv[])
+{
+    long iterations = argc > 1 ? strtol(argv[1], 0, 10) : 1000000;
+    struct message m, out;
+    volatile int64_t sink = 0;
+    double t;
+
+    fill(&m, 42);
+    bson_document_ref a = encode_builder(&m);
+    bson_document_ref b = message_encode(&m);
+    bson_document_ref r = encode_reversed(&m);
+    if(bson_document_size(a) != bson_document_size(b) || memcmp(a->data, b->data, bson_document_size(a)) != 0)
+    {
+        fprintf(stderr, "generated encoder differs from builder\n");
+        return EXIT_FAILURE;
+    }
+    if(message_decode(&out, r) != 0 || out.n != m.n || strcmp(out.title.data, m.title.data) != 0)
+    {
+        fprintf(stderr, "generated decoder failed on reordered document\n");
+        return EXIT_FAILURE;
+    }
+
+    t = now_sec();
+    for (long i = 0; i < iterations; ++i)
+    {
+        m.n = i;
+        bson_document_ref doc = encode_builder(&m);
+        sink += bson_document_size(doc);
+        bson_document_destroy(doc);
+    }
+    double enc_builder = (now_sec() - t) / iterations;
+
+    t = now_sec();
+    for (long i = 0; i < iterations; ++i)
+    {
+        m.n = i;
+        bson_document_ref doc = message_encode(&m);
+        sink += bson_document_size(doc);
+        bson_document_destroy(doc);
+    }
+    double enc_schema = (now_sec() - t) / iterations;
+
+    t = now_sec();
+    for (long i = 0; i < iterations; ++i)
+    {
+        decode_iterator(&out, b);
+        sink += out.n;
+    }
+    double dec_iterator = (now_sec() - t) / iterations;
+
+    t = now_sec();
+    for (long i = 0; i < iterations; ++i)
+    {
+        message_decode(&out, b);
+        sink += out.n;
+    }
+    double dec_schema = (now_sec() - t) / iterations;
+
+    t = now_sec();
+    for (long i = 0; i < iterations; ++i)
+    {
+        message_decode(&out, r);
+        sink += out.n;
+    }
+    double dec_reversed = (now_sec() - t) / iterations;
+
+    printf("encode  builder=%8.1f ns  schema=%8.1f ns  speedup=%.2f\n",
+           enc_builder * 1e9, enc_schema * 1e9, enc_builder / enc_schema);
+    printf("decode  iterator=%7.1f ns  schema=%8.1f ns  speedup=%.2f\n",
+           dec_iterator * 1e9, dec_schema * 1e9, dec_iterator / dec_schema);
+    printf("decode  reordered fields, schema=%8.1f ns\n", dec_reversed * 1e9);
+
+    bson_document_destroy(a);
+    bson_document_destroy(b);
+    bson_document_destroy(r);
+    return EXIT_SUCCESS;
+}
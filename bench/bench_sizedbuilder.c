@@ -0,0 +1,175 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "documentbuilder.h"
+#include "sizedbuilder.h"
+
+/*
+ * Two-pass sized builder against the region-growing builder
+ * on deeply nested and very wide documents.
+ * Usage: bench_sizedbuilder [iterations]
+ */
+
+#define DEEP_LEVELS     64
+#define DEEP_FIELDS     4
+#define WIDE_FIELDS     2000
+
+static const char* const s_keys[] = { "alpha", "beta", "gamma", "delta" };
+static char s_wide_keys[WIDE_FIELDS][24];
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Opens nested document the way json2bson does */
+static bson_document_builder_ref open_nested(bson_document_builder_ref parent, const char* k)
+{
+    bson_type_t type = bson_type_document;
+    cpl_region_append_data(&parent->r, &type, sizeof(type));
+    cpl_region_append_data(&parent->r, k, strlen(k) + 1);
+    return bson_document_builder_create_with_parent(parent);
+}
+
+static bson_document_ref build_deep_region()
+{
+    bson_document_builder_ref stack[DEEP_LEVELS + 1];
+    stack[0] = bson_document_builder_create();
+    for (int level = 0; level < DEEP_LEVELS; ++level)
+    {
+        for (int f = 0; f < DEEP_FIELDS; ++f)
+        {
+            bson_document_builder_append_l(stack[level], s_keys[f], level * f);
+        }
+        bson_document_builder_append_str(stack[level], "name", "nested level");
+        stack[level + 1] = open_nested(stack[level], "child");
+    }
+    for (int level = DEEP_LEVELS; level > 0; --level)
+    {
+        bson_document_builder_finalize(stack[level]);
+    }
+    return bson_document_builder_finalize(stack[0]);
+}
+
+static void emit_deep(bson_sized_builder_ref b, void* ctx)
+{
+    for (int level = 0; level < DEEP_LEVELS; ++level)
+    {
+        for (int f = 0; f < DEEP_FIELDS; ++f)
+        {
+            bson_sized_builder_append_l(b, s_keys[f], level * f);
+        }
+        bson_sized_builder_append_str(b, "name", "nested level");
+        bson_sized_builder_open_doc(b, "child");
+    }
+    for (int level = DEEP_LEVELS; level > 0; --level)
+    {
+        bson_sized_builder_close(b);
+    }
+}
+
+static bson_document_ref build_wide_region()
+{
+    bson_document_builder_ref b = bson_document_builder_create();
+    for (int f = 0; f < WIDE_FIELDS; ++f)
+    {
+        const char* k = s_wide_keys[f];
+        if(f & 1)
+        {
+            bson_document_builder_append_d(b, k, f * 0.5);
+        }
+        else
+        {
+            bson_document_builder_append_i(b, k, f);
+        }
+    }
+    return bson_document_builder_finalize(b);
+}
+
+static void emit_wide(bson_sized_builder_ref b, void* ctx)
+{
+    for (int f = 0; f < WIDE_FIELDS; ++f)
+    {
+        const char* k = s_wide_keys[f];
+        if(f & 1)
+        {
+            bson_sized_builder_append_d(b, k, f * 0.5);
+        }
+        else
+        {
+            bson_sized_builder_append_i(b, k, f);
+        }
+    }
+}
+
+static void run(const char* name, bson_document_ref (*region)(), bson_sized_builder_emit_t emit, int iterations)
+{
+    bson_document_ref a = region();
+    bson_document_ref b = bson_sized_builder_build(emit, 0);
+    if(!b || bson_document_size(a) != bson_document_size(b) || memcmp(a, b, bson_document_size(a)))
+    {
+        printf("%s: documents differ\n", name);
+        exit(EXIT_FAILURE);
+    }
+    const int32_t size = bson_document_size(a);
+    bson_document_destroy(a);
+    bson_document_destroy(b);
+
+    double t = now_sec();
+    for (int i = 0; i < iterations; ++i)
+    {
+        bson_document_destroy(region());
+    }
+    const double t_region = (now_sec() - t) / iterations;
+
+    t = now_sec();
+    for (int i = 0; i < iterations; ++i)
+    {
+        bson_document_destroy(bson_sized_builder_build(emit, 0));
+    }
+    const double t_sized = (now_sec() - t) / iterations;
+
+    printf("%-6s size=%-7d region=%9.0f ns  sized=%9.0f ns  speedup=%.2f\n",
+           name, size, t_region * 1e9, t_sized * 1e9, t_region / t_sized);
+}
+
+int main(int argc, char* argv[])
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 20000;
+
+    for (int f = 0; f < WIDE_FIELDS; ++f)
+    {
+        snprintf(s_wide_keys[f], sizeof(s_wide_keys[f]), "field%d", f);
+    }
+
+    run("deep", build_deep_region, emit_deep, iterations);
+    run("wide", build_wide_region, emit_wide, iterations / 10 + 1);
+
+    return EXIT_SUCCESS;
+}
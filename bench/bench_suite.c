@@ -0,0 +1,560 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cursor.h"
+#include "documentbuilder.h"
+#include "iterator.h"
+#include "jsonparser.h"
+#include "oid.h"
+
+/*
+ * Benchmark suite over fixed-seed synthetic corpora.
+ * Prints one JSON object per line:
+ *   {"bench":..., "corpus":..., "ops":..., "ns_per_op":..., "mb_per_s":..., "allocs_per_op":...}
+ * so results of two commits may be compared line by line.
+ * Usage: bench_suite [min seconds per benchmark] [filter]
+ */
+
+#define CORPUS_DOCS     64
+#define CORPUS_SEED     0x5eed5eedull
+#define REPEATS         3
+
+/******************************* Allocation count *****************************/
+/* Sanitizers provide their own malloc */
+#if defined(__SANITIZE_ADDRESS__)
+#define NO_MALLOC_INTERPOSE
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define NO_MALLOC_INTERPOSE
+#endif
+#endif
+
+#if defined(__GLIBC__) && !defined(NO_MALLOC_INTERPOSE)
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t n, size_t size);
+extern void* __libc_realloc(void* p, size_t size);
+
+static unsigned long long s_allocs;
+
+void* malloc(size_t size)
+{
+    ++s_allocs;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size)
+{
+    ++s_allocs;
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* p, size_t size)
+{
+    ++s_allocs;
+    return __libc_realloc(p, size);
+}
+
+#define ALLOCS_AVAILABLE    1
+
+#else
+
+static unsigned long long s_allocs;
+#define ALLOCS_AVAILABLE    0
+
+#endif
+
+/********************************** Corpora ***********************************/
+static uint64_t s_seed;
+
+static uint64_t next_random()
+{
+    /* splitmix64 */
+    uint64_t z = (s_seed += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+struct text
+{
+    char*   data;
+    size_t  size;
+    size_t  capacity;
+};
+
+static void put(struct text* t, const char* s, size_t n)
+{
+    if(t->size + n + 1 > t->capacity)
+    {
+        t->capacity = (t->size + n + 1) * 2;
+        t->data = (char *)realloc(t->data, t->capacity);
+    }
+    memcpy(t->data + t->size, s, n);
+    t->size += n;
+    t->data[t->size] = '\0';
+}
+
+static void puts_text(struct text* t, const char* s)
+{
+    put(t, s, strlen(s));
+}
+
+static void put_key(struct text* t, int i, int first)
+{
+    char buffer[32];
+    sprintf(buffer, "%s\"field_%d\": ", first ? "" : ", ", i);
+    puts_text(t, buffer);
+}
+
+static void put_word(struct text* t, size_t n)
+{
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    put(t, "\"", 1);
+    for (size_t i = 0; i < n; ++i)
+    {
+        put(t, &alphabet[next_random() % (sizeof(alphabet) - 1)], 1);
+    }
+    put(t, "\"", 1);
+}
+
+static void put_scalar(struct text* t)
+{
+    char buffer[64];
+    switch(next_random() % 6)
+    {
+        case 0:
+            sprintf(buffer, "%d", (int)(next_random() % 2000000) - 1000000);
+            break;
+        case 1:
+            sprintf(buffer, "%d.%03d", (int)(next_random() % 100000), (int)(next_random() % 1000));
+            break;
+        case 2:
+            strcpy(buffer, next_random() & 1 ? "true" : "false");
+            break;
+        case 3:
+            strcpy(buffer, "null");
+            break;
+        case 4:
+            sprintf(buffer, "ObjectId(\"%016llx%08x\")", (unsigned long long)next_random(),
+                    (unsigned)next_random());
+            break;
+        default:
+            put_word(t, 4 + next_random() % 16);
+            return;
+    }
+    puts_text(t, buffer);
+}
+
+static void gen_flat(struct text* t)
+{
+    int n = 10 + next_random() % 10;
+    puts_text(t, "{");
+    for (int i = 0; i < n; ++i)
+    {
+        put_key(t, i, i == 0);
+        put_scalar(t);
+    }
+    puts_text(t, "}");
+}
+
+static void gen_wide(struct text* t)
+{
+    puts_text(t, "{");
+    for (int i = 0; i < 500; ++i)
+    {
+        put_key(t, i, i == 0);
+        put_scalar(t);
+    }
+    puts_text(t, "}");
+}
+
+static void gen_deep(struct text* t)
+{
+    const int depth = 32;
+    for (int level = 0; level < depth; ++level)
+    {
+        puts_text(t, level ? ", \"child\": {" : "{");
+        for (int i = 0; i < 3; ++i)
+        {
+            put_key(t, i, i == 0);
+            put_scalar(t);
+        }
+    }
+    for (int level = 0; level < depth; ++level)
+    {
+        puts_text(t, "}");
+    }
+}
+
+static void gen_numeric(struct text* t)
+{
+    char buffer[32];
+    puts_text(t, "{");
+    for (int a = 0; a < 4; ++a)
+    {
+        put_key(t, a, a == 0);
+        puts_text(t, "[");
+        for (int i = 0; i < 256; ++i)
+        {
+            if(a & 1)
+            {
+                sprintf(buffer, "%s%d.%02d", i ? ", " : "", (int)(next_random() % 10000), (int)(next_random() % 100));
+            }
+            else
+            {
+                sprintf(buffer, "%s%d", i ? ", " : "", (int)(next_random() % 2000000) - 1000000);
+            }
+            puts_text(t, buffer);
+        }
+        puts_text(t, "]");
+    }
+    puts_text(t, "}");
+}
+
+static void gen_strings(struct text* t)
+{
+    puts_text(t, "{");
+    for (int i = 0; i < 16; ++i)
+    {
+        put_key(t, i, i == 0);
+        put_word(t, 64 + next_random() % 960);
+    }
+    puts_text(t, "}");
+}
+
+struct corpus
+{
+    const char*         name;
+    void                (*generate)(struct text* t);
+    struct text         json[CORPUS_DOCS];
+    bson_document_ref   docs[CORPUS_DOCS];
+    size_t              json_bytes;
+    size_t              bson_bytes;
+    size_t              elements;
+};
+
+static struct corpus s_corpora[] =
+{
+    { "flat",       gen_flat },
+    { "wide",       gen_wide },
+    { "deep",       gen_deep },
+    { "numeric",    gen_numeric },
+    { "strings",    gen_strings }
+};
+
+#define NCORPORA    (sizeof(s_corpora) / sizeof(s_corpora[0]))
+
+static size_t count_elements(bson_document_ref doc)
+{
+    size_t n = 0;
+    bson_cursor_t c;
+    for (bson_cursor_init(&c, doc); bson_cursor_next(&c); ++n)
+    {
+        if(bson_cursor_type(&c) == bson_type_document || bson_cursor_type(&c) == bson_type_array)
+        {
+            bson_document_ref child = (bson_document_ref)bson_cursor_value(&c);
+            n += count_elements(child);
+        }
+    }
+    return n;
+}
+
+static int build_corpus(struct corpus* c)
+{
+    s_seed = CORPUS_SEED;
+    for (int i = 0; i < CORPUS_DOCS; ++i)
+    {
+        c->generate(&c->json[i]);
+        c->docs[i] = json2bson(c->json[i].data, c->json[i].size);
+        if(!c->docs[i])
+        {
+            fprintf(stderr, "corpus %s: document %d is not parsed\n", c->name, i);
+            return 1;
+        }
+        bson_document_ref doc = c->docs[i];
+        c->json_bytes += c->json[i].size;
+        c->bson_bytes += bson_document_size(doc);
+        c->elements += count_elements(doc);
+    }
+    return 0;
+}
+
+/******************************** Benchmarks **********************************/
+static volatile uint64_t s_sink;
+
+static void bench_json2bson(struct corpus* c)
+{
+    for (int i = 0; i < CORPUS_DOCS; ++i)
+    {
+        bson_document_ref doc = json2bson(c->json[i].data, c->json[i].size);
+        s_sink += bson_document_size(doc);
+        bson_document_destroy(doc);
+    }
+}
+
+/* Appends elements of the document to the builder */
+static void rebuild(bson_document_builder_ref b, bson_document_ref doc)
+{
+    bson_cursor_t c;
+    for (bson_cursor_init(&c, doc); bson_cursor_next(&c); )
+    {
+        const char* k = bson_cursor_key(&c);
+        const size_t nk = strlen(k);
+        switch(bson_cursor_type(&c))
+        {
+            case bson_type_document:
+            case bson_type_array:
+            {
+                bson_type_t type = bson_cursor_type(&c);
+                cpl_region_append_data(&b->r, &type, sizeof(type));
+                cpl_region_append_data(&b->r, k, nk + 1);
+                bson_document_builder_ref child = bson_document_builder_create_with_parent(b);
+                rebuild(child, (bson_document_ref)bson_cursor_value(&c));
+                bson_document_builder_finalize(child);
+                break;
+            }
+            case bson_type_int:
+                bson_document_builder_append_i_n(b, k, nk, bson_cursor_i(&c));
+                break;
+            case bson_type_long:
+                bson_document_builder_append_l_n(b, k, nk, bson_cursor_l(&c));
+                break;
+            case bson_type_float:
+                bson_document_builder_append_d_n(b, k, nk, bson_cursor_d(&c));
+                break;
+            case bson_type_bool:
+                bson_document_builder_append_b_n(b, k, nk, bson_cursor_b(&c));
+                break;
+            case bson_type_null:
+                bson_document_builder_append_null_n(b, k, nk);
+                break;
+            case bson_type_oid:
+                bson_document_builder_append_oid_n(b, k, nk, bson_cursor_oid(&c));
+                break;
+            case bson_type_string:
+            {
+                size_t len;
+                const char* str = bson_cursor_str(&c, &len);
+                bson_document_builder_append_str_n(b, k, nk, str, len);
+                break;
+            }
+            default:
+                bson_document_builder_append_el(b, bson_cursor_element(&c));
+                break;
+        }
+    }
+}
+
+static void bench_builder(struct corpus* c)
+{
+    for (int i = 0; i < CORPUS_DOCS; ++i)
+    {
+        bson_document_builder_ref b = bson_document_builder_create();
+        rebuild(b, c->docs[i]);
+        bson_document_ref doc = bson_document_builder_finalize(b);
+        s_sink += bson_document_size(doc);
+        bson_document_destroy(doc);
+    }
+}
+
+static uint64_t walk(bson_document_ref doc)
+{
+    uint64_t n = 0;
+    bson_iterator_t iter;
+    bson_element_ref el;
+    for (el = bson_iterator_init(&iter, doc); !bson_iterator_end(&iter); el = bson_iterator_next(&iter))
+    {
+        bson_type_t type = bson_element_type(el);
+        n += type;
+        if(type == bson_type_document || type == bson_type_array)
+        {
+            n += walk((bson_document_ref)bson_element_value(el));
+        }
+    }
+    return n;
+}
+
+static void bench_iterator(struct corpus* c)
+{
+    for (int i = 0; i < CORPUS_DOCS; ++i)
+    {
+        s_sink += walk(c->docs[i]);
+    }
+}
+
+static uint64_t element_sizes(bson_document_ref doc)
+{
+    uint64_t n = 0;
+    const char* p = doc->data + 4;
+    while(*p != bson_type_eoo)
+    {
+        bson_element_ref el = bson_element_create_with_data(p);
+        size_t size = bson_element_size(el);
+        if(*p == bson_type_document || *p == bson_type_array)
+        {
+            n += element_sizes((bson_document_ref)bson_element_value(el));
+        }
+        n += size;
+        p += size;
+    }
+    return n;
+}
+
+static void bench_element_size(struct corpus* c)
+{
+    for (int i = 0; i < CORPUS_DOCS; ++i)
+    {
+        s_sink += element_sizes(c->docs[i]);
+    }
+}
+
+#define OID_BATCH   1024
+
+static void bench_oid_generate(struct corpus* c)
+{
+    bson_oid_t oid;
+    for (int i = 0; i < OID_BATCH; ++i)
+    {
+        bson_oid_init(&oid);
+        s_sink += oid.b;
+    }
+}
+
+static void bench_oid_format(struct corpus* c)
+{
+    bson_oid_t oid;
+    bson_oid_init(&oid);
+    for (int i = 0; i < OID_BATCH; ++i)
+    {
+        oid.b = i;
+        char* s = bson_oid_string_create(&oid);
+        s_sink += s[23];
+        free(s);
+    }
+}
+
+/*********************************** Driver ***********************************/
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+enum unit
+{
+    PER_DOCUMENT,
+    PER_ELEMENT,
+    PER_OID
+};
+
+static void run(const char* bench, void (*fn)(struct corpus*), struct corpus* c, enum unit unit,
+                int json_input, double min_time, const char* filter)
+{
+    const char* corpus = c ? c->name : "oid";
+    if(filter && !strstr(bench, filter) && !strstr(corpus, filter))
+    {
+        return;
+    }
+
+    size_t ops_per_call = unit == PER_OID ? OID_BATCH : unit == PER_ELEMENT ? c->elements : CORPUS_DOCS;
+    size_t bytes_per_call = !c ? 0 : json_input ? c->json_bytes : c->bson_bytes;
+
+    /* Warm up and count allocations of one call */
+    unsigned long long allocs = s_allocs;
+    fn(c);
+    allocs = s_allocs - allocs;
+
+    double best = 1e30;
+    size_t calls = 0;
+    for (int r = 0; r < REPEATS; ++r)
+    {
+        size_t n = 0;
+        double t = now_sec(), elapsed;
+        do
+        {
+            fn(c);
+            ++n;
+            elapsed = now_sec() - t;
+        } while(elapsed < min_time);
+
+        if(elapsed / n < best)
+        {
+            best = elapsed / n;
+            calls = n;
+        }
+    }
+
+    printf("{\"bench\": \"%s\", \"corpus\": \"%s\", \"ops\": %zu, \"ns_per_op\": %.2f, \"mb_per_s\": %.2f",
+           bench, corpus, calls * ops_per_call, best * 1e9 / ops_per_call,
+           bytes_per_call ? bytes_per_call / best / 1e6 : 0.0);
+    if(ALLOCS_AVAILABLE)
+    {
+        printf(", \"allocs_per_op\": %.3f}\n", (double)allocs / ops_per_call);
+    }
+    else
+    {
+        printf(", \"allocs_per_op\": null}\n");
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char* argv[])
+{
+    double min_time = argc > 1 ? strtod(argv[1], 0) : 0.2;
+    const char* filter = argc > 2 ? argv[2] : 0;
+
+    for (size_t i = 0; i < NCORPORA; ++i)
+    {
+        if(build_corpus(&s_corpora[i]))
+        {
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (size_t i = 0; i < NCORPORA; ++i)
+    {
+        struct corpus* c = &s_corpora[i];
+        run("json2bson", bench_json2bson, c, PER_DOCUMENT, 1, min_time, filter);
+        run("builder", bench_builder, c, PER_DOCUMENT, 0, min_time, filter);
+        run("iterator", bench_iterator, c, PER_DOCUMENT, 0, min_time, filter);
+        run("element_size", bench_element_size, c, PER_ELEMENT, 0, min_time, filter);
+    }
+    run("oid_generate", bench_oid_generate, 0, PER_OID, 0, min_time, filter);
+    run("oid_format", bench_oid_format, 0, PER_OID, 0, min_time, filter);
+
+    for (size_t i = 0; i < NCORPORA; ++i)
+    {
+        for (int j = 0; j < CORPUS_DOCS; ++j)
+        {
+            bson_document_destroy(s_corpora[i].docs[j]);
+            free(s_corpora[i].json[j].data);
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,161 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "crc32c.h"
+#include "documentbuilder.h"
+#include "wal.h"
+
+/*
+ * Commit throughput of the write-ahead log by group size, with several
+ * threads committing concurrently, and CRC-32C throughput of the kernels.
+ * The log is written to a temporary file in the current directory.
+ * Usage: bench_wal [commits per thread] [threads]
+ */
+
+struct bench_writer
+{
+    bson_wal_ref        wal;
+    long                count;
+    bson_document_ref   doc;
+    int                 errors;
+};
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void* bench_commit(void* arg)
+{
+    struct bench_writer* t = (struct bench_writer *)arg;
+    for (long i = 0; i < t->count; ++i)
+    {
+        t->errors += bson_wal_commit(t->wal, t->doc, 0);
+    }
+    return 0;
+}
+
+static int bench_replay(void* ctx, uint64_t lsn, bson_document_ref doc)
+{
+    (*(uint64_t *)ctx)++;
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    long count = argc > 1 ? strtol(argv[1], 0, 10) : 2000;
+    int nthreads = argc > 2 ? atoi(argv[2]) : 16;
+    if(nthreads < 1)
+    {
+        nthreads = 1;
+    }
+    
+    static char buffer[1 << 20];
+    for (size_t i = 0; i < sizeof(buffer); ++i)
+    {
+        buffer[i] = (char)(i * 131 + (i >> 7));
+    }
+    int rc = bson_crc32c(0, "123456789", 9) == 0xE3069283u &&
+             bson_crc32c_portable(0, "123456789", 9) == 0xE3069283u ? EXIT_SUCCESS : EXIT_FAILURE;
+    const uint32_t expected = bson_crc32c_portable(0, buffer, sizeof(buffer));
+    double t = now_sec();
+    for (int i = 0; i < 64; ++i)
+    {
+        rc |= bson_crc32c_portable(0, buffer, sizeof(buffer)) != expected;
+    }
+    printf("crc32c portable: %8.1f MB/s\n", 64.0 * sizeof(buffer) / (now_sec() - t) / 1e6);
+    t = now_sec();
+    for (int i = 0; i < 64; ++i)
+    {
+        rc |= bson_crc32c(0, buffer, sizeof(buffer)) != expected;
+    }
+    printf("crc32c dispatch: %8.1f MB/s\n", 64.0 * sizeof(buffer) / (now_sec() - t) / 1e6);
+    
+    bson_document_builder_ref b = bson_document_builder_create();
+    bson_document_builder_append_i(b, "n", 1);
+    bson_document_builder_append_str(b, "payload", "a record of the write-ahead log of moderate length");
+    bson_document_ref doc = bson_document_builder_finalize(b);
+    
+    static const size_t batches[] = { 1, 4, 16, 64, 256 };
+    pthread_t* threads = malloc(nthreads * sizeof(pthread_t));
+    struct bench_writer* writers = malloc(nthreads * sizeof(struct bench_writer));
+    for (size_t k = 0; k < sizeof(batches) / sizeof(batches[0]); ++k)
+    {
+        char name[] = "bench_wal_XXXXXX";
+        int fd = mkstemp(name);
+        if(fd < 0)
+        {
+            perror("mkstemp");
+            return EXIT_FAILURE;
+        }
+        unlink(name);
+        bson_wal_ref wal = bson_wal_open(fd, batches[k], 0, 0);
+        if(!wal)
+        {
+            fprintf(stderr, "opening log failed\n");
+            return EXIT_FAILURE;
+        }
+        
+        t = now_sec();
+        for (int i = 0; i < nthreads; ++i)
+        {
+            writers[i].wal = wal;
+            writers[i].count = count;
+            writers[i].doc = doc;
+            writers[i].errors = 0;
+            pthread_create(&threads[i], 0, bench_commit, &writers[i]);
+        }
+        for (int i = 0; i < nthreads; ++i)
+        {
+            pthread_join(threads[i], 0);
+            rc |= writers[i].errors != 0;
+        }
+        t = now_sec() - t;
+        
+        struct bson_wal_stats stats;
+        bson_wal_stats(wal, &stats);
+        rc |= bson_wal_close(wal);
+        
+        uint64_t replayed = 0, nrecords, size;
+        rc |= bson_wal_recover(fd, bench_replay, &replayed, &nrecords, &size);
+        rc |= replayed != (uint64_t)count * nthreads || nrecords != replayed;
+        close(fd);
+        
+        printf("batch %3zu, %2d threads: %9.0f commits/s, %6.1f records/fsync%s\n", batches[k], nthreads,
+               count * nthreads / t, stats.batches ? (double)stats.records / stats.batches : 0.0,
+               rc ? " FAILED" : "");
+    }
+    
+    free(writers);
+    free(threads);
+    bson_document_destroy(doc);
+    return rc;
+}
@@ -0,0 +1,133 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BSON_BATCH_H_
+#define _BSON_BATCH_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <bson/document.h>
+#include <bson/sizedbuilder.h>
+
+/**
+ * Batch of documents stored one after another in a single buffer.
+ *
+ * The buffer is a valid stream of BSON documents and may be handed to
+ * writers as is. Documents are addressed by offsets, so they stay valid
+ * only until the next append. bson_batch_reset() empties the batch but
+ * keeps its memory, so one batch may serve many requests.
+ */
+typedef struct bson_batch bson_batch_t;
+typedef struct bson_batch* bson_batch_ref;
+struct bson_batch
+{
+    char*               data;           /* Documents */
+    size_t              size;           /* Bytes used */
+    size_t              capacity;       /* Bytes allocated */
+    size_t*             offsets;        /* Offsets of documents */
+    size_t              count;          /* Number of documents */
+    size_t              max_count;      /* Number of offsets allocated */
+    bson_document_ref*  docs;           /* Pointers made by bson_batch_documents() */
+    size_t              max_docs;       /* Number of pointers allocated */
+};
+
+#define BSON_BATCH_INITIALIZER              { 0, 0, 0, 0, 0, 0, 0, 0 }
+
+/**
+ * Initializes empty batch
+ */
+static inline void bson_batch_init(bson_batch_ref __restrict b)
+{
+    bson_batch_t empty = BSON_BATCH_INITIALIZER;
+    *b = empty;
+}
+
+/**
+ * Frees the memory of the batch
+ */
+void bson_batch_deinit(bson_batch_ref b);
+
+/**
+ * Removes all documents, keeping the memory
+ */
+static inline void bson_batch_reset(bson_batch_ref __restrict b)
+{
+    b->size = 0;
+    b->count = 0;
+}
+
+/**
+ * Makes room for given number of documents and bytes in total
+ * @return 0 on success, 1 if out of memory
+ */
+int bson_batch_reserve(bson_batch_ref __restrict b, size_t ndocs, size_t nbytes);
+
+/**
+ * Appends a document of given size and returns its memory. The caller
+ * must write exactly size bytes of valid document there.
+ * @return 0 if out of memory
+ */
+char* bson_batch_alloc(bson_batch_ref __restrict b, size_t size);
+
+/**
+ * Appends copy of the document
+ * @return 0 on success, 1 if out of memory
+ */
+int bson_batch_append(bson_batch_ref __restrict b, bson_document_ref doc);
+
+/**
+ * Builds the document with the sized builder right in the batch
+ * @return 0 on success, 1 if out of memory or the emitter failed
+ */
+int bson_batch_append_sized(bson_batch_ref __restrict b, bson_sized_builder_emit_t emit, void* ctx);
+
+/**
+ * Appends documents stored one after another in the buffer
+ * @return 0 on success, 1 if the buffer is malformed or out of memory
+ */
+int bson_batch_append_buffer(bson_batch_ref __restrict b, const char* data, size_t size);
+
+/**
+ * Get number of documents
+ */
+#define bson_batch_count(b)                 ((b)->count)
+
+/**
+ * Get document by index
+ */
+#define bson_batch_get(b, i)                ((bson_document_ref)((b)->data + (b)->offsets[i]))
+
+/**
+ * Get the buffer with all documents and its size in bytes
+ */
+#define bson_batch_data(b)                  ((const char *)(b)->data)
+#define bson_batch_size(b)                  ((b)->size)
+
+/**
+ * Get array of pointers to the documents, e.g. for bson_scan().
+ * The array is owned by the batch and valid until the next append.
+ * @return 0 if out of memory
+ */
+bson_document_ref* bson_batch_documents(bson_batch_ref b);
+
+#endif // _BSON_BATCH_H_
@@ -0,0 +1,180 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BSON_BLOCKFILE_H_
+#define _BSON_BLOCKFILE_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <bson/document.h>
+
+/**
+ * Block compressed container of BSON documents.
+ *
+ * Documents are grouped into blocks of about the block size, every block
+ * is compressed with bson_lz. A block holds the number of documents and
+ * their offsets followed by the documents. The index at the end of file
+ * stores, for every block, its position, the number of the first document
+ * and the keys of the first elements of its first and last documents, so
+ * readers can skip blocks by key range and decompress only the blocks
+ * they need.
+ *
+ * Block keys are bson_index_key() encodings of the value of the first
+ * element, truncated to BSON_BLOCKFILE_KEY_SIZE bytes. Names of the
+ * elements are not compared. Key ranges are meaningful for files written
+ * in order of the first element, e.g. of sequential ObjectIDs.
+ */
+
+/**
+ * Default size of uncompressed block
+ */
+#define BSON_BLOCKFILE_BLOCK_SIZE           (64 * 1024)
+
+/**
+ * Maximal size of block keys stored in the index
+ */
+#define BSON_BLOCKFILE_KEY_SIZE             32
+
+/**
+ * Writer
+ */
+typedef struct bson_blockfile_writer* bson_blockfile_writer_ref;
+
+/**
+ * Creates writer. Zero block_size means default.
+ */
+bson_blockfile_writer_ref bson_blockfile_writer_create(int fd, size_t block_size);
+
+/**
+ * Appends copy of the document
+ * @return 0 on success
+ */
+int bson_blockfile_writer_append(bson_blockfile_writer_ref __restrict w, bson_document_ref doc);
+
+/**
+ * Flushes pending documents, writes the index and destroys the writer.
+ * The descriptor is not closed.
+ * @return 0 on success
+ */
+int bson_blockfile_writer_finalize(bson_blockfile_writer_ref w);
+
+/**
+ * Entry of the block index
+ */
+struct bson_blockfile_block_info
+{
+    uint64_t    offset;         /* Offset of the block in the file */
+    uint32_t    stored_size;    /* Size of the block in the file */
+    uint32_t    raw_size;       /* Size of the block after decompression */
+    uint64_t    first_doc;      /* Number of the first document in the block */
+    uint32_t    ndocs;
+    uint8_t     min_key_size;
+    uint8_t     max_key_size;
+    char        min_key[BSON_BLOCKFILE_KEY_SIZE];   /* Key of the first element of the first document */
+    char        max_key[BSON_BLOCKFILE_KEY_SIZE];   /* Key of the first element of the last document */
+};
+
+/**
+ * Decompressed block. Documents point into the block and stay valid
+ * until the block is loaded again or deinitialized.
+ */
+typedef struct bson_blockfile_block bson_blockfile_block_t;
+struct bson_blockfile_block
+{
+    char*           data;
+    size_t          alloced;
+    size_t          index;      /* Index of loaded block or SIZE_MAX */
+    uint32_t        ndocs;
+    const uint32_t* offsets;
+};
+
+#define BSON_BLOCKFILE_BLOCK_INITIALIZER    { 0, 0, SIZE_MAX, 0, 0 }
+
+#define bson_blockfile_block_doc(b, i)      ((bson_document_ref)((b)->data + (b)->offsets[i]))
+
+static inline void bson_blockfile_block_deinit(bson_blockfile_block_t* __restrict block)
+{
+    free(block->data);
+    block->data = 0;
+    block->alloced = 0;
+    block->index = SIZE_MAX;
+}
+
+/**
+ * Reader
+ */
+typedef struct bson_blockfile_reader* bson_blockfile_reader_ref;
+
+/**
+ * Reads the index of the file
+ * @return 0 if the file is malformed or out of memory
+ */
+bson_blockfile_reader_ref bson_blockfile_reader_open(int fd);
+
+/**
+ * Destroys reader. The descriptor is not closed.
+ */
+void bson_blockfile_reader_close(bson_blockfile_reader_ref r);
+
+/**
+ * Get number of blocks
+ */
+size_t bson_blockfile_reader_nblocks(bson_blockfile_reader_ref r);
+
+/**
+ * Get number of documents
+ */
+uint64_t bson_blockfile_reader_ndocs(bson_blockfile_reader_ref r);
+
+/**
+ * Get index entry of the block
+ */
+const struct bson_blockfile_block_info* bson_blockfile_reader_info(bson_blockfile_reader_ref r, size_t i);
+
+/**
+ * Finds blocks which may hold documents with the key of the first element
+ * in [low, high]. Bounds are keys made by bson_index_key(); zero bound
+ * means unbounded. Blocks are found by their truncated keys, so they may
+ * also hold documents out of the range.
+ * @return number of blocks, first of them in *first
+ */
+size_t bson_blockfile_reader_find_range(bson_blockfile_reader_ref __restrict r,
+                                        const char* __restrict low, size_t nlow,
+                                        const char* __restrict high, size_t nhigh,
+                                        size_t* __restrict first);
+
+/**
+ * Reads and decompresses the block. Does nothing if it's already loaded.
+ * @return 0 on success
+ */
+int bson_blockfile_reader_load(bson_blockfile_reader_ref __restrict r, size_t i,
+                               bson_blockfile_block_t* __restrict block);
+
+/**
+ * Get document by its number, loading its block if needed
+ * @return 0 on error
+ */
+bson_document_ref bson_blockfile_reader_get(bson_blockfile_reader_ref __restrict r, uint64_t n,
+                                            bson_blockfile_block_t* __restrict block);
+
+#endif // _BSON_BLOCKFILE_H_
@@ -89,6 +89,9 @@ enum bson_types
     /** 64 bit integer */
     bson_type_long,
     
+    /* 128 bit IEEE 754-2008 decimal floating point, BID encoding */
+    bson_type_decimal128,
+    
     /* larger than all other types */
     bson_type_maxkey = 127
 };
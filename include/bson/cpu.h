@@ -0,0 +1,52 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BSON_CPU_H_
+#define _BSON_CPU_H_
+
+/**
+ * Instruction set extensions used by SIMD kernels.
+ *
+ * Kernels for an extension are compiled in separate translation units
+ * with the matching compiler flags (see CMakeLists.txt) and are chosen
+ * at run time, so the library runs on any CPU of the architecture.
+ */
+enum bson_cpu_features
+{
+    BSON_CPU_SSE42 = 1 << 0,
+    BSON_CPU_AVX2 = 1 << 1
+};
+
+/**
+ * Get extensions supported by the CPU. The result is computed once.
+ * Setting BSON_CPU_FEATURES environment variable to a number masks the
+ * detected features, e.g. BSON_CPU_FEATURES=0 forces portable code.
+ */
+unsigned bson_cpu_features();
+
+/**
+ * Check that the CPU supports all of given extensions
+ */
+#define bson_cpu_has(features)              ((bson_cpu_features() & (features)) == (features))
+
+#endif // _BSON_CPU_H_
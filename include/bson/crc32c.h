@@ -0,0 +1,45 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BSON_CRC32C_H_
+#define _BSON_CRC32C_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * CRC-32C (Castagnoli) of the bytes. Pass 0 to start, or the previous
+ * result to continue over the next bytes. Uses SSE4.2 instruction if the
+ * CPU has it, see cpu.h.
+ */
+uint32_t bson_crc32c(uint32_t crc, const void* data, size_t size);
+
+/*
+ * Kernels
+ */
+typedef uint32_t (*bson_crc32c_kernel_t)(uint32_t crc, const void* data, size_t size);
+
+uint32_t bson_crc32c_portable(uint32_t crc, const void* data, size_t size);
+uint32_t bson_crc32c_sse42(uint32_t crc, const void* data, size_t size);
+
+#endif // _BSON_CRC32C_H_
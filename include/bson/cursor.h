@@ -0,0 +1,209 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BSON_CURSOR_H_
+#define _BSON_CURSOR_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <bson/decimal128.h>
+#include <bson/element.h>
+#include <bson/document.h>
+#include <bson/oid.h>
+
+/**
+ * Lazy cursor over document.
+ *
+ * The cursor never copies or decodes anything until asked. Embedded
+ * documents and arrays are stepped over in O(1) using their size prefix,
+ * and child cursors point into the same buffer.
+ */
+typedef struct bson_cursor bson_cursor_t;
+typedef struct bson_cursor* bson_cursor_ref;
+struct bson_cursor
+{
+    const char* doc;        /* Document being walked */
+    const char* next;       /* Next element */
+    const char* el;         /* Current element or 0 */
+    const char* value;      /* Value of current element */
+};
+
+inline void bson_cursor_init(bson_cursor_ref __restrict c, bson_document_ref doc)
+{
+    c->doc = doc->data;
+    c->next = doc->data + sizeof(int32_t);
+    c->el = 0;
+    c->value = 0;
+}
+
+/**
+ * Moves cursor to the next element. The first call moves to the first one.
+ * @return 0 at the end of document
+ */
+inline int bson_cursor_next(bson_cursor_ref __restrict c)
+{
+    if(c->el)
+    {
+        if(*c->el == bson_type_eoo)
+        {
+            return 0;
+        }
+        c->next = c->value + bson_value_size(*c->el, c->value);
+    }
+
+    c->el = c->next;
+    if(*c->el == bson_type_eoo)
+    {
+        c->value = 0;
+        return 0;
+    }
+
+    c->value = c->el + 1 + strlen(c->el + 1) + 1;
+    return 1;
+}
+
+/**
+ * Moves cursor forward to the element with given key
+ * @return 0 if there is no such element
+ */
+int bson_cursor_find(bson_cursor_ref __restrict c, const char* __restrict key);
+
+/**
+ * Initializes child cursor over current embedded document or array
+ * @return 0 if current element is neither document nor array
+ */
+inline int bson_cursor_child(bson_cursor_ref __restrict c, bson_cursor_ref __restrict child)
+{
+    if(!c->value || (*c->el != bson_type_document && *c->el != bson_type_array))
+    {
+        return 0;
+    }
+
+    bson_cursor_init(child, (bson_document_ref)c->value);
+    return 1;
+}
+
+/**
+ * Get current element
+ */
+#define bson_cursor_element(c)              bson_element_create_with_data((c)->el)
+
+/**
+ * Get type of current element
+ */
+#define bson_cursor_type(c)                 ((bson_type_t)*(c)->el)
+
+/**
+ * Get key of current element
+ */
+#define bson_cursor_key(c)                  ((c)->el + 1)
+
+/**
+ * Get raw value of current element
+ */
+#define bson_cursor_value(c)                ((c)->value)
+
+/**
+ * Get size of the value of current element. Computed on demand.
+ */
+#define bson_cursor_value_size(c)           bson_value_size(*(c)->el, (c)->value)
+
+/**
+ * Get size of the whole document the cursor walks
+ */
+#define bson_cursor_doc_size(c)             (*(const int32_t *)(c)->doc)
+
+/**
+ * Typed accessors. The type of current element must match.
+ */
+static inline int32_t bson_cursor_i(bson_cursor_ref __restrict c)
+{
+    int32_t v;
+    memcpy(&v, c->value, sizeof(v));
+    return v;
+}
+
+static inline int64_t bson_cursor_l(bson_cursor_ref __restrict c)
+{
+    int64_t v;
+    memcpy(&v, c->value, sizeof(v));
+    return v;
+}
+
+static inline double bson_cursor_d(bson_cursor_ref __restrict c)
+{
+    double v;
+    memcpy(&v, c->value, sizeof(v));
+    return v;
+}
+
+static inline char bson_cursor_b(bson_cursor_ref __restrict c)
+{
+    return *c->value;
+}
+
+#define bson_cursor_date(c)                 bson_cursor_l(c)
+
+static inline bson_decimal128_t bson_cursor_dec128(bson_cursor_ref __restrict c)
+{
+    bson_decimal128_t v;
+    bson_decimal128_init_with_bytes(&v, c->value);
+    return v;
+}
+
+static inline bson_oid_ref bson_cursor_oid(bson_cursor_ref __restrict c)
+{
+    return (bson_oid_ref)c->value;
+}
+
+/**
+ * Get string of current string, code or symbol element
+ * @param len length of the string without trailing zero, may be 0
+ */
+static inline const char* bson_cursor_str(bson_cursor_ref __restrict c, size_t* __restrict len)
+{
+    if(len)
+    {
+        *len = (size_t)bson_cursor_i(c) - 1;
+    }
+    return c->value + sizeof(int32_t);
+}
+
+/**
+ * Get binary data of current element
+ */
+static inline const void* bson_cursor_bin(bson_cursor_ref __restrict c, bson_subtype_t* __restrict t,
+                                          size_t* __restrict len)
+{
+    if(t)
+    {
+        *t = c->value[sizeof(int32_t)];
+    }
+    if(len)
+    {
+        *len = (size_t)bson_cursor_i(c);
+    }
+    return c->value + sizeof(int32_t) + 1;
+}
+
+#endif // _BSON_CURSOR_H_
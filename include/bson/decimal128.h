@@ -0,0 +1,127 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BSON_DECIMAL128_H_
+#define _BSON_DECIMAL128_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * IEEE 754-2008 128 bit decimal in binary integer decimal (BID) encoding:
+ * sign, 14 bit exponent biased by 6176 and up to 34 digits of coefficient.
+ * Stored little-endian, as BSON does.
+ */
+typedef struct bson_decimal128 bson_decimal128_t;
+typedef struct bson_decimal128* bson_decimal128_ref;
+struct bson_decimal128
+{
+    uint64_t low;
+    uint64_t high;
+};
+
+enum
+{
+    /* Digits of coefficient */
+    bson_decimal128_digits = 34,
+    
+    /* Range of exponent */
+    bson_decimal128_exponent_max = 6111,
+    bson_decimal128_exponent_min = -6176,
+    bson_decimal128_exponent_bias = 6176,
+    
+    /* Size of string buffer, including terminating zero */
+    bson_decimal128_string_size = 43
+};
+
+/**
+ * Zero with exponent 0
+ */
+#define BSON_DECIMAL128_INITIALIZER         { 0, 0x3040000000000000ull }
+
+#define BSON_DECIMAL128_SIGN                0x8000000000000000ull
+#define BSON_DECIMAL128_INF                 0x7800000000000000ull
+#define BSON_DECIMAL128_NAN                 0x7c00000000000000ull
+
+/**
+ * Initialize decimal with raw value of BSON element
+ */
+static inline void bson_decimal128_init_with_bytes(bson_decimal128_ref __restrict d, const char* __restrict value)
+{
+    memcpy(d, value, sizeof(*d));
+}
+
+/**
+ * Initialize decimal with integer, exponent 0
+ */
+static inline void bson_decimal128_init_with_int64(bson_decimal128_ref __restrict d, int64_t v)
+{
+    d->low = v < 0 ? 0 - (uint64_t)v : (uint64_t)v;
+    d->high = 0x3040000000000000ull | (v < 0 ? BSON_DECIMAL128_SIGN : 0);
+}
+
+static inline int bson_decimal128_is_nan(const bson_decimal128_t* __restrict d)
+{
+    return (d->high & BSON_DECIMAL128_NAN) == BSON_DECIMAL128_NAN;
+}
+
+static inline int bson_decimal128_is_inf(const bson_decimal128_t* __restrict d)
+{
+    return (d->high & BSON_DECIMAL128_NAN) == BSON_DECIMAL128_INF;
+}
+
+static inline void bson_decimal128_negate(bson_decimal128_ref __restrict d)
+{
+    d->high ^= BSON_DECIMAL128_SIGN;
+}
+
+/**
+ * Parses decimal string: [+-]digits[.digits][(e|E)[+-]digits], Infinity,
+ * Inf or NaN. More than 34 significant digits are rounded half to even.
+ * @return 0 on success, 1 if the string is invalid or out of range
+ */
+int bson_decimal128_from_string(bson_decimal128_ref __restrict d, const char* __restrict s, size_t n);
+
+/**
+ * Formats decimal as the BSON specification requires: plain notation
+ * for non-positive exponents down to 1E-6, scientific otherwise.
+ * @param buffer at least bson_decimal128_string_size bytes
+ * @return length of the string
+ */
+size_t bson_decimal128_to_string(const bson_decimal128_t* __restrict d, char* __restrict buffer);
+
+/**
+ * Compares numeric values: 1.0 equals 1.00 and -0 equals 0.
+ * NaN equals NaN and is less than any number.
+ * @return negative, zero or positive value as a < b, a == b or a > b
+ */
+int bson_decimal128_compare(const bson_decimal128_t* __restrict a, const bson_decimal128_t* __restrict b);
+
+/**
+ * Adds two decimals, rounding half to even to 34 digits.
+ * Overflow produces infinity. The result may alias an operand.
+ */
+void bson_decimal128_add(bson_decimal128_ref r, const bson_decimal128_t* a, const bson_decimal128_t* b);
+
+#endif // _BSON_DECIMAL128_H_
@@ -28,9 +28,11 @@
 #include <stdio.h>
 
 #include <bson/bsontypes.h>
+#include <bson/decimal128.h>
 #include <bson/element.h>
 #include <bson/document.h>
 #include <bson/oid.h>
+#include <bson/stats.h>
 #include <cpl/cpl_region.h>
 
 /*
@@ -41,6 +43,7 @@ struct bson_document_builder
 {
     cpl_region_t    r;
     size_t          index;      /* An index to build array instead of document */
+    int             error;      /* An append failed, finalize returns 0 */
     bson_document_builder_ref parent;
 };
 
@@ -55,14 +58,16 @@ inline bson_document_builder_ref bson_document_builder_create_with_parent(bson_d
         if(parent)
         {
             bld->r = parent->r;
+            bld->error = parent->error;
         }
         else
         {
-            cpl_region_init(cpl_allocator_get_default(), &bld->r, 0);
+            bld->error = cpl_region_init(cpl_allocator_get_default(), &bld->r, 0) != 0;
         }
         
         bld->r.offset += sizeof(int32_t);
         bld->parent = parent;
+        BSON_STATS_INC(BSON_STATS_ALLOCATIONS);
         bld->index = 0;
     }
     return bld;
@@ -80,22 +85,40 @@ static inline bson_document_builder_ref bson_document_builder_create()
 
 /*
  * Common destructor. Finalize and returns document. Frees builder.
+ * Returns 0 if any append ran out of memory.
  */
 inline bson_document_ref bson_document_builder_finalize(bson_document_builder_ref __restrict bld)
 {
     bson_type_t type = bson_type_eoo;
-    cpl_region_append_data(&bld->r, &type, sizeof(type));
+    bld->error |= cpl_region_append_data(&bld->r, &type, sizeof(type)) != 0;
     int32_t* count;
     if(bld->parent)
     {
+        if(bld->error)
+        {
+            /* The parent takes the region back and fails as well */
+            bld->parent->r = bld->r;
+            bld->parent->error = 1;
+            free(bld);
+            return 0;
+        }
+        
         count = bld->r.data + bld->parent->r.offset;
         *count = (int32_t)(bld->r.offset - bld->parent->r.offset);
         bld->parent->r = bld->r;
     }
     else
     {
+        if(bld->error)
+        {
+            cpl_region_deinit(&bld->r);
+            free(bld);
+            return 0;
+        }
+        
         count = bld->r.data;
         *count = (int32_t)bld->r.offset;
+        BSON_STATS_DOCUMENT(bld->r.offset);
     }
     
     bson_document_ref doc = (bson_document_ref)count;
@@ -103,122 +126,253 @@ inline bson_document_ref bson_document_builder_finalize(bson_document_builder_re
     return doc;
 }
 
+/*
+ * Elements up to this size are assembled on the stack and appended
+ * to the region at once
+ */
+#define BSON_DOCUMENT_BUILDER_INLINE_SIZE   256
+
+/*
+ * Appends the element: type, key of nk bytes and the value preceded
+ * by prefix. Elements up to BSON_DOCUMENT_BUILDER_INLINE_SIZE are staged
+ * on the stack, so they take a single region call at the cost of one
+ * more copy. Longer values are appended after the staged head.
+ */
+inline void bson_document_builder_append_raw(bson_document_builder_ref __restrict bld,
+                                             bson_type_t type, const char* __restrict k, size_t nk,
+                                             const void* __restrict prefix, size_t nprefix,
+                                             const void* __restrict value, size_t nvalue)
+{
+    char buffer[BSON_DOCUMENT_BUILDER_INLINE_SIZE];
+    const size_t nhead = 2 + nk + nprefix;
+    BSON_STATS_ONLY(const void* data = bld->r.data);
+    BSON_STATS_ELEMENT(type);
+    int rc;
+    if(nhead > sizeof(buffer))
+    {
+        /* Very long key */
+        rc = cpl_region_append_data(&bld->r, &type, sizeof(type)) ||
+             cpl_region_append_data(&bld->r, k, nk) ||
+             cpl_region_append_data(&bld->r, "", 1) ||
+             cpl_region_append_data(&bld->r, prefix, nprefix) ||
+             cpl_region_append_data(&bld->r, value, nvalue);
+    }
+    else
+    {
+        buffer[0] = type;
+        memcpy(buffer + 1, k, nk);
+        buffer[1 + nk] = '\0';
+        memcpy(buffer + 2 + nk, prefix, nprefix);
+        if(nhead + nvalue <= sizeof(buffer))
+        {
+            memcpy(buffer + nhead, value, nvalue);
+            rc = cpl_region_append_data(&bld->r, buffer, nhead + nvalue);
+        }
+        else
+        {
+            rc = cpl_region_append_data(&bld->r, buffer, nhead) ||
+                 cpl_region_append_data(&bld->r, value, nvalue);
+        }
+    }
+    bld->error |= rc != 0;
+    BSON_STATS_ONLY(if(bld->r.data != data) BSON_STATS_INC(BSON_STATS_REGION_GROWTHS));
+}
+
+/*
+ * Append routines taking the length of the key
+ */
+inline void bson_document_builder_append_doc_n(bson_document_builder_ref __restrict bld,
+                                               const char* __restrict k, size_t nk,
+                                               const bson_document_ref __restrict doc)
+{
+    bson_document_builder_append_raw(bld, bson_type_document, k, nk, "", 0, doc->data, bson_document_size(doc));
+}
+
+inline void bson_document_builder_append_arr_n(bson_document_builder_ref __restrict bld,
+                                               const char* __restrict k, size_t nk,
+                                               const bson_array_ref __restrict arr)
+{
+    bson_document_builder_append_raw(bld, bson_type_array, k, nk, "", 0, arr->data, bson_document_size(arr));
+}
+
+inline void bson_document_builder_append_b_n(bson_document_builder_ref __restrict bld,
+                                             const char* __restrict k, size_t nk, char b)
+{
+    bson_document_builder_append_raw(bld, bson_type_bool, k, nk, "", 0, &b, sizeof(b));
+}
+
+inline void bson_document_builder_append_i_n(bson_document_builder_ref __restrict bld,
+                                             const char* __restrict k, size_t nk, int32_t i)
+{
+    bson_document_builder_append_raw(bld, bson_type_int, k, nk, "", 0, &i, sizeof(i));
+}
+
+inline void bson_document_builder_append_l_n(bson_document_builder_ref __restrict bld,
+                                             const char* __restrict k, size_t nk, int64_t l)
+{
+    bson_document_builder_append_raw(bld, bson_type_long, k, nk, "", 0, &l, sizeof(l));
+}
+
+inline void bson_document_builder_append_d_n(bson_document_builder_ref __restrict bld,
+                                             const char* __restrict k, size_t nk, double d)
+{
+    bson_document_builder_append_raw(bld, bson_type_float, k, nk, "", 0, &d, sizeof(d));
+}
+
+inline void bson_document_builder_append_oid_n(bson_document_builder_ref __restrict bld,
+                                               const char* __restrict k, size_t nk,
+                                               const bson_oid_ref __restrict oid)
+{
+    bson_document_builder_append_raw(bld, bson_type_oid, k, nk, "", 0, oid->data, sizeof(oid->data));
+}
+
+inline void bson_document_builder_append_date_n(bson_document_builder_ref __restrict bld,
+                                                const char* __restrict k, size_t nk, int64_t dt)
+{
+    bson_document_builder_append_raw(bld, bson_type_date, k, nk, "", 0, &dt, sizeof(dt));
+}
+
+inline void bson_document_builder_append_dec128_n(bson_document_builder_ref __restrict bld,
+                                                  const char* __restrict k, size_t nk,
+                                                  const bson_decimal128_t* __restrict dec)
+{
+    bson_document_builder_append_raw(bld, bson_type_decimal128, k, nk, "", 0, dec, sizeof(*dec));
+}
+
+/*
+ * Append a string of given length. The string must be NUL-terminated.
+ */
+inline void bson_document_builder_append_str_n(bson_document_builder_ref __restrict bld,
+                                               const char* __restrict k, size_t nk,
+                                               const char* __restrict str, size_t nstr)
+{
+    int32_t size = (int32_t)nstr + 1;
+    bson_document_builder_append_raw(bld, bson_type_string, k, nk, &size, sizeof(size), str, size);
+}
+
+inline void bson_document_builder_append_js_n(bson_document_builder_ref __restrict bld,
+                                              const char* __restrict k, size_t nk,
+                                              const char* __restrict js, size_t njs)
+{
+    int32_t size = (int32_t)njs + 1;
+    bson_document_builder_append_raw(bld, bson_type_code, k, nk, &size, sizeof(size), js, size);
+}
+
+inline void bson_document_builder_append_null_n(bson_document_builder_ref __restrict bld,
+                                                const char* __restrict k, size_t nk)
+{
+    bson_document_builder_append_raw(bld, bson_type_null, k, nk, "", 0, "", 0);
+}
+
+inline void bson_document_builder_append_regex_n(bson_document_builder_ref __restrict bld,
+                                                 const char* __restrict k, size_t nk,
+                                                 const char* __restrict regex,
+                                                 const char* __restrict flags)
+{
+    if(!flags)
+    {
+        flags = "";
+    }
+    bson_document_builder_append_raw(bld, bson_type_regex, k, nk, regex, strlen(regex) + 1,
+                                     flags, strlen(flags) + 1);
+}
+
+inline void bson_document_builder_append_bin_n(bson_document_builder_ref __restrict bld,
+                                               const char* __restrict k, size_t nk,
+                                               bson_subtype_t t, void* __restrict d,
+                                               int32_t sz)
+{
+    char prefix[sizeof(sz) + sizeof(t)];
+    memcpy(prefix, &sz, sizeof(sz));
+    prefix[sizeof(sz)] = t;
+    bson_document_builder_append_raw(bld, bson_type_bindata, k, nk, prefix, sizeof(prefix), d, sz);
+}
+
 /*
  * Append routines
  */
 inline void bson_document_builder_append_el(bson_document_builder_ref __restrict bld,
                                             const bson_element_ref __restrict e)
 {
-    cpl_region_append_data(&bld->r, e->data, bson_element_size(e));
+    bld->error |= cpl_region_append_data(&bld->r, e->data, bson_element_size(e)) != 0;
 }
 
 inline void bson_document_builder_append_doc(bson_document_builder_ref __restrict bld,
                                              const char* __restrict k,
                                              const bson_document_ref __restrict doc)
 {
-    bson_type_t type = bson_type_document;
-    cpl_region_append_data(&bld->r, &type, sizeof(type));
-    cpl_region_append_data(&bld->r, k, strlen(k) + 1);
-    cpl_region_append_data(&bld->r, doc->data, bson_document_size(doc));
+    bson_document_builder_append_doc_n(bld, k, strlen(k), doc);
 }
 
 inline void bson_document_builder_append_arr(bson_document_builder_ref __restrict bld,
                                              const char* __restrict k,
                                              const bson_array_ref __restrict arr)
 {
-    bson_type_t type = bson_type_array;
-    cpl_region_append_data(&bld->r, &type, sizeof(type));
-    cpl_region_append_data(&bld->r, k, strlen(k) + 1);
-    cpl_region_append_data(&bld->r, arr->data, bson_document_size(arr));
+    bson_document_builder_append_arr_n(bld, k, strlen(k), arr);
 }
 
 inline void bson_document_builder_append_b(bson_document_builder_ref __restrict bld,
                                            const char* __restrict k, char b)
 {
-    bson_type_t type = bson_type_bool;
-    cpl_region_append_data(&bld->r, &type, sizeof(type));
-    cpl_region_append_data(&bld->r, k, strlen(k)+1);
-    cpl_region_append_data(&bld->r, &b, sizeof(b));
+    bson_document_builder_append_b_n(bld, k, strlen(k), b);
 }
 
 inline void bson_document_builder_append_i(bson_document_builder_ref __restrict bld,
                                            const char* __restrict k, int32_t i)
 {
-    bson_type_t type = bson_type_int;
-    cpl_region_append_data(&bld->r, &type, sizeof(type));
-    cpl_region_append_data(&bld->r, k, strlen(k)+1);
-    cpl_region_append_data(&bld->r, &i, sizeof(i));
+    bson_document_builder_append_i_n(bld, k, strlen(k), i);
 }
 
 inline void bson_document_builder_append_l(bson_document_builder_ref __restrict bld,
                                            const char* __restrict k, int64_t l)
 {
-    bson_type_t type = bson_type_long;
-    cpl_region_append_data(&bld->r, &type, sizeof(type));
-    cpl_region_append_data(&bld->r, k, strlen(k)+1);
-    cpl_region_append_data(&bld->r, &l, sizeof(l));
+    bson_document_builder_append_l_n(bld, k, strlen(k), l);
 }
 
 inline void bson_document_builder_append_d(bson_document_builder_ref __restrict bld,
                                            const char* __restrict k, double d)
 {
-    bson_type_t type = bson_type_float;
-    cpl_region_append_data(&bld->r, &type, sizeof(type));
-    cpl_region_append_data(&bld->r, k, strlen(k)+1);
-    cpl_region_append_data(&bld->r, &d, sizeof(d));
+    bson_document_builder_append_d_n(bld, k, strlen(k), d);
 }
 
 inline void bson_document_builder_append_oid(bson_document_builder_ref __restrict bld,
                                              const char* __restrict k,
                                              const bson_oid_ref __restrict oid)
 {
-    bson_type_t type = bson_type_oid;
-    cpl_region_append_data(&bld->r, &type, sizeof(type));
-    cpl_region_append_data(&bld->r, k, strlen(k)+1);
-    cpl_region_append_data(&bld->r, oid->data, sizeof(oid->data));
+    bson_document_builder_append_oid_n(bld, k, strlen(k), oid);
 }
 
 inline void bson_document_builder_append_date(bson_document_builder_ref __restrict bld,
                                               const char* __restrict k, int64_t dt)
 {
-    bson_type_t type = bson_type_date;
-    cpl_region_append_data(&bld->r, &type, sizeof(type));
-    cpl_region_append_data(&bld->r, k, strlen(k)+1);
-    cpl_region_append_data(&bld->r, &dt, sizeof(dt));
+    bson_document_builder_append_date_n(bld, k, strlen(k), dt);
+}
+
+inline void bson_document_builder_append_dec128(bson_document_builder_ref __restrict bld,
+                                                const char* __restrict k,
+                                                const bson_decimal128_t* __restrict dec)
+{
+    bson_document_builder_append_dec128_n(bld, k, strlen(k), dec);
 }
 
 inline void bson_document_builder_append_str(bson_document_builder_ref __restrict bld,
                                              const char* __restrict k,
                                              const char* __restrict str)
 {
-    bson_type_t type = bson_type_string;
-    cpl_region_append_data(&bld->r, &type, sizeof(type));
-    cpl_region_append_data(&bld->r, k, strlen(k)+1);
-    
-    size_t size = strlen(str) + 1;
-    cpl_region_append_data(&bld->r, &size, sizeof(size));
-    cpl_region_append_data(&bld->r, str, size);
+    bson_document_builder_append_str_n(bld, k, strlen(k), str, strlen(str));
 }
 
 inline void bson_document_builder_append_js(bson_document_builder_ref __restrict bld,
                                             const char* __restrict k,
                                             const char* __restrict js)
 {
-    bson_type_t type = bson_type_code;
-    cpl_region_append_data(&bld->r, &type, sizeof(type));
-    cpl_region_append_data(&bld->r, k, strlen(k)+1);
-    
-    int32_t size = (int32_t)strlen(js) + 1;
-    cpl_region_append_data(&bld->r, &size, sizeof(size));
-    cpl_region_append_data(&bld->r, js, size);
+    bson_document_builder_append_js_n(bld, k, strlen(k), js, strlen(js));
 }
 
 inline void bson_document_builder_append_null(bson_document_builder_ref __restrict bld,
                                               const char* __restrict k)
 {
-    bson_type_t type = bson_type_null;
-    cpl_region_append_data(&bld->r, &type, sizeof(type));
-    cpl_region_append_data(&bld->r, k, strlen(k)+1);
+    bson_document_builder_append_null_n(bld, k, strlen(k));
 }
 
 /*
@@ -231,15 +385,7 @@ inline void bson_document_builder_append_regex(bson_document_builder_ref __restr
                                                const char* __restrict regex,
                                                const char* __restrict flags)
 {
-    bson_type_t type = bson_type_regex;
-    cpl_region_append_data(&bld->r, &type, sizeof(type));
-    cpl_region_append_data(&bld->r, k, strlen(k)+1);
-    cpl_region_append_data(&bld->r, regex, strlen(regex)+1);
-    if(!flags)
-    {
-        flags = "";
-    }
-    cpl_region_append_data(&bld->r, flags, strlen(flags) + 1);
+    bson_document_builder_append_regex_n(bld, k, strlen(k), regex, flags);
 }
 
 inline void bson_document_builder_append_bin(bson_document_builder_ref __restrict bld,
@@ -247,12 +393,7 @@ inline void bson_document_builder_append_bin(bson_document_builder_ref __restric
                                              bson_subtype_t t, void* __restrict d,
                                              int32_t sz)
 {
-    bson_type_t type = bson_type_bindata;
-    cpl_region_append_data(&bld->r, &type, sizeof(type));
-    cpl_region_append_data(&bld->r, k, strlen(k)+1);
-    cpl_region_append_data(&bld->r, &sz, sizeof(sz));
-    cpl_region_append_data(&bld->r, &t, sizeof(t));
-    cpl_region_append_data(&bld->r, d, sz);
+    bson_document_builder_append_bin_n(bld, k, strlen(k), t, d, sz);
 }
 
 /**
@@ -263,109 +404,149 @@ inline void bson_document_builder_append_bin(bson_document_builder_ref __restric
 #define bson_array_builder_destroy(bld)     bson_document_builder_destroy(bld)
 #define bson_array_builder_finalize(bld)    bson_document_builder_finalize(bld)
 
+/*
+ * Formats the next index of the array into the buffer. Returns the key.
+ */
+static inline const char* bson_array_builder_next_key(bson_array_builder_ref __restrict bld,
+                                                      char k[24], size_t* __restrict nk)
+{
+    size_t i = bld->index++;
+    char* p = k + 23;
+    *p = '\0';
+    do
+    {
+        *--p = (char)('0' + i % 10);
+        i /= 10;
+    } while(i);
+    *nk = k + 23 - p;
+    return p;
+}
+
 static inline void bson_array_builder_append_doc(bson_array_builder_ref __restrict bld,
                                                  const bson_document_ref __restrict doc)
 {
-    char k[16];
-    sprintf(k, "%lu", bld->index++);
-    bson_document_builder_append_doc(bld, k, doc);
+    char k[24];
+    size_t nk;
+    const char* key = bson_array_builder_next_key(bld, k, &nk);
+    bson_document_builder_append_doc_n(bld, key, nk, doc);
 }
 
 static inline void bson_array_builder_append_arr(bson_array_builder_ref __restrict bld,
                                                  const bson_array_ref __restrict arr)
 {
-    char k[16];
-    sprintf(k, "%lu", bld->index++);
-    bson_document_builder_append_arr(bld, k, arr);
+    char k[24];
+    size_t nk;
+    const char* key = bson_array_builder_next_key(bld, k, &nk);
+    bson_document_builder_append_arr_n(bld, key, nk, arr);
 }
 
 static inline void bson_array_builder_append_b(bson_array_builder_ref __restrict bld,
                                                char b)
 {
-    char k[16];
-    sprintf(k, "%lu", bld->index++);
-    bson_document_builder_append_b(bld, k, b);
+    char k[24];
+    size_t nk;
+    const char* key = bson_array_builder_next_key(bld, k, &nk);
+    bson_document_builder_append_b_n(bld, key, nk, b);
 }
 
 static inline void bson_array_builder_append_i(bson_array_builder_ref __restrict bld,
                                                int32_t i)
 {
-    char k[16];
-    sprintf(k, "%lu", bld->index++);
-    bson_document_builder_append_i(bld, k, i);
+    char k[24];
+    size_t nk;
+    const char* key = bson_array_builder_next_key(bld, k, &nk);
+    bson_document_builder_append_i_n(bld, key, nk, i);
 }
 
 static inline void bson_array_builder_append_l(bson_array_builder_ref __restrict bld,
                                                int64_t l)
 {
-    char k[16];
-    sprintf(k, "%lu", bld->index++);
-    bson_document_builder_append_l(bld, k, l);
+    char k[24];
+    size_t nk;
+    const char* key = bson_array_builder_next_key(bld, k, &nk);
+    bson_document_builder_append_l_n(bld, key, nk, l);
 }
 
 static inline void bson_array_builder_append_d(bson_array_builder_ref __restrict bld,
                                                double d)
 {
-    char k[16];
-    sprintf(k, "%lu", bld->index++);
-    bson_document_builder_append_d(bld, k, d);
+    char k[24];
+    size_t nk;
+    const char* key = bson_array_builder_next_key(bld, k, &nk);
+    bson_document_builder_append_d_n(bld, key, nk, d);
 }
 
 static inline void bson_array_builder_append_oid(bson_document_builder_ref __restrict bld,
                                                  const bson_oid_ref __restrict oid)
 {
-    char k[16];
-    sprintf(k, "%lu", bld->index++);
-    bson_document_builder_append_oid(bld, k, oid);
+    char k[24];
+    size_t nk;
+    const char* key = bson_array_builder_next_key(bld, k, &nk);
+    bson_document_builder_append_oid_n(bld, key, nk, oid);
 }
 
 static inline void bson_array_builder_append_date(bson_array_builder_ref __restrict bld,
                                                   int64_t dt)
 {
-    char k[16];
-    sprintf(k, "%lu", bld->index++);
-    bson_document_builder_append_date(bld, k, dt);
+    char k[24];
+    size_t nk;
+    const char* key = bson_array_builder_next_key(bld, k, &nk);
+    bson_document_builder_append_date_n(bld, key, nk, dt);
+}
+
+static inline void bson_array_builder_append_dec128(bson_array_builder_ref __restrict bld,
+                                                    const bson_decimal128_t* __restrict dec)
+{
+    char k[24];
+    size_t nk;
+    const char* key = bson_array_builder_next_key(bld, k, &nk);
+    bson_document_builder_append_dec128_n(bld, key, nk, dec);
 }
 
 static inline void bson_array_builder_append_str(bson_array_builder_ref __restrict bld,
                                                  const char* __restrict str)
 {
-    char k[16];
-    sprintf(k, "%lu", bld->index++);
-    bson_document_builder_append_str(bld, k, str);
+    char k[24];
+    size_t nk;
+    const char* key = bson_array_builder_next_key(bld, k, &nk);
+    bson_document_builder_append_str_n(bld, key, nk, str, strlen(str));
 }
 
 static inline void bson_array_builder_append_js(bson_array_builder_ref __restrict bld,
                                             const char* __restrict js)
 {
-    char k[16];
-    sprintf(k, "%lu", bld->index);
-    bson_document_builder_append_js(bld, k, js);
+    char k[24];
+    size_t nk;
+    const char* key = bson_array_builder_next_key(bld, k, &nk);
+    bson_document_builder_append_js_n(bld, key, nk, js, strlen(js));
 }
 
 static inline void bson_array_builder_append_null(bson_array_builder_ref __restrict bld)
 {
-    char k[16];
-    sprintf(k, "%lu", bld->index++);
-    bson_document_builder_append_null(bld, k);
+    char k[24];
+    size_t nk;
+    const char* key = bson_array_builder_next_key(bld, k, &nk);
+    bson_document_builder_append_null_n(bld, key, nk);
 }
 
 static inline void bson_array_builder_append_regex(bson_array_builder_ref __restrict bld,
                                                    const char* __restrict regex,
                                                    const char* __restrict flags)
 {
-    char k[16];
-    sprintf(k, "%lu", bld->index++);
-    bson_document_builder_append_regex(bld, k, regex, flags);
+    char k[24];
+    size_t nk;
+    const char* key = bson_array_builder_next_key(bld, k, &nk);
+    bson_document_builder_append_regex_n(bld, key, nk, regex, flags);
 }
 
 static inline void bson_array_builder_append_bin(bson_array_builder_ref __restrict bld,
                                              bson_subtype_t t, void* __restrict d,
                                              int32_t sz)
 {
-    char k[16];
-    sprintf(k, "%lu", bld->index++);
-    bson_document_builder_append_bin(bld, k, t, d, sz);
+    char k[24];
+    size_t nk;
+    const char* key = bson_array_builder_next_key(bld, k, &nk);
+    bson_document_builder_append_bin_n(bld, key, nk, t, d, sz);
 }
 
 #endif // _BSON_DOCUMENTBUILDER_H_
@@ -24,6 +24,7 @@
 #ifndef _BSON_ELEMENT_H_
 #define _BSON_ELEMENT_H_
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <bson/bsontypes.h>
@@ -95,6 +96,52 @@ static inline const char* bson_element_value(bson_element_ref __restrict e)
     return e->data + bson_element_key_size(e) + 1;
 }
 
+/**
+ * How the size of a value is computed
+ */
+enum bson_value_size_kinds
+{
+    BSON_VALUE_SIZE_INVALID = 0,    /* Not a value type */
+    BSON_VALUE_SIZE_FIXED,          /* size */
+    BSON_VALUE_SIZE_PREFIXED,       /* size + int32 at the start of value */
+    BSON_VALUE_SIZE_CSTRINGS        /* Two NUL-terminated strings */
+};
+
+struct bson_value_size_info
+{
+    uint8_t     kind;
+    uint8_t     size;
+};
+
+/**
+ * Size rules indexed by type byte
+ */
+extern const struct bson_value_size_info bson_value_sizes[256];
+
+/**
+ * Get size of the value of type other than fixed or prefixed
+ */
+size_t bson_value_size_slow(bson_type_t type, const char* __restrict value);
+
+/**
+ * Get size of the value of given type.
+ */
+inline size_t bson_value_size(bson_type_t type, const char* __restrict value)
+{
+    const struct bson_value_size_info info = bson_value_sizes[(unsigned char)type];
+    if(__builtin_expect(info.kind == BSON_VALUE_SIZE_FIXED, 1))
+    {
+        return info.size;
+    }
+    if(info.kind == BSON_VALUE_SIZE_PREFIXED)
+    {
+        int32_t len;
+        memcpy(&len, value, sizeof(len));
+        return info.size + len;
+    }
+    return bson_value_size_slow(type, value);
+}
+
 /**
  * Get size of the value.
  */
@@ -103,9 +150,10 @@ size_t bson_element_value_size(bson_element_ref __restrict e);
 /**
  * Get size of the element.
  */
-static inline size_t bson_element_size(bson_element_ref __restrict e)
+inline size_t bson_element_size(bson_element_ref __restrict e)
 {
-    return 1 + bson_element_key_size(e) + bson_element_value_size(e);
+    const size_t nkey = strlen(e->data + 1);
+    return 2 + nkey + bson_value_size(bson_element_type(e), e->data + 2 + nkey);
 }
 
 #endif // _BSON_ELEMENT_H_
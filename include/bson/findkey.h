@@ -0,0 +1,57 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BSON_FINDKEY_H_
+#define _BSON_FINDKEY_H_
+
+#include <stdlib.h>
+#include <bson/document.h>
+#include <bson/element.h>
+
+/**
+ * Finds the element of the document by key of given length.
+ * Uses SIMD kernel for the CPU, see cpu.h.
+ * @return element or 0 if there is no such key
+ */
+bson_element_ref bson_document_find_key(bson_document_ref __restrict doc, const char* __restrict key,
+                                        size_t nkey);
+
+/**
+ * Finds the element by dotted path, e.g. "address.city" or "items.0.price".
+ * Every step but the last must be an embedded document or array.
+ * @return element or 0 if there is no such path
+ */
+bson_element_ref bson_document_find_path(bson_document_ref __restrict doc, const char* __restrict path,
+                                         size_t npath);
+
+/*
+ * Kernels. Each walks the elements of document data, comparing keys
+ * of nkey bytes, and returns the matching element or 0.
+ */
+typedef const char* (*bson_find_key_kernel_t)(const char* data, const char* key, size_t nkey);
+
+const char* bson_find_key_portable(const char* data, const char* key, size_t nkey);
+const char* bson_find_key_sse42(const char* data, const char* key, size_t nkey);
+const char* bson_find_key_avx2(const char* data, const char* key, size_t nkey);
+
+#endif // _BSON_FINDKEY_H_
@@ -0,0 +1,99 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BSON_HANDLE_H_
+#define _BSON_HANDLE_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <bson/document.h>
+
+/**
+ * Shared immutable document.
+ *
+ * Handle owns a finalized document and counts references to it, so the
+ * document may be passed between threads without copying. Retain and
+ * release are atomic and lock-free. The document is destroyed with the
+ * last reference and must not be modified while shared.
+ *
+ * Handles may also be embedded into other structures, which are then
+ * freed by the destroy callback (see bson_handle_init()).
+ */
+typedef struct bson_handle bson_handle_t;
+typedef struct bson_handle* bson_handle_ref;
+
+/**
+ * Called when the last reference is released
+ */
+typedef void (*bson_handle_destroy_t)(bson_handle_ref h);
+
+struct bson_handle
+{
+    volatile int32_t        refs;
+    int32_t                 reserved;
+    bson_document_ref       doc;
+    bson_handle_destroy_t   destroy;
+};
+
+/**
+ * Creates handle with one reference, taking ownership of the document.
+ * The document is destroyed with bson_document_destroy() when released.
+ * @return 0 if out of memory; the document is destroyed then
+ */
+bson_handle_ref bson_handle_create(bson_document_ref doc);
+
+/**
+ * Initializes embedded handle with one reference. The destroy callback
+ * frees the handle, its container and the document as needed.
+ */
+static inline void bson_handle_init(bson_handle_ref __restrict h, bson_document_ref doc,
+                                    bson_handle_destroy_t destroy)
+{
+    h->refs = 1;
+    h->reserved = 0;
+    h->doc = doc;
+    h->destroy = destroy;
+}
+
+/**
+ * Adds a reference
+ * @return the handle
+ */
+bson_handle_ref bson_handle_retain(bson_handle_ref h);
+
+/**
+ * Drops a reference, destroying the handle with the last one
+ */
+void bson_handle_release(bson_handle_ref h);
+
+/**
+ * Get the document. It stays valid while the reference is held.
+ */
+#define bson_handle_document(h)             ((h)->doc)
+
+/**
+ * Get number of references. Exact only if no other thread holds one.
+ */
+#define bson_handle_refs(h)                 ((h)->refs)
+
+#endif // _BSON_HANDLE_H_
@@ -0,0 +1,80 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BSON_HASH_H_
+#define _BSON_HASH_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <bson/bsontypes.h>
+#include <bson/document.h>
+
+/**
+ * Default seed of the hash functions
+ */
+#define BSON_HASH_SEED                      0x2d358dccaa6c78a5ull
+
+/**
+ * Fast 64-bit hash of the bytes (wyhash). Not cryptographic.
+ * The result depends only on the bytes and the seed, not on the platform.
+ */
+uint64_t bson_hash_bytes(const void* __restrict data, size_t size, uint64_t seed);
+
+/**
+ * Modes of value and document hashing
+ */
+typedef enum
+{
+    /**
+     * Exact bytes of the value and its type. Fastest, for exact matching.
+     */
+    bson_hash_raw = 0,
+
+    /**
+     * Equal values hash the same regardless of encoding: int, long and
+     * double of the same numeric value, 0.0 and -0.0, all NaNs, string and
+     * symbol. Order of fields still matters. Decimal128 values hash their
+     * bytes, so 1.0 and 1.00 differ.
+     */
+    bson_hash_semantic = 1
+} bson_hash_mode_t;
+
+/**
+ * Hashes the value of given type
+ */
+uint64_t bson_hash_value(bson_type_t type, const char* __restrict value, bson_hash_mode_t mode, uint64_t seed);
+
+/**
+ * Hashes the document. In raw mode it equals hash of its bytes.
+ */
+uint64_t bson_hash_document(bson_document_ref doc, bson_hash_mode_t mode, uint64_t seed);
+
+/**
+ * Hashes the value of dotted path (see bson_document_find_path()) in every
+ * document. Missing values hash as null in semantic mode.
+ * @param hashes array of ndocs results
+ */
+void bson_hash_path(const bson_document_ref* __restrict docs, size_t ndocs, const char* __restrict path,
+                    bson_hash_mode_t mode, uint64_t seed, uint64_t* __restrict hashes);
+
+#endif // _BSON_HASH_H_
@@ -0,0 +1,147 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BSON_INDEX_H_
+#define _BSON_INDEX_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <bson/bsontypes.h>
+
+/**
+ * Secondary index over a collection of BSON documents stored one after
+ * another, e.g. an mmapped file.
+ *
+ * The index is a B+-tree of fixed size pages in its own file, bulk
+ * loaded bottom-up from sorted runs and read through mmap. It maps the
+ * value of one dotted path (see bson_document_find_path()) to offsets of
+ * documents in the collection. Documents missing the path are indexed
+ * as null. Arrays are indexed as whole values, not per element.
+ *
+ * Values are encoded as memcmp-comparable keys: the type class, then
+ * an order preserving encoding of the value. Types are ordered
+ *   minKey < null < numbers < strings < documents < arrays < binary
+ *     < ObjectID < bool < date < timestamp < regex < other < maxKey
+ * Numbers of all types compare by value; undefined is null and symbol
+ * is string. Documents, arrays, binary and other types compare by bytes.
+ */
+
+/**
+ * Size of index page
+ */
+#define BSON_INDEX_PAGE_SIZE                4096
+
+/**
+ * Maximal size of encoded key. Building fails on larger values.
+ */
+#define BSON_INDEX_KEY_SIZE                 1024
+
+/**
+ * Maximal length of the indexed path
+ */
+#define BSON_INDEX_PATH_SIZE                256
+
+/**
+ * Number of keys sorted in memory at once before merging
+ */
+#define BSON_INDEX_RUN_SIZE                 (64 * 1024)
+
+/**
+ * Encodes the value of given type as index key
+ * @param key buffer of BSON_INDEX_KEY_SIZE bytes
+ * @return size of the key or 0 if the value is too large
+ */
+size_t bson_index_key(bson_type_t type, const char* __restrict value, char* __restrict key);
+
+/**
+ * Builds the index of the path over documents in the buffer and writes
+ * it to the file from its start. The descriptor is not closed.
+ * @return 0 on success, 1 if the buffer is malformed, a key is too large,
+ *         the path is too long, out of memory or write failed
+ */
+int bson_index_build(int fd, const char* __restrict data, size_t size, const char* __restrict path);
+
+/**
+ * Index opened for lookups. It is immutable and may be shared by threads.
+ */
+typedef struct bson_index* bson_index_ref;
+
+/**
+ * Maps the index file
+ * @return 0 if the file is malformed
+ */
+bson_index_ref bson_index_open(int fd);
+
+/**
+ * Unmaps the index. The descriptor is not closed.
+ */
+void bson_index_close(bson_index_ref idx);
+
+/**
+ * Get indexed path
+ */
+const char* bson_index_path(bson_index_ref idx);
+
+/**
+ * Get number of indexed documents
+ */
+uint64_t bson_index_count(bson_index_ref idx);
+
+/**
+ * Cursor over offsets of documents with keys in a range, in key order.
+ * Documents with equal keys follow in order of their offsets.
+ */
+typedef struct bson_index_cursor bson_index_cursor_t;
+typedef struct bson_index_cursor* bson_index_cursor_ref;
+struct bson_index_cursor
+{
+    bson_index_ref  idx;
+    uint64_t        page;       /* Current leaf or 0 at the end */
+    uint32_t        slot;       /* Next entry of the leaf */
+    uint32_t        nhigh;      /* Size of the upper bound */
+    int             has_high;
+    char            high[BSON_INDEX_KEY_SIZE];
+};
+
+/**
+ * Positions cursor at documents with keys in [low, high]. Bounds are
+ * keys made by bson_index_key(); zero bound means unbounded.
+ */
+void bson_index_range(bson_index_ref __restrict idx, const char* __restrict low, size_t nlow,
+                      const char* __restrict high, size_t nhigh, bson_index_cursor_ref __restrict c);
+
+/**
+ * Positions cursor at documents with the value equal to given one
+ * @return 0 on success, 1 if the value is too large to be indexed
+ */
+int bson_index_find(bson_index_ref __restrict idx, bson_type_t type, const char* __restrict value,
+                    bson_index_cursor_ref __restrict c);
+
+/**
+ * Moves the cursor to the next document
+ * @param offset receives offset of the document in the collection
+ * @return 0 at the end of range
+ */
+int bson_index_cursor_next(bson_index_cursor_ref __restrict c, uint64_t* __restrict offset);
+
+#endif // _BSON_INDEX_H_
@@ -24,6 +24,7 @@
 #ifndef _BSON_ITERATOR_H_
 #define _BSON_ITERATOR_H_
 
+#include <bson/decimal128.h>
 #include <bson/element.h>
 #include <bson/document.h>
 
@@ -34,9 +35,42 @@ struct bson_iterator
     bson_document_ref d;
     size_t     curr_off;
     size_t     next_off;
+    size_t     key_len;     /* Length of current key */
+    const char* value;      /* Value of current element */
 };
 
-bson_element_ref bson_iterator_next(bson_iterator_ref __restrict i);
+/*
+ * Moves to the next element, measuring its key once
+ */
+inline const char* bson_iterator_step(bson_iterator_ref __restrict i)
+{
+    i->curr_off = i->next_off;
+    
+    const char* p = i->d->data + i->curr_off;
+    if(*p == bson_type_eoo)
+    {
+        i->next_off = 0;
+        i->key_len = 0;
+        i->value = 0;
+    }
+    else
+    {
+        const size_t key_len = strlen(p + 1);
+        i->key_len = key_len;
+        i->value = p + 2 + key_len;
+        i->next_off = i->curr_off + 2 + key_len + bson_value_size(*p, i->value);
+    }
+    return p;
+}
+
+inline bson_element_ref bson_iterator_next(bson_iterator_ref __restrict i)
+{
+    if(i->next_off == 0)
+        return 0;
+    
+    return (bson_element_ref)bson_iterator_step(i);
+}
+
 void bson_iterator_next_el(bson_iterator_ref __restrict i, bson_element_ref *e);
 
 inline int bson_iterator_end(bson_iterator_ref __restrict i)
@@ -52,4 +86,17 @@ inline bson_element_ref bson_iterator_init(bson_iterator_ref __restrict i, bson_
     return bson_iterator_next(i);
 }
 
+/**
+ * Key, its length and value of the current element,
+ * computed once when the iterator moved
+ */
+#define bson_iterator_key(i)                ((i)->d->data + (i)->curr_off + 1)
+#define bson_iterator_key_len(i)            ((i)->key_len)
+#define bson_iterator_value(i)              ((i)->value)
+
+/**
+ * Get value of the current decimal128 element
+ */
+#define bson_iterator_dec128(i, d)          bson_decimal128_init_with_bytes((d), (i)->value)
+
 #endif // _BSON_ITERATOR_H_
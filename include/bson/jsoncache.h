@@ -0,0 +1,85 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BSON_JSONCACHE_H_
+#define _BSON_JSONCACHE_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <bson/document.h>
+#include <bson/handle.h>
+
+/**
+ * Number of independently locked parts of the cache, a power of two
+ */
+#define BSON_JSON_CACHE_STRIPES             16
+
+/**
+ * Bounded LRU cache of parsed JSON in front of json2bson().
+ *
+ * Inputs are keyed by 64-bit hash of their bytes and compared exactly on
+ * hit, so repeated inputs are never parsed again. Every stripe of the
+ * cache has its own lock, LRU list and 1/BSON_JSON_CACHE_STRIPES of the
+ * memory budget.
+ *
+ * Documents are returned as shared handles: they stay valid until the
+ * handle is released, even after eviction or destruction of the cache.
+ */
+typedef struct bson_json_cache* bson_json_cache_ref;
+
+/**
+ * Cache counters
+ */
+struct bson_json_cache_stats
+{
+    uint64_t    hits;
+    uint64_t    misses;         /* Including failed parses */
+    uint64_t    evictions;
+    size_t      entries;        /* Number of cached inputs */
+    size_t      bytes;          /* Memory used by cached inputs and documents */
+};
+
+/**
+ * Creates cache limited by memory used by the inputs and their documents
+ */
+bson_json_cache_ref bson_json_cache_create(size_t max_bytes);
+
+/**
+ * Destroys cache. Documents which are not released yet stay valid.
+ */
+void bson_json_cache_destroy(bson_json_cache_ref cache);
+
+/**
+ * Converts JSON like json2bson() or returns the cached document.
+ * Thread-safe. The handle must be released with bson_handle_release().
+ * @return 0 if the JSON is malformed or out of memory
+ */
+bson_handle_ref bson_json_cache_get(bson_json_cache_ref __restrict cache, const char* __restrict json,
+                                    size_t nlength);
+
+/**
+ * Get counters summed over all stripes
+ */
+void bson_json_cache_stats(bson_json_cache_ref __restrict cache, struct bson_json_cache_stats* __restrict stats);
+
+#endif // _BSON_JSONCACHE_H_
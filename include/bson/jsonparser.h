@@ -28,6 +28,23 @@
 #include <bson/bsontypes.h>
 #include <bson/document.h>
 
+/*
+ * Values follow the type in the variadic arguments:
+ *   bson_type_string       char* string
+ *   bson_type_float        double
+ *   bson_type_int          long
+ *   bson_type_bool         int
+ *   bson_type_null         none
+ *   bson_type_oid          bson_oid_ref
+ *   bson_type_long         int64_t, from {"$numberLong": "..."}
+ *   bson_type_date         int64_t milliseconds, from {"$date": ...}
+ *   bson_type_decimal128   bson_decimal128_ref, from {"$numberDecimal": "..."}
+ *   bson_type_bindata      int subtype, void* data, int32_t size, from {"$binary": {...}}
+ *   bson_type_regex        char* pattern, char* options, from {"$regularExpression": {...}}
+ * Extended JSON v2 wrappers are recognized only as values; {"$numberInt": "..."},
+ * {"$numberDouble": "..."} and {"$oid": "..."} produce int, float and oid.
+ * Objects that do not match a wrapper exactly are parsed as usual.
+ */
 struct json_parser_callbacks
 {
     void    (*xProductPair)(void *, const char *, bson_type_t, ...);
@@ -0,0 +1,113 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BSON_JSONWRITER_H_
+#define _BSON_JSONWRITER_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <bson/document.h>
+
+/**
+ * Default size of chunks handed to the sink
+ */
+#define BSON_JSON_WRITER_CHUNK_SIZE         16384
+
+/**
+ * Receives a full chunk of JSON text, or the rest on flush.
+ * The data is valid only during the call.
+ * @return 0 to continue, non-zero to stop writing
+ */
+typedef int (*bson_json_sink_t)(void* ctx, const char* data, size_t size);
+
+/**
+ * Streaming BSON to JSON writer.
+ *
+ * Documents are written as relaxed Extended JSON v2. json2bson() reads
+ * them back with the same types, except timestamp, code, code with scope,
+ * symbol, min/max key, undefined and DBPointer values: the parser does not
+ * accept their wrappers. Int64 values use the canonical
+ * {"$numberLong": ...} form to keep their type. Text goes into one fixed-size chunk; the sink gets it
+ * whenever the chunk fills, so output of any size needs only the chunk.
+ * Strings without characters to escape are copied as they are.
+ */
+typedef struct bson_json_writer bson_json_writer_t;
+typedef struct bson_json_writer* bson_json_writer_ref;
+struct bson_json_writer
+{
+    char*               chunk;
+    size_t              size;           /* Bytes used in the chunk */
+    size_t              capacity;
+    bson_json_sink_t    sink;
+    void*               ctx;
+    int                 error;          /* The sink stopped writing */
+};
+
+/**
+ * Initializes writer. Zero chunk size means default.
+ * @return 0 on success, 1 if out of memory
+ */
+int bson_json_writer_init(bson_json_writer_ref __restrict w, size_t chunk_size, bson_json_sink_t sink,
+                          void* ctx);
+
+/**
+ * Releases the chunk. Unflushed text is dropped.
+ */
+void bson_json_writer_deinit(bson_json_writer_ref __restrict w);
+
+/**
+ * Appends raw text, e.g. separators of a result set
+ * @return 0 on success, 1 if the sink stopped writing
+ */
+int bson_json_writer_write(bson_json_writer_ref __restrict w, const char* __restrict data, size_t size);
+
+/**
+ * Appends document as JSON object
+ * @return 0 on success, 1 if the sink stopped writing
+ */
+int bson_json_writer_document(bson_json_writer_ref __restrict w, bson_document_ref doc);
+
+/**
+ * Appends documents as JSON array of objects
+ * @return 0 on success, 1 if the sink stopped writing
+ */
+int bson_json_writer_documents(bson_json_writer_ref __restrict w, bson_document_ref* docs, size_t count);
+
+/**
+ * Hands buffered text to the sink
+ * @return 0 on success, 1 if the sink stopped writing
+ */
+int bson_json_writer_flush(bson_json_writer_ref __restrict w);
+
+/*
+ * Escape scanning kernels: position of the first byte below 0x20,
+ * '"' or '\\', or n if there is none.
+ */
+typedef size_t (*bson_json_escape_kernel_t)(const char* s, size_t n);
+
+size_t bson_json_escape_scan_portable(const char* s, size_t n);
+size_t bson_json_escape_scan_sse42(const char* s, size_t n);
+size_t bson_json_escape_scan_avx2(const char* s, size_t n);
+
+#endif // _BSON_JSONWRITER_H_
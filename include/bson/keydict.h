@@ -0,0 +1,168 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BSON_KEYDICT_H_
+#define _BSON_KEYDICT_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <bson/bsontypes.h>
+#include <bson/document.h>
+
+/**
+ * Shared dictionary of field names.
+ *
+ * Compact documents have the same layout as BSON documents, but every
+ * element of an embedded document stores varint ID of its key instead of
+ * the NUL-terminated name, and elements of arrays store no key at all.
+ * Scalar values are unchanged; the int32 size prefixes of the document
+ * and of every embedded document and array are rewritten to the compact
+ * sizes.
+ *
+ * The dictionary is not synchronized: documents may be expanded
+ * concurrently, but compacting may add keys and must be serialized.
+ */
+typedef struct bson_keydict* bson_keydict_ref;
+
+/**
+ * Returned by lookup when the key is not in the dictionary
+ */
+#define BSON_KEYDICT_NOTFOUND               UINT32_MAX
+
+/**
+ * Creates empty dictionary
+ */
+bson_keydict_ref bson_keydict_create();
+
+/**
+ * Destroys dictionary
+ */
+void bson_keydict_destroy(bson_keydict_ref dict);
+
+/**
+ * Get number of keys in the dictionary
+ */
+uint32_t bson_keydict_count(bson_keydict_ref dict);
+
+/**
+ * Get ID of the key or BSON_KEYDICT_NOTFOUND
+ */
+uint32_t bson_keydict_lookup(bson_keydict_ref __restrict dict, const char* __restrict key, size_t nkey);
+
+/**
+ * Get ID of the key. Adds the key to the dictionary if needed.
+ * @return BSON_KEYDICT_NOTFOUND if out of memory
+ */
+uint32_t bson_keydict_intern(bson_keydict_ref __restrict dict, const char* __restrict key, size_t nkey);
+
+/**
+ * Get key by ID or 0 if ID is unknown
+ */
+const char* bson_keydict_key(bson_keydict_ref __restrict dict, uint32_t id, size_t* __restrict nkey);
+
+/**
+ * Saves the dictionary as BSON array of keys, ordered by ID
+ */
+bson_array_ref bson_keydict_save(bson_keydict_ref dict);
+
+/**
+ * Creates dictionary from the array made by bson_keydict_save()
+ */
+bson_keydict_ref bson_keydict_load(bson_array_ref arr);
+
+/**
+ * Compact document
+ */
+typedef struct bson_compact* bson_compact_ref;
+struct bson_compact
+{
+    const char data[5];     /* Raw Data of the compact document */
+};
+
+#define bson_compact_size(c)                (*(int32_t *)(c)->data)
+#define bson_compact_destroy(c)             free(c)
+
+/**
+ * Converts BSON document into compact form, interning its keys
+ * @return 0 if out of memory
+ */
+bson_compact_ref bson_keydict_compact(bson_keydict_ref __restrict dict, bson_document_ref doc);
+
+/**
+ * Converts compact document back to BSON
+ * @return 0 if the document refers unknown key or out of memory
+ */
+bson_document_ref bson_keydict_expand(bson_keydict_ref __restrict dict, bson_compact_ref c);
+
+/**
+ * Iterator over compact document. Keys are resolved only on demand.
+ */
+typedef struct bson_compact_iterator bson_compact_iterator_t;
+typedef struct bson_compact_iterator* bson_compact_iterator_ref;
+struct bson_compact_iterator
+{
+    bson_keydict_ref    dict;
+    const char*         next;           /* Next element */
+    int                 is_array;
+    uint32_t            index;          /* Index of current element */
+    uint32_t            key_id;         /* Key ID of current element */
+    bson_type_t         type;           /* Type of current element */
+    const char*         value;          /* Value of current element */
+    char                index_key[12];  /* Key of current array element */
+};
+
+/**
+ * Initializes iterator. The first call of bson_compact_iterator_next()
+ * moves it to the first element.
+ */
+void bson_compact_iterator_init(bson_compact_iterator_ref __restrict i, bson_keydict_ref dict,
+                                bson_compact_ref c);
+
+/**
+ * Moves iterator to the next element.
+ * @return 0 at the end of document or at malformed key ID
+ */
+int bson_compact_iterator_next(bson_compact_iterator_ref __restrict i);
+
+/**
+ * Get key of current element
+ */
+const char* bson_compact_iterator_key(bson_compact_iterator_ref __restrict i, size_t* __restrict nkey);
+
+/**
+ * Get type of current element
+ */
+#define bson_compact_iterator_type(i)       ((i)->type)
+
+/**
+ * Get raw value of current element
+ */
+#define bson_compact_iterator_value(i)      ((i)->value)
+
+/**
+ * Initializes child iterator over current embedded document or array
+ */
+void bson_compact_iterator_child(bson_compact_iterator_ref __restrict i,
+                                 bson_compact_iterator_ref __restrict child);
+
+#endif // _BSON_KEYDICT_H_
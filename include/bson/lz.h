@@ -0,0 +1,56 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BSON_LZ_H_
+#define _BSON_LZ_H_
+
+#include <stdlib.h>
+
+/**
+ * Fast LZ77 codec in the spirit of LZ4.
+ *
+ * The stream is a sequence of tokens. High nibble of a token is the number
+ * of literals, low nibble is the match length minus 4, both extended by
+ * bytes of 255 when equal to 15. Literals follow the token and are
+ * followed by 2-byte little-endian match offset. The last sequence has
+ * literals only.
+ */
+
+/**
+ * Get maximal size of compressed data
+ */
+#define bson_lz_compress_bound(n)           ((n) + (n) / 255 + 16)
+
+/**
+ * Compresses data
+ * @return size of compressed data or 0 if it doesn't fit into dst
+ */
+size_t bson_lz_compress(const void* __restrict src, size_t nsrc, void* __restrict dst, size_t ndst);
+
+/**
+ * Decompresses data. Size of the original data must be known.
+ * @return 0 on success, 1 if the data is corrupted
+ */
+int bson_lz_decompress(const void* __restrict src, size_t nsrc, void* __restrict dst, size_t ndst);
+
+#endif // _BSON_LZ_H_
@@ -29,14 +29,17 @@
 #include <stdlib.h>
 
 /**
- * ObjectID constant size in bytes
+ * ObjectID sizes in bytes. Enumerators, since C does not allow const
+ * variables as array sizes at file scope.
  */
-static const int bson_oid_size = 12;
-
-/**
- * ObjectID's inc field size in bytes
- */
-static const int bson_oid_inc_size = 3;
+enum
+{
+    /* ObjectID constant size */
+    bson_oid_size = 12,
+    
+    /* ObjectID's inc field size */
+    bson_oid_inc_size = 3
+};
 
 /**
  * Generic ObjectID type
@@ -120,6 +123,44 @@ static inline int bson_oid_compare(const bson_oid_ref __restrict oidl,
     return memcmp(oidl->data, oidr->data, bson_oid_size);
 }
 
+/**
+ * Get creation time of ObjectID in seconds since the Epoch. Reads the
+ * big-endian field in place, so the ObjectID may point into a document.
+ */
+static inline uint32_t bson_oid_time(const bson_oid_ref __restrict oid)
+{
+    uint32_t t;
+    memcpy(&t, oid->time, sizeof(t));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    t = __builtin_bswap32(t);
+#endif
+    return t;
+}
+
+/**
+ * Initialize the least ObjectID created at given time
+ */
+static inline void bson_oid_init_time_min(bson_oid_ref __restrict oid, uint32_t t)
+{
+    memset(oid->data, 0, bson_oid_size);
+    oid->time[0] = (uint8_t)(t >> 24);
+    oid->time[1] = (uint8_t)(t >> 16);
+    oid->time[2] = (uint8_t)(t >> 8);
+    oid->time[3] = (uint8_t)t;
+}
+
+/**
+ * Initialize the greatest ObjectID created at given time
+ */
+static inline void bson_oid_init_time_max(bson_oid_ref __restrict oid, uint32_t t)
+{
+    memset(oid->data, 0xff, bson_oid_size);
+    oid->time[0] = (uint8_t)(t >> 24);
+    oid->time[1] = (uint8_t)(t >> 16);
+    oid->time[2] = (uint8_t)(t >> 8);
+    oid->time[3] = (uint8_t)t;
+}
+
 /**
  * Create string representation of ObjectID
  */
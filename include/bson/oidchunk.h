@@ -0,0 +1,70 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BSON_OIDCHUNK_H_
+#define _BSON_OIDCHUNK_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <bson/oid.h>
+
+/**
+ * Range of a sorted ObjectID stream.
+ *
+ * ObjectIDs start with their big-endian creation time, so a stream sorted
+ * by ObjectID is sorted by time too, and chunks of it can be pruned by
+ * time without looking at their documents.
+ */
+typedef struct bson_oid_chunk bson_oid_chunk_t;
+typedef struct bson_oid_chunk* bson_oid_chunk_ref;
+struct bson_oid_chunk
+{
+    size_t      begin;          /* Index of the first ObjectID */
+    size_t      end;            /* Index past the last ObjectID */
+    uint64_t    weight;         /* Sum of sizes, or number of ObjectIDs */
+    bson_oid_t  min;            /* First ObjectID */
+    bson_oid_t  max;            /* Last ObjectID */
+};
+
+/**
+ * Splits sorted ObjectIDs into the least number of balanced chunks, such
+ * that every chunk weighs about max_weight or less. A chunk may exceed it
+ * by less than one item.
+ * ObjectIDs are referred by pointers, so they may point into documents.
+ * @param sizes sizes of the documents to balance by bytes, or 0 to balance by count
+ * @param chunks receives the array of chunks, which must be freed by the caller
+ * @return number of chunks or 0 if n is 0, max_weight is 0 or out of memory
+ */
+size_t bson_oid_split(const bson_oid_ref* __restrict oids, const uint32_t* __restrict sizes, size_t n,
+                      uint64_t max_weight, bson_oid_chunk_t** __restrict chunks);
+
+/**
+ * Finds the chunks which may contain ObjectIDs created in [from, to]
+ * seconds since the Epoch. Other chunks can be skipped.
+ * @param first receives index of the first such chunk
+ * @return number of such chunks, which follow one another
+ */
+size_t bson_oid_chunk_find_time(const bson_oid_chunk_t* __restrict chunks, size_t nchunks,
+                                uint32_t from, uint32_t to, size_t* __restrict first);
+
+#endif // _BSON_OIDCHUNK_H_
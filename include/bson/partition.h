@@ -0,0 +1,72 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BSON_PARTITION_H_
+#define _BSON_PARTITION_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <bson/batch.h>
+#include <bson/scan.h>
+
+/**
+ * Maximal number of partitions
+ */
+#define BSON_PARTITION_MAX                  4096
+
+/**
+ * Budget of write-combining buffers of one worker, split among partitions.
+ * Sized to stay in L2 cache.
+ */
+#define BSON_PARTITION_BUFFER_SIZE          (128 * 1024)
+
+/**
+ * Get partition of the key hash. Nodes routing single documents must
+ * use the same mapping as bson_partition().
+ */
+static inline unsigned bson_partition_of(uint64_t hash, unsigned npartitions)
+{
+    return (unsigned)(((unsigned __int128)hash * npartitions) >> 64);
+}
+
+/**
+ * Hash-partitioned shuffle of the batch.
+ *
+ * Every document goes to the partition of semantic hash (see hash.h) of
+ * the value of its shard key path with BSON_HASH_SEED; documents missing
+ * the key go where null does. Each output batch is reset and gets its
+ * documents in input order, stored one after another, ready for
+ * bson_wire_frame_add_data().
+ *
+ * Workers of the pool take contiguous ranges of the input. The first pass
+ * hashes keys and counts documents and bytes per partition, the second
+ * one copies every document straight to its final place through per
+ * partition write-combining buffers.
+ *
+ * @param out array of npartitions initialized batches
+ * @return 0 on success, 1 if out of memory or npartitions is out of range
+ */
+int bson_partition(bson_scan_pool_ref __restrict pool, bson_batch_ref __restrict in, const char* __restrict path,
+                   unsigned npartitions, bson_batch_t* __restrict out);
+
+#endif // _BSON_PARTITION_H_
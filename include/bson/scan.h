@@ -0,0 +1,123 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BSON_SCAN_H_
+#define _BSON_SCAN_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <bson/document.h>
+
+/**
+ * Default number of documents in a morsel
+ */
+#define BSON_SCAN_MORSEL_SIZE               4096
+
+/**
+ * Filter callback. Returns non-zero to select the document.
+ * It is called concurrently from all workers of the pool. The index of the
+ * document lets projections write their output without synchronization.
+ */
+typedef int (*bson_scan_filter_t)(void *ctx, size_t index, bson_document_ref doc);
+
+/**
+ * Per-thread throughput statistics
+ */
+struct bson_scan_stats
+{
+    size_t      morsels;        /* Number of morsels processed */
+    size_t      documents;      /* Number of documents passed to the filter */
+    size_t      bytes;          /* Total size of these documents */
+    size_t      selected;       /* Number of selected documents */
+    uint64_t    nanoseconds;    /* Time spent by the worker */
+};
+
+/**
+ * Selection vector. Indexes of the selected documents in ascending order.
+ */
+typedef struct bson_selection bson_selection_t;
+struct bson_selection
+{
+    size_t*     indexes;
+    size_t      count;
+};
+
+/**
+ * Frees the memory of selection vector
+ */
+static inline void bson_selection_deinit(bson_selection_t* __restrict sel)
+{
+    free(sel->indexes);
+    sel->indexes = 0;
+    sel->count = 0;
+}
+
+/**
+ * Pool of worker threads. The thread calling bson_scan_pool_run() is
+ * the worker number 0, so the pool of size 1 starts no threads at all.
+ */
+typedef struct bson_scan_pool* bson_scan_pool_ref;
+
+/**
+ * Creates pool with given number of workers. Zero means number of online CPUs.
+ */
+bson_scan_pool_ref bson_scan_pool_create(unsigned nthreads);
+
+/**
+ * Stops workers and destroys the pool
+ */
+void bson_scan_pool_destroy(bson_scan_pool_ref pool);
+
+/**
+ * Get number of workers in the pool
+ */
+unsigned bson_scan_pool_size(bson_scan_pool_ref pool);
+
+/**
+ * Runs the job on every worker of the pool and waits for all of them.
+ * Must not be called concurrently for the same pool.
+ */
+void bson_scan_pool_run(bson_scan_pool_ref pool, void (*job)(void *, unsigned), void* arg);
+
+/**
+ * Evaluates the filter on every document. Documents are split into morsels
+ * of given size (0 for default) which are distributed among the workers.
+ * Selection vectors of morsels are merged into sel.
+ * @param stats array of bson_scan_pool_size() elements or 0
+ * @return 0 on success
+ */
+int bson_scan(bson_scan_pool_ref pool,
+              const bson_document_ref* docs, size_t ndocs, size_t morsel,
+              bson_scan_filter_t filter, void* ctx,
+              bson_selection_t* sel, struct bson_scan_stats* stats);
+
+/**
+ * Builds an array of documents stored one after another in the buffer,
+ * e.g. in mmapped BSON file. Documents point into the buffer.
+ * The array must be freed by the caller.
+ * @return 0 on success, 1 if the buffer is malformed
+ */
+int bson_scan_index_buffer(const char* data, size_t size,
+                           bson_document_ref** docs, size_t* ndocs);
+
+#endif // _BSON_SCAN_H_
@@ -0,0 +1,237 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BSON_SCHEMA_H_
+#define _BSON_SCHEMA_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <bson/bsontypes.h>
+#include <bson/document.h>
+#include <bson/oid.h>
+
+/**
+ * Compile-time schemas.
+ *
+ * A schema is a list of fields given as X-macro:
+ *
+ *     #define POINT_FIELDS(X)  X(oid, _id) X(i, x) X(i, y) X(str, label)
+ *     BSON_SCHEMA_DECLARE(point, POINT_FIELDS)      (in a header)
+ *     BSON_SCHEMA_DEFINE(point, POINT_FIELDS)       (in one source file)
+ *
+ * This declares struct point with the fields and the functions
+ *
+ *     size_t            point_size(const struct point* s);
+ *     char*             point_write(const struct point* s, char* data);
+ *     bson_document_ref point_encode(const struct point* s);
+ *     int               point_decode(struct point* s, bson_document_ref doc);
+ *
+ * Element headers (type byte, key and its terminator) are string literals,
+ * so encoding is a sequence of fixed-size copies into exactly sized buffer.
+ * Decoding expects fields in the declared order and falls back to scanning
+ * the document by name when a field is found out of place.
+ *
+ * Field types are i (int32_t), l (int64_t), d (double), b (char),
+ * date (int64_t), oid (bson_oid_t) and str (bson_schema_str_t).
+ */
+
+/**
+ * String field. Decoded strings point into the document.
+ */
+typedef struct bson_schema_str bson_schema_str_t;
+struct bson_schema_str
+{
+    const char* data;       /* NUL-terminated */
+    size_t size;            /* Length without terminator */
+};
+
+/*
+ * Per-type definitions: C type, BSON type byte as string literal,
+ * value size, writer and reader
+ */
+#define BSON_SCHEMA_CTYPE_i                 int32_t
+#define BSON_SCHEMA_CTYPE_l                 int64_t
+#define BSON_SCHEMA_CTYPE_d                 double
+#define BSON_SCHEMA_CTYPE_b                 char
+#define BSON_SCHEMA_CTYPE_date              int64_t
+#define BSON_SCHEMA_CTYPE_oid               bson_oid_t
+#define BSON_SCHEMA_CTYPE_str               bson_schema_str_t
+
+#define BSON_SCHEMA_TAG_i                   "\x10"
+#define BSON_SCHEMA_TAG_l                   "\x12"
+#define BSON_SCHEMA_TAG_d                   "\x01"
+#define BSON_SCHEMA_TAG_b                   "\x08"
+#define BSON_SCHEMA_TAG_date                "\x09"
+#define BSON_SCHEMA_TAG_oid                 "\x07"
+#define BSON_SCHEMA_TAG_str                 "\x02"
+
+#define BSON_SCHEMA_FIXED_FIELD(t, size)                                            \
+static inline size_t bson_schema_size_##t(const BSON_SCHEMA_CTYPE_##t* v)           \
+{                                                                                   \
+    return size;                                                                    \
+}                                                                                   \
+static inline char* bson_schema_put_##t(char* __restrict p,                         \
+                                        const BSON_SCHEMA_CTYPE_##t* __restrict v)  \
+{                                                                                   \
+    memcpy(p, v, size);                                                             \
+    return p + size;                                                                \
+}                                                                                   \
+static inline const char* bson_schema_get_##t(const char* __restrict p,             \
+                                              BSON_SCHEMA_CTYPE_##t* __restrict v)  \
+{                                                                                   \
+    memcpy(v, p, size);                                                             \
+    return p + size;                                                                \
+}
+
+BSON_SCHEMA_FIXED_FIELD(i, 4)
+BSON_SCHEMA_FIXED_FIELD(l, 8)
+BSON_SCHEMA_FIXED_FIELD(d, 8)
+BSON_SCHEMA_FIXED_FIELD(b, 1)
+BSON_SCHEMA_FIXED_FIELD(date, 8)
+BSON_SCHEMA_FIXED_FIELD(oid, 12)
+
+static inline size_t bson_schema_size_str(const bson_schema_str_t* v)
+{
+    return sizeof(int32_t) + v->size + 1;
+}
+
+static inline char* bson_schema_put_str(char* __restrict p, const bson_schema_str_t* __restrict v)
+{
+    int32_t size = (int32_t)v->size + 1;
+    memcpy(p, &size, sizeof(size));
+    memcpy(p + sizeof(size), v->data, v->size);
+    p[sizeof(size) + v->size] = '\0';
+    return p + sizeof(size) + size;
+}
+
+static inline const char* bson_schema_get_str(const char* __restrict p, bson_schema_str_t* __restrict v)
+{
+    int32_t size;
+    memcpy(&size, p, sizeof(size));
+    v->data = p + sizeof(size);
+    v->size = size - 1;
+    return p + sizeof(size) + size;
+}
+
+/**
+ * Find element by its header (type byte, key and terminator)
+ * @return element or 0 if the document has no such element
+ */
+const char* bson_schema_find(const char* __restrict data, const char* __restrict header, size_t nheader);
+
+/**
+ * Get element with given header, trying the element at p first
+ */
+static inline const char* bson_schema_match(const char* __restrict data, const char* __restrict p,
+                                            const char* __restrict header, size_t nheader)
+{
+    const char* end = data + *(const int32_t *)data - 1;
+    if(p + nheader <= end && memcmp(p, header, nheader) == 0)
+    {
+        return p;
+    }
+    return bson_schema_find(data, header, nheader);
+}
+
+/*
+ * Expansions of field list
+ */
+#define BSON_SCHEMA_HEADER(t, f)            BSON_SCHEMA_TAG_##t #f
+
+#define BSON_SCHEMA_X_MEMBER(t, f)          BSON_SCHEMA_CTYPE_##t f;
+
+#define BSON_SCHEMA_X_SIZE(t, f)                                                    \
+    n += sizeof(BSON_SCHEMA_HEADER(t, f)) + bson_schema_size_##t(&s->f);
+
+#define BSON_SCHEMA_X_PUT(t, f)                                                     \
+    memcpy(p, BSON_SCHEMA_HEADER(t, f), sizeof(BSON_SCHEMA_HEADER(t, f)));          \
+    p = bson_schema_put_##t(p + sizeof(BSON_SCHEMA_HEADER(t, f)), &s->f);
+
+#define BSON_SCHEMA_X_GET(t, f)                                                     \
+    el = bson_schema_match(data, p, BSON_SCHEMA_HEADER(t, f),                       \
+                           sizeof(BSON_SCHEMA_HEADER(t, f)));                       \
+    if(!el)                                                                         \
+    {                                                                               \
+        return 1;                                                                   \
+    }                                                                               \
+    p = bson_schema_get_##t(el + sizeof(BSON_SCHEMA_HEADER(t, f)), &s->f);
+
+/**
+ * Declares struct and functions of the schema
+ */
+#define BSON_SCHEMA_DECLARE(name, FIELDS)                                           \
+struct name                                                                         \
+{                                                                                   \
+    FIELDS(BSON_SCHEMA_X_MEMBER)                                                    \
+};                                                                                  \
+size_t name##_size(const struct name* __restrict s);                                \
+char* name##_write(const struct name* __restrict s, char* __restrict data);         \
+bson_document_ref name##_encode(const struct name* __restrict s);                   \
+int name##_decode(struct name* __restrict s, bson_document_ref doc);
+
+/**
+ * Defines functions of the schema
+ */
+#define BSON_SCHEMA_DEFINE(name, FIELDS)                                            \
+/* Get size of encoded document */                                                  \
+size_t name##_size(const struct name* __restrict s)                                 \
+{                                                                                   \
+    size_t n = sizeof(int32_t) + 1;                                                 \
+    FIELDS(BSON_SCHEMA_X_SIZE)                                                      \
+    return n;                                                                       \
+}                                                                                   \
+/* Encode into buffer of name##_size() bytes. Returns end of the document. */       \
+char* name##_write(const struct name* __restrict s, char* __restrict data)          \
+{                                                                                   \
+    char* p = data + sizeof(int32_t);                                               \
+    int32_t size;                                                                   \
+    FIELDS(BSON_SCHEMA_X_PUT)                                                       \
+    *p++ = '\0';                                                                    \
+    size = (int32_t)(p - data);                                                     \
+    memcpy(data, &size, sizeof(size));                                              \
+    return p;                                                                       \
+}                                                                                   \
+/* Encode into new document. Returns 0 if out of memory. */                         \
+bson_document_ref name##_encode(const struct name* __restrict s)                    \
+{                                                                                   \
+    char* data = (char *)malloc(name##_size(s));                                    \
+    if(!data)                                                                       \
+    {                                                                               \
+        return 0;                                                                   \
+    }                                                                               \
+    name##_write(s, data);                                                          \
+    return (bson_document_ref)data;                                                 \
+}                                                                                   \
+/* Decode the document. Returns 1 if some field is missing or mistyped. */          \
+int name##_decode(struct name* __restrict s, bson_document_ref doc)                 \
+{                                                                                   \
+    const char* data = doc->data;                                                   \
+    const char* p = data + sizeof(int32_t);                                         \
+    const char* el;                                                                 \
+    FIELDS(BSON_SCHEMA_X_GET)                                                       \
+    (void)p;                                                                        \
+    return 0;                                                                       \
+}
+
+#endif // _BSON_SCHEMA_H_
@@ -0,0 +1,95 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BSON_SCHEMAPROFILER_H_
+#define _BSON_SCHEMAPROFILER_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <bson/document.h>
+
+/**
+ * Default limit of distinct paths tracked by the profiler
+ */
+#define BSON_SCHEMA_PROFILER_MAX_PATHS      1024
+
+/**
+ * Maximal length of a dotted path. Deeper fields are counted as dropped.
+ */
+#define BSON_SCHEMA_PROFILER_MAX_PATH_LEN   256
+
+/**
+ * Precision of cardinality sketches: 2^10 registers, ~3% standard error
+ */
+#define BSON_SCHEMA_PROFILER_HLL_BITS       10
+
+/**
+ * Single pass schema profiler.
+ *
+ * Collects per-path type histograms, value sizes, cardinality estimates
+ * and array lengths. Elements of arrays are collapsed into the "$" path
+ * component, e.g. "tags.$" or "items.$.price". Memory is bounded by the
+ * maximal number of paths given at creation.
+ *
+ * The profiler is not thread-safe: use one per thread and merge them.
+ */
+typedef struct bson_schema_profiler* bson_schema_profiler_ref;
+
+/**
+ * Creates profiler. Zero max_paths means default limit.
+ */
+bson_schema_profiler_ref bson_schema_profiler_create(size_t max_paths);
+
+/**
+ * Destroys profiler
+ */
+void bson_schema_profiler_destroy(bson_schema_profiler_ref p);
+
+/**
+ * Accounts the document
+ */
+void bson_schema_profiler_add(bson_schema_profiler_ref __restrict p, bson_document_ref doc);
+
+/**
+ * Merges statistics of src into dst
+ * @return 0 on success
+ */
+int bson_schema_profiler_merge(bson_schema_profiler_ref __restrict dst,
+                               bson_schema_profiler_ref __restrict src);
+
+/**
+ * Get number of profiled documents
+ */
+uint64_t bson_schema_profiler_count(bson_schema_profiler_ref p);
+
+/**
+ * Builds the report:
+ * { documents: long, dropped: long,
+ *   paths: [ { path: string, count: long, types: { <type name>: long, ... },
+ *              minSize: int, maxSize: int, avgSize: double, cardinality: long,
+ *              array: { count: long, minLength: int, maxLength: int, avgLength: double } } ] }
+ * The "array" subdocument is present only for paths with arrays.
+ */
+bson_document_ref bson_schema_profiler_report(bson_schema_profiler_ref p);
+
+#endif // _BSON_SCHEMAPROFILER_H_
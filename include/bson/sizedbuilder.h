@@ -0,0 +1,328 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BSON_SIZEDBUILDER_H_
+#define _BSON_SIZEDBUILDER_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <bson/bsontypes.h>
+#include <bson/decimal128.h>
+#include <bson/document.h>
+#include <bson/oid.h>
+#include <bson/stats.h>
+
+/**
+ * Two-pass document builder.
+ *
+ * The emit callback is called twice with the same builder API: the first
+ * pass only computes the exact encoded size, then the buffer is allocated
+ * once and the second pass writes into it without growing it. Stores
+ * which would end past the buffer are refused and fail the build.
+ * The callback must emit the same elements on both passes.
+ */
+
+/**
+ * Maximal nesting of documents
+ */
+#define BSON_SIZED_BUILDER_MAX_DEPTH        100
+
+typedef struct bson_sized_builder* bson_sized_builder_ref;
+struct bson_sized_builder
+{
+    char*       data;           /* 0 on the sizing pass */
+    size_t      end;            /* Size of data */
+    size_t      offset;
+    size_t      depth;
+    int         error;          /* Too deep nesting or output past end */
+    size_t      start[BSON_SIZED_BUILDER_MAX_DEPTH];    /* Offsets of open documents */
+    uint32_t    index[BSON_SIZED_BUILDER_MAX_DEPTH];    /* Next index of open arrays */
+};
+
+typedef void (*bson_sized_builder_emit_t)(bson_sized_builder_ref b, void* ctx);
+
+/**
+ * Builds the document. Returns 0 if out of memory, on too deep nesting
+ * or if passes emitted different sizes.
+ */
+bson_document_ref bson_sized_builder_build(bson_sized_builder_emit_t emit, void* ctx);
+
+/**
+ * Computes size of the document without building it
+ */
+size_t bson_sized_builder_measure(bson_sized_builder_emit_t emit, void* ctx);
+
+/**
+ * Builds the document of known size into the caller's buffer. Nothing
+ * is written past size bytes.
+ * @return 0 on success, 1 if the emitter produced different size
+ */
+int bson_sized_builder_write(bson_sized_builder_emit_t emit, void* ctx, char* data, size_t size);
+
+/**
+ * Returns non-zero on the sizing pass. Emitters which know the size of
+ * their output may report it with bson_sized_builder_skip() instead of
+ * emitting the elements.
+ */
+#define bson_sized_builder_sizing(b)        ((b)->data == 0)
+
+/**
+ * Accounts given number of bytes on the sizing pass
+ */
+static inline void bson_sized_builder_skip(bson_sized_builder_ref __restrict b, size_t size)
+{
+    b->offset += size;
+}
+
+static inline void bson_sized_builder_put(bson_sized_builder_ref __restrict b, const void* __restrict p, size_t n)
+{
+    if(b->data)
+    {
+        if(b->offset + n > b->end)
+        {
+            b->error = 1;
+            return;
+        }
+        memcpy(b->data + b->offset, p, n);
+    }
+    b->offset += n;
+}
+
+/*
+ * Formats the next index of the array being built. Returns the key.
+ */
+static inline const char* bson_sized_builder_index_key(bson_sized_builder_ref __restrict b,
+                                                       char buffer[12], size_t* __restrict nk)
+{
+    uint32_t i = b->index[b->depth - 1]++;
+    char* p = buffer + 11;
+    *p = '\0';
+    do
+    {
+        *--p = (char)('0' + i % 10);
+        i /= 10;
+    } while(i);
+    *nk = buffer + 11 - p;
+    return p;
+}
+
+/*
+ * Writes the element: type, key and value. Zero key means the next index
+ * of the array being built. Prefix is written before the value.
+ */
+static inline void bson_sized_builder_put_element(bson_sized_builder_ref __restrict b, bson_type_t type,
+                                                  const char* __restrict k,
+                                                  const void* __restrict prefix, size_t nprefix,
+                                                  const void* __restrict value, size_t nvalue)
+{
+    char buffer[12];
+    size_t nk;
+    if(k)
+    {
+        nk = strlen(k);
+    }
+    else
+    {
+        k = bson_sized_builder_index_key(b, buffer, &nk);
+    }
+
+    const size_t offset = b->offset;
+    b->offset = offset + 2 + nk + nprefix + nvalue;
+    if(b->data)
+    {
+        if(b->offset > b->end)
+        {
+            b->error = 1;
+            return;
+        }
+
+        char* __restrict p = b->data + offset;
+        BSON_STATS_ELEMENT(type);
+        *p++ = type;
+        memcpy(p, k, nk + 1);
+        p += nk + 1;
+        memcpy(p, prefix, nprefix);
+        memcpy(p + nprefix, value, nvalue);
+    }
+}
+
+static inline void bson_sized_builder_put_key(bson_sized_builder_ref __restrict b, bson_type_t type,
+                                              const char* __restrict k)
+{
+    bson_sized_builder_put_element(b, type, k, "", 0, "", 0);
+}
+
+/*
+ * Nested documents and arrays
+ */
+static inline void bson_sized_builder_open(bson_sized_builder_ref __restrict b, bson_type_t type,
+                                           const char* __restrict k)
+{
+    if(b->depth == BSON_SIZED_BUILDER_MAX_DEPTH)
+    {
+        b->error = 1;
+        return;
+    }
+
+    if(b->depth)
+    {
+        bson_sized_builder_put_key(b, type, k);
+    }
+    b->start[b->depth] = b->offset;
+    b->index[b->depth] = 0;
+    b->depth++;
+    b->offset += sizeof(int32_t);
+}
+
+#define bson_sized_builder_open_doc(b, k)   bson_sized_builder_open((b), bson_type_document, (k))
+#define bson_sized_builder_open_arr(b, k)   bson_sized_builder_open((b), bson_type_array, (k))
+
+static inline void bson_sized_builder_close(bson_sized_builder_ref __restrict b)
+{
+    if(b->error || b->depth == 0)
+    {
+        b->error = 1;
+        return;
+    }
+
+    b->depth--;
+    if(b->data)
+    {
+        if(b->offset + 1 > b->end)
+        {
+            b->error = 1;
+            return;
+        }
+        b->data[b->offset] = bson_type_eoo;
+        const int32_t size = (int32_t)(b->offset + 1 - b->start[b->depth]);
+        memcpy(b->data + b->start[b->depth], &size, sizeof(size));
+    }
+    b->offset++;
+}
+
+/*
+ * Append routines. Zero key appends the next element of array.
+ */
+static inline void bson_sized_builder_append_doc(bson_sized_builder_ref __restrict b,
+                                                 const char* __restrict k,
+                                                 const bson_document_ref __restrict doc)
+{
+    bson_sized_builder_put_element(b, bson_type_document, k, "", 0, doc->data, bson_document_size(doc));
+}
+
+static inline void bson_sized_builder_append_arr(bson_sized_builder_ref __restrict b,
+                                                 const char* __restrict k,
+                                                 const bson_array_ref __restrict arr)
+{
+    bson_sized_builder_put_element(b, bson_type_array, k, "", 0, arr->data, bson_document_size(arr));
+}
+
+static inline void bson_sized_builder_append_b(bson_sized_builder_ref __restrict b,
+                                               const char* __restrict k, char v)
+{
+    bson_sized_builder_put_element(b, bson_type_bool, k, "", 0, &v, sizeof(v));
+}
+
+static inline void bson_sized_builder_append_i(bson_sized_builder_ref __restrict b,
+                                               const char* __restrict k, int32_t v)
+{
+    bson_sized_builder_put_element(b, bson_type_int, k, "", 0, &v, sizeof(v));
+}
+
+static inline void bson_sized_builder_append_l(bson_sized_builder_ref __restrict b,
+                                               const char* __restrict k, int64_t v)
+{
+    bson_sized_builder_put_element(b, bson_type_long, k, "", 0, &v, sizeof(v));
+}
+
+static inline void bson_sized_builder_append_d(bson_sized_builder_ref __restrict b,
+                                               const char* __restrict k, double v)
+{
+    bson_sized_builder_put_element(b, bson_type_float, k, "", 0, &v, sizeof(v));
+}
+
+static inline void bson_sized_builder_append_date(bson_sized_builder_ref __restrict b,
+                                                  const char* __restrict k, int64_t dt)
+{
+    bson_sized_builder_put_element(b, bson_type_date, k, "", 0, &dt, sizeof(dt));
+}
+
+static inline void bson_sized_builder_append_dec128(bson_sized_builder_ref __restrict b,
+                                                    const char* __restrict k,
+                                                    const bson_decimal128_t* __restrict dec)
+{
+    bson_sized_builder_put_element(b, bson_type_decimal128, k, "", 0, dec, sizeof(*dec));
+}
+
+static inline void bson_sized_builder_append_oid(bson_sized_builder_ref __restrict b,
+                                                 const char* __restrict k,
+                                                 const bson_oid_ref __restrict oid)
+{
+    bson_sized_builder_put_element(b, bson_type_oid, k, "", 0, oid->data, sizeof(oid->data));
+}
+
+static inline void bson_sized_builder_append_null(bson_sized_builder_ref __restrict b,
+                                                  const char* __restrict k)
+{
+    bson_sized_builder_put_key(b, bson_type_null, k);
+}
+
+static inline void bson_sized_builder_append_str_n(bson_sized_builder_ref __restrict b,
+                                                   const char* __restrict k,
+                                                   const char* __restrict str, size_t len)
+{
+    const int32_t size = (int32_t)len + 1;
+    bson_sized_builder_put_element(b, bson_type_string, k, &size, sizeof(size), str, len + 1);
+}
+
+static inline void bson_sized_builder_append_str(bson_sized_builder_ref __restrict b,
+                                                 const char* __restrict k,
+                                                 const char* __restrict str)
+{
+    bson_sized_builder_append_str_n(b, k, str, strlen(str));
+}
+
+static inline void bson_sized_builder_append_regex(bson_sized_builder_ref __restrict b,
+                                                   const char* __restrict k,
+                                                   const char* __restrict regex,
+                                                   const char* __restrict flags)
+{
+    if(!flags)
+    {
+        flags = "";
+    }
+    bson_sized_builder_put_element(b, bson_type_regex, k, regex, strlen(regex) + 1, flags, strlen(flags) + 1);
+}
+
+static inline void bson_sized_builder_append_bin(bson_sized_builder_ref __restrict b,
+                                                 const char* __restrict k,
+                                                 bson_subtype_t t, const void* __restrict d,
+                                                 int32_t sz)
+{
+    char prefix[sizeof(sz) + sizeof(t)];
+    memcpy(prefix, &sz, sizeof(sz));
+    prefix[sizeof(sz)] = t;
+    bson_sized_builder_put_element(b, bson_type_bindata, k, prefix, sizeof(prefix), d, sz);
+}
+
+#endif // _BSON_SIZEDBUILDER_H_
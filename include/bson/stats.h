@@ -0,0 +1,157 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BSON_STATS_H_
+#define _BSON_STATS_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * Instrumentation of the hot paths.
+ *
+ * Counters are compiled in only when BSON_ENABLE_STATS is defined, both
+ * for the library and its users; otherwise the macros below expand to
+ * nothing and the snapshot is always empty.
+ *
+ * Every thread updates its own counters without synchronization.
+ * A snapshot sums the counters of all threads, including finished ones.
+ * Counters of running threads are read without locking, so a snapshot
+ * taken under load is approximate.
+ */
+enum bson_stats_counters
+{
+    BSON_STATS_ALLOCATIONS = 0,         /* Heap allocations by builders and parser */
+    BSON_STATS_DOCUMENTS,               /* Documents finalized by builders */
+    BSON_STATS_DOCUMENT_BYTES,          /* Bytes of finalized documents */
+    BSON_STATS_REGION_GROWTHS,          /* Builder region relocations */
+    BSON_STATS_JSON_DOCUMENTS,          /* Calls of json2bson() */
+    BSON_STATS_JSON_BYTES,              /* Bytes of JSON given to json2bson() */
+    BSON_STATS_JSON_COPIES,             /* Keys and strings copied by the parser */
+    BSON_STATS_JSON_COPY_BYTES,         /* Bytes copied by the parser */
+    BSON_STATS_COUNTERS
+};
+
+enum bson_stats_errors
+{
+    BSON_STATS_ERROR_CHAR = 0,          /* Unexpected character */
+    BSON_STATS_ERROR_STRING,            /* Bad or unterminated string */
+    BSON_STATS_ERROR_NUMBER,            /* Bad number */
+    BSON_STATS_ERROR_LITERAL,           /* Bad null, true or false */
+    BSON_STATS_ERROR_OID,               /* Bad ObjectId(...) */
+    BSON_STATS_ERROR_STRUCTURE,         /* Unbalanced document */
+    BSON_STATS_ERRORS
+};
+
+/**
+ * Histograms have power of two buckets: bucket i counts values
+ * in [2^(i-1), 2^i), bucket 0 counts zeros.
+ */
+#define BSON_STATS_HISTOGRAM_BUCKETS        48
+
+struct bson_stats
+{
+    uint64_t    counters[BSON_STATS_COUNTERS];
+    uint64_t    errors[BSON_STATS_ERRORS];          /* Parse errors by kind */
+    uint64_t    elements[256];                      /* Elements appended by type */
+    uint64_t    document_sizes[BSON_STATS_HISTOGRAM_BUCKETS];   /* Bytes */
+    uint64_t    parse_times[BSON_STATS_HISTOGRAM_BUCKETS];      /* Nanoseconds per json2bson() */
+    unsigned    threads;                            /* Threads with counters, in snapshot only */
+};
+
+/**
+ * Sums counters of all threads
+ */
+void bson_stats_snapshot(struct bson_stats* __restrict s);
+
+/**
+ * Clears counters of all threads
+ */
+void bson_stats_reset();
+
+/**
+ * Get name of the counter
+ */
+const char* bson_stats_counter_name(int counter);
+
+/**
+ * Get name of the error kind
+ */
+const char* bson_stats_error_name(int error);
+
+#ifdef BSON_ENABLE_STATS
+
+extern __thread struct bson_stats* bson_stats_tls;
+
+/**
+ * Allocates counters of the calling thread
+ */
+struct bson_stats* bson_stats_register();
+
+/**
+ * Get monotonic time in nanoseconds
+ */
+uint64_t bson_stats_now();
+
+inline struct bson_stats* bson_stats_local()
+{
+    struct bson_stats* s = bson_stats_tls;
+    if(__builtin_expect(s == 0, 0))
+    {
+        s = bson_stats_register();
+    }
+    return s;
+}
+
+inline void bson_stats_histogram_add(uint64_t* __restrict h, uint64_t value)
+{
+    unsigned i = value ? 64 - __builtin_clzll(value) : 0;
+    ++h[i < BSON_STATS_HISTOGRAM_BUCKETS ? i : BSON_STATS_HISTOGRAM_BUCKETS - 1];
+}
+
+#define BSON_STATS_ADD(counter, n)          (bson_stats_local()->counters[counter] += (n))
+#define BSON_STATS_INC(counter)             BSON_STATS_ADD(counter, 1)
+#define BSON_STATS_ERROR(error)             (++bson_stats_local()->errors[error])
+#define BSON_STATS_ELEMENT(type)            (++bson_stats_local()->elements[(unsigned char)(type)])
+#define BSON_STATS_DOCUMENT(size)           (BSON_STATS_INC(BSON_STATS_DOCUMENTS),                      \
+                                             BSON_STATS_ADD(BSON_STATS_DOCUMENT_BYTES, size),           \
+                                             bson_stats_histogram_add(bson_stats_local()->document_sizes, size))
+#define BSON_STATS_TIMER(var)               const uint64_t var = bson_stats_now()
+#define BSON_STATS_PARSE_TIME(var)          bson_stats_histogram_add(bson_stats_local()->parse_times,  \
+                                                                     bson_stats_now() - (var))
+#define BSON_STATS_ONLY(x)                  x
+
+#else
+
+#define BSON_STATS_ADD(counter, n)          ((void)0)
+#define BSON_STATS_INC(counter)             ((void)0)
+#define BSON_STATS_ERROR(error)             ((void)0)
+#define BSON_STATS_ELEMENT(type)            ((void)0)
+#define BSON_STATS_DOCUMENT(size)           ((void)0)
+#define BSON_STATS_TIMER(var)
+#define BSON_STATS_PARSE_TIME(var)          ((void)0)
+#define BSON_STATS_ONLY(x)
+
+#endif // BSON_ENABLE_STATS
+
+#endif // _BSON_STATS_H_
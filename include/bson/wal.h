@@ -0,0 +1,122 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BSON_WAL_H_
+#define _BSON_WAL_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <bson/document.h>
+
+/**
+ * Write-ahead log of BSON documents with group commit.
+ *
+ * The file starts with 8 byte magic followed by records: the header below
+ * and the document. Records are numbered from 1 in log order by their
+ * LSN. CRC-32C of a record covers the document, then the LSN.
+ *
+ * Any thread may append. Records are copied into a lock-free MPSC queue,
+ * and a committer thread takes everything queued, up to the batch limit,
+ * and makes it durable with one writev() and one fdatasync().
+ */
+struct bson_wal_record
+{
+    uint32_t    size;           /* Size of the document */
+    uint32_t    crc;
+    uint64_t    lsn;
+};
+
+/**
+ * Maximal number of records in a batch, one iovec each
+ */
+#define BSON_WAL_MAX_BATCH                  1024
+
+/**
+ * Callback of the recovery. Returns nonzero to stop.
+ */
+typedef int (*bson_wal_replay_t)(void* ctx, uint64_t lsn, bson_document_ref doc);
+
+/**
+ * Validates records of the log from the start and replays them in order.
+ * Scanning stops at the first torn or corrupted record: records after
+ * it were never acknowledged as durable.
+ * @param replay callback or 0 to validate only
+ * @param nrecords receives number of valid records
+ * @param size receives size of the valid part of the file
+ * @return 0 on success, 1 if the file is not a log, reading failed or
+ *         the callback stopped the scan
+ */
+int bson_wal_recover(int fd, bson_wal_replay_t replay, void* ctx, uint64_t* __restrict nrecords,
+                     uint64_t* __restrict size);
+
+/**
+ * Log writer
+ */
+typedef struct bson_wal* bson_wal_ref;
+
+/**
+ * Recovers the log, cuts off its torn tail and starts the committer.
+ * An empty file becomes an empty log. The descriptor is not closed.
+ * @param max_batch limit of records per commit, 0 for BSON_WAL_MAX_BATCH
+ * @return 0 on error
+ */
+bson_wal_ref bson_wal_open(int fd, size_t max_batch, bson_wal_replay_t replay, void* ctx);
+
+/**
+ * Commits everything appended and stops the committer
+ * @return 0 if every commit succeeded
+ */
+int bson_wal_close(bson_wal_ref w);
+
+/**
+ * Appends copy of the document without waiting for it to be durable
+ * @return 0 on success, 1 if out of memory or the log failed
+ */
+int bson_wal_append(bson_wal_ref __restrict w, bson_document_ref doc);
+
+/**
+ * Appends copy of the document and waits until it is durable
+ * @param lsn receives LSN of the record, may be 0
+ * @return 0 on success, 1 if out of memory or writing failed
+ */
+int bson_wal_commit(bson_wal_ref __restrict w, bson_document_ref doc, uint64_t* __restrict lsn);
+
+/**
+ * Waits until every document appended by this thread is durable
+ * @return 0 on success, 1 if out of memory or writing failed
+ */
+int bson_wal_flush(bson_wal_ref w);
+
+/**
+ * Committer counters
+ */
+struct bson_wal_stats
+{
+    uint64_t    records;
+    uint64_t    batches;        /* Number of writes and syncs */
+    uint64_t    bytes;
+};
+
+void bson_wal_stats(bson_wal_ref __restrict w, struct bson_wal_stats* __restrict stats);
+
+#endif // _BSON_WAL_H_
@@ -0,0 +1,173 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BSON_WIRE_H_
+#define _BSON_WIRE_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <bson/document.h>
+
+/**
+ * Length-prefixed messages carrying BSON documents.
+ *
+ * A message is the header followed by documents stored one after another.
+ * The length in the header includes the header itself.
+ */
+struct bson_wire_header
+{
+    int32_t     length;         /* Size of the message in bytes */
+    int32_t     request_id;
+    int32_t     response_to;
+    int32_t     opcode;
+};
+
+/**
+ * Maximal size of a message
+ */
+#define BSON_WIRE_MAX_MESSAGE_SIZE          (48 * 1024 * 1024)
+
+/**
+ * Outgoing message. Documents are not copied: the frame refers them
+ * until it is sent, so they must stay alive.
+ */
+typedef struct bson_wire_frame bson_wire_frame_t;
+typedef struct bson_wire_frame* bson_wire_frame_ref;
+struct bson_wire_frame
+{
+    struct bson_wire_header header;
+    struct iovec*   iov;        /* Header and bodies */
+    size_t          niov;
+    size_t          max_iov;
+};
+
+/**
+ * Initializes empty frame
+ */
+void bson_wire_frame_init(bson_wire_frame_ref __restrict f, int32_t request_id, int32_t response_to,
+                          int32_t opcode);
+
+/**
+ * Frees the memory of the frame
+ */
+void bson_wire_frame_deinit(bson_wire_frame_ref f);
+
+/**
+ * Removes all documents keeping the memory, and sets new header
+ */
+void bson_wire_frame_reset(bson_wire_frame_ref __restrict f, int32_t request_id, int32_t response_to,
+                           int32_t opcode);
+
+/**
+ * Appends the document to the message
+ * @return 0 on success, 1 if out of memory or the message is too big
+ */
+int bson_wire_frame_add(bson_wire_frame_ref __restrict f, bson_document_ref doc);
+
+/**
+ * Appends documents stored one after another, e.g. a batch
+ * @return 0 on success, 1 if out of memory or the message is too big
+ */
+int bson_wire_frame_add_data(bson_wire_frame_ref __restrict f, const char* data, size_t size);
+
+/**
+ * Get the message as iovec list for writev() or sendmsg()
+ * @return 0 if out of memory
+ */
+const struct iovec* bson_wire_frame_iov(bson_wire_frame_ref __restrict f, size_t* __restrict niov);
+
+/**
+ * Writes whole message to the blocking descriptor
+ * @return 0 on success, 1 on error (see errno)
+ */
+int bson_wire_frame_send(int fd, bson_wire_frame_ref f);
+
+/**
+ * Received message. Points into the ring buffer.
+ */
+typedef struct bson_wire_message bson_wire_message_t;
+typedef struct bson_wire_message* bson_wire_message_ref;
+struct bson_wire_message
+{
+    struct bson_wire_header header;
+    const char*     body;       /* Documents */
+    size_t          size;       /* Size of body */
+};
+
+/**
+ * Iterates documents of the message. Offset must be zero initially.
+ * @return next document or 0 at the end of message
+ */
+bson_document_ref bson_wire_message_next(bson_wire_message_ref __restrict msg, size_t* __restrict offset);
+
+/**
+ * Receive buffer. Messages are parsed in place and stay valid until they
+ * are released, in the order they were received. Incomplete message is
+ * moved to the start of the buffer when it does not fit at the end.
+ */
+typedef struct bson_wire_ring bson_wire_ring_t;
+typedef struct bson_wire_ring* bson_wire_ring_ref;
+struct bson_wire_ring
+{
+    char*       data;
+    size_t      capacity;
+    size_t      release;        /* Oldest unreleased message */
+    size_t      parse;          /* Next unparsed byte */
+    size_t      write;          /* Next free byte */
+    size_t      wrap;           /* End of older messages when wrapped, 0 otherwise */
+    size_t      need;           /* Size of the next message or header */
+};
+
+/**
+ * Initializes ring buffer of given capacity
+ * @return 0 on success, 1 if out of memory
+ */
+int bson_wire_ring_init(bson_wire_ring_ref __restrict r, size_t capacity);
+
+/**
+ * Frees the memory of ring buffer
+ */
+void bson_wire_ring_deinit(bson_wire_ring_ref r);
+
+/**
+ * Reads available data from the descriptor
+ * @return number of bytes read, 0 at the end of stream or -1 on error (see errno).
+ * errno is ENOBUFS if messages must be released first and EMSGSIZE if
+ * the next message is larger than the buffer.
+ */
+ssize_t bson_wire_ring_recv(bson_wire_ring_ref __restrict r, int fd);
+
+/**
+ * Parses the next received message
+ * @return 1 if message is parsed, 0 if more data is needed, -1 if the stream is malformed
+ */
+int bson_wire_ring_next(bson_wire_ring_ref __restrict r, bson_wire_message_ref __restrict msg);
+
+/**
+ * Releases the oldest parsed message
+ */
+void bson_wire_ring_release(bson_wire_ring_ref r);
+
+#endif // _BSON_WIRE_H_
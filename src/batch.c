@@ -0,0 +1,165 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "batch.h"
+
+#include <string.h>
+
+/************************** Private batch interface ***************************/
+static int bson_batch_grow(void** p, size_t* capacity, size_t needed, size_t item)
+{
+    if(needed <= *capacity)
+    {
+        return 0;
+    }
+
+    size_t n = *capacity ? *capacity : 16;
+    while(n < needed)
+    {
+        n *= 2;
+    }
+    void* q = realloc(*p, n * item);
+    if(!q)
+    {
+        return 1;
+    }
+    *p = q;
+    *capacity = n;
+    return 0;
+}
+
+/*************************** Public batch interface ***************************/
+void bson_batch_deinit(bson_batch_ref b)
+{
+    free(b->data);
+    free(b->offsets);
+    free(b->docs);
+    bson_batch_init(b);
+}
+
+int bson_batch_reserve(bson_batch_ref __restrict b, size_t ndocs, size_t nbytes)
+{
+    if(bson_batch_grow((void **)&b->offsets, &b->max_count, b->count + ndocs, sizeof(size_t)))
+    {
+        return 1;
+    }
+    return bson_batch_grow((void **)&b->data, &b->capacity, b->size + nbytes, 1);
+}
+
+char* bson_batch_alloc(bson_batch_ref __restrict b, size_t size)
+{
+    if(bson_batch_reserve(b, 1, size))
+    {
+        return 0;
+    }
+
+    char* p = b->data + b->size;
+    b->offsets[b->count++] = b->size;
+    b->size += size;
+    return p;
+}
+
+int bson_batch_append(bson_batch_ref __restrict b, bson_document_ref doc)
+{
+    const size_t size = bson_document_size(doc);
+    char* p = bson_batch_alloc(b, size);
+    if(!p)
+    {
+        return 1;
+    }
+    memcpy(p, doc->data, size);
+    return 0;
+}
+
+int bson_batch_append_sized(bson_batch_ref __restrict b, bson_sized_builder_emit_t emit, void* ctx)
+{
+    const size_t size = bson_sized_builder_measure(emit, ctx);
+    if(!size)
+    {
+        return 1;
+    }
+
+    char* p = bson_batch_alloc(b, size);
+    if(!p)
+    {
+        return 1;
+    }
+    if(bson_sized_builder_write(emit, ctx, p, size))
+    {
+        /* Drop the document */
+        --b->count;
+        b->size -= size;
+        return 1;
+    }
+    return 0;
+}
+
+int bson_batch_append_buffer(bson_batch_ref __restrict b, const char* data, size_t size)
+{
+    size_t ndocs = 0;
+    size_t offset = 0;
+    while(offset < size)
+    {
+        int32_t n;
+        if(size - offset < 5)
+        {
+            return 1;
+        }
+        memcpy(&n, data + offset, sizeof(n));
+        if(n < 5 || (size_t)n > size - offset)
+        {
+            return 1;
+        }
+        offset += n;
+        ++ndocs;
+    }
+
+    if(bson_batch_reserve(b, ndocs, size))
+    {
+        return 1;
+    }
+
+    memcpy(b->data + b->size, data, size);
+    for (offset = 0; offset < size; )
+    {
+        int32_t n;
+        memcpy(&n, data + offset, sizeof(n));
+        b->offsets[b->count++] = b->size + offset;
+        offset += n;
+    }
+    b->size += size;
+    return 0;
+}
+
+bson_document_ref* bson_batch_documents(bson_batch_ref b)
+{
+    if(bson_batch_grow((void **)&b->docs, &b->max_docs, b->count, sizeof(bson_document_ref)))
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < b->count; ++i)
+    {
+        b->docs[i] = bson_batch_get(b, i);
+    }
+    return b->docs;
+}
@@ -0,0 +1,502 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "blockfile.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "element.h"
+#include "index.h"
+#include "lz.h"
+
+/*********************** Private blockfile types ******************************/
+static const char s_blockfile_magic[8] = { 'B', 'S', 'O', 'N', 'B', 'L', 'K', '1' };
+
+struct bson_blockfile_footer
+{
+    uint64_t    index_offset;
+    uint64_t    nblocks;
+    char        magic[8];
+};
+
+struct bson_blockfile_writer
+{
+    int         fd;
+    size_t      block_size;
+    uint64_t    offset;         /* Current size of the file */
+    uint64_t    ndocs;
+    char*       docs;           /* Documents of pending block */
+    size_t      docs_size;
+    size_t      docs_alloced;
+    uint32_t*   offsets;        /* Offsets of pending documents */
+    uint32_t    npending;
+    uint32_t    offsets_alloced;
+    char*       scratch;        /* Raw and compressed block */
+    size_t      scratch_alloced;
+    struct bson_blockfile_block_info* blocks;
+    size_t      nblocks;
+    size_t      blocks_alloced; /* In bytes */
+};
+
+struct bson_blockfile_reader
+{
+    int         fd;
+    uint64_t    ndocs;
+    char*       scratch;        /* Compressed block */
+    size_t      scratch_alloced;
+    struct bson_blockfile_block_info* blocks;
+    size_t      nblocks;
+};
+
+/*********************** Private blockfile interface **************************/
+static int bson_blockfile_write(int fd, const void* data, size_t size)
+{
+    const char* p = (const char *)data;
+    while(size)
+    {
+        ssize_t n = write(fd, p, size);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return 1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static int bson_blockfile_pread(int fd, void* data, size_t size, uint64_t offset)
+{
+    char* p = (char *)data;
+    while(size)
+    {
+        ssize_t n = pread(fd, p, size, (off_t)offset);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return 1;
+        }
+        if(n == 0)
+        {
+            return 1;
+        }
+        p += n;
+        size -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+static int bson_blockfile_reserve(void** data, size_t* alloced, size_t size)
+{
+    if(size <= *alloced)
+    {
+        return 0;
+    }
+
+    size_t n = *alloced ? *alloced : 1024;
+    while(n < size)
+    {
+        n *= 2;
+    }
+
+    void* p = realloc(*data, n);
+    if(!p)
+    {
+        return 1;
+    }
+    *data = p;
+    *alloced = n;
+    return 0;
+}
+
+/*
+ * Truncated key of the first element. Prefixes keep the order of keys, so
+ * truncated bounds of a block still enclose truncated keys of its documents.
+ * Values too large for a key are replaced by the lowest or the highest key.
+ */
+static void bson_blockfile_key(bson_document_ref doc, int is_max, char* __restrict key, uint8_t* __restrict size)
+{
+    char buffer[BSON_INDEX_KEY_SIZE];
+    bson_element_ref el = bson_document_get_first(doc);
+    const bson_type_t type = bson_element_type(el);
+    size_t n = bson_index_key(type, type == bson_type_eoo ? 0 : bson_element_value(el), buffer);
+    if(n == 0 && is_max)
+    {
+        memset(buffer, 0xff, BSON_BLOCKFILE_KEY_SIZE);
+        n = BSON_BLOCKFILE_KEY_SIZE;
+    }
+    if(n > BSON_BLOCKFILE_KEY_SIZE)
+    {
+        n = BSON_BLOCKFILE_KEY_SIZE;
+    }
+    memcpy(key, buffer, n);
+    *size = (uint8_t)n;
+}
+
+/* Compares keys truncated to BSON_BLOCKFILE_KEY_SIZE bytes */
+static int bson_blockfile_key_compare(const char* __restrict a, size_t na, const char* __restrict b, size_t nb)
+{
+    na = na < BSON_BLOCKFILE_KEY_SIZE ? na : BSON_BLOCKFILE_KEY_SIZE;
+    nb = nb < BSON_BLOCKFILE_KEY_SIZE ? nb : BSON_BLOCKFILE_KEY_SIZE;
+    const int c = memcmp(a, b, na < nb ? na : nb);
+    return c ? c : (na > nb) - (na < nb);
+}
+
+static int bson_blockfile_writer_flush(bson_blockfile_writer_ref __restrict w)
+{
+    if(w->npending == 0)
+    {
+        return 0;
+    }
+
+    const size_t header = sizeof(uint32_t) * (1 + w->npending);
+    const size_t raw_size = header + w->docs_size;
+    const size_t bound = bson_lz_compress_bound(raw_size);
+    if(raw_size > UINT32_MAX ||
+       bson_blockfile_reserve((void **)&w->scratch, &w->scratch_alloced, raw_size + bound) ||
+       bson_blockfile_reserve((void **)&w->blocks, &w->blocks_alloced,
+                              (w->nblocks + 1) * sizeof(struct bson_blockfile_block_info)))
+    {
+        return 1;
+    }
+
+    uint32_t* raw = (uint32_t *)w->scratch;
+    raw[0] = w->npending;
+    for (uint32_t i = 0; i < w->npending; ++i)
+    {
+        raw[1 + i] = (uint32_t)header + w->offsets[i];
+    }
+    memcpy(w->scratch + header, w->docs, w->docs_size);
+
+    char* compressed = w->scratch + raw_size;
+    size_t stored_size = bson_lz_compress(w->scratch, raw_size, compressed, bound);
+    const char* stored = compressed;
+    if(stored_size == 0 || stored_size >= raw_size)
+    {
+        /* Incompressible block is stored as is */
+        stored = w->scratch;
+        stored_size = raw_size;
+    }
+
+    if(bson_blockfile_write(w->fd, stored, stored_size))
+    {
+        return 1;
+    }
+
+    struct bson_blockfile_block_info* info = &w->blocks[w->nblocks++];
+    memset(info, 0, sizeof(*info));
+    info->offset = w->offset;
+    info->stored_size = (uint32_t)stored_size;
+    info->raw_size = (uint32_t)raw_size;
+    info->first_doc = w->ndocs;
+    info->ndocs = w->npending;
+    bson_blockfile_key((bson_document_ref)w->docs, 0, info->min_key, &info->min_key_size);
+    bson_blockfile_key((bson_document_ref)(w->docs + w->offsets[w->npending - 1]), 1, info->max_key,
+                       &info->max_key_size);
+
+    w->offset += stored_size;
+    w->ndocs += w->npending;
+    w->npending = 0;
+    w->docs_size = 0;
+    return 0;
+}
+
+/*********************** Public blockfile interface ***************************/
+bson_blockfile_writer_ref bson_blockfile_writer_create(int fd, size_t block_size)
+{
+    bson_blockfile_writer_ref w = (bson_blockfile_writer_ref)calloc(1, sizeof(struct bson_blockfile_writer));
+    if(w)
+    {
+        w->fd = fd;
+        w->block_size = block_size ? block_size : BSON_BLOCKFILE_BLOCK_SIZE;
+        if(bson_blockfile_write(fd, s_blockfile_magic, sizeof(s_blockfile_magic)))
+        {
+            free(w);
+            return 0;
+        }
+        w->offset = sizeof(s_blockfile_magic);
+    }
+    return w;
+}
+
+int bson_blockfile_writer_append(bson_blockfile_writer_ref __restrict w, bson_document_ref doc)
+{
+    const size_t size = bson_document_size(doc);
+    if(bson_blockfile_reserve((void **)&w->docs, &w->docs_alloced, w->docs_size + size))
+    {
+        return 1;
+    }
+
+    if(w->npending == w->offsets_alloced)
+    {
+        uint32_t n = w->offsets_alloced ? w->offsets_alloced * 2 : 256;
+        uint32_t* offsets = (uint32_t *)realloc(w->offsets, n * sizeof(uint32_t));
+        if(!offsets)
+        {
+            return 1;
+        }
+        w->offsets = offsets;
+        w->offsets_alloced = n;
+    }
+
+    w->offsets[w->npending++] = (uint32_t)w->docs_size;
+    memcpy(w->docs + w->docs_size, doc->data, size);
+    w->docs_size += size;
+
+    if(w->docs_size >= w->block_size)
+    {
+        return bson_blockfile_writer_flush(w);
+    }
+    return 0;
+}
+
+int bson_blockfile_writer_finalize(bson_blockfile_writer_ref w)
+{
+    int rc = bson_blockfile_writer_flush(w);
+    if(rc == 0)
+    {
+        struct bson_blockfile_footer footer;
+        footer.index_offset = w->offset;
+        footer.nblocks = w->nblocks;
+        memcpy(footer.magic, s_blockfile_magic, sizeof(footer.magic));
+
+        rc = bson_blockfile_write(w->fd, w->blocks, w->nblocks * sizeof(struct bson_blockfile_block_info)) ||
+             bson_blockfile_write(w->fd, &footer, sizeof(footer));
+    }
+
+    free(w->blocks);
+    free(w->scratch);
+    free(w->offsets);
+    free(w->docs);
+    free(w);
+    return rc;
+}
+
+bson_blockfile_reader_ref bson_blockfile_reader_open(int fd)
+{
+    struct stat st;
+    if(fstat(fd, &st) || (uint64_t)st.st_size < sizeof(s_blockfile_magic) + sizeof(struct bson_blockfile_footer))
+    {
+        return 0;
+    }
+
+    struct bson_blockfile_footer footer;
+    char magic[sizeof(s_blockfile_magic)];
+    const uint64_t size = st.st_size;
+    if(bson_blockfile_pread(fd, magic, sizeof(magic), 0) ||
+       bson_blockfile_pread(fd, &footer, sizeof(footer), size - sizeof(footer)) ||
+       memcmp(magic, s_blockfile_magic, sizeof(magic)) ||
+       memcmp(footer.magic, s_blockfile_magic, sizeof(magic)) ||
+       footer.index_offset > size - sizeof(footer) ||
+       footer.nblocks != (size - sizeof(footer) - footer.index_offset) / sizeof(struct bson_blockfile_block_info))
+    {
+        return 0;
+    }
+
+    bson_blockfile_reader_ref r = (bson_blockfile_reader_ref)calloc(1, sizeof(struct bson_blockfile_reader));
+    if(!r)
+    {
+        return 0;
+    }
+
+    r->fd = fd;
+    r->nblocks = (size_t)footer.nblocks;
+    r->blocks = (struct bson_blockfile_block_info *)malloc((r->nblocks + 1) * sizeof(struct bson_blockfile_block_info));
+    if(!r->blocks ||
+       bson_blockfile_pread(fd, r->blocks, r->nblocks * sizeof(struct bson_blockfile_block_info), footer.index_offset))
+    {
+        bson_blockfile_reader_close(r);
+        return 0;
+    }
+
+    for (size_t i = 0; i < r->nblocks; ++i)
+    {
+        const struct bson_blockfile_block_info* info = &r->blocks[i];
+        if(info->first_doc != r->ndocs || info->offset + info->stored_size > footer.index_offset ||
+           info->stored_size > info->raw_size)
+        {
+            bson_blockfile_reader_close(r);
+            return 0;
+        }
+        r->ndocs += info->ndocs;
+    }
+
+    return r;
+}
+
+void bson_blockfile_reader_close(bson_blockfile_reader_ref r)
+{
+    free(r->scratch);
+    free(r->blocks);
+    free(r);
+}
+
+size_t bson_blockfile_reader_nblocks(bson_blockfile_reader_ref r)
+{
+    return r->nblocks;
+}
+
+uint64_t bson_blockfile_reader_ndocs(bson_blockfile_reader_ref r)
+{
+    return r->ndocs;
+}
+
+const struct bson_blockfile_block_info* bson_blockfile_reader_info(bson_blockfile_reader_ref r, size_t i)
+{
+    return &r->blocks[i];
+}
+
+size_t bson_blockfile_reader_find_range(bson_blockfile_reader_ref __restrict r,
+                                        const char* __restrict low, size_t nlow,
+                                        const char* __restrict high, size_t nhigh,
+                                        size_t* __restrict first)
+{
+    /* First block ending at or after low */
+    size_t lo = 0;
+    size_t hi = r->nblocks;
+    while(low && lo < hi)
+    {
+        const size_t mid = (lo + hi) / 2;
+        const struct bson_blockfile_block_info* info = &r->blocks[mid];
+        if(bson_blockfile_key_compare(info->max_key, info->max_key_size, low, nlow) < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    *first = lo;
+    
+    /* First block starting after high */
+    hi = r->nblocks;
+    while(high && lo < hi)
+    {
+        const size_t mid = (lo + hi) / 2;
+        const struct bson_blockfile_block_info* info = &r->blocks[mid];
+        if(bson_blockfile_key_compare(info->min_key, info->min_key_size, high, nhigh) <= 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return high ? lo - *first : r->nblocks - *first;
+}
+
+int bson_blockfile_reader_load(bson_blockfile_reader_ref __restrict r, size_t i,
+                               bson_blockfile_block_t* __restrict block)
+{
+    if(block->index == i)
+    {
+        return 0;
+    }
+
+    const struct bson_blockfile_block_info* info = &r->blocks[i];
+    block->index = SIZE_MAX;
+    if(bson_blockfile_reserve((void **)&block->data, &block->alloced, info->raw_size))
+    {
+        return 1;
+    }
+
+    if(info->stored_size == info->raw_size)
+    {
+        if(bson_blockfile_pread(r->fd, block->data, info->raw_size, info->offset))
+        {
+            return 1;
+        }
+    }
+    else if(bson_blockfile_reserve((void **)&r->scratch, &r->scratch_alloced, info->stored_size) ||
+            bson_blockfile_pread(r->fd, r->scratch, info->stored_size, info->offset) ||
+            bson_lz_decompress(r->scratch, info->stored_size, block->data, info->raw_size))
+    {
+        return 1;
+    }
+
+    const uint32_t* header = (const uint32_t *)block->data;
+    if(info->raw_size < sizeof(uint32_t) * (1 + (size_t)info->ndocs) || header[0] != info->ndocs)
+    {
+        return 1;
+    }
+    for (uint32_t d = 0; d < info->ndocs; ++d)
+    {
+        const uint32_t offset = header[1 + d];
+        if(offset > info->raw_size - 5)
+        {
+            return 1;
+        }
+        bson_document_ref doc = (bson_document_ref)(block->data + offset);
+        if(bson_document_size(doc) < 5 || (uint32_t)bson_document_size(doc) > info->raw_size - offset)
+        {
+            return 1;
+        }
+    }
+
+    block->ndocs = info->ndocs;
+    block->offsets = header + 1;
+    block->index = i;
+    return 0;
+}
+
+bson_document_ref bson_blockfile_reader_get(bson_blockfile_reader_ref __restrict r, uint64_t n,
+                                            bson_blockfile_block_t* __restrict block)
+{
+    if(n >= r->ndocs)
+    {
+        return 0;
+    }
+
+    size_t lo = 0;
+    size_t hi = r->nblocks;
+    while(hi - lo > 1)
+    {
+        size_t mid = (lo + hi) / 2;
+        if(r->blocks[mid].first_doc <= n)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    if(bson_blockfile_reader_load(r, lo, block))
+    {
+        return 0;
+    }
+    return bson_blockfile_block_doc(block, n - r->blocks[lo].first_doc);
+}
@@ -0,0 +1,66 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "cpu.h"
+
+#include <stdlib.h>
+
+/*
+ * Detected features, plus one to tell "not yet detected" from "none".
+ * Races are harmless: every thread computes the same value.
+ */
+static volatile unsigned s_features;
+
+static unsigned bson_cpu_detect()
+{
+    unsigned features = 0;
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("sse4.2"))
+    {
+        features |= BSON_CPU_SSE42;
+    }
+    if(__builtin_cpu_supports("avx2"))
+    {
+        features |= BSON_CPU_AVX2;
+    }
+#endif
+
+    const char* mask = getenv("BSON_CPU_FEATURES");
+    if(mask)
+    {
+        features &= (unsigned)strtoul(mask, 0, 0);
+    }
+    return features;
+}
+
+unsigned bson_cpu_features()
+{
+    unsigned features = s_features;
+    if(!features)
+    {
+        features = bson_cpu_detect() + 1;
+        s_features = features;
+    }
+    return features - 1;
+}
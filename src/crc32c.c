@@ -0,0 +1,114 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "crc32c.h"
+
+#include <pthread.h>
+#include <string.h>
+#include "cpu.h"
+
+/*************************** Private interface ********************************/
+/*
+ * Slicing-by-8 tables of the reflected polynomial
+ */
+static uint32_t s_table[8][256];
+static pthread_once_t s_table_once = PTHREAD_ONCE_INIT;
+
+static void bson_crc32c_init_table()
+{
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k)
+        {
+            c = c & 1 ? (c >> 1) ^ 0x82f63b78 : c >> 1;
+        }
+        s_table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+        for (int t = 1; t < 8; ++t)
+        {
+            s_table[t][i] = (s_table[t - 1][i] >> 8) ^ s_table[0][s_table[t - 1][i] & 0xff];
+        }
+    }
+}
+
+static bson_crc32c_kernel_t bson_crc32c_select()
+{
+#ifdef BSON_HAVE_X86_SIMD
+    if(bson_cpu_has(BSON_CPU_SSE42))
+    {
+        return bson_crc32c_sse42;
+    }
+#endif
+    return bson_crc32c_portable;
+}
+
+/*
+ * Selected on the first call. Races are harmless: all threads select
+ * the same kernel.
+ */
+static volatile bson_crc32c_kernel_t s_kernel;
+
+/*************************** Public interface *********************************/
+uint32_t bson_crc32c_portable(uint32_t crc, const void* data, size_t size)
+{
+    pthread_once(&s_table_once, bson_crc32c_init_table);
+    
+    const unsigned char* p = (const unsigned char *)data;
+    crc = ~crc;
+    while(size >= 8)
+    {
+        uint32_t lo, hi;
+        memcpy(&lo, p, sizeof(lo));
+        memcpy(&hi, p + 4, sizeof(hi));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        lo = __builtin_bswap32(lo);
+        hi = __builtin_bswap32(hi);
+#endif
+        lo ^= crc;
+        crc = s_table[7][lo & 0xff] ^ s_table[6][(lo >> 8) & 0xff] ^
+              s_table[5][(lo >> 16) & 0xff] ^ s_table[4][lo >> 24] ^
+              s_table[3][hi & 0xff] ^ s_table[2][(hi >> 8) & 0xff] ^
+              s_table[1][(hi >> 16) & 0xff] ^ s_table[0][hi >> 24];
+        p += 8;
+        size -= 8;
+    }
+    while(size--)
+    {
+        crc = (crc >> 8) ^ s_table[0][(crc ^ *p++) & 0xff];
+    }
+    return ~crc;
+}
+
+uint32_t bson_crc32c(uint32_t crc, const void* data, size_t size)
+{
+    bson_crc32c_kernel_t kernel = s_kernel;
+    if(!kernel)
+    {
+        kernel = bson_crc32c_select();
+        s_kernel = kernel;
+    }
+    return kernel(crc, data, size);
+}
@@ -0,0 +1,626 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "decimal128.h"
+
+typedef unsigned __int128 bson_u128;
+
+enum
+{
+    BSON_DECIMAL128_FINITE = 0,
+    BSON_DECIMAL128_KIND_INF,
+    BSON_DECIMAL128_KIND_NAN
+};
+
+/*
+ * Unpacked decimal
+ */
+struct bson_decimal128_parts
+{
+    int         sign;
+    int         kind;
+    int         exponent;   /* Unbiased */
+    bson_u128   coef;
+};
+
+static const bson_u128 s_pow10[39] =
+{
+    1ull,
+    10ull,
+    100ull,
+    1000ull,
+    10000ull,
+    100000ull,
+    1000000ull,
+    10000000ull,
+    100000000ull,
+    1000000000ull,
+    10000000000ull,
+    100000000000ull,
+    1000000000000ull,
+    10000000000000ull,
+    100000000000000ull,
+    1000000000000000ull,
+    10000000000000000ull,
+    100000000000000000ull,
+    1000000000000000000ull,
+    10000000000000000000ull,
+    (bson_u128)10000000000000000000ull * 10ull,
+    (bson_u128)10000000000000000000ull * 100ull,
+    (bson_u128)10000000000000000000ull * 1000ull,
+    (bson_u128)10000000000000000000ull * 10000ull,
+    (bson_u128)10000000000000000000ull * 100000ull,
+    (bson_u128)10000000000000000000ull * 1000000ull,
+    (bson_u128)10000000000000000000ull * 10000000ull,
+    (bson_u128)10000000000000000000ull * 100000000ull,
+    (bson_u128)10000000000000000000ull * 1000000000ull,
+    (bson_u128)10000000000000000000ull * 10000000000ull,
+    (bson_u128)10000000000000000000ull * 100000000000ull,
+    (bson_u128)10000000000000000000ull * 1000000000000ull,
+    (bson_u128)10000000000000000000ull * 10000000000000ull,
+    (bson_u128)10000000000000000000ull * 100000000000000ull,
+    (bson_u128)10000000000000000000ull * 1000000000000000ull,
+    (bson_u128)10000000000000000000ull * 10000000000000000ull,
+    (bson_u128)10000000000000000000ull * 100000000000000000ull,
+    (bson_u128)10000000000000000000ull * 1000000000000000000ull,
+    (bson_u128)10000000000000000000ull * 10000000000000000000ull
+};
+
+static const char s_pairs[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/************************ Private decimal interface ***************************/
+static inline int bson_decimal128_ndigits(bson_u128 c)
+{
+    if(!c)
+    {
+        return 1;
+    }
+    const uint64_t hi = (uint64_t)(c >> 64);
+    const int bits = hi ? 128 - __builtin_clzll(hi) : 64 - __builtin_clzll((uint64_t)c);
+    const int t = bits * 1233 >> 12;
+    return t + (c >= s_pow10[t]);
+}
+
+static inline void bson_decimal128_unpack(const bson_decimal128_t* __restrict d,
+                                          struct bson_decimal128_parts* __restrict p)
+{
+    p->sign = (int)(d->high >> 63);
+    p->kind = BSON_DECIMAL128_FINITE;
+    p->exponent = 0;
+    p->coef = 0;
+    if((d->high & BSON_DECIMAL128_NAN) == BSON_DECIMAL128_NAN)
+    {
+        p->kind = BSON_DECIMAL128_KIND_NAN;
+    }
+    else if((d->high & BSON_DECIMAL128_NAN) == BSON_DECIMAL128_INF)
+    {
+        p->kind = BSON_DECIMAL128_KIND_INF;
+    }
+    else if((d->high >> 61 & 3) == 3)
+    {
+        /* Coefficients of this form exceed 34 digits: non-canonical zero */
+        p->exponent = (int)(d->high >> 47 & 0x3fff) - bson_decimal128_exponent_bias;
+    }
+    else
+    {
+        p->exponent = (int)(d->high >> 49 & 0x3fff) - bson_decimal128_exponent_bias;
+        p->coef = (bson_u128)(d->high & ((1ull << 49) - 1)) << 64 | d->low;
+        if(p->coef >= s_pow10[bson_decimal128_digits])
+        {
+            p->coef = 0;
+        }
+    }
+}
+
+static inline void bson_decimal128_pack(bson_decimal128_ref __restrict d, int sign, int exponent, bson_u128 coef)
+{
+    d->low = (uint64_t)coef;
+    d->high = (uint64_t)(coef >> 64) | (uint64_t)(exponent + bson_decimal128_exponent_bias) << 49 |
+              (sign ? BSON_DECIMAL128_SIGN : 0);
+}
+
+/*
+ * Drops k low digits of coefficient, rounding half to even.
+ * Sticky tells that non-zero digits were dropped below the coefficient.
+ */
+static bson_u128 bson_decimal128_round(bson_u128 c, int k, int sticky)
+{
+    if(k > 38)
+    {
+        return 0;
+    }
+    const bson_u128 p = s_pow10[k];
+    const bson_u128 half = p / 2;
+    bson_u128 q = c / p;
+    const bson_u128 rem = c - q * p;
+    if(rem > half || (rem == half && (sticky || (q & 1))))
+    {
+        q++;
+    }
+    return q;
+}
+
+/*
+ * Clamps exponent of finite value into the range
+ * @return 0 on success, 1 on overflow
+ */
+static int bson_decimal128_clamp(bson_u128* __restrict c, int64_t* __restrict exponent)
+{
+    if(*c == 0)
+    {
+        if(*exponent > bson_decimal128_exponent_max)
+            *exponent = bson_decimal128_exponent_max;
+        if(*exponent < bson_decimal128_exponent_min)
+            *exponent = bson_decimal128_exponent_min;
+        return 0;
+    }
+    
+    if(*exponent > bson_decimal128_exponent_max)
+    {
+        /* Trailing zeros of coefficient may absorb the excess */
+        const int64_t k = *exponent - bson_decimal128_exponent_max;
+        if(bson_decimal128_ndigits(*c) + k > bson_decimal128_digits)
+        {
+            return 1;
+        }
+        *c *= s_pow10[k];
+        *exponent = bson_decimal128_exponent_max;
+    }
+    else if(*exponent < bson_decimal128_exponent_min)
+    {
+        const int64_t k = bson_decimal128_exponent_min - *exponent;
+        *c = bson_decimal128_round(*c, k > 39 ? 39 : (int)k, 0);
+        *exponent = bson_decimal128_exponent_min;
+    }
+    return 0;
+}
+
+/*
+ * Writes decimal digits of v
+ * @return number of digits
+ */
+static inline int bson_decimal128_format_u64(uint64_t v, char* __restrict out)
+{
+    char tmp[20];
+    char* p = tmp + sizeof(tmp);
+    while(v >= 100)
+    {
+        const unsigned r = (unsigned)(v % 100);
+        v /= 100;
+        p -= 2;
+        memcpy(p, s_pairs + 2 * r, 2);
+    }
+    if(v >= 10)
+    {
+        p -= 2;
+        memcpy(p, s_pairs + 2 * v, 2);
+    }
+    else
+    {
+        *--p = (char)('0' + v);
+    }
+    
+    const int n = (int)(tmp + sizeof(tmp) - p);
+    memcpy(out, p, n);
+    return n;
+}
+
+static inline int bson_decimal128_format_coef(bson_u128 c, char* __restrict out)
+{
+    if(!(c >> 64))
+    {
+        return bson_decimal128_format_u64((uint64_t)c, out);
+    }
+    
+    /* Below 10^34: the quotient fits 64 bits, the remainder has 19 digits */
+    const bson_u128 p = s_pow10[19];
+    const uint64_t hi = (uint64_t)(c / p);
+    uint64_t lo = (uint64_t)(c - hi * p);
+    const int n = bson_decimal128_format_u64(hi, out);
+    for (int i = n + 18; i >= n; --i)
+    {
+        out[i] = (char)('0' + lo % 10);
+        lo /= 10;
+    }
+    return n + 19;
+}
+
+static inline int bson_decimal128_match(const char* s, size_t n, const char* word)
+{
+    size_t i = 0;
+    for (; i < n && word[i]; ++i)
+    {
+        if((s[i] | 0x20) != word[i])
+        {
+            return 0;
+        }
+    }
+    return i == n && !word[i];
+}
+
+/*
+ * Compares magnitudes of finite non-zero values or infinities
+ */
+static int bson_decimal128_compare_magnitude(const struct bson_decimal128_parts* __restrict a,
+                                             const struct bson_decimal128_parts* __restrict b)
+{
+    if(a->kind == BSON_DECIMAL128_KIND_INF || b->kind == BSON_DECIMAL128_KIND_INF)
+    {
+        return (a->kind == BSON_DECIMAL128_KIND_INF) - (b->kind == BSON_DECIMAL128_KIND_INF);
+    }
+    
+    const int da = bson_decimal128_ndigits(a->coef), db = bson_decimal128_ndigits(b->coef);
+    const int adjusted_a = a->exponent + da - 1, adjusted_b = b->exponent + db - 1;
+    if(adjusted_a != adjusted_b)
+    {
+        return adjusted_a < adjusted_b ? -1 : 1;
+    }
+    
+    /* The same magnitude order: aligned coefficients keep at most 34 digits */
+    bson_u128 ca = a->coef, cb = b->coef;
+    if(a->exponent > b->exponent)
+    {
+        ca *= s_pow10[a->exponent - b->exponent];
+    }
+    else
+    {
+        cb *= s_pow10[b->exponent - a->exponent];
+    }
+    return (ca > cb) - (ca < cb);
+}
+
+/************************* Public decimal interface ***************************/
+int bson_decimal128_from_string(bson_decimal128_ref __restrict d, const char* __restrict s, size_t n)
+{
+    const char* p = s;
+    const char* e = s + n;
+    int sign = 0;
+    if(p != e && (*p == '+' || *p == '-'))
+    {
+        sign = *p++ == '-';
+    }
+    
+    if(bson_decimal128_match(p, e - p, "infinity") || bson_decimal128_match(p, e - p, "inf"))
+    {
+        d->low = 0;
+        d->high = BSON_DECIMAL128_INF | (sign ? BSON_DECIMAL128_SIGN : 0);
+        return 0;
+    }
+    if(bson_decimal128_match(p, e - p, "nan"))
+    {
+        d->low = 0;
+        d->high = BSON_DECIMAL128_NAN;
+        return 0;
+    }
+    
+    /* Up to 19 digits accumulate in 64 bits */
+    uint64_t acc = 0;
+    bson_u128 coef = 0;
+    int ndigits = 0;            /* Significant digits kept */
+    int seen_digit = 0, seen_point = 0;
+    int64_t exponent = 0;
+    int round_digit = 0, sticky = 0;
+    for (; p != e; ++p)
+    {
+        const unsigned digit = (unsigned)(*p - '0');
+        if(digit < 10)
+        {
+            seen_digit = 1;
+            if(ndigits == 0 && digit == 0)
+            {
+                /* Leading zero */
+                exponent -= seen_point;
+            }
+            else if(ndigits < 19)
+            {
+                acc = acc * 10 + digit;
+                ndigits++;
+                exponent -= seen_point;
+            }
+            else if(ndigits < bson_decimal128_digits)
+            {
+                if(ndigits == 19)
+                {
+                    coef = acc;
+                }
+                coef = coef * 10 + digit;
+                ndigits++;
+                exponent -= seen_point;
+            }
+            else
+            {
+                /* Dropped digit */
+                if(ndigits++ == bson_decimal128_digits)
+                    round_digit = digit;
+                else
+                    sticky |= digit != 0;
+                exponent += !seen_point;
+            }
+        }
+        else if(*p == '.' && !seen_point)
+        {
+            seen_point = 1;
+        }
+        else
+        {
+            break;
+        }
+    }
+    if(!seen_digit)
+    {
+        return 1;
+    }
+    if(ndigits <= 19)
+    {
+        coef = acc;
+    }
+    
+    if(p != e && (*p | 0x20) == 'e')
+    {
+        int esign = 0;
+        if(++p != e && (*p == '+' || *p == '-'))
+        {
+            esign = *p++ == '-';
+        }
+        const char* start = p;
+        int64_t v = 0;
+        for (; p != e && (unsigned)(*p - '0') < 10; ++p)
+        {
+            if(v < 1000000)
+            {
+                v = v * 10 + (*p - '0');
+            }
+        }
+        if(p == start)
+        {
+            return 1;
+        }
+        exponent += esign ? -v : v;
+    }
+    if(p != e)
+    {
+        return 1;
+    }
+    
+    if(ndigits > bson_decimal128_digits &&
+       (round_digit > 5 || (round_digit == 5 && (sticky || (coef & 1)))))
+    {
+        if(++coef == s_pow10[bson_decimal128_digits])
+        {
+            coef = s_pow10[bson_decimal128_digits - 1];
+            exponent++;
+        }
+    }
+    
+    if(bson_decimal128_clamp(&coef, &exponent))
+    {
+        return 1;
+    }
+    bson_decimal128_pack(d, sign, (int)exponent, coef);
+    return 0;
+}
+
+size_t bson_decimal128_to_string(const bson_decimal128_t* __restrict d, char* __restrict buffer)
+{
+    struct bson_decimal128_parts p;
+    bson_decimal128_unpack(d, &p);
+    
+    char* out = buffer;
+    if(p.kind == BSON_DECIMAL128_KIND_NAN)
+    {
+        memcpy(out, "NaN", 4);
+        return 3;
+    }
+    if(p.sign)
+    {
+        *out++ = '-';
+    }
+    if(p.kind == BSON_DECIMAL128_KIND_INF)
+    {
+        memcpy(out, "Infinity", 9);
+        return out + 8 - buffer;
+    }
+    
+    char digits[40];
+    const int nd = bson_decimal128_format_coef(p.coef, digits);
+    const int adjusted = p.exponent + nd - 1;
+    if(p.exponent <= 0 && adjusted >= -6)
+    {
+        const int point = nd + p.exponent;
+        if(p.exponent == 0)
+        {
+            memcpy(out, digits, nd);
+            out += nd;
+        }
+        else if(point > 0)
+        {
+            memcpy(out, digits, point);
+            out += point;
+            *out++ = '.';
+            memcpy(out, digits + point, nd - point);
+            out += nd - point;
+        }
+        else
+        {
+            *out++ = '0';
+            *out++ = '.';
+            memset(out, '0', -point);
+            out += -point;
+            memcpy(out, digits, nd);
+            out += nd;
+        }
+    }
+    else
+    {
+        *out++ = digits[0];
+        if(nd > 1)
+        {
+            *out++ = '.';
+            memcpy(out, digits + 1, nd - 1);
+            out += nd - 1;
+        }
+        *out++ = 'E';
+        *out++ = adjusted < 0 ? '-' : '+';
+        out += bson_decimal128_format_u64((uint64_t)(adjusted < 0 ? -adjusted : adjusted), out);
+    }
+    
+    *out = '\0';
+    return out - buffer;
+}
+
+int bson_decimal128_compare(const bson_decimal128_t* __restrict a, const bson_decimal128_t* __restrict b)
+{
+    struct bson_decimal128_parts pa, pb;
+    bson_decimal128_unpack(a, &pa);
+    bson_decimal128_unpack(b, &pb);
+    
+    if(pa.kind == BSON_DECIMAL128_KIND_NAN || pb.kind == BSON_DECIMAL128_KIND_NAN)
+    {
+        return (pb.kind == BSON_DECIMAL128_KIND_NAN) - (pa.kind == BSON_DECIMAL128_KIND_NAN);
+    }
+    
+    const int zero_a = pa.kind == BSON_DECIMAL128_FINITE && pa.coef == 0;
+    const int zero_b = pb.kind == BSON_DECIMAL128_FINITE && pb.coef == 0;
+    if(zero_a || zero_b)
+    {
+        if(zero_a && zero_b)
+            return 0;
+        if(zero_a)
+            return pb.sign ? 1 : -1;
+        return pa.sign ? -1 : 1;
+    }
+    if(pa.sign != pb.sign)
+    {
+        return pa.sign ? -1 : 1;
+    }
+    
+    const int c = bson_decimal128_compare_magnitude(&pa, &pb);
+    return pa.sign ? -c : c;
+}
+
+void bson_decimal128_add(bson_decimal128_ref r, const bson_decimal128_t* a, const bson_decimal128_t* b)
+{
+    struct bson_decimal128_parts pa, pb;
+    bson_decimal128_unpack(a, &pa);
+    bson_decimal128_unpack(b, &pb);
+    
+    if(pa.kind == BSON_DECIMAL128_KIND_NAN || pb.kind == BSON_DECIMAL128_KIND_NAN ||
+       (pa.kind == BSON_DECIMAL128_KIND_INF && pb.kind == BSON_DECIMAL128_KIND_INF && pa.sign != pb.sign))
+    {
+        r->low = 0;
+        r->high = BSON_DECIMAL128_NAN;
+        return;
+    }
+    if(pa.kind == BSON_DECIMAL128_KIND_INF || pb.kind == BSON_DECIMAL128_KIND_INF)
+    {
+        const int sign = pa.kind == BSON_DECIMAL128_KIND_INF ? pa.sign : pb.sign;
+        r->low = 0;
+        r->high = BSON_DECIMAL128_INF | (sign ? BSON_DECIMAL128_SIGN : 0);
+        return;
+    }
+    
+    if(pa.exponent < pb.exponent)
+    {
+        const struct bson_decimal128_parts t = pa;
+        pa = pb;
+        pb = t;
+    }
+    
+    /*
+     * Align to the smaller exponent. The coefficient with larger exponent
+     * grows up to 37 digits, then the other one loses digits, which only
+     * matter for rounding.
+     */
+    bson_u128 ca = pa.coef, cb = pb.coef;
+    int64_t exponent = pb.exponent;
+    int sticky = 0;
+    int diff = pa.exponent - pb.exponent;
+    if(diff && ca)
+    {
+        const int room = 37 - bson_decimal128_ndigits(ca);
+        const int k = diff < room ? diff : room;
+        ca *= s_pow10[k];
+        diff -= k;
+        exponent = pa.exponent - k;
+        if(diff > 38)
+        {
+            sticky = cb != 0;
+            cb = 0;
+        }
+        else if(diff)
+        {
+            const bson_u128 q = cb / s_pow10[diff];
+            sticky = cb != q * s_pow10[diff];
+            cb = q;
+        }
+    }
+    
+    int sign;
+    bson_u128 c;
+    if(pa.sign == pb.sign)
+    {
+        c = ca + cb;
+        sign = pa.sign;
+    }
+    else if(ca >= cb)
+    {
+        /* With sticky digits the true difference lies between c and c + 1 */
+        c = ca - cb - sticky;
+        sign = pa.sign;
+    }
+    else
+    {
+        c = cb - ca;
+        sign = pb.sign;
+    }
+    if(c == 0 && !sticky)
+    {
+        sign = pa.sign && pb.sign;
+    }
+    
+    const int nd = bson_decimal128_ndigits(c);
+    if(nd > bson_decimal128_digits)
+    {
+        const int k = nd - bson_decimal128_digits;
+        c = bson_decimal128_round(c, k, sticky);
+        exponent += k;
+        if(c == s_pow10[bson_decimal128_digits])
+        {
+            c = s_pow10[bson_decimal128_digits - 1];
+            exponent++;
+        }
+    }
+    
+    if(bson_decimal128_clamp(&c, &exponent))
+    {
+        r->low = 0;
+        r->high = BSON_DECIMAL128_INF | (sign ? BSON_DECIMAL128_SIGN : 0);
+        return;
+    }
+    bson_decimal128_pack(r, sign, (int)exponent, c);
+}
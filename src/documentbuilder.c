@@ -26,6 +26,49 @@
 extern inline bson_document_builder_ref bson_document_builder_create_with_parent(bson_document_builder_ref parent);
 extern inline bson_document_ref bson_document_builder_finalize(bson_document_builder_ref __restrict bld);
 
+extern inline void bson_document_builder_append_raw(bson_document_builder_ref __restrict bld,
+                                                    bson_type_t type, const char* __restrict k, size_t nk,
+                                                    const void* __restrict prefix, size_t nprefix,
+                                                    const void* __restrict value, size_t nvalue);
+extern inline void bson_document_builder_append_doc_n(bson_document_builder_ref __restrict bld,
+                                                      const char* __restrict k, size_t nk,
+                                                      const bson_document_ref __restrict doc);
+extern inline void bson_document_builder_append_arr_n(bson_document_builder_ref __restrict bld,
+                                                      const char* __restrict k, size_t nk,
+                                                      const bson_array_ref __restrict arr);
+extern inline void bson_document_builder_append_b_n(bson_document_builder_ref __restrict bld,
+                                                    const char* __restrict k, size_t nk, char b);
+extern inline void bson_document_builder_append_i_n(bson_document_builder_ref __restrict bld,
+                                                    const char* __restrict k, size_t nk, int32_t i);
+extern inline void bson_document_builder_append_l_n(bson_document_builder_ref __restrict bld,
+                                                    const char* __restrict k, size_t nk, int64_t l);
+extern inline void bson_document_builder_append_d_n(bson_document_builder_ref __restrict bld,
+                                                    const char* __restrict k, size_t nk, double d);
+extern inline void bson_document_builder_append_oid_n(bson_document_builder_ref __restrict bld,
+                                                      const char* __restrict k, size_t nk,
+                                                      const bson_oid_ref __restrict oid);
+extern inline void bson_document_builder_append_date_n(bson_document_builder_ref __restrict bld,
+                                                       const char* __restrict k, size_t nk, int64_t dt);
+extern inline void bson_document_builder_append_dec128_n(bson_document_builder_ref __restrict bld,
+                                                         const char* __restrict k, size_t nk,
+                                                         const bson_decimal128_t* __restrict dec);
+extern inline void bson_document_builder_append_str_n(bson_document_builder_ref __restrict bld,
+                                                      const char* __restrict k, size_t nk,
+                                                      const char* __restrict str, size_t nstr);
+extern inline void bson_document_builder_append_js_n(bson_document_builder_ref __restrict bld,
+                                                     const char* __restrict k, size_t nk,
+                                                     const char* __restrict js, size_t njs);
+extern inline void bson_document_builder_append_null_n(bson_document_builder_ref __restrict bld,
+                                                       const char* __restrict k, size_t nk);
+extern inline void bson_document_builder_append_regex_n(bson_document_builder_ref __restrict bld,
+                                                        const char* __restrict k, size_t nk,
+                                                        const char* __restrict regex,
+                                                        const char* __restrict flags);
+extern inline void bson_document_builder_append_bin_n(bson_document_builder_ref __restrict bld,
+                                                      const char* __restrict k, size_t nk,
+                                                      bson_subtype_t t, void* __restrict d,
+                                                      int32_t sz);
+
 extern inline void bson_document_builder_append_el(bson_document_builder_ref __restrict bld,
                                                    const bson_element_ref __restrict e);
 extern inline void bson_document_builder_append_doc(bson_document_builder_ref __restrict bld,
@@ -47,6 +90,9 @@ extern inline void bson_document_builder_append_oid(bson_document_builder_ref __
                                                     const bson_oid_ref __restrict oid);
 extern inline void bson_document_builder_append_date(bson_document_builder_ref __restrict bld,
                                                      const char* __restrict k, int64_t dt);
+extern inline void bson_document_builder_append_dec128(bson_document_builder_ref __restrict bld,
+                                                       const char* __restrict k,
+                                                       const bson_decimal128_t* __restrict dec);
 extern inline void bson_document_builder_append_str(bson_document_builder_ref __restrict bld,
                                                     const char* __restrict k,
                                                     const char* __restrict str);
@@ -28,82 +28,61 @@
 
 /****************************** Public Impl ***********************************/
 
-size_t bson_element_value_size(bson_element_ref __restrict e)
+#define FIXED(n)        { BSON_VALUE_SIZE_FIXED, n }
+#define PREFIXED(n)     { BSON_VALUE_SIZE_PREFIXED, n }
+
+const struct bson_value_size_info bson_value_sizes[256] =
 {
-    size_t size = 0;
-    switch (bson_element_type(e)) {
-        case bson_type_date:
-        case bson_type_long:
-        case bson_type_float:
-        case bson_type_timestamp:
-            size = 8;
-            break;
-            
-        case bson_type_code:
-        case bson_type_symbol:
-        case bson_type_string:
-        {
-            int32_t len = *(int32_t*)bson_element_value(e);
-            size = sizeof(len) + len;
-            break;
-        }
-        case bson_type_array:
-        case bson_type_document:
-        {
-            size = *(int32_t*)bson_element_value(e);
-            break;
-        }
-            
-        case bson_type_bindata:
-        {
-            int32_t len = *(int32_t*)bson_element_value(e);
-            size = sizeof(len) + 1 + len;
-            break;
-        }
-            
-        case bson_type_oid:
-            size = bson_oid_size;
-            break;
-            
-        case bson_type_bool:
-            size = 1;
-            break;
-            
-        case bson_type_regex:
+    [bson_type_float]                       = FIXED(8),
+    [bson_type_string]                      = PREFIXED(4),
+    [bson_type_document]                    = PREFIXED(0),
+    [bson_type_array]                       = PREFIXED(0),
+    [bson_type_bindata]                     = PREFIXED(5),
+    [bson_type_undefined]                   = FIXED(0),
+    [bson_type_oid]                         = FIXED(bson_oid_size),
+    [bson_type_bool]                        = FIXED(1),
+    [bson_type_date]                        = FIXED(8),
+    [bson_type_null]                        = FIXED(0),
+    [bson_type_regex]                       = { BSON_VALUE_SIZE_CSTRINGS, 0 },
+    [bson_type_dbpointer]                   = PREFIXED(4 + bson_oid_size),
+    [bson_type_code]                        = PREFIXED(4),
+    [bson_type_symbol]                      = PREFIXED(4),
+    [bson_type_codewscope]                  = PREFIXED(0),
+    [bson_type_int]                         = FIXED(4),
+    [bson_type_timestamp]                   = FIXED(8),
+    [bson_type_long]                        = FIXED(8),
+    [bson_type_decimal128]                  = FIXED(16),
+    [(unsigned char)bson_type_minkey]       = FIXED(0),
+    [bson_type_maxkey]                      = FIXED(0)
+};
+
+#undef FIXED
+#undef PREFIXED
+
+extern inline size_t bson_value_size(bson_type_t type, const char* __restrict value);
+extern inline size_t bson_element_size(bson_element_ref __restrict e);
+
+size_t bson_value_size_slow(bson_type_t type, const char* __restrict value)
+{
+    switch(bson_value_sizes[(unsigned char)type].kind)
+    {
+        case BSON_VALUE_SIZE_CSTRINGS:
         {
-            const char* pattern = bson_element_value(e);
+            const char* pattern = value;
             size_t pattern_len = strlen(pattern) + 1;
             const char* opts = pattern + pattern_len;
             size_t opts_len = strlen(opts) + 1;
-            size = pattern_len + opts_len;
-            break;
-        }
-            
-        case bson_type_codewscope:
-        {
-            const char* code = bson_element_value(e);
-            int32_t code_len = *(int32_t*)code;
-            const char* scope = code + sizeof(code_len) + code_len;
-            int32_t scope_len = *(int32_t*)scope;
-            size = sizeof(code_len) + code_len + sizeof(scope_len) + scope_len;
-            break;
+            return pattern_len + opts_len;
         }
             
-        case bson_type_int:
-            size = 4;
-            break;
-            
-        case bson_type_undefined:
-        case bson_type_minkey:
-        case bson_type_maxkey:
-            break;
-            
-        case bson_type_eoo:
+        case BSON_VALUE_SIZE_INVALID:
         default:
             assert(0);
-            break;
+            return 0;
     }
-    
-    return size;
 }
 
+size_t bson_element_value_size(bson_element_ref __restrict e)
+{
+    return bson_value_size(bson_element_type(e), bson_element_value(e));
+}
@@ -0,0 +1,101 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "findkey.h"
+
+#include <string.h>
+#include "cpu.h"
+
+/************************** Private find interface ****************************/
+static bson_find_key_kernel_t bson_find_key_select()
+{
+#ifdef BSON_HAVE_X86_SIMD
+    if(bson_cpu_has(BSON_CPU_AVX2))
+    {
+        return bson_find_key_avx2;
+    }
+    if(bson_cpu_has(BSON_CPU_SSE42))
+    {
+        return bson_find_key_sse42;
+    }
+#endif
+    return bson_find_key_portable;
+}
+
+/*
+ * Selected on the first call. Races are harmless: all threads select
+ * the same kernel.
+ */
+static volatile bson_find_key_kernel_t s_kernel;
+
+/*************************** Public find interface ****************************/
+const char* bson_find_key_portable(const char* data, const char* key, size_t nkey)
+{
+    const char* p = data + sizeof(int32_t);
+    while(*p != bson_type_eoo)
+    {
+        const char* k = p + 1;
+        const size_t len = strlen(k);
+        if(len == nkey && memcmp(k, key, nkey) == 0)
+        {
+            return p;
+        }
+        const char* value = k + len + 1;
+        p = value + bson_value_size(*p, value);
+    }
+    return 0;
+}
+
+bson_element_ref bson_document_find_key(bson_document_ref __restrict doc, const char* __restrict key,
+                                        size_t nkey)
+{
+    bson_find_key_kernel_t kernel = s_kernel;
+    if(!kernel)
+    {
+        kernel = bson_find_key_select();
+        s_kernel = kernel;
+    }
+    return (bson_element_ref)kernel(doc->data, key, nkey);
+}
+
+bson_element_ref bson_document_find_path(bson_document_ref __restrict doc, const char* __restrict path,
+                                         size_t npath)
+{
+    const char* end = path + npath;
+    for (;;)
+    {
+        const char* dot = memchr(path, '.', end - path);
+        const char* key_end = dot ? dot : end;
+        bson_element_ref e = bson_document_find_key(doc, path, key_end - path);
+        if(!e || !dot)
+        {
+            return e;
+        }
+        if(bson_element_type(e) != bson_type_document && bson_element_type(e) != bson_type_array)
+        {
+            return 0;
+        }
+        doc = (bson_document_ref)bson_element_value(e);
+        path = dot + 1;
+    }
+}
@@ -0,0 +1,116 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "findkey.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+/*
+ * AVX2 kernel: terminators are searched in 64 byte windows with two
+ * 32 byte compares, and candidate keys are compared 32 bytes at a time.
+ * Compiled with the matching -m flags, called only after CPU detection.
+ */
+#define WIDTH       32
+#define WINDOW      64
+
+/*
+ * Bit mask of NUL bytes among WINDOW bytes at s
+ */
+static inline uint64_t nul_mask(const char* s)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const uint64_t m0 = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)s), zero));
+    const uint64_t m1 = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(s + 32)), zero));
+    return m0 | m1 << 32;
+}
+
+const char* bson_find_key_avx2(const char* data, const char* key, size_t nkey)
+{
+    int32_t size;
+    memcpy(&size, data, sizeof(size));
+    const char* end = data + size;
+
+    /* The key padded with zeros */
+    char target[WIDTH] = { 0 };
+    memcpy(target, key, nkey < WIDTH ? nkey : WIDTH);
+    const __m256i t = _mm256_loadu_si256((const __m256i *)target);
+    const uint32_t mask = nkey >= WIDTH ? 0xffffffffu : (1u << nkey) - 1;
+
+    /*
+     * Terminators within the window at base. Key lengths are taken from
+     * the mask, so the walk does not wait for a load per element.
+     */
+    const char* base = end;
+    uint64_t nul = 0;
+
+    const char* p = data + sizeof(int32_t);
+    while(*p != bson_type_eoo)
+    {
+        const char* k = p + 1;
+        const size_t off = (size_t)(k - base);
+        uint64_t bits;
+        size_t len;
+        if(off < WINDOW && (bits = nul >> off) != 0)
+        {
+            len = __builtin_ctzll(bits);
+        }
+        else if(end - data >= WINDOW)
+        {
+            /* The last window is aligned to the end of the document */
+            base = k + WINDOW <= end ? k : end - WINDOW;
+            nul = nul_mask(base);
+            bits = nul >> (k - base);
+            len = bits ? (size_t)__builtin_ctzll(bits)
+                       : (size_t)(base + WINDOW - k) + strlen(base + WINDOW);
+        }
+        else
+        {
+            len = strlen(k);
+        }
+
+        if(__builtin_expect(len == nkey, 0))
+        {
+            int match;
+            if(k + WIDTH <= end)
+            {
+                const __m256i v = _mm256_loadu_si256((const __m256i *)k);
+                const uint32_t eq = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, t));
+                match = (eq & mask) == mask &&
+                        (nkey <= WIDTH || memcmp(k + WIDTH, key + WIDTH, nkey - WIDTH) == 0);
+            }
+            else
+            {
+                match = memcmp(k, key, nkey) == 0;
+            }
+            if(match)
+            {
+                return p;
+            }
+        }
+        const char* value = k + len + 1;
+        p = value + bson_value_size(*p, value);
+    }
+    return 0;
+}
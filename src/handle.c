@@ -0,0 +1,61 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "handle.h"
+
+#include "cpl_atomic.h"
+
+/*************************** Private interface ********************************/
+static void bson_handle_free(bson_handle_ref h)
+{
+    bson_document_destroy(h->doc);
+    free(h);
+}
+
+/*************************** Public interface *********************************/
+bson_handle_ref bson_handle_create(bson_document_ref doc)
+{
+    bson_handle_ref h = malloc(sizeof(*h));
+    if(!h)
+    {
+        bson_document_destroy(doc);
+        return 0;
+    }
+    bson_handle_init(h, doc, bson_handle_free);
+    return h;
+}
+
+bson_handle_ref bson_handle_retain(bson_handle_ref h)
+{
+    cpl_atomic_increment(&h->refs);
+    return h;
+}
+
+void bson_handle_release(bson_handle_ref h)
+{
+    /* The decrement is a full barrier, so writes of other owners are visible to destroy */
+    if(cpl_atomic_decrement(&h->refs) == 0)
+    {
+        h->destroy(h);
+    }
+}
@@ -0,0 +1,261 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "hash.h"
+
+#include <string.h>
+#include "findkey.h"
+
+static const uint64_t s_secret[4] =
+{
+    0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6dbull, 0x589965cc75374cc3ull
+};
+
+/*************************** Private interface ********************************/
+static inline uint64_t bson_hash_mix(uint64_t a, uint64_t b)
+{
+    unsigned __int128 r = (unsigned __int128)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+static inline uint64_t bson_hash_read64(const unsigned char* p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline uint64_t bson_hash_read32(const unsigned char* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+/*
+ * Classes of values in semantic mode. Other types use 0x100 + type.
+ */
+enum
+{
+    BSON_HASH_NUMBER = 1,       /* Integral value of any numeric type */
+    BSON_HASH_FRACTION,         /* Any other double, by its bits */
+    BSON_HASH_STRING,
+    BSON_HASH_DOCUMENT,
+    BSON_HASH_ARRAY,
+    BSON_HASH_NULL,
+    BSON_HASH_BOOL,
+    BSON_HASH_OTHER = 0x100
+};
+
+static inline uint64_t bson_hash_tag(uint64_t seed, unsigned tag)
+{
+    return seed ^ (tag * s_secret[3]);
+}
+
+static inline uint64_t bson_hash_word(uint64_t v, uint64_t seed)
+{
+    return bson_hash_mix(bson_hash_mix(v ^ s_secret[1], seed ^ s_secret[0]), s_secret[2] ^ v);
+}
+
+static uint64_t bson_hash_value_semantic(bson_type_t type, const char* __restrict value, uint64_t seed);
+
+static uint64_t bson_hash_document_semantic(const char* __restrict data, int is_array, uint64_t seed)
+{
+    uint64_t h = bson_hash_tag(seed, is_array ? BSON_HASH_ARRAY : BSON_HASH_DOCUMENT);
+    uint64_t count = 0;
+    const char* p = data + sizeof(int32_t);
+    while(*p != bson_type_eoo)
+    {
+        const char* key = p + 1;
+        const size_t nkey = strlen(key);
+        const char* value = key + nkey + 1;
+        /* Keys of arrays are implied by positions */
+        if(!is_array)
+        {
+            h = bson_hash_bytes(key, nkey, h);
+        }
+        h = bson_hash_value_semantic(*p, value, h);
+        p = value + bson_value_size(*p, value);
+        count++;
+    }
+    return bson_hash_word(count, h);
+}
+
+static uint64_t bson_hash_value_semantic(bson_type_t type, const char* __restrict value, uint64_t seed)
+{
+    switch(type)
+    {
+        case bson_type_int:
+        {
+            int32_t v;
+            memcpy(&v, value, sizeof(v));
+            return bson_hash_word((uint64_t)(int64_t)v, bson_hash_tag(seed, BSON_HASH_NUMBER));
+        }
+        case bson_type_long:
+        {
+            int64_t v;
+            memcpy(&v, value, sizeof(v));
+            return bson_hash_word((uint64_t)v, bson_hash_tag(seed, BSON_HASH_NUMBER));
+        }
+        case bson_type_float:
+        {
+            double d;
+            memcpy(&d, value, sizeof(d));
+            if(d >= -9223372036854775808.0 && d < 9223372036854775808.0 && (double)(int64_t)d == d)
+            {
+                /* Also maps -0.0 to 0 */
+                return bson_hash_word((uint64_t)(int64_t)d, bson_hash_tag(seed, BSON_HASH_NUMBER));
+            }
+            uint64_t bits;
+            if(d != d)
+            {
+                bits = 0x7ff8000000000000ull;
+            }
+            else
+            {
+                memcpy(&bits, &d, sizeof(bits));
+            }
+            return bson_hash_word(bits, bson_hash_tag(seed, BSON_HASH_FRACTION));
+        }
+        case bson_type_string:
+        case bson_type_symbol:
+        {
+            int32_t len;
+            memcpy(&len, value, sizeof(len));
+            return bson_hash_bytes(value + sizeof(int32_t), len - 1, bson_hash_tag(seed, BSON_HASH_STRING));
+        }
+        case bson_type_document:
+        case bson_type_array:
+            return bson_hash_document_semantic(value, type == bson_type_array, seed);
+        case bson_type_bool:
+            return bson_hash_word(*value != 0, bson_hash_tag(seed, BSON_HASH_BOOL));
+        case bson_type_eoo:
+        case bson_type_null:
+        case bson_type_undefined:
+            return bson_hash_word(0, bson_hash_tag(seed, BSON_HASH_NULL));
+        default:
+            return bson_hash_bytes(value, bson_value_size(type, value),
+                                   bson_hash_tag(seed, BSON_HASH_OTHER + (unsigned char)type));
+    }
+}
+
+/*************************** Public interface *********************************/
+uint64_t bson_hash_bytes(const void* __restrict data, size_t size, uint64_t seed)
+{
+    const unsigned char* p = (const unsigned char *)data;
+    uint64_t a, b;
+    seed ^= bson_hash_mix(seed ^ s_secret[0], s_secret[1]);
+    if(size <= 16)
+    {
+        if(size >= 4)
+        {
+            const size_t shift = (size >> 3) << 2;
+            a = (bson_hash_read32(p) << 32) | bson_hash_read32(p + shift);
+            b = (bson_hash_read32(p + size - 4) << 32) | bson_hash_read32(p + size - 4 - shift);
+        }
+        else if(size > 0)
+        {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[size >> 1] << 8) | p[size - 1];
+            b = 0;
+        }
+        else
+        {
+            a = b = 0;
+        }
+    }
+    else
+    {
+        size_t i = size;
+        if(i > 48)
+        {
+            /* Three independent lanes */
+            uint64_t see1 = seed, see2 = seed;
+            do
+            {
+                seed = bson_hash_mix(bson_hash_read64(p) ^ s_secret[1], bson_hash_read64(p + 8) ^ seed);
+                see1 = bson_hash_mix(bson_hash_read64(p + 16) ^ s_secret[2], bson_hash_read64(p + 24) ^ see1);
+                see2 = bson_hash_mix(bson_hash_read64(p + 32) ^ s_secret[3], bson_hash_read64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while(i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while(i > 16)
+        {
+            seed = bson_hash_mix(bson_hash_read64(p) ^ s_secret[1], bson_hash_read64(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = bson_hash_read64(p + i - 16);
+        b = bson_hash_read64(p + i - 8);
+    }
+    
+    a ^= s_secret[1];
+    b ^= seed;
+    unsigned __int128 r = (unsigned __int128)a * b;
+    a = (uint64_t)r;
+    b = (uint64_t)(r >> 64);
+    return bson_hash_mix(a ^ s_secret[0] ^ size, b ^ s_secret[1]);
+}
+
+uint64_t bson_hash_value(bson_type_t type, const char* __restrict value, bson_hash_mode_t mode, uint64_t seed)
+{
+    if(mode == bson_hash_semantic)
+    {
+        return bson_hash_value_semantic(type, value, seed);
+    }
+    const size_t size = type == bson_type_eoo ? 0 : bson_value_size(type, value);
+    return bson_hash_bytes(value, size, bson_hash_tag(seed, BSON_HASH_OTHER + (unsigned char)type));
+}
+
+uint64_t bson_hash_document(bson_document_ref doc, bson_hash_mode_t mode, uint64_t seed)
+{
+    if(mode == bson_hash_semantic)
+    {
+        return bson_hash_document_semantic(doc->data, 0, seed);
+    }
+    const int32_t size = bson_document_size(doc);
+    return bson_hash_bytes(doc->data, size, seed);
+}
+
+void bson_hash_path(const bson_document_ref* __restrict docs, size_t ndocs, const char* __restrict path,
+                    bson_hash_mode_t mode, uint64_t seed, uint64_t* __restrict hashes)
+{
+    const size_t npath = strlen(path);
+    const uint64_t missing = bson_hash_value(bson_type_eoo, "", mode, seed);
+    for (size_t i = 0; i < ndocs; ++i)
+    {
+        if(i + 4 < ndocs)
+        {
+            __builtin_prefetch(docs[i + 4]->data);
+        }
+        bson_element_ref e = bson_document_find_path(docs[i], path, npath);
+        hashes[i] = e ? bson_hash_value(bson_element_type(e), bson_element_value(e), mode, seed) : missing;
+    }
+}
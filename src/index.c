@@ -0,0 +1,754 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "index.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "findkey.h"
+#include "scan.h"
+
+/*************************** Private types ************************************/
+static const char s_index_magic[8] = { 'B', 'S', 'O', 'N', 'I', 'D', 'X', '1' };
+
+/*
+ * Type classes, the first byte of keys
+ */
+enum
+{
+    BSON_INDEX_MINKEY = 0x01,
+    BSON_INDEX_NULL = 0x10,
+    BSON_INDEX_NUMBER = 0x20,
+    BSON_INDEX_STRING = 0x30,
+    BSON_INDEX_DOCUMENT = 0x40,
+    BSON_INDEX_ARRAY = 0x50,
+    BSON_INDEX_BINARY = 0x60,
+    BSON_INDEX_OID = 0x70,
+    BSON_INDEX_BOOL = 0x80,
+    BSON_INDEX_DATE = 0x90,
+    BSON_INDEX_TIMESTAMP = 0xa0,
+    BSON_INDEX_REGEX = 0xb0,
+    BSON_INDEX_OTHER = 0xc0,
+    BSON_INDEX_MAXKEY = 0xff
+};
+
+/*
+ * The first page of the file
+ */
+struct bson_index_header
+{
+    char        magic[8];
+    uint32_t    page_size;
+    uint32_t    height;         /* Number of levels, including leaves */
+    uint64_t    root;           /* Page number of the root */
+    uint64_t    npages;         /* Including the header */
+    uint64_t    count;          /* Number of indexed documents */
+    char        path[BSON_INDEX_PATH_SIZE];
+};
+
+/*
+ * Slotted page. Entries are stored from the end of the page down: size of
+ * the key as uint16_t, the key, then document offset in leaves or child
+ * page number in branches as uint64_t. Every branch entry holds the first
+ * key of its child.
+ */
+struct bson_index_page
+{
+    uint8_t     leaf;
+    uint8_t     reserved;
+    uint16_t    count;
+    uint32_t    reserved2;
+    uint64_t    next;           /* Next leaf or 0 */
+    uint16_t    slots[];        /* Offsets of entries in key order */
+};
+
+#define BSON_INDEX_MAX_HEIGHT       16
+
+struct bson_index
+{
+    const char*                         map;
+    size_t                              size;
+    const struct bson_index_header*     header;
+};
+
+/*
+ * Key of a document while building
+ */
+struct bson_index_entry
+{
+    uint64_t    prefix;         /* First bytes of the key as big-endian number */
+    const char* key;
+    uint64_t    offset;
+    uint32_t    nkey;
+};
+
+struct bson_index_level
+{
+    struct bson_index_page* page;
+    uint64_t    number;         /* Page number of the page being filled */
+    uint32_t    free_end;       /* Entries start here */
+    uint64_t    npages;         /* Pages written */
+    uint32_t    nfirst;
+    char        first[BSON_INDEX_KEY_SIZE];
+};
+
+struct bson_index_builder
+{
+    int         fd;
+    uint64_t    next_page;
+    uint32_t    height;
+    struct bson_index_level levels[BSON_INDEX_MAX_HEIGHT];
+};
+
+/*************************** Private interface ********************************/
+static inline int bson_index_compare(const char* a, size_t na, const char* b, size_t nb)
+{
+    const int r = memcmp(a, b, na < nb ? na : nb);
+    return r ? r : (na > nb) - (na < nb);
+}
+
+static inline void bson_index_put64(char* p, uint64_t v)
+{
+    for (int i = 7; i >= 0; --i)
+    {
+        p[i] = (char)v;
+        v >>= 8;
+    }
+}
+
+static size_t bson_index_key_number(double d, int64_t residual, char* __restrict key)
+{
+    uint64_t bits = 0;
+    if(d == d)
+    {
+        /* -0.0 is 0, then flip the sign bit of positives and all bits of negatives */
+        d = d == 0 ? 0.0 : d;
+        memcpy(&bits, &d, sizeof(bits));
+        bits = bits >> 63 ? ~bits : bits | 0x8000000000000000ull;
+    }
+    key[0] = BSON_INDEX_NUMBER;
+    bson_index_put64(key + 1, bits);
+    bson_index_put64(key + 9, (uint64_t)residual ^ 0x8000000000000000ull);
+    return 17;
+}
+
+/* Key of int64 is its nearest double and the difference */
+static size_t bson_index_key_long(int64_t v, char* __restrict key)
+{
+    const double d = (double)v;
+    return bson_index_key_number(d, (int64_t)((__int128)v - (__int128)d), key);
+}
+
+static size_t bson_index_key_bytes(int tag, const char* __restrict data, size_t size, char* __restrict key)
+{
+    if(size + 1 > BSON_INDEX_KEY_SIZE)
+    {
+        return 0;
+    }
+    key[0] = (char)tag;
+    memcpy(key + 1, data, size);
+    return size + 1;
+}
+
+static inline const char* bson_index_page_at(bson_index_ref idx, uint64_t n)
+{
+    return idx->map + n * BSON_INDEX_PAGE_SIZE;
+}
+
+static inline const char* bson_index_entry_key(const char* page, unsigned slot, size_t* __restrict nkey)
+{
+    const char* e = page + ((const struct bson_index_page *)page)->slots[slot];
+    uint16_t n;
+    memcpy(&n, e, sizeof(n));
+    *nkey = n;
+    return e + sizeof(n);
+}
+
+static inline uint64_t bson_index_entry_value(const char* key, size_t nkey)
+{
+    uint64_t v;
+    memcpy(&v, key + nkey, sizeof(v));
+    return v;
+}
+
+static int bson_index_entry_less(const struct bson_index_entry* a, const struct bson_index_entry* b)
+{
+    if(a->prefix != b->prefix)
+    {
+        return a->prefix < b->prefix;
+    }
+    const int r = bson_index_compare(a->key, a->nkey, b->key, b->nkey);
+    return r < 0 || (r == 0 && a->offset < b->offset);
+}
+
+static int bson_index_entry_cmp(const void* a, const void* b)
+{
+    const struct bson_index_entry* x = (const struct bson_index_entry *)a;
+    const struct bson_index_entry* y = (const struct bson_index_entry *)b;
+    return bson_index_entry_less(x, y) ? -1 : bson_index_entry_less(y, x);
+}
+
+static int bson_index_pwrite(int fd, const void* data, size_t size, uint64_t offset)
+{
+    const char* p = (const char *)data;
+    while(size)
+    {
+        ssize_t n = pwrite(fd, p, size, (off_t)offset);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return 1;
+        }
+        p += n;
+        size -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+static void bson_index_level_reset(struct bson_index_level* __restrict l, int leaf, uint64_t number)
+{
+    memset(l->page, 0, BSON_INDEX_PAGE_SIZE);
+    l->page->leaf = (uint8_t)leaf;
+    l->number = number;
+    l->free_end = BSON_INDEX_PAGE_SIZE;
+}
+
+static int bson_index_builder_add(struct bson_index_builder* __restrict b, uint32_t level,
+                                  const char* __restrict key, size_t nkey, uint64_t value);
+
+/* Writes the page of the level and adds it to its parent */
+static int bson_index_builder_flush(struct bson_index_builder* __restrict b, uint32_t level, uint64_t next)
+{
+    struct bson_index_level* l = &b->levels[level];
+    l->page->next = next;
+    if(bson_index_pwrite(b->fd, l->page, BSON_INDEX_PAGE_SIZE, l->number * BSON_INDEX_PAGE_SIZE))
+    {
+        return 1;
+    }
+    l->npages++;
+    return bson_index_builder_add(b, level + 1, l->first, l->nfirst, l->number);
+}
+
+/* Adds level above the others with an empty page */
+static int bson_index_builder_grow(struct bson_index_builder* __restrict b)
+{
+    if(b->height == BSON_INDEX_MAX_HEIGHT)
+    {
+        return 1;
+    }
+    struct bson_index_level* l = &b->levels[b->height];
+    l->page = malloc(BSON_INDEX_PAGE_SIZE);
+    if(!l->page)
+    {
+        return 1;
+    }
+    bson_index_level_reset(l, b->height == 0, b->next_page++);
+    l->npages = 0;
+    b->height++;
+    return 0;
+}
+
+static int bson_index_builder_add(struct bson_index_builder* __restrict b, uint32_t level,
+                                  const char* __restrict key, size_t nkey, uint64_t value)
+{
+    if(level == b->height && bson_index_builder_grow(b))
+    {
+        return 1;
+    }
+    
+    struct bson_index_level* l = &b->levels[level];
+    const size_t size = sizeof(uint16_t) + nkey + sizeof(uint64_t);
+    const size_t used = sizeof(struct bson_index_page) + (l->page->count + 1) * sizeof(uint16_t);
+    if(l->page->count && used + size > l->free_end)
+    {
+        /* Leaves are chained, so the next one gets its number now */
+        const uint64_t number = b->next_page++;
+        if(bson_index_builder_flush(b, level, level == 0 ? number : 0))
+        {
+            return 1;
+        }
+        bson_index_level_reset(l, level == 0, number);
+    }
+    
+    if(!l->page->count)
+    {
+        memcpy(l->first, key, nkey);
+        l->nfirst = (uint32_t)nkey;
+    }
+    
+    char* p = (char *)l->page;
+    const uint16_t n = (uint16_t)nkey;
+    l->free_end -= size;
+    memcpy(p + l->free_end, &n, sizeof(n));
+    memcpy(p + l->free_end + sizeof(n), key, nkey);
+    memcpy(p + l->free_end + sizeof(n) + nkey, &value, sizeof(value));
+    l->page->slots[l->page->count++] = (uint16_t)l->free_end;
+    return 0;
+}
+
+/* Writes pending pages of every level, the top one is the root */
+static int bson_index_builder_finish(struct bson_index_builder* __restrict b, uint64_t* __restrict root)
+{
+    for (uint32_t level = 0; level < b->height; ++level)
+    {
+        struct bson_index_level* l = &b->levels[level];
+        if(level + 1 == b->height && l->npages == 0)
+        {
+            *root = l->number;
+            l->page->next = 0;
+            return bson_index_pwrite(b->fd, l->page, BSON_INDEX_PAGE_SIZE, l->number * BSON_INDEX_PAGE_SIZE);
+        }
+        if(bson_index_builder_flush(b, level, 0))
+        {
+            return 1;
+        }
+    }
+    return 1;
+}
+
+/* Sifts down the run at the node of the heap of runs ordered by their heads */
+static void bson_index_heap_down(size_t* __restrict heap, size_t n, size_t i,
+                                 const struct bson_index_entry* entries, const size_t* __restrict heads)
+{
+    for (;;)
+    {
+        size_t m = i, l = 2 * i + 1, r = l + 1;
+        if(l < n && bson_index_entry_less(&entries[heads[heap[l]]], &entries[heads[heap[m]]]))
+        {
+            m = l;
+        }
+        if(r < n && bson_index_entry_less(&entries[heads[heap[r]]], &entries[heads[heap[m]]]))
+        {
+            m = r;
+        }
+        if(m == i)
+        {
+            return;
+        }
+        const size_t t = heap[i];
+        heap[i] = heap[m];
+        heap[m] = t;
+        i = m;
+    }
+}
+
+/* Merges sorted runs of entries into the leaves */
+static int bson_index_merge(struct bson_index_builder* __restrict b, const struct bson_index_entry* entries,
+                            size_t n)
+{
+    const size_t nruns = (n + BSON_INDEX_RUN_SIZE - 1) / BSON_INDEX_RUN_SIZE;
+    size_t* heads = malloc(nruns * 2 * sizeof(size_t) + 1);
+    if(!heads)
+    {
+        return 1;
+    }
+    size_t* heap = heads + nruns;
+    for (size_t r = 0; r < nruns; ++r)
+    {
+        heads[r] = r * BSON_INDEX_RUN_SIZE;
+        heap[r] = r;
+    }
+    
+    size_t nheap = nruns;
+    for (size_t i = nheap / 2; i-- > 0; )
+    {
+        bson_index_heap_down(heap, nheap, i, entries, heads);
+    }
+    
+    int rc = 0;
+    while(nheap && !rc)
+    {
+        const size_t r = heap[0];
+        const struct bson_index_entry* e = &entries[heads[r]++];
+        rc = bson_index_builder_add(b, 0, e->key, e->nkey, e->offset);
+        
+        const size_t end = r + 1 == nruns ? n : (r + 1) * BSON_INDEX_RUN_SIZE;
+        if(heads[r] == end)
+        {
+            heap[0] = heap[--nheap];
+        }
+        bson_index_heap_down(heap, nheap, 0, entries, heads);
+    }
+    free(heads);
+    return rc;
+}
+
+/*************************** Public interface *********************************/
+size_t bson_index_key(bson_type_t type, const char* __restrict value, char* __restrict key)
+{
+    switch(type)
+    {
+        case bson_type_minkey:
+            key[0] = (char)BSON_INDEX_MINKEY;
+            return 1;
+        case bson_type_maxkey:
+            key[0] = (char)BSON_INDEX_MAXKEY;
+            return 1;
+        case bson_type_eoo:
+        case bson_type_null:
+        case bson_type_undefined:
+            key[0] = BSON_INDEX_NULL;
+            return 1;
+        case bson_type_int:
+        {
+            int32_t v;
+            memcpy(&v, value, sizeof(v));
+            return bson_index_key_long(v, key);
+        }
+        case bson_type_long:
+        {
+            int64_t v;
+            memcpy(&v, value, sizeof(v));
+            return bson_index_key_long(v, key);
+        }
+        case bson_type_float:
+        {
+            /* Integral doubles are exact, so their difference is 0 */
+            double d;
+            memcpy(&d, value, sizeof(d));
+            return bson_index_key_number(d, 0, key);
+        }
+        case bson_type_string:
+        case bson_type_symbol:
+        {
+            int32_t len;
+            memcpy(&len, value, sizeof(len));
+            return bson_index_key_bytes(BSON_INDEX_STRING, value + sizeof(int32_t), len - 1, key);
+        }
+        case bson_type_document:
+        case bson_type_array:
+        case bson_type_bindata:
+        case bson_type_regex:
+        {
+            const int tag = type == bson_type_document ? BSON_INDEX_DOCUMENT :
+                            type == bson_type_array ? BSON_INDEX_ARRAY :
+                            type == bson_type_bindata ? BSON_INDEX_BINARY : BSON_INDEX_REGEX;
+            return bson_index_key_bytes(tag, value, bson_value_size(type, value), key);
+        }
+        case bson_type_oid:
+            return bson_index_key_bytes(BSON_INDEX_OID, value, 12, key);
+        case bson_type_bool:
+            key[0] = (char)BSON_INDEX_BOOL;
+            key[1] = *value != 0;
+            return 2;
+        case bson_type_date:
+        {
+            int64_t v;
+            memcpy(&v, value, sizeof(v));
+            key[0] = (char)BSON_INDEX_DATE;
+            bson_index_put64(key + 1, (uint64_t)v ^ 0x8000000000000000ull);
+            return 9;
+        }
+        case bson_type_timestamp:
+        {
+            uint64_t v;
+            memcpy(&v, value, sizeof(v));
+            key[0] = (char)BSON_INDEX_TIMESTAMP;
+            bson_index_put64(key + 1, v);
+            return 9;
+        }
+        default:
+        {
+            const size_t size = bson_value_size(type, value);
+            if(size + 2 > BSON_INDEX_KEY_SIZE)
+            {
+                return 0;
+            }
+            key[0] = (char)BSON_INDEX_OTHER;
+            key[1] = type;
+            memcpy(key + 2, value, size);
+            return size + 2;
+        }
+    }
+}
+
+int bson_index_build(int fd, const char* __restrict data, size_t size, const char* __restrict path)
+{
+    const size_t npath = strlen(path);
+    if(npath >= BSON_INDEX_PATH_SIZE)
+    {
+        return 1;
+    }
+    
+    bson_document_ref* docs;
+    size_t ndocs;
+    if(bson_scan_index_buffer(data, size, &docs, &ndocs))
+    {
+        return 1;
+    }
+    
+    /* Keys of all documents, then sorted runs of them */
+    int rc = 1;
+    char* arena = 0;
+    size_t arena_size = 0, arena_alloced = 0;
+    struct bson_index_entry* entries = malloc(ndocs * sizeof(*entries) + 1);
+    struct bson_index_builder b;
+    memset(&b, 0, sizeof(b));
+    if(!entries)
+    {
+        goto done;
+    }
+    
+    for (size_t i = 0; i < ndocs; ++i)
+    {
+        if(arena_size + BSON_INDEX_KEY_SIZE > arena_alloced)
+        {
+            size_t n = arena_alloced ? arena_alloced * 2 : 64 * 1024;
+            char* p = realloc(arena, n);
+            if(!p)
+            {
+                goto done;
+            }
+            arena = p;
+            arena_alloced = n;
+        }
+        bson_element_ref e = bson_document_find_path(docs[i], path, npath);
+        const size_t nkey = e ? bson_index_key(bson_element_type(e), bson_element_value(e), arena + arena_size)
+                              : bson_index_key(bson_type_eoo, "", arena + arena_size);
+        if(!nkey)
+        {
+            goto done;
+        }
+        entries[i].key = (const char *)(uintptr_t)arena_size;
+        entries[i].nkey = (uint32_t)nkey;
+        entries[i].offset = (uint64_t)(docs[i]->data - data);
+        arena_size += nkey;
+    }
+    
+    for (size_t i = 0; i < ndocs; ++i)
+    {
+        unsigned char prefix[8] = { 0 };
+        entries[i].key = arena + (uintptr_t)entries[i].key;
+        memcpy(prefix, entries[i].key, entries[i].nkey < 8 ? entries[i].nkey : 8);
+        entries[i].prefix = 0;
+        for (int k = 0; k < 8; ++k)
+        {
+            entries[i].prefix = (entries[i].prefix << 8) | prefix[k];
+        }
+    }
+    for (size_t i = 0; i < ndocs; i += BSON_INDEX_RUN_SIZE)
+    {
+        const size_t n = ndocs - i < BSON_INDEX_RUN_SIZE ? ndocs - i : BSON_INDEX_RUN_SIZE;
+        qsort(entries + i, n, sizeof(*entries), bson_index_entry_cmp);
+    }
+    
+    /* Leaves from the merged runs, branches above them as pages fill */
+    uint64_t root;
+    b.fd = fd;
+    b.next_page = 1;
+    if(bson_index_builder_grow(&b) || bson_index_merge(&b, entries, ndocs) || bson_index_builder_finish(&b, &root))
+    {
+        goto done;
+    }
+    
+    struct bson_index_header* h = calloc(1, BSON_INDEX_PAGE_SIZE);
+    if(!h)
+    {
+        goto done;
+    }
+    memcpy(h->magic, s_index_magic, sizeof(s_index_magic));
+    h->page_size = BSON_INDEX_PAGE_SIZE;
+    h->height = b.height;
+    h->root = root;
+    h->npages = b.next_page;
+    h->count = ndocs;
+    memcpy(h->path, path, npath + 1);
+    rc = bson_index_pwrite(fd, h, BSON_INDEX_PAGE_SIZE, 0) || ftruncate(fd, (off_t)(b.next_page * BSON_INDEX_PAGE_SIZE));
+    free(h);
+    
+done:
+    for (uint32_t level = 0; level < b.height; ++level)
+    {
+        free(b.levels[level].page);
+    }
+    free(arena);
+    free(entries);
+    free(docs);
+    return rc;
+}
+
+bson_index_ref bson_index_open(int fd)
+{
+    struct stat st;
+    if(fstat(fd, &st) || (size_t)st.st_size < BSON_INDEX_PAGE_SIZE)
+    {
+        return 0;
+    }
+    
+    void* map = mmap(0, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED)
+    {
+        return 0;
+    }
+    
+    const struct bson_index_header* h = (const struct bson_index_header *)map;
+    bson_index_ref idx = 0;
+    if(memcmp(h->magic, s_index_magic, sizeof(s_index_magic)) == 0 &&
+       h->page_size == BSON_INDEX_PAGE_SIZE &&
+       h->npages <= (uint64_t)st.st_size / BSON_INDEX_PAGE_SIZE &&
+       h->root > 0 && h->root < h->npages &&
+       memchr(h->path, 0, BSON_INDEX_PATH_SIZE))
+    {
+        idx = malloc(sizeof(*idx));
+    }
+    if(!idx)
+    {
+        munmap(map, (size_t)st.st_size);
+        return 0;
+    }
+    
+    idx->map = (const char *)map;
+    idx->size = (size_t)st.st_size;
+    idx->header = h;
+    return idx;
+}
+
+void bson_index_close(bson_index_ref idx)
+{
+    munmap((void *)idx->map, idx->size);
+    free(idx);
+}
+
+const char* bson_index_path(bson_index_ref idx)
+{
+    return idx->header->path;
+}
+
+uint64_t bson_index_count(bson_index_ref idx)
+{
+    return idx->header->count;
+}
+
+void bson_index_range(bson_index_ref __restrict idx, const char* __restrict low, size_t nlow,
+                      const char* __restrict high, size_t nhigh, bson_index_cursor_ref __restrict c)
+{
+    uint64_t number = idx->header->root;
+    const char* page = bson_index_page_at(idx, number);
+    size_t nkey;
+    
+    /* Child with the last first key less than low, where the first equal key may be */
+    while(!((const struct bson_index_page *)page)->leaf)
+    {
+        unsigned slot = 0;
+        if(low)
+        {
+            unsigned l = 0, r = ((const struct bson_index_page *)page)->count;
+            while(l < r)
+            {
+                const unsigned m = (l + r) / 2;
+                const char* key = bson_index_entry_key(page, m, &nkey);
+                if(bson_index_compare(key, nkey, low, nlow) < 0)
+                {
+                    l = m + 1;
+                }
+                else
+                {
+                    r = m;
+                }
+            }
+            slot = l ? l - 1 : 0;
+        }
+        const char* key = bson_index_entry_key(page, slot, &nkey);
+        number = bson_index_entry_value(key, nkey);
+        page = bson_index_page_at(idx, number);
+    }
+    
+    /* First entry not less than low. It may be in the next leaf. */
+    unsigned l = 0;
+    if(low)
+    {
+        unsigned r = ((const struct bson_index_page *)page)->count;
+        while(l < r)
+        {
+            const unsigned m = (l + r) / 2;
+            const char* key = bson_index_entry_key(page, m, &nkey);
+            if(bson_index_compare(key, nkey, low, nlow) < 0)
+            {
+                l = m + 1;
+            }
+            else
+            {
+                r = m;
+            }
+        }
+    }
+    
+    c->idx = idx;
+    c->page = number;
+    c->slot = l;
+    c->has_high = high != 0;
+    c->nhigh = high ? (uint32_t)nhigh : 0;
+    if(high)
+    {
+        memcpy(c->high, high, nhigh);
+    }
+}
+
+int bson_index_find(bson_index_ref __restrict idx, bson_type_t type, const char* __restrict value,
+                    bson_index_cursor_ref __restrict c)
+{
+    char key[BSON_INDEX_KEY_SIZE];
+    const size_t nkey = bson_index_key(type, value, key);
+    if(!nkey)
+    {
+        c->idx = idx;
+        c->page = 0;
+        return 1;
+    }
+    bson_index_range(idx, key, nkey, key, nkey, c);
+    return 0;
+}
+
+int bson_index_cursor_next(bson_index_cursor_ref __restrict c, uint64_t* __restrict offset)
+{
+    while(c->page)
+    {
+        const char* page = bson_index_page_at(c->idx, c->page);
+        const struct bson_index_page* p = (const struct bson_index_page *)page;
+        if(c->slot >= p->count)
+        {
+            c->page = p->next;
+            c->slot = 0;
+            continue;
+        }
+        
+        size_t nkey;
+        const char* key = bson_index_entry_key(page, c->slot, &nkey);
+        if(c->has_high && bson_index_compare(key, nkey, c->high, c->nhigh) > 0)
+        {
+            c->page = 0;
+            return 0;
+        }
+        *offset = bson_index_entry_value(key, nkey);
+        c->slot++;
+        return 1;
+    }
+    return 0;
+}
@@ -26,43 +26,14 @@
 
 extern inline int bson_iterator_end(bson_iterator_ref __restrict i);
 extern inline bson_element_ref bson_iterator_init(bson_iterator_ref __restrict i, bson_document_ref doc);
+extern inline const char* bson_iterator_step(bson_iterator_ref __restrict i);
+extern inline bson_element_ref bson_iterator_next(bson_iterator_ref __restrict i);
 
+/*********************** Public iterator interface ****************************/
 void bson_iterator_next_el(bson_iterator_ref __restrict i, bson_element_ref* e)
 {
     if(i->next_off == 0)
         return ;
     
-    i->curr_off = i->next_off;
-    
-    *e = (bson_element_ref)(i->d->data + i->curr_off);
-    
-    if(bson_element_type(*e) == bson_type_eoo)
-    {
-        i->next_off = 0;
-    }
-    else
-    {
-        i->next_off = i->curr_off + bson_element_size(*e);
-    }
+    *e = (bson_element_ref)bson_iterator_step(i);
 }
-
-bson_element_ref bson_iterator_next(bson_iterator_ref __restrict i)
-{
-    if(i->next_off == 0)
-        return 0;
-    
-    i->curr_off = i->next_off;
-    
-    bson_element_ref el = bson_element_create_with_data(i->d->data + i->curr_off);
-    
-    if(bson_element_type(el) == bson_type_eoo)
-    {
-        i->next_off = 0;
-    }
-    else
-    {
-        i->next_off = i->curr_off + bson_element_size(el);
-    }
-    
-    return el;
-}
\ No newline at end of file
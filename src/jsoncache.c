@@ -0,0 +1,319 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "jsoncache.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+#include "hash.h"
+#include "jsonparser.h"
+
+/*************************** Private types ************************************/
+/*
+ * Entry is a single allocation: header, document, then the input
+ */
+struct bson_json_cache_entry
+{
+    struct bson_json_cache_entry*   chain;      /* Next entry of the bucket */
+    struct bson_json_cache_entry*   prev;       /* LRU list, most recent first */
+    struct bson_json_cache_entry*   next;
+    uint64_t                        hash;
+    size_t                          nlength;    /* Size of the input */
+    size_t                          size;       /* Size of the allocation */
+    bson_handle_t                   handle;     /* The cache holds a reference while linked */
+    char                            data[];     /* Document, then the input */
+};
+
+struct bson_json_cache_stripe
+{
+    pthread_mutex_t                 mutex;
+    struct bson_json_cache_entry**  buckets;
+    size_t                          mask;
+    struct bson_json_cache_entry*   head;
+    struct bson_json_cache_entry*   tail;
+    size_t                          count;
+    size_t                          bytes;
+    size_t                          max_bytes;
+    uint64_t                        hits;
+    uint64_t                        misses;
+    uint64_t                        evictions;
+} __attribute__((aligned(64)));
+
+struct bson_json_cache
+{
+    struct bson_json_cache_stripe   stripes[BSON_JSON_CACHE_STRIPES];
+};
+
+#define BSON_JSON_CACHE_BUCKETS     16
+
+/* Stripes are selected by the high bits of the hash */
+typedef char bson_json_cache_stripes_power_of_two
+    [BSON_JSON_CACHE_STRIPES > 0 && (BSON_JSON_CACHE_STRIPES & (BSON_JSON_CACHE_STRIPES - 1)) == 0 ? 1 : -1];
+#define BSON_JSON_CACHE_STRIPE_BITS (__builtin_ctzll(BSON_JSON_CACHE_STRIPES))
+
+/*************************** Private interface ********************************/
+static inline bson_document_ref bson_json_cache_document(struct bson_json_cache_entry* e)
+{
+    return (bson_document_ref)e->data;
+}
+
+/* Destroy callback of the handle: the document lives in the entry */
+static void bson_json_cache_free(bson_handle_ref h)
+{
+    free((char *)h - offsetof(struct bson_json_cache_entry, handle));
+}
+
+static struct bson_json_cache_entry* bson_json_cache_find(struct bson_json_cache_stripe* __restrict s,
+                                                          uint64_t hash, const char* __restrict json,
+                                                          size_t nlength)
+{
+    struct bson_json_cache_entry* e = s->buckets[hash & s->mask];
+    for (; e; e = e->chain)
+    {
+        if(e->hash == hash && e->nlength == nlength)
+        {
+            bson_document_ref doc = bson_json_cache_document(e);
+            int32_t size = bson_document_size(doc);
+            if(memcmp(e->data + size, json, nlength) == 0)
+            {
+                break;
+            }
+        }
+    }
+    return e;
+}
+
+static void bson_json_cache_lru_unlink(struct bson_json_cache_stripe* __restrict s,
+                                       struct bson_json_cache_entry* __restrict e)
+{
+    *(e->prev ? &e->prev->next : &s->head) = e->next;
+    *(e->next ? &e->next->prev : &s->tail) = e->prev;
+}
+
+static void bson_json_cache_lru_push(struct bson_json_cache_stripe* __restrict s,
+                                     struct bson_json_cache_entry* __restrict e)
+{
+    e->prev = 0;
+    e->next = s->head;
+    *(s->head ? &s->head->prev : &s->tail) = e;
+    s->head = e;
+}
+
+/* Returns the entry to the caller with a new reference */
+static bson_handle_ref bson_json_cache_hit(struct bson_json_cache_stripe* __restrict s,
+                                             struct bson_json_cache_entry* __restrict e)
+{
+    if(s->head != e)
+    {
+        bson_json_cache_lru_unlink(s, e);
+        bson_json_cache_lru_push(s, e);
+    }
+    return bson_handle_retain(&e->handle);
+}
+
+static void bson_json_cache_evict(struct bson_json_cache_stripe* __restrict s,
+                                  struct bson_json_cache_entry* __restrict e)
+{
+    struct bson_json_cache_entry** p = &s->buckets[e->hash & s->mask];
+    while(*p != e)
+    {
+        p = &(*p)->chain;
+    }
+    *p = e->chain;
+    bson_json_cache_lru_unlink(s, e);
+    s->count--;
+    s->bytes -= e->size;
+    bson_handle_release(&e->handle);
+}
+
+/* Doubles the number of buckets. Longer chains are fine if out of memory. */
+static void bson_json_cache_grow(struct bson_json_cache_stripe* s)
+{
+    const size_t nbuckets = (s->mask + 1) * 2;
+    struct bson_json_cache_entry** buckets = calloc(nbuckets, sizeof(*buckets));
+    if(!buckets)
+    {
+        return;
+    }
+    
+    for (size_t i = 0; i <= s->mask; ++i)
+    {
+        struct bson_json_cache_entry* e = s->buckets[i];
+        while(e)
+        {
+            struct bson_json_cache_entry* chain = e->chain;
+            e->chain = buckets[e->hash & (nbuckets - 1)];
+            buckets[e->hash & (nbuckets - 1)] = e;
+            e = chain;
+        }
+    }
+    free(s->buckets);
+    s->buckets = buckets;
+    s->mask = nbuckets - 1;
+}
+
+/*************************** Public interface *********************************/
+bson_json_cache_ref bson_json_cache_create(size_t max_bytes)
+{
+    bson_json_cache_ref cache = 0;
+    if(posix_memalign((void **)&cache, 64, sizeof(*cache)))
+    {
+        return 0;
+    }
+    
+    memset(cache, 0, sizeof(*cache));
+    for (int i = 0; i < BSON_JSON_CACHE_STRIPES; ++i)
+    {
+        struct bson_json_cache_stripe* s = &cache->stripes[i];
+        s->buckets = calloc(BSON_JSON_CACHE_BUCKETS, sizeof(*s->buckets));
+        if(!s->buckets)
+        {
+            while(i--)
+            {
+                pthread_mutex_destroy(&cache->stripes[i].mutex);
+                free(cache->stripes[i].buckets);
+            }
+            free(cache);
+            return 0;
+        }
+        s->mask = BSON_JSON_CACHE_BUCKETS - 1;
+        s->max_bytes = max_bytes / BSON_JSON_CACHE_STRIPES;
+        pthread_mutex_init(&s->mutex, 0);
+    }
+    return cache;
+}
+
+void bson_json_cache_destroy(bson_json_cache_ref cache)
+{
+    for (int i = 0; i < BSON_JSON_CACHE_STRIPES; ++i)
+    {
+        struct bson_json_cache_stripe* s = &cache->stripes[i];
+        while(s->head)
+        {
+            struct bson_json_cache_entry* e = s->head;
+            s->head = e->next;
+            bson_handle_release(&e->handle);
+        }
+        pthread_mutex_destroy(&s->mutex);
+        free(s->buckets);
+    }
+    free(cache);
+}
+
+bson_handle_ref bson_json_cache_get(bson_json_cache_ref __restrict cache, const char* __restrict json,
+                                    size_t nlength)
+{
+    const uint64_t hash = bson_hash_bytes(json, nlength, BSON_HASH_SEED);
+    /* Low bits select the bucket, so take the stripe from the high ones.
+       Shifting in two steps keeps a single stripe well-defined */
+    struct bson_json_cache_stripe* s = &cache->stripes[hash >> 1 >> (63 - BSON_JSON_CACHE_STRIPE_BITS)];
+    
+    pthread_mutex_lock(&s->mutex);
+    struct bson_json_cache_entry* e = bson_json_cache_find(s, hash, json, nlength);
+    if(e)
+    {
+        s->hits++;
+        bson_handle_ref h = bson_json_cache_hit(s, e);
+        pthread_mutex_unlock(&s->mutex);
+        return h;
+    }
+    s->misses++;
+    pthread_mutex_unlock(&s->mutex);
+    
+    /* Parse without the lock */
+    bson_document_ref parsed = json2bson(json, nlength);
+    if(!parsed)
+    {
+        return 0;
+    }
+    
+    const int32_t size = bson_document_size(parsed);
+    const size_t nalloc = offsetof(struct bson_json_cache_entry, data) + size + nlength;
+    e = malloc(nalloc);
+    if(!e)
+    {
+        bson_document_destroy(parsed);
+        return 0;
+    }
+    e->hash = hash;
+    e->nlength = nlength;
+    e->size = nalloc;
+    bson_handle_init(&e->handle, bson_json_cache_document(e), bson_json_cache_free);
+    memcpy(e->data, parsed->data, size);
+    memcpy(e->data + size, json, nlength);
+    bson_document_destroy(parsed);
+    
+    if(nalloc > s->max_bytes)
+    {
+        /* Never fits, the caller is the only owner */
+        return &e->handle;
+    }
+    
+    pthread_mutex_lock(&s->mutex);
+    struct bson_json_cache_entry* other = bson_json_cache_find(s, hash, json, nlength);
+    if(other)
+    {
+        /* Lost the race with another thread parsing the same input */
+        bson_handle_ref h = bson_json_cache_hit(s, other);
+        pthread_mutex_unlock(&s->mutex);
+        free(e);
+        return h;
+    }
+    
+    while(s->bytes + nalloc > s->max_bytes)
+    {
+        bson_json_cache_evict(s, s->tail);
+        s->evictions++;
+    }
+    
+    if(s->count > s->mask)
+    {
+        bson_json_cache_grow(s);
+    }
+    /* One reference for the cache, one for the caller */
+    bson_handle_retain(&e->handle);
+    e->chain = s->buckets[hash & s->mask];
+    s->buckets[hash & s->mask] = e;
+    bson_json_cache_lru_push(s, e);
+    s->count++;
+    s->bytes += nalloc;
+    pthread_mutex_unlock(&s->mutex);
+    return &e->handle;
+}
+
+void bson_json_cache_stats(bson_json_cache_ref __restrict cache, struct bson_json_cache_stats* __restrict stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    for (int i = 0; i < BSON_JSON_CACHE_STRIPES; ++i)
+    {
+        struct bson_json_cache_stripe* s = &cache->stripes[i];
+        pthread_mutex_lock(&s->mutex);
+        stats->hits += s->hits;
+        stats->misses += s->misses;
+        stats->evictions += s->evictions;
+        stats->entries += s->count;
+        stats->bytes += s->bytes;
+        pthread_mutex_unlock(&s->mutex);
+    }
+}
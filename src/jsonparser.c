@@ -26,12 +26,17 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
 #include <ctype.h>
 
 // For debug purpose only
 #include <stdarg.h>
 
+#include "decimal128.h"
 #include "documentbuilder.h"
+#include "stats.h"
 #include <cpl/cpl_array.h>
 
 enum json_parser_lexems
@@ -58,7 +63,12 @@ enum json_parser_tokens
     JT_OID,
     JT_KEY,
     JT_FALSE,
-    JT_TRUE
+    JT_TRUE,
+    JT_LONG,        /* {"$numberLong": "..."} */
+    JT_DATE,        /* {"$date": ...} */
+    JT_BINARY,      /* {"$binary": {"base64": "...", "subType": "..."}} */
+    JT_REGEX,       /* {"$regularExpression": {"pattern": "...", "options": "..."}} */
+    JT_DECIMAL      /* {"$numberDecimal": "..."} */
 };
 
 struct json_token
@@ -66,12 +76,17 @@ struct json_token
     enum json_parser_tokens type;
     const char *start;
     size_t length;
+    const char *start2;     /* Options of regex */
+    size_t length2;
     union
     {
         int has_escape;
         long ivalue;
         double fvalue;
         bson_oid_t oid;
+        int64_t lvalue;     /* Long and date */
+        int subtype;        /* Binary, its base64 text is start and length */
+        bson_decimal128_t dec;
     };
 };
 
@@ -83,6 +98,7 @@ struct json_parser
     const char  *end;
     struct json_token last_token;
     struct json_token key_token;
+    int depth;              /* Nesting of objects and arrays */
 };
 
 static void json_parser_colon(struct json_parser* parser)
@@ -91,16 +107,68 @@ static void json_parser_colon(struct json_parser* parser)
     parser->key_token.type = JT_KEY;
 }
 
+static size_t json_base64_decode(const char* s, size_t n, unsigned char* out);
+
+/*
+ * Decodes base64 text of binary token
+ * @return buffer to free
+ */
+static unsigned char* json_token_binary(struct json_token* token, int32_t* size)
+{
+    unsigned char* data = (unsigned char *)malloc(token->length / 4 * 3 + 1);
+    BSON_STATS_INC(BSON_STATS_ALLOCATIONS);
+    *size = (int32_t)json_base64_decode(token->start, token->length, data);
+    return data;
+}
+
+/*
+ * Copies pattern and options of regex token. Options are sorted as BSON requires.
+ * @return buffer to free, holding both strings
+ */
+static char* json_token_regex(struct json_token* token, const char** options)
+{
+    char* pattern = (char *)malloc(token->length + token->length2 + 2);
+    BSON_STATS_INC(BSON_STATS_ALLOCATIONS);
+    BSON_STATS_INC(BSON_STATS_JSON_COPIES);
+    BSON_STATS_ADD(BSON_STATS_JSON_COPY_BYTES, token->length + token->length2);
+    
+    memcpy(pattern, token->start, token->length);
+    pattern[token->length] = '\0';
+    
+    char* opts = pattern + token->length + 1;
+    memcpy(opts, token->start2, token->length2);
+    opts[token->length2] = '\0';
+    for (size_t i = 1; i < token->length2; ++i)
+    {
+        char c = opts[i];
+        size_t j = i;
+        for (; j > 0 && opts[j - 1] > c; --j)
+        {
+            opts[j] = opts[j - 1];
+        }
+        opts[j] = c;
+    }
+    
+    *options = opts;
+    return pattern;
+}
+
 static void jsonProductPair(struct json_parser* parser)
 {
     if(!parser->callbacks.xProductPair) return;
     
     char* key = strndup(parser->key_token.start, parser->key_token.length);
+    BSON_STATS_INC(BSON_STATS_ALLOCATIONS);
+    BSON_STATS_INC(BSON_STATS_JSON_COPIES);
+    BSON_STATS_ADD(BSON_STATS_JSON_COPY_BYTES, parser->key_token.length);
     
     switch (parser->last_token.type) {
         case JT_STRING:
         {
             char* val = strndup(parser->last_token.start, parser->last_token.length);
+            BSON_STATS_INC(BSON_STATS_ALLOCATIONS);
+            BSON_STATS_INC(BSON_STATS_JSON_COPIES);
+            BSON_STATS_ADD(BSON_STATS_JSON_COPY_BYTES, parser->last_token.length);
             
             parser->callbacks.xProductPair(parser->data, key, bson_type_string, val);
             
@@ -132,6 +200,41 @@ static void jsonProductPair(struct json_parser* parser)
             parser->callbacks.xProductPair(parser->data, key, bson_type_oid, &parser->last_token.oid);
             break;
             
+        case JT_LONG:
+            parser->callbacks.xProductPair(parser->data, key, bson_type_long, parser->last_token.lvalue);
+            break;
+            
+        case JT_DATE:
+            parser->callbacks.xProductPair(parser->data, key, bson_type_date, parser->last_token.lvalue);
+            break;
+            
+        case JT_DECIMAL:
+            parser->callbacks.xProductPair(parser->data, key, bson_type_decimal128, &parser->last_token.dec);
+            break;
+            
+        case JT_BINARY:
+        {
+            int32_t size;
+            unsigned char* bin = json_token_binary(&parser->last_token, &size);
+            
+            parser->callbacks.xProductPair(parser->data, key, bson_type_bindata, parser->last_token.subtype,
+                                           bin, size);
+            
+            free(bin);
+            break;
+        }
+            
+        case JT_REGEX:
+        {
+            const char* options;
+            char* pattern = json_token_regex(&parser->last_token, &options);
+            
+            parser->callbacks.xProductPair(parser->data, key, bson_type_regex, pattern, options);
+            
+            free(pattern);
+            break;
+        }
+            
         case JT_KEY:
         default:
             assert(0);
@@ -180,6 +283,40 @@ static void jsonProductValue(struct json_parser* parser)
             parser->callbacks.xProductVal(parser->data, bson_type_oid, &parser->last_token.oid);
             break;
             
+        case JT_LONG:
+            parser->callbacks.xProductVal(parser->data, bson_type_long, parser->last_token.lvalue);
+            break;
+            
+        case JT_DATE:
+            parser->callbacks.xProductVal(parser->data, bson_type_date, parser->last_token.lvalue);
+            break;
+            
+        case JT_DECIMAL:
+            parser->callbacks.xProductVal(parser->data, bson_type_decimal128, &parser->last_token.dec);
+            break;
+            
+        case JT_BINARY:
+        {
+            int32_t size;
+            unsigned char* bin = json_token_binary(&parser->last_token, &size);
+            
+            parser->callbacks.xProductVal(parser->data, bson_type_bindata, parser->last_token.subtype, bin, size);
+            
+            free(bin);
+            break;
+        }
+            
+        case JT_REGEX:
+        {
+            const char* options;
+            char* pattern = json_token_regex(&parser->last_token, &options);
+            
+            parser->callbacks.xProductVal(parser->data, bson_type_regex, pattern, options);
+            
+            free(pattern);
+            break;
+        }
+            
         case JT_KEY:
         default:
             assert(0);
@@ -219,6 +356,7 @@ static void json_parser_start_object(struct json_parser* parser)
         }
     }
     
+    parser->depth++;
     parser->key_token.type = JT_UNDEF;
     parser->last_token.type = JT_UNDEF;
 }
@@ -235,6 +373,9 @@ static void json_parser_finish_object(struct json_parser* parser)
         parser->callbacks.xEndObject(parser->data);
     }
     
+    /* The key of the last pair must not name the next element of an array */
+    parser->depth--;
+    parser->key_token.type = JT_UNDEF;
     parser->last_token.type = JT_UNDEF;
 }
 
@@ -252,6 +393,7 @@ static void json_parser_start_array(struct json_parser* parser)
         }
     }
     
+    parser->depth++;
     parser->key_token.type = JT_UNDEF;
     parser->last_token.type = JT_UNDEF;
 }
@@ -268,6 +410,8 @@ static void json_parser_finish_array(struct json_parser* parser)
         parser->callbacks.xEndArray(parser->data);
     }
     
+    parser->depth--;
+    parser->key_token.type = JT_UNDEF;
     parser->last_token.type = JT_UNDEF;
 }
 
@@ -453,6 +597,495 @@ Lexit:
     return 0;
 }
 
+// EXTENDED JSON v2 SECTION
+static const char* json_ext_skip_ws(const char* p, const char* end)
+{
+    while(p != end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+    {
+        p++;
+    }
+    return p;
+}
+
+/*
+ * Expects character c after whitespace
+ * @return position after c or 0
+ */
+static const char* json_ext_char(const char* p, const char* end, char c)
+{
+    p = json_ext_skip_ws(p, end);
+    return p != end && *p == c ? p + 1 : 0;
+}
+
+/*
+ * Scans string after whitespace
+ * @return position after closing quote or 0
+ */
+static const char* json_ext_string(const char* p, const char* end, const char** s, size_t* n)
+{
+    p = json_ext_char(p, end, JL_DQUOT);
+    if(!p)
+    {
+        return 0;
+    }
+    
+    *s = p;
+    for (; p != end; ++p)
+    {
+        if(*p == JL_DQUOT)
+        {
+            *n = p - *s;
+            return p + 1;
+        }
+        if((unsigned char)*p < 0x20)
+        {
+            return 0;
+        }
+        if(*p == JL_BACKSLASH && ++p == end)
+        {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Scans key with its colon
+ */
+static const char* json_ext_key(const char* p, const char* end, const char** s, size_t* n)
+{
+    p = json_ext_string(p, end, s, n);
+    return p ? json_ext_char(p, end, JL_COLON) : 0;
+}
+
+#define json_ext_is(s, n, name)             ((n) == sizeof(name) - 1 && memcmp((s), (name), (n)) == 0)
+
+static int json_ext_int64(const char* s, size_t n, int64_t* v)
+{
+    const char* e = s + n;
+    int neg = s != e && *s == '-';
+    s += neg;
+    if(s == e)
+    {
+        return 1;
+    }
+    
+    uint64_t u = 0;
+    for (; s != e; ++s)
+    {
+        if(!isdigit((unsigned char)*s) || u > (UINT64_MAX - 9) / 10)
+        {
+            return 1;
+        }
+        u = u * 10 + (*s - '0');
+    }
+    if(u > (uint64_t)INT64_MAX + neg)
+    {
+        return 1;
+    }
+    *v = neg ? (int64_t)(0 - u) : (int64_t)u;
+    return 0;
+}
+
+static int json_ext_double(const char* s, size_t n, double* v)
+{
+    if(json_ext_is(s, n, "Infinity"))
+    {
+        *v = INFINITY;
+        return 0;
+    }
+    if(json_ext_is(s, n, "-Infinity"))
+    {
+        *v = -INFINITY;
+        return 0;
+    }
+    if(json_ext_is(s, n, "NaN"))
+    {
+        *v = NAN;
+        return 0;
+    }
+    
+    char buffer[64];
+    if(n == 0 || n >= sizeof(buffer))
+    {
+        return 1;
+    }
+    memcpy(buffer, s, n);
+    buffer[n] = '\0';
+    
+    char* e;
+    *v = strtod(buffer, &e);
+    return e != buffer + n;
+}
+
+static int json_ext_digits(const char** p, const char* e, int count, int* v)
+{
+    *v = 0;
+    for (; count; --count, ++*p)
+    {
+        if(*p == e || !isdigit((unsigned char)**p))
+        {
+            return 1;
+        }
+        *v = *v * 10 + (**p - '0');
+    }
+    return 0;
+}
+
+/*
+ * Parses ISO-8601 date and time: YYYY-MM-DDTHH:MM:SS[.sss](Z|+HH:MM|-HH:MM)
+ */
+static int json_ext_iso8601(const char* s, size_t n, int64_t* ms)
+{
+    const char* e = s + n;
+    int y, mo, d, h, mi, sec, frac = 0;
+    if(json_ext_digits(&s, e, 4, &y) || s == e || *s++ != '-' ||
+       json_ext_digits(&s, e, 2, &mo) || s == e || *s++ != '-' ||
+       json_ext_digits(&s, e, 2, &d) || s == e || *s++ != 'T' ||
+       json_ext_digits(&s, e, 2, &h) || s == e || *s++ != ':' ||
+       json_ext_digits(&s, e, 2, &mi) || s == e || *s++ != ':' ||
+       json_ext_digits(&s, e, 2, &sec))
+    {
+        return 1;
+    }
+    
+    if(s != e && *s == '.')
+    {
+        int scale = 100;
+        for (++s; s != e && isdigit((unsigned char)*s); ++s)
+        {
+            frac += (*s - '0') * scale;
+            scale /= 10;
+        }
+    }
+    
+    int offset = 0;
+    if(s != e && *s == 'Z')
+    {
+        s++;
+    }
+    else if(s != e && (*s == '+' || *s == '-'))
+    {
+        int sign = *s++ == '-' ? -1 : 1, oh, om;
+        if(json_ext_digits(&s, e, 2, &oh) || (s != e && *s == ':' && ++s == e) ||
+           json_ext_digits(&s, e, 2, &om))
+        {
+            return 1;
+        }
+        offset = sign * (oh * 60 + om);
+    }
+    else
+    {
+        return 1;
+    }
+    
+    if(s != e || mo < 1 || mo > 12 || d < 1 || d > 31 || h > 23 || mi > 59 || sec > 60)
+    {
+        return 1;
+    }
+    
+    /* Days since the epoch in the proleptic Gregorian calendar */
+    y -= mo <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const int64_t yoe = y - era * 400;
+    const int64_t doy = (153 * (mo > 2 ? mo - 3 : mo + 9) + 2) / 5 + d - 1;
+    const int64_t days = era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+    
+    *ms = ((days * 24 + h) * 60 + mi - offset) * 60000 + sec * 1000 + frac;
+    return 0;
+}
+
+static int json_ext_base64_value(char c)
+{
+    if(c >= 'A' && c <= 'Z') return c - 'A';
+    if(c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if(c >= '0' && c <= '9') return c - '0' + 52;
+    if(c == '+') return 62;
+    if(c == '/') return 63;
+    return -1;
+}
+
+/*
+ * Decodes base64 text with optional escaped slashes.
+ * Without output buffer only validates the text.
+ * @return decoded size or (size_t)-1 if the text is invalid
+ */
+static size_t json_base64_decode(const char* s, size_t n, unsigned char* out)
+{
+    const char* e = s + n;
+    uint32_t acc = 0;
+    size_t nchars = 0, size = 0, padding = 0;
+    for (; s != e; ++s)
+    {
+        char c = *s;
+        if(c == JL_BACKSLASH && s + 1 != e && s[1] == '/')
+        {
+            continue;
+        }
+        if(c == '=')
+        {
+            padding++;
+            acc <<= 6;
+        }
+        else
+        {
+            int v = json_ext_base64_value(c);
+            if(v < 0 || padding)
+            {
+                return (size_t)-1;
+            }
+            acc = acc << 6 | v;
+        }
+        
+        if(++nchars % 4 == 0)
+        {
+            if(out)
+            {
+                out[size] = acc >> 16;
+                out[size + 1] = acc >> 8;
+                out[size + 2] = acc;
+            }
+            size += 3;
+            acc = 0;
+        }
+    }
+    
+    if(nchars % 4 || padding > 2)
+    {
+        return (size_t)-1;
+    }
+    return size - padding;
+}
+
+static const char* json_ext_date(struct json_parser* parser, const char* p)
+{
+    const char* s;
+    size_t n;
+    const char* end = parser->end;
+    p = json_ext_skip_ws(p, end);
+    if(p == end)
+    {
+        return 0;
+    }
+    
+    if(*p == JL_LBRACE)
+    {
+        /* Canonical: {"$numberLong": "<millis>"} */
+        if(!(p = json_ext_key(p + 1, end, &s, &n)) || !json_ext_is(s, n, "$numberLong") ||
+           !(p = json_ext_string(p, end, &s, &n)) || json_ext_int64(s, n, &parser->last_token.lvalue))
+        {
+            return 0;
+        }
+        return json_ext_char(p, end, JL_RBRACE);
+    }
+    
+    if(*p == JL_DQUOT)
+    {
+        /* Relaxed: ISO-8601 */
+        if(!(p = json_ext_string(p, end, &s, &n)) || json_ext_iso8601(s, n, &parser->last_token.lvalue))
+        {
+            return 0;
+        }
+        return p;
+    }
+    
+    /* Legacy: integer millis */
+    for (s = p; p != end && (isdigit((unsigned char)*p) || (*p == '-' && p == s)); ++p);
+    return json_ext_int64(s, p - s, &parser->last_token.lvalue) ? 0 : p;
+}
+
+static const char* json_ext_binary(struct json_parser* parser, const char* p)
+{
+    const char* end = parser->end;
+    const char *base64 = 0, *subtype = 0, *s, *k;
+    size_t nbase64 = 0, nsubtype = 0, n, nk;
+    if(!(p = json_ext_char(p, end, JL_LBRACE)))
+    {
+        return 0;
+    }
+    
+    for (int i = 0; i < 2; ++i)
+    {
+        if((i && !(p = json_ext_char(p, end, JL_COMMA))) ||
+           !(p = json_ext_key(p, end, &k, &nk)) || !(p = json_ext_string(p, end, &s, &n)))
+        {
+            return 0;
+        }
+        if(json_ext_is(k, nk, "base64") && !base64)
+        {
+            base64 = s;
+            nbase64 = n;
+        }
+        else if(json_ext_is(k, nk, "subType") && !subtype)
+        {
+            subtype = s;
+            nsubtype = n;
+        }
+        else
+        {
+            return 0;
+        }
+    }
+    
+    if(nsubtype < 1 || nsubtype > 2 || !isxdigit((unsigned char)subtype[0]) ||
+       (nsubtype == 2 && !isxdigit((unsigned char)subtype[1])) ||
+       json_base64_decode(base64, nbase64, 0) == (size_t)-1)
+    {
+        return 0;
+    }
+    
+    char hex[3] = { subtype[0], nsubtype == 2 ? subtype[1] : '\0', '\0' };
+    parser->last_token.subtype = (int)strtol(hex, 0, 16);
+    parser->last_token.start = base64;
+    parser->last_token.length = nbase64;
+    return json_ext_char(p, end, JL_RBRACE);
+}
+
+static const char* json_ext_regex(struct json_parser* parser, const char* p)
+{
+    const char* end = parser->end;
+    const char *pattern = 0, *options = 0, *s, *k;
+    size_t npattern = 0, noptions = 0, n, nk;
+    if(!(p = json_ext_char(p, end, JL_LBRACE)))
+    {
+        return 0;
+    }
+    
+    for (int i = 0; i < 2; ++i)
+    {
+        if((i && !(p = json_ext_char(p, end, JL_COMMA))) ||
+           !(p = json_ext_key(p, end, &k, &nk)) || !(p = json_ext_string(p, end, &s, &n)))
+        {
+            return 0;
+        }
+        if(json_ext_is(k, nk, "pattern") && !pattern)
+        {
+            pattern = s;
+            npattern = n;
+        }
+        else if(json_ext_is(k, nk, "options") && !options)
+        {
+            options = s;
+            noptions = n;
+        }
+        else
+        {
+            return 0;
+        }
+    }
+    
+    parser->last_token.start = pattern;
+    parser->last_token.length = npattern;
+    parser->last_token.start2 = options;
+    parser->last_token.length2 = noptions;
+    return json_ext_char(p, end, JL_RBRACE);
+}
+
+/*
+ * Parses the object at the cursor as Extended JSON v2 wrapper of a typed
+ * value, e.g. {"$numberLong": "1"}, into the last token. The cursor stops
+ * at the closing brace.
+ * @return 0 if the object is a wrapper, otherwise the cursor is unchanged
+ */
+static int json_parse_extended(struct json_parser* parser)
+{
+    const char* end = parser->end;
+    const char *name, *s;
+    size_t nname, n;
+    const char* p = json_ext_skip_ws(parser->cur + 1, end);
+    if(end - p < 3 || p[0] != JL_DQUOT || p[1] != '$' || !(p = json_ext_key(p, end, &name, &nname)))
+    {
+        return 1;
+    }
+    
+    enum json_parser_tokens type;
+    if(json_ext_is(name, nname, "$numberLong"))
+    {
+        type = JT_LONG;
+        if(!(p = json_ext_string(p, end, &s, &n)) || json_ext_int64(s, n, &parser->last_token.lvalue))
+        {
+            p = 0;
+        }
+    }
+    else if(json_ext_is(name, nname, "$numberInt"))
+    {
+        int64_t v;
+        type = JT_INT;
+        if(!(p = json_ext_string(p, end, &s, &n)) || json_ext_int64(s, n, &v) || v < INT32_MIN || v > INT32_MAX)
+        {
+            p = 0;
+        }
+        else
+        {
+            parser->last_token.ivalue = (long)v;
+        }
+    }
+    else if(json_ext_is(name, nname, "$numberDouble"))
+    {
+        type = JT_FLOAT;
+        if(!(p = json_ext_string(p, end, &s, &n)) || json_ext_double(s, n, &parser->last_token.fvalue))
+        {
+            p = 0;
+        }
+    }
+    else if(json_ext_is(name, nname, "$numberDecimal"))
+    {
+        type = JT_DECIMAL;
+        if(!(p = json_ext_string(p, end, &s, &n)) || bson_decimal128_from_string(&parser->last_token.dec, s, n))
+        {
+            p = 0;
+        }
+    }
+    else if(json_ext_is(name, nname, "$oid"))
+    {
+        type = JT_OID;
+        if(!(p = json_ext_string(p, end, &s, &n)) || n != 24)
+        {
+            p = 0;
+        }
+        for (size_t i = 0; p && i < n; ++i)
+        {
+            if(!isxdigit((unsigned char)s[i]))
+            {
+                p = 0;
+            }
+        }
+        if(p)
+        {
+            bson_oid_init_with_str(&parser->last_token.oid, s);
+        }
+    }
+    else if(json_ext_is(name, nname, "$date"))
+    {
+        type = JT_DATE;
+        p = json_ext_date(parser, p);
+    }
+    else if(json_ext_is(name, nname, "$binary"))
+    {
+        type = JT_BINARY;
+        p = json_ext_binary(parser, p);
+    }
+    else if(json_ext_is(name, nname, "$regularExpression"))
+    {
+        type = JT_REGEX;
+        p = json_ext_regex(parser, p);
+    }
+    else
+    {
+        return 1;
+    }
+    
+    if(!p || !(p = json_ext_char(p, end, JL_RBRACE)))
+    {
+        /* Not a wrapper, parsed as usual object */
+        return 1;
+    }
+    
+    parser->last_token.type = type;
+    parser->cur = p - 1;
+    return 0;
+}
+
 int json_parser_parse(const char *json, size_t nlength, struct json_parser_callbacks* callbacks, void* data)
 {
     struct json_parser parser = {
@@ -475,6 +1108,11 @@ int json_parser_parse(const char *json, size_t nlength, struct json_parser_callb
         char ch = *parser.cur;
         switch (ch) {
             case JL_LBRACE:
+                /* Values may be Extended JSON wrappers of typed values */
+                if((parser.key_token.type == JT_KEY || parser.depth > 0) && json_parse_extended(&parser) == 0)
+                {
+                    break;
+                }
                 json_parser_start_object(&parser);
                 break;
                 
@@ -494,6 +1132,7 @@ int json_parser_parse(const char *json, size_t nlength, struct json_parser_callb
                 if(json_parse_string(&parser) != 0)
                 {
                     // error
+                    BSON_STATS_ERROR(BSON_STATS_ERROR_STRING);
                     return 1;
                 }
                 break;
@@ -510,6 +1149,7 @@ int json_parser_parse(const char *json, size_t nlength, struct json_parser_callb
             case '6': case '7': case '8': case '9': case '0':
                 if(json_parse_num(&parser))
                 {
+                    BSON_STATS_ERROR(BSON_STATS_ERROR_NUMBER);
                     return 1;
                 }
                 break;
@@ -518,6 +1158,7 @@ int json_parser_parse(const char *json, size_t nlength, struct json_parser_callb
                 if(json_parse_null(&parser))
                 {
                     // error
+                    BSON_STATS_ERROR(BSON_STATS_ERROR_LITERAL);
                     return 1;
                 }
                 break;
@@ -526,6 +1167,7 @@ int json_parser_parse(const char *json, size_t nlength, struct json_parser_callb
                 if(json_parse_true(&parser))
                 {
                     // error
+                    BSON_STATS_ERROR(BSON_STATS_ERROR_LITERAL);
                     return 1;
                 }
                 break;
@@ -534,6 +1176,7 @@ int json_parser_parse(const char *json, size_t nlength, struct json_parser_callb
                 if(json_parse_false(&parser))
                 {
                     // error
+                    BSON_STATS_ERROR(BSON_STATS_ERROR_LITERAL);
                     return 1;
                 }
                 break;
@@ -541,6 +1184,7 @@ int json_parser_parse(const char *json, size_t nlength, struct json_parser_callb
             case 'O':
                 if(json_parse_oid(&parser))
                 {
+                    BSON_STATS_ERROR(BSON_STATS_ERROR_OID);
                     return 1;
                 }
                 break;
@@ -550,6 +1194,7 @@ int json_parser_parse(const char *json, size_t nlength, struct json_parser_callb
                 break;
                 
             default:
+                BSON_STATS_ERROR(BSON_STATS_ERROR_CHAR);
                 return 1;
         }
     }
@@ -562,6 +1207,7 @@ struct _helper
 {
     cpl_array_t a;
     bson_document_ref d;
+    int error;          /* Unbalanced or repeated document */
 };
 
 static void xProductPair(void *data, const char *key, bson_type_t type, ...)
@@ -598,6 +1244,33 @@ static void xProductPair(void *data, const char *key, bson_type_t type, ...)
             bson_document_builder_append_oid(b, key, va_arg(v, bson_oid_ref));
             break;
             
+        case bson_type_long:
+            bson_document_builder_append_l(b, key, va_arg(v, int64_t));
+            break;
+            
+        case bson_type_date:
+            bson_document_builder_append_date(b, key, va_arg(v, int64_t));
+            break;
+            
+        case bson_type_decimal128:
+            bson_document_builder_append_dec128(b, key, va_arg(v, bson_decimal128_ref));
+            break;
+            
+        case bson_type_bindata:
+        {
+            bson_subtype_t t = (bson_subtype_t)va_arg(v, int);
+            void* bin = va_arg(v, void *);
+            bson_document_builder_append_bin(b, key, t, bin, va_arg(v, int32_t));
+            break;
+        }
+            
+        case bson_type_regex:
+        {
+            const char* regex = va_arg(v, const char *);
+            bson_document_builder_append_regex(b, key, regex, va_arg(v, const char *));
+            break;
+        }
+            
         default:
             assert(0);
             break;
@@ -640,6 +1313,33 @@ static void xProductVal(void *data, bson_type_t type, ...)
             bson_array_builder_append_oid(b, va_arg(v, bson_oid_ref));
             break;
             
+        case bson_type_long:
+            bson_array_builder_append_l(b, va_arg(v, int64_t));
+            break;
+            
+        case bson_type_date:
+            bson_array_builder_append_date(b, va_arg(v, int64_t));
+            break;
+            
+        case bson_type_decimal128:
+            bson_array_builder_append_dec128(b, va_arg(v, bson_decimal128_ref));
+            break;
+            
+        case bson_type_bindata:
+        {
+            bson_subtype_t t = (bson_subtype_t)va_arg(v, int);
+            void* bin = va_arg(v, void *);
+            bson_array_builder_append_bin(b, t, bin, va_arg(v, int32_t));
+            break;
+        }
+            
+        case bson_type_regex:
+        {
+            const char* regex = va_arg(v, const char *);
+            bson_array_builder_append_regex(b, regex, va_arg(v, const char *));
+            break;
+        }
+            
         default:
             assert(0);
             break;
@@ -679,7 +1379,9 @@ static void xStartObject(void *data, const char *key, size_t nkey)
             len = sprintf(buffer+1, "%lu", parent->index++) + 2;
         }
         
-        cpl_region_append_data(&parent->r, buffer, len);
+        parent->error |= cpl_region_append_data(&parent->r, buffer, len) != 0;
+        BSON_STATS_INC(BSON_STATS_ALLOCATIONS);
+        BSON_STATS_ELEMENT(*buffer);
         
         free(buffer);
     }
@@ -719,7 +1421,9 @@ static void xStartArray(void *data, const char *key, size_t nkey)
             len = sprintf(buffer+1, "%lu", parent->index++) + 2;
         }
         
-        cpl_region_append_data(&parent->r, buffer, len);
+        parent->error |= cpl_region_append_data(&parent->r, buffer, len) != 0;
+        BSON_STATS_INC(BSON_STATS_ALLOCATIONS);
+        BSON_STATS_ELEMENT(*buffer);
         
         free(buffer);
     }
@@ -733,6 +1437,12 @@ static void xEndObject(void *data)
     struct _helper* h = (struct _helper *)data;
     cpl_array_ref a = &h->a;
     
+    if(!cpl_array_count(a))
+    {
+        h->error = 1;
+        return;
+    }
+    
     bson_document_builder_ref b = cpl_array_back(a, bson_document_builder_ref);
     cpl_array_pop_back(a);
     
@@ -740,6 +1450,12 @@ static void xEndObject(void *data)
     
     if(cpl_array_count(a) == 0)
     {
+        if(h->d)
+        {
+            /* Second document */
+            bson_document_destroy(h->d);
+            h->error = 1;
+        }
         h->d = d;
     }
 }
@@ -747,6 +1463,8 @@ static void xEndObject(void *data)
 bson_document_ref json2bson(const char *json, size_t nlength)
 {
     struct _helper h;
+    h.d = 0;
+    h.error = 0;
     cpl_array_init(&h.a, sizeof(bson_document_builder_ref), 16);
     struct json_parser_callbacks c =
     {
@@ -758,13 +1476,50 @@ bson_document_ref json2bson(const char *json, size_t nlength)
         .xEndArray = xEndObject
     };
     
+    BSON_STATS_TIMER(start);
+    BSON_STATS_INC(BSON_STATS_JSON_DOCUMENTS);
+    BSON_STATS_ADD(BSON_STATS_JSON_BYTES, nlength);
+    
     int rc = json_parser_parse(json, nlength, &c, &h);
-    if(rc)
+    if(h.error)
+    {
+        BSON_STATS_ERROR(BSON_STATS_ERROR_STRUCTURE);
+        rc = 1;
+    }
+    
+    if(cpl_array_count(&h.a))
+    {
+        /* Unfinished documents share the region of the innermost one */
+        bson_document_builder_destroy(cpl_array_back(&h.a, bson_document_builder_ref));
+        cpl_array_pop_back(&h.a);
+        while(cpl_array_count(&h.a))
+        {
+            free(cpl_array_back(&h.a, bson_document_builder_ref));
+            cpl_array_pop_back(&h.a);
+        }
+        if(!rc)
+        {
+            BSON_STATS_ERROR(BSON_STATS_ERROR_STRUCTURE);
+        }
+        rc = 1;
+    }
+    cpl_array_deinit(&h.a);
+    
+    if(rc || !h.d)
     {
         // TODO: report error
+        if(!rc)
+        {
+            BSON_STATS_ERROR(BSON_STATS_ERROR_STRUCTURE);
+        }
+        if(h.d)
+        {
+            bson_document_destroy(h.d);
+        }
         return 0;
     }
     
+    BSON_STATS_PARSE_TIME(start);
     return h.d;
 }
 
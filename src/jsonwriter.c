@@ -0,0 +1,517 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "jsonwriter.h"
+
+#include <math.h>
+#include <stdio.h>
+#include "cpu.h"
+#include "decimal128.h"
+#include "iterator.h"
+#include "oid.h"
+
+/*
+ * Escape letters: 'u' for \u00XX, 0 if the byte is written as is
+ */
+static const char s_escape[256] =
+{
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    ['"'] = '"',
+    ['\\'] = '\\'
+};
+
+static const char s_hex[] = "0123456789abcdef";
+
+static const char s_base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/************************* Private writer interface ***************************/
+static bson_json_escape_kernel_t bson_json_escape_select()
+{
+#ifdef BSON_HAVE_X86_SIMD
+    if(bson_cpu_has(BSON_CPU_AVX2))
+    {
+        return bson_json_escape_scan_avx2;
+    }
+    if(bson_cpu_has(BSON_CPU_SSE42))
+    {
+        return bson_json_escape_scan_sse42;
+    }
+#endif
+    return bson_json_escape_scan_portable;
+}
+
+/*
+ * Selected on the first writer initialization
+ */
+static volatile bson_json_escape_kernel_t s_escape_scan = bson_json_escape_scan_portable;
+
+/*
+ * Fills the chunk, handing it to the sink as often as needed
+ */
+static void bson_json_spill(bson_json_writer_ref __restrict w, const char* __restrict data, size_t size)
+{
+    while(!w->error && size)
+    {
+        size_t n = w->capacity - w->size;
+        if(n > size)
+        {
+            n = size;
+        }
+        memcpy(w->chunk + w->size, data, n);
+        w->size += n;
+        data += n;
+        size -= n;
+        if(w->size == w->capacity)
+        {
+            bson_json_writer_flush(w);
+        }
+    }
+}
+
+static inline void bson_json_put(bson_json_writer_ref __restrict w, const char* __restrict data, size_t size)
+{
+    if(__builtin_expect(w->size + size < w->capacity, 1))
+    {
+        memcpy(w->chunk + w->size, data, size);
+        w->size += size;
+    }
+    else
+    {
+        bson_json_spill(w, data, size);
+    }
+}
+
+#define bson_json_put_literal(w, s)         bson_json_put((w), (s), sizeof(s) - 1)
+
+static inline void bson_json_put_char(bson_json_writer_ref __restrict w, char c)
+{
+    bson_json_put(w, &c, 1);
+}
+
+/*
+ * Quoted string. Runs without escapes are copied at once.
+ */
+static void bson_json_put_string(bson_json_writer_ref __restrict w, const char* __restrict s, size_t n)
+{
+    const bson_json_escape_kernel_t scan = s_escape_scan;
+    bson_json_put_char(w, '"');
+    while(n)
+    {
+        const size_t run = scan(s, n);
+        bson_json_put(w, s, run);
+        if(run == n)
+        {
+            break;
+        }
+        
+        const unsigned char c = (unsigned char)s[run];
+        char esc[6] = { '\\', s_escape[c], '0', '0', s_hex[c >> 4], s_hex[c & 0xf] };
+        bson_json_put(w, esc, esc[1] == 'u' ? 6 : 2);
+        s += run + 1;
+        n -= run + 1;
+    }
+    bson_json_put_char(w, '"');
+}
+
+static void bson_json_put_int(bson_json_writer_ref __restrict w, int64_t v)
+{
+    char buffer[24];
+    char* p = buffer + sizeof(buffer);
+    uint64_t u = v < 0 ? 0 - (uint64_t)v : (uint64_t)v;
+    do
+    {
+        *--p = (char)('0' + u % 10);
+        u /= 10;
+    } while(u);
+    if(v < 0)
+    {
+        *--p = '-';
+    }
+    bson_json_put(w, p, buffer + sizeof(buffer) - p);
+}
+
+/*
+ * Shortest of 15 to 17 significant digits that reads back exactly
+ */
+static void bson_json_put_double(bson_json_writer_ref __restrict w, double d)
+{
+    if(!isfinite(d))
+    {
+        bson_json_put_literal(w, "{\"$numberDouble\":\"");
+        if(isnan(d))
+            bson_json_put_literal(w, "NaN");
+        else if(d < 0)
+            bson_json_put_literal(w, "-Infinity");
+        else
+            bson_json_put_literal(w, "Infinity");
+        bson_json_put_literal(w, "\"}");
+        return;
+    }
+    
+    char buffer[32];
+    int n = 0;
+    for (int precision = 15; precision <= 17; ++precision)
+    {
+        n = snprintf(buffer, sizeof(buffer), "%.*g", precision, d);
+        if(strtod(buffer, 0) == d)
+        {
+            break;
+        }
+    }
+    
+    /* Integral values keep a fraction to stay doubles */
+    if(!memchr(buffer, '.', n) && !memchr(buffer, 'e', n))
+    {
+        buffer[n++] = '.';
+        buffer[n++] = '0';
+    }
+    bson_json_put(w, buffer, n);
+}
+
+static void bson_json_put_oid(bson_json_writer_ref __restrict w, const char* __restrict value)
+{
+    char buffer[2 * bson_oid_size];
+    for (int i = 0; i < bson_oid_size; ++i)
+    {
+        buffer[2 * i] = s_hex[(unsigned char)value[i] >> 4];
+        buffer[2 * i + 1] = s_hex[value[i] & 0xf];
+    }
+    bson_json_put_literal(w, "{\"$oid\":\"");
+    bson_json_put(w, buffer, sizeof(buffer));
+    bson_json_put_literal(w, "\"}");
+}
+
+static void bson_json_put_base64(bson_json_writer_ref __restrict w, const unsigned char* __restrict data,
+                                 size_t n)
+{
+    char buffer[64];
+    size_t len = 0;
+    for (size_t i = 0; i < n; i += 3)
+    {
+        const uint32_t v = (uint32_t)data[i] << 16 | (i + 1 < n ? data[i + 1] << 8 : 0) |
+                           (i + 2 < n ? data[i + 2] : 0);
+        buffer[len] = s_base64[v >> 18];
+        buffer[len + 1] = s_base64[v >> 12 & 0x3f];
+        buffer[len + 2] = i + 1 < n ? s_base64[v >> 6 & 0x3f] : '=';
+        buffer[len + 3] = i + 2 < n ? s_base64[v & 0x3f] : '=';
+        if((len += 4) == sizeof(buffer))
+        {
+            bson_json_put(w, buffer, len);
+            len = 0;
+        }
+    }
+    bson_json_put(w, buffer, len);
+}
+
+/*
+ * ISO-8601 for years 1970 to 9999, as relaxed Extended JSON requires,
+ * otherwise canonical milliseconds
+ */
+static void bson_json_put_date(bson_json_writer_ref __restrict w, int64_t ms)
+{
+    if(ms < 0 || ms >= 253402300800000ll)
+    {
+        bson_json_put_literal(w, "{\"$date\":{\"$numberLong\":\"");
+        bson_json_put_int(w, ms);
+        bson_json_put_literal(w, "\"}}");
+        return;
+    }
+    
+    /* Civil date from days since the epoch */
+    const int64_t days = ms / 86400000 + 719468;
+    const int64_t ms_of_day = ms % 86400000;
+    const int64_t era = days / 146097;
+    const int64_t doe = days - era * 146097;
+    const int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const int64_t mp = (5 * doy + 2) / 153;
+    const int day = (int)(doy - (153 * mp + 2) / 5 + 1);
+    const int month = (int)(mp < 10 ? mp + 3 : mp - 9);
+    const int year = (int)(yoe + era * 400 + (month <= 2));
+    
+    char buffer[40];
+    int n = snprintf(buffer, sizeof(buffer), "{\"$date\":\"%04d-%02d-%02dT%02d:%02d:%02d", year, month, day,
+                     (int)(ms_of_day / 3600000), (int)(ms_of_day / 60000 % 60), (int)(ms_of_day / 1000 % 60));
+    if(ms % 1000)
+    {
+        n += snprintf(buffer + n, sizeof(buffer) - n, ".%03d", (int)(ms % 1000));
+    }
+    bson_json_put(w, buffer, n);
+    bson_json_put_literal(w, "Z\"}");
+}
+
+static void bson_json_put_document(bson_json_writer_ref __restrict w, bson_document_ref doc, int is_array);
+
+static void bson_json_put_value(bson_json_writer_ref __restrict w, bson_type_t type, const char* __restrict value)
+{
+    int32_t i32;
+    int64_t i64;
+    double d;
+    switch(type)
+    {
+        case bson_type_float:
+            memcpy(&d, value, sizeof(d));
+            bson_json_put_double(w, d);
+            break;
+            
+        case bson_type_string:
+            memcpy(&i32, value, sizeof(i32));
+            bson_json_put_string(w, value + 4, i32 - 1);
+            break;
+            
+        case bson_type_document:
+        case bson_type_array:
+            bson_json_put_document(w, (bson_document_ref)value, type == bson_type_array);
+            break;
+            
+        case bson_type_bindata:
+        {
+            memcpy(&i32, value, sizeof(i32));
+            const unsigned char subtype = (unsigned char)value[4];
+            const char t[2] = { s_hex[subtype >> 4], s_hex[subtype & 0xf] };
+            bson_json_put_literal(w, "{\"$binary\":{\"base64\":\"");
+            bson_json_put_base64(w, (const unsigned char *)value + 5, i32);
+            bson_json_put_literal(w, "\",\"subType\":\"");
+            bson_json_put(w, t, sizeof(t));
+            bson_json_put_literal(w, "\"}}");
+            break;
+        }
+            
+        case bson_type_undefined:
+            bson_json_put_literal(w, "{\"$undefined\":true}");
+            break;
+            
+        case bson_type_oid:
+            bson_json_put_oid(w, value);
+            break;
+            
+        case bson_type_bool:
+            if(*value)
+                bson_json_put_literal(w, "true");
+            else
+                bson_json_put_literal(w, "false");
+            break;
+            
+        case bson_type_date:
+            memcpy(&i64, value, sizeof(i64));
+            bson_json_put_date(w, i64);
+            break;
+            
+        case bson_type_null:
+            bson_json_put_literal(w, "null");
+            break;
+            
+        case bson_type_regex:
+        {
+            const size_t npattern = strlen(value);
+            bson_json_put_literal(w, "{\"$regularExpression\":{\"pattern\":");
+            bson_json_put_string(w, value, npattern);
+            bson_json_put_literal(w, ",\"options\":");
+            bson_json_put_string(w, value + npattern + 1, strlen(value + npattern + 1));
+            bson_json_put_literal(w, "}}");
+            break;
+        }
+            
+        case bson_type_dbpointer:
+            memcpy(&i32, value, sizeof(i32));
+            bson_json_put_literal(w, "{\"$dbPointer\":{\"$ref\":");
+            bson_json_put_string(w, value + 4, i32 - 1);
+            bson_json_put_literal(w, ",\"$id\":");
+            bson_json_put_oid(w, value + 4 + i32);
+            bson_json_put_literal(w, "}}");
+            break;
+            
+        case bson_type_code:
+            memcpy(&i32, value, sizeof(i32));
+            bson_json_put_literal(w, "{\"$code\":");
+            bson_json_put_string(w, value + 4, i32 - 1);
+            bson_json_put_char(w, '}');
+            break;
+            
+        case bson_type_symbol:
+            memcpy(&i32, value, sizeof(i32));
+            bson_json_put_literal(w, "{\"$symbol\":");
+            bson_json_put_string(w, value + 4, i32 - 1);
+            bson_json_put_char(w, '}');
+            break;
+            
+        case bson_type_codewscope:
+            /* Total size, code string, scope document */
+            memcpy(&i32, value + 4, sizeof(i32));
+            bson_json_put_literal(w, "{\"$code\":");
+            bson_json_put_string(w, value + 8, i32 - 1);
+            bson_json_put_literal(w, ",\"$scope\":");
+            bson_json_put_document(w, (bson_document_ref)(value + 8 + i32), 0);
+            bson_json_put_char(w, '}');
+            break;
+            
+        case bson_type_int:
+            memcpy(&i32, value, sizeof(i32));
+            bson_json_put_int(w, i32);
+            break;
+            
+        case bson_type_timestamp:
+            memcpy(&i64, value, sizeof(i64));
+            bson_json_put_literal(w, "{\"$timestamp\":{\"t\":");
+            bson_json_put_int(w, (uint32_t)((uint64_t)i64 >> 32));
+            bson_json_put_literal(w, ",\"i\":");
+            bson_json_put_int(w, (uint32_t)i64);
+            bson_json_put_literal(w, "}}");
+            break;
+            
+        case bson_type_long:
+            memcpy(&i64, value, sizeof(i64));
+            bson_json_put_literal(w, "{\"$numberLong\":\"");
+            bson_json_put_int(w, i64);
+            bson_json_put_literal(w, "\"}");
+            break;
+            
+        case bson_type_decimal128:
+        {
+            bson_decimal128_t dec;
+            char buffer[bson_decimal128_string_size];
+            bson_decimal128_init_with_bytes(&dec, value);
+            bson_json_put_literal(w, "{\"$numberDecimal\":\"");
+            bson_json_put(w, buffer, bson_decimal128_to_string(&dec, buffer));
+            bson_json_put_literal(w, "\"}");
+            break;
+        }
+            
+        case bson_type_minkey:
+            bson_json_put_literal(w, "{\"$minKey\":1}");
+            break;
+            
+        case bson_type_maxkey:
+            bson_json_put_literal(w, "{\"$maxKey\":1}");
+            break;
+            
+        default:
+            bson_json_put_literal(w, "null");
+            break;
+    }
+}
+
+static void bson_json_put_document(bson_json_writer_ref __restrict w, bson_document_ref doc, int is_array)
+{
+    bson_iterator_t iter;
+    int first = 1;
+    bson_json_put_char(w, is_array ? '[' : '{');
+    for (bson_iterator_init(&iter, doc); !bson_iterator_end(&iter) && !w->error; bson_iterator_next(&iter))
+    {
+        if(!first)
+        {
+            bson_json_put_char(w, ',');
+        }
+        first = 0;
+        
+        const char* el = bson_iterator_key(&iter) - 1;
+        if(!is_array)
+        {
+            bson_json_put_string(w, bson_iterator_key(&iter), bson_iterator_key_len(&iter));
+            bson_json_put_char(w, ':');
+        }
+        bson_json_put_value(w, *el, bson_iterator_value(&iter));
+    }
+    bson_json_put_char(w, is_array ? ']' : '}');
+}
+
+/************************** Public writer interface ***************************/
+size_t bson_json_escape_scan_portable(const char* s, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        if(s_escape[(unsigned char)s[i]])
+        {
+            return i;
+        }
+    }
+    return n;
+}
+
+int bson_json_writer_init(bson_json_writer_ref __restrict w, size_t chunk_size, bson_json_sink_t sink,
+                          void* ctx)
+{
+    if(chunk_size < 64)
+    {
+        chunk_size = chunk_size ? 64 : BSON_JSON_WRITER_CHUNK_SIZE;
+    }
+    
+    w->chunk = (char *)malloc(chunk_size);
+    if(!w->chunk)
+    {
+        return 1;
+    }
+    w->size = 0;
+    w->capacity = chunk_size;
+    w->sink = sink;
+    w->ctx = ctx;
+    w->error = 0;
+    
+    s_escape_scan = bson_json_escape_select();
+    return 0;
+}
+
+void bson_json_writer_deinit(bson_json_writer_ref __restrict w)
+{
+    free(w->chunk);
+    w->chunk = 0;
+    w->size = w->capacity = 0;
+}
+
+int bson_json_writer_write(bson_json_writer_ref __restrict w, const char* __restrict data, size_t size)
+{
+    bson_json_put(w, data, size);
+    return w->error;
+}
+
+int bson_json_writer_document(bson_json_writer_ref __restrict w, bson_document_ref doc)
+{
+    bson_json_put_document(w, doc, 0);
+    return w->error;
+}
+
+int bson_json_writer_documents(bson_json_writer_ref __restrict w, bson_document_ref* docs, size_t count)
+{
+    bson_json_put_char(w, '[');
+    for (size_t i = 0; i < count && !w->error; ++i)
+    {
+        if(i)
+        {
+            bson_json_put_char(w, ',');
+        }
+        bson_json_put_document(w, docs[i], 0);
+    }
+    bson_json_put_char(w, ']');
+    return w->error;
+}
+
+int bson_json_writer_flush(bson_json_writer_ref __restrict w)
+{
+    if(!w->error && w->size)
+    {
+        w->error = w->sink(w->ctx, w->chunk, w->size) != 0;
+    }
+    w->size = 0;
+    return w->error;
+}
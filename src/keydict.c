@@ -0,0 +1,486 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "keydict.h"
+
+#include <string.h>
+#include "documentbuilder.h"
+#include "hash.h"
+#include "iterator.h"
+#include <cpl/cpl_region.h>
+
+/*********************** Private dictionary types *****************************/
+struct bson_keydict_key
+{
+    uint32_t    offset;         /* Offset of the key in the arena */
+    uint32_t    length;
+    uint64_t    hash;
+};
+
+struct bson_keydict
+{
+    char*                       arena;      /* NUL-terminated keys */
+    size_t                      arena_size;
+    size_t                      arena_alloced;
+    struct bson_keydict_key*    keys;       /* Keys by ID */
+    uint32_t                    nkeys;
+    uint32_t                    keys_alloced;
+    uint32_t*                   slots;      /* ID + 1 or 0 for empty slot */
+    size_t                      mask;
+};
+
+/*********************** Private dictionary interface *************************/
+static inline size_t bson_keydict_varint_encode(char* __restrict p, uint32_t v)
+{
+    size_t n = 0;
+    while(v >= 0x80)
+    {
+        p[n++] = (char)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (char)v;
+    return n;
+}
+
+/* Returns 0 if the varint is longer than 5 bytes or overflows 32 bits */
+static inline const char* bson_keydict_varint_decode(const char* __restrict p, uint32_t* __restrict v)
+{
+    uint32_t result = 0;
+    for (unsigned shift = 0; shift < 35; shift += 7)
+    {
+        const unsigned char c = (unsigned char)*p++;
+        if(shift == 28 && c > 0x0F)
+        {
+            return 0;
+        }
+        result |= (uint32_t)(c & 0x7F) << shift;
+        if(!(c & 0x80))
+        {
+            *v = result;
+            return p;
+        }
+    }
+    return 0;
+}
+
+static inline size_t bson_keydict_format_index(char* __restrict buffer, uint32_t index)
+{
+    char tmp[10];
+    size_t n = 0;
+    do
+    {
+        tmp[n++] = (char)('0' + index % 10);
+        index /= 10;
+    } while(index);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        buffer[i] = tmp[n - 1 - i];
+    }
+    buffer[n] = '\0';
+    return n;
+}
+
+static int bson_keydict_rehash(bson_keydict_ref __restrict dict, size_t nslots)
+{
+    uint32_t* slots = (uint32_t *)calloc(nslots, sizeof(uint32_t));
+    if(!slots)
+    {
+        return 1;
+    }
+
+    const size_t mask = nslots - 1;
+    for (uint32_t id = 0; id < dict->nkeys; ++id)
+    {
+        size_t slot = dict->keys[id].hash & mask;
+        while(slots[slot])
+        {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = id + 1;
+    }
+
+    free(dict->slots);
+    dict->slots = slots;
+    dict->mask = mask;
+    return 0;
+}
+
+static int bson_keydict_compact_doc(bson_keydict_ref __restrict dict, cpl_region_ref __restrict r,
+                                    bson_document_ref doc, int is_array)
+{
+    const size_t start = r->offset;
+    int32_t size = 0;
+    cpl_region_append_data(r, &size, sizeof(size));
+
+    const char* p = doc->data + sizeof(int32_t);
+    while(*p != bson_type_eoo)
+    {
+        const bson_type_t type = *p;
+        const char* key = p + 1;
+        const size_t nkey = strlen(key);
+        const char* value = key + nkey + 1;
+
+        char head[6] = { type };
+        size_t nhead = 1;
+        if(!is_array)
+        {
+            const uint32_t id = bson_keydict_intern(dict, key, nkey);
+            if(id == BSON_KEYDICT_NOTFOUND)
+            {
+                return 1;
+            }
+            nhead += bson_keydict_varint_encode(head + 1, id);
+        }
+        cpl_region_append_data(r, head, nhead);
+
+        size_t nvalue = bson_value_size(type, value);
+        if(type == bson_type_document || type == bson_type_array)
+        {
+            if(bson_keydict_compact_doc(dict, r, (bson_document_ref)value, type == bson_type_array))
+            {
+                return 1;
+            }
+        }
+        else
+        {
+            cpl_region_append_data(r, value, nvalue);
+        }
+
+        p = value + nvalue;
+    }
+
+    const bson_type_t eoo = bson_type_eoo;
+    cpl_region_append_data(r, &eoo, sizeof(eoo));
+    *(int32_t *)((char *)r->data + start) = (int32_t)(r->offset - start);
+    return 0;
+}
+
+static int bson_keydict_expand_doc(bson_keydict_ref __restrict dict, cpl_region_ref __restrict r,
+                                   const char* __restrict c, int is_array)
+{
+    const size_t start = r->offset;
+    int32_t size = 0;
+    cpl_region_append_data(r, &size, sizeof(size));
+
+    const char* p = c + sizeof(int32_t);
+    uint32_t index = 0;
+    while(*p != bson_type_eoo)
+    {
+        const bson_type_t type = *p++;
+        char head[16];
+        head[0] = type;
+
+        if(is_array)
+        {
+            size_t n = bson_keydict_format_index(head + 1, index++);
+            cpl_region_append_data(r, head, n + 2);
+        }
+        else
+        {
+            uint32_t id;
+            p = bson_keydict_varint_decode(p, &id);
+            if(!p || id >= dict->nkeys)
+            {
+                return 1;
+            }
+            cpl_region_append_data(r, head, 1);
+            cpl_region_append_data(r, dict->arena + dict->keys[id].offset, dict->keys[id].length + 1);
+        }
+
+        size_t nvalue = bson_value_size(type, p);
+        if(type == bson_type_document || type == bson_type_array)
+        {
+            if(bson_keydict_expand_doc(dict, r, p, type == bson_type_array))
+            {
+                return 1;
+            }
+        }
+        else
+        {
+            cpl_region_append_data(r, p, nvalue);
+        }
+
+        p += nvalue;
+    }
+
+    const bson_type_t eoo = bson_type_eoo;
+    cpl_region_append_data(r, &eoo, sizeof(eoo));
+    *(int32_t *)((char *)r->data + start) = (int32_t)(r->offset - start);
+    return 0;
+}
+
+/*********************** Public dictionary interface **************************/
+bson_keydict_ref bson_keydict_create()
+{
+    bson_keydict_ref dict = (bson_keydict_ref)calloc(1, sizeof(struct bson_keydict));
+    if(dict && bson_keydict_rehash(dict, 64))
+    {
+        free(dict);
+        dict = 0;
+    }
+    return dict;
+}
+
+void bson_keydict_destroy(bson_keydict_ref dict)
+{
+    free(dict->slots);
+    free(dict->keys);
+    free(dict->arena);
+    free(dict);
+}
+
+uint32_t bson_keydict_count(bson_keydict_ref dict)
+{
+    return dict->nkeys;
+}
+
+uint32_t bson_keydict_lookup(bson_keydict_ref __restrict dict, const char* __restrict key, size_t nkey)
+{
+    const uint64_t hash = bson_hash_bytes(key, nkey, BSON_HASH_SEED);
+    size_t slot = hash & dict->mask;
+    for (;;)
+    {
+        const uint32_t id = dict->slots[slot];
+        if(!id)
+        {
+            return BSON_KEYDICT_NOTFOUND;
+        }
+
+        const struct bson_keydict_key* k = &dict->keys[id - 1];
+        if(k->hash == hash && k->length == nkey && memcmp(dict->arena + k->offset, key, nkey) == 0)
+        {
+            return id - 1;
+        }
+        slot = (slot + 1) & dict->mask;
+    }
+}
+
+uint32_t bson_keydict_intern(bson_keydict_ref __restrict dict, const char* __restrict key, size_t nkey)
+{
+    uint32_t id = bson_keydict_lookup(dict, key, nkey);
+    if(id != BSON_KEYDICT_NOTFOUND)
+    {
+        return id;
+    }
+
+    if(dict->nkeys == BSON_KEYDICT_NOTFOUND - 1)
+    {
+        return BSON_KEYDICT_NOTFOUND;
+    }
+
+    if((dict->nkeys + 1) * 2 > dict->mask + 1)
+    {
+        if(bson_keydict_rehash(dict, (dict->mask + 1) * 2))
+        {
+            return BSON_KEYDICT_NOTFOUND;
+        }
+    }
+
+    if(dict->nkeys == dict->keys_alloced)
+    {
+        uint32_t n = dict->keys_alloced ? dict->keys_alloced * 2 : 32;
+        struct bson_keydict_key* keys = (struct bson_keydict_key *)realloc(dict->keys, n * sizeof(struct bson_keydict_key));
+        if(!keys)
+        {
+            return BSON_KEYDICT_NOTFOUND;
+        }
+        dict->keys = keys;
+        dict->keys_alloced = n;
+    }
+
+    if(dict->arena_size + nkey + 1 > dict->arena_alloced)
+    {
+        size_t n = dict->arena_alloced ? dict->arena_alloced * 2 : 1024;
+        while(n < dict->arena_size + nkey + 1)
+        {
+            n *= 2;
+        }
+        char* arena = (char *)realloc(dict->arena, n);
+        if(!arena)
+        {
+            return BSON_KEYDICT_NOTFOUND;
+        }
+        dict->arena = arena;
+        dict->arena_alloced = n;
+    }
+
+    id = dict->nkeys++;
+    struct bson_keydict_key* k = &dict->keys[id];
+    k->offset = (uint32_t)dict->arena_size;
+    k->length = (uint32_t)nkey;
+    k->hash = bson_hash_bytes(key, nkey, BSON_HASH_SEED);
+    memcpy(dict->arena + k->offset, key, nkey);
+    dict->arena[k->offset + nkey] = '\0';
+    dict->arena_size += nkey + 1;
+
+    size_t slot = k->hash & dict->mask;
+    while(dict->slots[slot])
+    {
+        slot = (slot + 1) & dict->mask;
+    }
+    dict->slots[slot] = id + 1;
+
+    return id;
+}
+
+const char* bson_keydict_key(bson_keydict_ref __restrict dict, uint32_t id, size_t* __restrict nkey)
+{
+    if(id >= dict->nkeys)
+    {
+        return 0;
+    }
+
+    if(nkey)
+    {
+        *nkey = dict->keys[id].length;
+    }
+    return dict->arena + dict->keys[id].offset;
+}
+
+bson_array_ref bson_keydict_save(bson_keydict_ref dict)
+{
+    bson_array_builder_ref b = bson_array_builder_create();
+    for (uint32_t id = 0; id < dict->nkeys; ++id)
+    {
+        bson_array_builder_append_str(b, dict->arena + dict->keys[id].offset);
+    }
+    return bson_array_builder_finalize(b);
+}
+
+bson_keydict_ref bson_keydict_load(bson_array_ref arr)
+{
+    bson_keydict_ref dict = bson_keydict_create();
+    if(!dict)
+    {
+        return 0;
+    }
+
+    bson_iterator_t iter;
+    bson_element_ref el;
+    for (el = bson_iterator_init(&iter, arr); !bson_iterator_end(&iter); el = bson_iterator_next(&iter))
+    {
+        if(bson_element_type(el) != bson_type_string)
+        {
+            bson_keydict_destroy(dict);
+            return 0;
+        }
+
+        const char* value = bson_element_value(el);
+        const uint32_t id = bson_keydict_intern(dict, value + sizeof(int32_t), *(int32_t *)value - 1);
+        if(id != dict->nkeys - 1)
+        {
+            /* Duplicate keys or out of memory */
+            bson_keydict_destroy(dict);
+            return 0;
+        }
+    }
+    return dict;
+}
+
+bson_compact_ref bson_keydict_compact(bson_keydict_ref __restrict dict, bson_document_ref doc)
+{
+    cpl_region_t r;
+    cpl_region_init(cpl_allocator_get_default(), &r, bson_document_size(doc));
+    if(bson_keydict_compact_doc(dict, &r, doc, 0))
+    {
+        cpl_region_deinit(&r);
+        return 0;
+    }
+    return (bson_compact_ref)r.data;
+}
+
+bson_document_ref bson_keydict_expand(bson_keydict_ref __restrict dict, bson_compact_ref c)
+{
+    cpl_region_t r;
+    cpl_region_init(cpl_allocator_get_default(), &r, bson_compact_size(c) * 2);
+    if(bson_keydict_expand_doc(dict, &r, c->data, 0))
+    {
+        cpl_region_deinit(&r);
+        return 0;
+    }
+    return (bson_document_ref)r.data;
+}
+
+void bson_compact_iterator_init(bson_compact_iterator_ref __restrict i, bson_keydict_ref dict,
+                                bson_compact_ref c)
+{
+    i->dict = dict;
+    i->next = c->data + sizeof(int32_t);
+    i->is_array = 0;
+    i->index = UINT32_MAX;
+    i->key_id = BSON_KEYDICT_NOTFOUND;
+    i->type = bson_type_eoo;
+    i->value = 0;
+}
+
+int bson_compact_iterator_next(bson_compact_iterator_ref __restrict i)
+{
+    const char* p = i->next;
+    i->type = *p++;
+    if(i->type == bson_type_eoo)
+    {
+        i->value = 0;
+        return 0;
+    }
+
+    if(!i->is_array && !(p = bson_keydict_varint_decode(p, &i->key_id)))
+    {
+        /* Malformed key ID ends the iteration */
+        i->type = bson_type_eoo;
+        i->value = 0;
+        return 0;
+    }
+
+    i->index++;
+    i->value = p;
+    i->next = p + bson_value_size(i->type, p);
+    return 1;
+}
+
+const char* bson_compact_iterator_key(bson_compact_iterator_ref __restrict i, size_t* __restrict nkey)
+{
+    if(i->is_array)
+    {
+        size_t n = bson_keydict_format_index(i->index_key, i->index);
+        if(nkey)
+        {
+            *nkey = n;
+        }
+        return i->index_key;
+    }
+
+    return bson_keydict_key(i->dict, i->key_id, nkey);
+}
+
+void bson_compact_iterator_child(bson_compact_iterator_ref __restrict i,
+                                 bson_compact_iterator_ref __restrict child)
+{
+    child->dict = i->dict;
+    child->next = i->value + sizeof(int32_t);
+    child->is_array = i->type == bson_type_array;
+    child->index = UINT32_MAX;
+    child->key_id = BSON_KEYDICT_NOTFOUND;
+    child->type = bson_type_eoo;
+    child->value = 0;
+}
@@ -0,0 +1,229 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "lz.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/****************************** Private Impl **********************************/
+#define BSON_LZ_HASH_BITS                   12
+#define BSON_LZ_MIN_MATCH                   4
+#define BSON_LZ_MAX_OFFSET                  65535
+#define BSON_LZ_LAST_LITERALS               5       /* Matches never cover the tail */
+#define BSON_LZ_MFLIMIT                     12      /* Matches never start in the tail */
+
+static inline uint32_t bson_lz_read32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t bson_lz_hash(uint32_t seq)
+{
+    return (seq * 2654435761u) >> (32 - BSON_LZ_HASH_BITS);
+}
+
+static inline uint8_t* bson_lz_write_length(uint8_t* __restrict op, size_t len)
+{
+    while(len >= 255)
+    {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+static inline const uint8_t* bson_lz_read_length(const uint8_t* __restrict ip, const uint8_t* iend,
+                                                 size_t* __restrict len)
+{
+    uint8_t b;
+    do
+    {
+        if(ip == iend)
+        {
+            return 0;
+        }
+        b = *ip++;
+        *len += b;
+    } while(b == 255);
+    return ip;
+}
+
+/* Emits the sequence. Returns 0 if it doesn't fit */
+static inline uint8_t* bson_lz_emit(uint8_t* __restrict op, uint8_t* oend,
+                                    const uint8_t* __restrict literals, size_t nliterals,
+                                    size_t offset, size_t match)
+{
+    if((size_t)(oend - op) < nliterals + nliterals / 255 + match / 255 + 8)
+    {
+        return 0;
+    }
+
+    uint8_t* token = op++;
+    *token = (uint8_t)((nliterals < 15 ? nliterals : 15) << 4);
+    if(nliterals >= 15)
+    {
+        op = bson_lz_write_length(op, nliterals - 15);
+    }
+    memcpy(op, literals, nliterals);
+    op += nliterals;
+
+    if(match)
+    {
+        *op++ = (uint8_t)offset;
+        *op++ = (uint8_t)(offset >> 8);
+        match -= BSON_LZ_MIN_MATCH;
+        *token |= (uint8_t)(match < 15 ? match : 15);
+        if(match >= 15)
+        {
+            op = bson_lz_write_length(op, match - 15);
+        }
+    }
+    return op;
+}
+
+/****************************** Public Impl ***********************************/
+size_t bson_lz_compress(const void* __restrict src, size_t nsrc, void* __restrict dst, size_t ndst)
+{
+    uint32_t table[1 << BSON_LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    const uint8_t* const base = (const uint8_t *)src;
+    const uint8_t* const iend = base + nsrc;
+    const uint8_t* const mflimit = nsrc > BSON_LZ_MFLIMIT ? iend - BSON_LZ_MFLIMIT : base;
+    const uint8_t* const mlimit = iend - BSON_LZ_LAST_LITERALS;
+    const uint8_t* ip = base;
+    const uint8_t* anchor = base;
+    uint8_t* op = (uint8_t *)dst;
+    uint8_t* const oend = op + ndst;
+
+    while(ip < mflimit)
+    {
+        const uint32_t seq = bson_lz_read32(ip);
+        const uint32_t h = bson_lz_hash(seq);
+        const uint8_t* ref = base + table[h];
+        table[h] = (uint32_t)(ip - base);
+
+        if(ref >= ip || ip - ref > BSON_LZ_MAX_OFFSET || bson_lz_read32(ref) != seq)
+        {
+            /* Skip faster through incompressible data */
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+
+        size_t match = BSON_LZ_MIN_MATCH;
+        while(ip + match < mlimit && ref[match] == ip[match])
+        {
+            match++;
+        }
+
+        op = bson_lz_emit(op, oend, anchor, ip - anchor, ip - ref, match);
+        if(!op)
+        {
+            return 0;
+        }
+
+        ip += match;
+        anchor = ip;
+    }
+
+    op = bson_lz_emit(op, oend, anchor, iend - anchor, 0, 0);
+    if(!op)
+    {
+        return 0;
+    }
+    return op - (uint8_t *)dst;
+}
+
+int bson_lz_decompress(const void* __restrict src, size_t nsrc, void* __restrict dst, size_t ndst)
+{
+    const uint8_t* ip = (const uint8_t *)src;
+    const uint8_t* const iend = ip + nsrc;
+    uint8_t* op = (uint8_t *)dst;
+    uint8_t* const oend = op + ndst;
+
+    while(ip < iend)
+    {
+        const uint8_t token = *ip++;
+
+        size_t nliterals = token >> 4;
+        if(nliterals == 15 && !(ip = bson_lz_read_length(ip, iend, &nliterals)))
+        {
+            return 1;
+        }
+        if(nliterals > (size_t)(iend - ip) || nliterals > (size_t)(oend - op))
+        {
+            return 1;
+        }
+        memcpy(op, ip, nliterals);
+        op += nliterals;
+        ip += nliterals;
+
+        if(ip == iend)
+        {
+            break;
+        }
+
+        if(iend - ip < 2)
+        {
+            return 1;
+        }
+        const size_t offset = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        if(offset == 0 || offset > (size_t)(op - (uint8_t *)dst))
+        {
+            return 1;
+        }
+
+        size_t match = token & 15;
+        if(match == 15 && !(ip = bson_lz_read_length(ip, iend, &match)))
+        {
+            return 1;
+        }
+        match += BSON_LZ_MIN_MATCH;
+        if(match > (size_t)(oend - op))
+        {
+            return 1;
+        }
+
+        const uint8_t* ref = op - offset;
+        if(offset >= match)
+        {
+            memcpy(op, ref, match);
+        }
+        else
+        {
+            /* Overlapping match repeats the last offset bytes */
+            for (size_t i = 0; i < match; ++i)
+            {
+                op[i] = ref[i];
+            }
+        }
+        op += match;
+    }
+
+    return op == oend ? 0 : 1;
+}
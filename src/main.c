@@ -23,13 +23,37 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
 #include "oid.h"
 #include "cpl_array.h"
 #include "documentbuilder.h"
 #include "document.h"
 #include "iterator.h"
+#include "cursor.h"
+#include "wire.h"
+#include "findkey.h"
+#include "cpu.h"
+#include "jsonparser.h"
+#include "jsonwriter.h"
+#include "jsoncache.h"
+#include "handle.h"
+#include "hash.h"
+#include "partition.h"
+#include "oidchunk.h"
+#include "index.h"
+#include "crc32c.h"
+#include "wal.h"
+#include "lz.h"
+#include "blockfile.h"
+#include "keydict.h"
+#include "stats.h"
+#include "schemaprofiler.h"
+#include "sizedbuilder.h"
 
-static inline void test_oid()
+static inline int test_oid()
 {
     bson_oid_ref oid = bson_oid_create();
     bson_oid_init(oid);
@@ -46,11 +70,14 @@ static inline void test_oid()
     
     puts(representation);
     free(representation);
+    
+    return 0;
 }
 
-static inline void test_cpl_array()
+static inline int test_cpl_array()
 {
     cpl_array_ref a = cpl_array_create(sizeof(int), 4);
+    int errors = 0;
     
     int i = 0;
     cpl_array_push_back(a, i);
@@ -74,12 +101,15 @@ static inline void test_cpl_array()
         printf("a[%d] = %d\n", k, arr[k]);
         int it = cpl_array_get(a, k, int);
         printf("b[%d] = %d\n", k, it);
+        errors += arr[k] != k || it != k;
     }
     
     cpl_array_destroy(a);
+    
+    return errors;
 }
 
-static inline void test_builder()
+static inline int test_builder()
 {
     char* argv[4] = {
         "index1",
@@ -116,24 +146,27 @@ static inline void test_builder()
     bson_document_ref d = bson_document_builder_finalize(b);
     printf("sizeof d: %d\n", bson_document_size(d));
     
-    bson_iterator_t iter;
-    bson_element_ref el = 0;
-    for (el = bson_iterator_init(&iter, d); !bson_iterator_end(&iter); bson_iterator_next_el(&iter, el)) {
-        printf("Element: size=%zu key=%s", bson_element_size(el), bson_element_fieldname(el));
+    bson_cursor_t c;
+    for (bson_cursor_init(&c, d); bson_cursor_next(&c); ) {
+        printf("Element: size=%zu key=%s", bson_element_size(bson_cursor_element(&c)), bson_cursor_key(&c));
         
-        switch(bson_element_type(el))
+        switch(bson_cursor_type(&c))
         {
             case bson_type_string:
-                printf(" value=[%d]%s", *(int32_t*)bson_element_value(el), bson_element_value(el) + sizeof(int32_t));
+            {
+                size_t len;
+                const char* str = bson_cursor_str(&c, &len);
+                printf(" value=[%zu]%s", len, str);
                 break;
+            }
             
             case bson_type_bool:
-                printf(" value=%s", (*bson_element_value(el)?"true":"false"));
+                printf(" value=%s", (bson_cursor_b(&c)?"true":"false"));
                 break;
                 
             case bson_type_oid:
             {
-                char* oid = bson_oid_string_create((const bson_oid_ref)bson_element_value(el));
+                char* oid = bson_oid_string_create(bson_cursor_oid(&c));
                 printf(" value=%s", oid);
                 free(oid);
                 break;
@@ -141,16 +174,13 @@ static inline void test_builder()
                 
             case bson_type_array:
             {
-                bson_array_ref arr = bson_array_create_with_data(bson_element_value(el));
-                printf(" values = [%d]{\n", bson_document_size(arr));
-                bson_iterator_t i;
-                bson_element_ref e = 0;
-                for(e = bson_iterator_init(&i, arr); !bson_iterator_end(&i); bson_iterator_next_el(&i, e))
+                bson_cursor_t child;
+                bson_cursor_child(&c, &child);
+                printf(" values = [%d]{\n", bson_cursor_doc_size(&child));
+                while(bson_cursor_next(&child))
                 {
-                    printf("    Element: size=%zu key=%s\n", bson_element_size(e), bson_element_fieldname(e));
+                    printf("    Element: size=%zu key=%s\n", bson_element_size(bson_cursor_element(&child)), bson_cursor_key(&child));
                 }
-                bson_element_destroy(e);
-                bson_array_destroy(arr);
                 printf("};");
                 break;
             }
@@ -159,18 +189,1339 @@ static inline void test_builder()
         putchar('\n');
     }
     
-    bson_element_destroy(el);
+    bson_document_destroy(d);
+    
+    return 0;
+}
+
+static inline int test_builder_n()
+{
+    int errors = 0;
+    char key[300];
+    char str[1000];
+    memset(key, 'k', sizeof(key));
+    memset(str, 's', sizeof(str) - 1);
+    str[sizeof(str) - 1] = '\0';
+    char bin[5] = { 1, 2, 3, 4, 5 };
+    
+    /* Keys are taken by length from longer buffers; the long key and string
+       do not fit the stack buffer of bson_document_builder_append_raw() */
+    bson_document_builder_ref b = bson_document_builder_create();
+    bson_document_builder_append_i_n(b, "int32", 3, 42);
+    bson_document_builder_append_l_n(b, "long_key", 4, 1LL << 40);
+    bson_document_builder_append_d_n(b, "dd", 1, 2.5);
+    bson_document_builder_append_b_n(b, "bb", 1, 1);
+    bson_document_builder_append_null_n(b, "nn", 1);
+    bson_document_builder_append_str_n(b, key, sizeof(key) - 1, str, sizeof(str) - 1);
+    bson_document_builder_append_bin_n(b, "binary", 3, bson_subtype_generic, bin, sizeof(bin));
+    bson_document_ref d = bson_document_builder_finalize(b);
+    
+    int size = bson_document_size(d);
+    errors += size != 1366;
+    
+    int n = 0;
+    bson_cursor_t c;
+    for(bson_cursor_init(&c, d); bson_cursor_next(&c); n++)
+    {
+        const char* k = bson_cursor_key(&c);
+        switch(n)
+        {
+            case 0:
+                errors += bson_cursor_type(&c) != bson_type_int || strcmp(k, "int") || bson_cursor_i(&c) != 42;
+                break;
+            case 1:
+                errors += bson_cursor_type(&c) != bson_type_long || strcmp(k, "long") || bson_cursor_l(&c) != 1LL << 40;
+                break;
+            case 2:
+                errors += bson_cursor_type(&c) != bson_type_float || strcmp(k, "d") || bson_cursor_d(&c) != 2.5;
+                break;
+            case 3:
+                errors += bson_cursor_type(&c) != bson_type_bool || strcmp(k, "b") || bson_cursor_b(&c) != 1;
+                break;
+            case 4:
+                errors += bson_cursor_type(&c) != bson_type_null || strcmp(k, "n");
+                break;
+            case 5:
+            {
+                size_t len;
+                const char* v = bson_cursor_str(&c, &len);
+                errors += bson_cursor_type(&c) != bson_type_string || strlen(k) != sizeof(key) - 1 ||
+                          memcmp(k, key, sizeof(key) - 1) || len != sizeof(str) - 1 || strcmp(v, str);
+                break;
+            }
+            case 6:
+            {
+                bson_subtype_t t;
+                size_t len;
+                const void* v = bson_cursor_bin(&c, &t, &len);
+                errors += bson_cursor_type(&c) != bson_type_bindata || strcmp(k, "bin") ||
+                          t != bson_subtype_generic || len != sizeof(bin) || memcmp(v, bin, sizeof(bin));
+                break;
+            }
+        }
+    }
+    errors += n != 7;
+    
+    bson_document_destroy(d);
+    
+    /* A failed append in a nested document fails the whole document */
+    b = bson_document_builder_create();
+    bson_document_builder_append_i_n(b, "a", 1, 1);
+    bson_document_builder_append_raw(b, bson_type_document, "child", 5, "", 0, "", 0);
+    bson_document_builder_ref child = bson_document_builder_create_with_parent(b);
+    bson_document_builder_append_i_n(child, "b", 1, 2);
+    child->error = 1;
+    errors += bson_document_builder_finalize(child) != 0 || !b->error;
+    errors += bson_document_builder_finalize(b) != 0;
+    
+    printf("builder_n: size=%d elements=%d errors=%d\n", size, n, errors);
+    
+    return errors;
+}
+
+static void test_sized_emit(bson_sized_builder_ref b, void* ctx)
+{
+    int* passes = (int *)ctx;
+    bson_sized_builder_append_i(b, "i", 7);
+    bson_sized_builder_open_arr(b, "a");
+    bson_sized_builder_append_str(b, 0, "first");
+    bson_sized_builder_append_str(b, 0, "second");
+    bson_sized_builder_close(b);
+    
+    /* Emits more on the writing pass when asked to */
+    if(passes && (*passes)++ && !bson_sized_builder_sizing(b))
+    {
+        bson_sized_builder_append_str(b, "extra", "past the measured end");
+    }
+}
+
+static inline int test_sized_builder()
+{
+    int errors = 0;
+    
+    bson_array_builder_ref a = bson_array_builder_create();
+    bson_array_builder_append_str(a, "first");
+    bson_array_builder_append_str(a, "second");
+    bson_array_ref arr = bson_array_builder_finalize(a);
+    bson_document_builder_ref rb = bson_document_builder_create();
+    bson_document_builder_append_i(rb, "i", 7);
+    bson_document_builder_append_arr(rb, "a", arr);
+    bson_document_ref expected = bson_document_builder_finalize(rb);
+    bson_array_destroy(arr);
+    
+    const size_t size = bson_sized_builder_measure(test_sized_emit, 0);
+    bson_document_ref d = bson_sized_builder_build(test_sized_emit, 0);
+    errors += !d || size != (size_t)bson_document_size(expected) ||
+              memcmp(d, expected, size);
+    
+    /* A short buffer is refused without writing past its end */
+    char buffer[64];
+    memset(buffer, 0x5a, sizeof(buffer));
+    errors += size + 1 > sizeof(buffer) ||
+              bson_sized_builder_write(test_sized_emit, 0, buffer, size - 1) != 1 ||
+              buffer[size - 1] != 0x5a;
+    
+    /* So is an emitter which grows between the passes */
+    int passes = 0;
+    errors += bson_sized_builder_build(test_sized_emit, &passes) != 0 || passes != 2;
+    
+    printf("sized builder: size=%zu errors=%d\n", size, errors);
+    if(d)
+    {
+        bson_document_destroy(d);
+    }
+    bson_document_destroy(expected);
+    
+    return errors;
+}
+
+static inline int test_wire()
+{
+    int fds[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+    {
+        perror("socketpair");
+        return 1;
+    }
+    
+    bson_document_ref docs[3];
+    for (int i = 0; i < 3; i++) {
+        bson_document_builder_ref b = bson_document_builder_create();
+        bson_document_builder_append_i(b, "n", i);
+        bson_document_builder_append_str(b, "name", "wire message body");
+        docs[i] = bson_document_builder_finalize(b);
+    }
+    
+    /* Messages of 1..3 documents */
+    enum { nmessages = 30 };
+    int nsent = 0;
+    bson_wire_frame_t f;
+    bson_wire_frame_init(&f, 0, 0, 1);
+    for (int i = 0; i < nmessages; i++) {
+        bson_wire_frame_reset(&f, i, 0, 1);
+        for (int j = 0; j <= i % 3; j++) {
+            bson_wire_frame_add(&f, docs[j]);
+            nsent++;
+        }
+        bson_wire_frame_send(fds[0], &f);
+    }
+    bson_wire_frame_deinit(&f);
+    close(fds[0]);
+    
+    /* Small ring keeping two messages unreleased wraps several times */
+    bson_wire_ring_t r;
+    bson_wire_ring_init(&r, 200);
+    int received = 0, ndocs = 0, held = 0, bad = 0;
+    for (;;) {
+        bson_wire_message_t msg;
+        int rc = bson_wire_ring_next(&r, &msg);
+        if(rc < 0) {
+            bad++;
+            break;
+        }
+        if(rc == 0) {
+            if(bson_wire_ring_recv(&r, fds[1]) > 0) {
+                continue;
+            }
+            if(held == 0) {
+                break;
+            }
+            /* Out of space or end of stream: release the oldest */
+            bson_wire_ring_release(&r);
+            held--;
+            continue;
+        }
+        
+        size_t offset = 0;
+        int j = 0;
+        bson_document_ref doc;
+        while((doc = bson_wire_message_next(&msg, &offset))) {
+            bson_cursor_t c;
+            bson_cursor_init(&c, doc);
+            if(!bson_cursor_next(&c) || bson_cursor_i(&c) != j) {
+                bad++;
+            }
+            j++;
+        }
+        if(msg.header.request_id != received || j != received % 3 + 1) {
+            bad++;
+        }
+        received++;
+        ndocs += j;
+        if(++held > 2) {
+            bson_wire_ring_release(&r);
+            held--;
+        }
+    }
+    /* Nothing may be lost or left behind */
+    bad += received != nmessages || ndocs != nsent;
+    printf("wire: messages=%d documents=%d errors=%d\n", received, ndocs, bad);
+    
+    bson_wire_ring_deinit(&r);
+    close(fds[1]);
+    for (int i = 0; i < 3; i++) {
+        bson_document_destroy(docs[i]);
+    }
+    
+    return bad;
+}
+
+static inline int test_find_key()
+{
+    static const char* keys[] = {
+        "a", "ab", "abc", "b", "abcdefghijklmnop", "abcdefghijklmnopq",
+        "a_key_longer_than_thirty_two_bytes_in_total", "z"
+    };
+    bson_document_builder_ref small = bson_document_builder_create();
+    bson_document_builder_append_i(small, "ab", 1);
+    bson_document_builder_append_i(small, "a", 2);
+    bson_document_builder_ref large = bson_document_builder_create();
+    for (int i = 0; i < 7; i++) {
+        bson_document_builder_append_str(large, keys[i], keys[i]);
+        bson_document_builder_append_i(large, keys[i] + 1, i);
+    }
+    bson_document_ref docs[2] = {
+        bson_document_builder_finalize(small),
+        bson_document_builder_finalize(large)
+    };
+    
+    int lookups = 0, errors = 0;
+    for (int d = 0; d < 2; d++) {
+        for (int k = 0; k < 8; k++) {
+            bson_cursor_t c;
+            bson_cursor_init(&c, docs[d]);
+            const char* expected = bson_cursor_find(&c, keys[k]) ? (const char*)bson_cursor_element(&c) : 0;
+            size_t nkey = strlen(keys[k]);
+            
+            if((const char*)bson_document_find_key(docs[d], keys[k], nkey) != expected)
+                errors++;
+            if(bson_find_key_portable(docs[d]->data, keys[k], nkey) != expected)
+                errors++;
+#ifdef BSON_HAVE_X86_SIMD
+            if(bson_cpu_has(BSON_CPU_SSE42) && bson_find_key_sse42(docs[d]->data, keys[k], nkey) != expected)
+                errors++;
+            if(bson_cpu_has(BSON_CPU_AVX2) && bson_find_key_avx2(docs[d]->data, keys[k], nkey) != expected)
+                errors++;
+#endif
+            lookups++;
+        }
+        bson_document_destroy(docs[d]);
+    }
+    printf("find_key: lookups=%d errors=%d\n", lookups, errors);
+    
+    return errors;
+}
+
+static inline int test_json_extended()
+{
+    static const char json[] =
+        "{\"n\": {\"$numberLong\": \"-9007199254740993\"}, "
+        "\"i\": {\"$numberInt\": \"42\"}, "
+        "\"d\": {\"$date\": {\"$numberLong\": \"1388534400000\"}}, "
+        "\"iso\": {\"$date\": \"2014-01-01T03:00:00.5+03:00\"}, "
+        "\"bin\": {\"$binary\": {\"subType\": \"04\", \"base64\": \"aGVsbG8=\"}}, "
+        "\"re\": {\"$regularExpression\": {\"pattern\": \"^a\", \"options\": \"xi\"}}, "
+        "\"id\": {\"$oid\": \"52c3e2de5e4b7c0cd8ab4d01\"}, "
+        "\"arr\": [{\"$numberDouble\": \"-Infinity\"}, {\"$date\": 0}], "
+        "\"price\": {\"$numberDecimal\": \"1234.5600\"}, "
+        "\"doc\": {\"$date\": \"not a date\"}}";
+    
+    bson_document_ref d = json2bson(json, sizeof(json) - 1);
+    if(!d)
+    {
+        printf("json extended: parse failed\n");
+        return 1;
+    }
+    
+    int errors = 0;
+    bson_cursor_t c;
+    bson_cursor_init(&c, d);
+    errors += !bson_cursor_find(&c, "n") || bson_cursor_type(&c) != bson_type_long ||
+              bson_cursor_l(&c) != -9007199254740993ll;
+    errors += !bson_cursor_find(&c, "i") || bson_cursor_type(&c) != bson_type_int || bson_cursor_i(&c) != 42;
+    errors += !bson_cursor_find(&c, "d") || bson_cursor_type(&c) != bson_type_date ||
+              bson_cursor_date(&c) != 1388534400000ll;
+    errors += !bson_cursor_find(&c, "iso") || bson_cursor_type(&c) != bson_type_date ||
+              bson_cursor_date(&c) != 1388534400500ll;
+    
+    size_t len;
+    bson_subtype_t t;
+    errors += !bson_cursor_find(&c, "bin") || bson_cursor_type(&c) != bson_type_bindata ||
+              memcmp(bson_cursor_bin(&c, &t, &len), "hello", 5) || len != 5 || t != bson_subtype_uuid;
+    errors += !bson_cursor_find(&c, "re") || bson_cursor_type(&c) != bson_type_regex ||
+              strcmp(bson_cursor_value(&c), "^a") || strcmp(bson_cursor_value(&c) + 3, "ix");
+    errors += !bson_cursor_find(&c, "id") || bson_cursor_type(&c) != bson_type_oid;
     
+    bson_cursor_t child;
+    errors += !bson_cursor_find(&c, "arr") || !bson_cursor_child(&c, &child) ||
+              !bson_cursor_next(&child) || bson_cursor_type(&child) != bson_type_float ||
+              bson_cursor_d(&child) != -1.0 / 0.0 || !bson_cursor_next(&child) ||
+              bson_cursor_type(&child) != bson_type_date || bson_cursor_date(&child) != 0;
+    
+    bson_decimal128_t price, cents, sum;
+    char text[bson_decimal128_string_size];
+    bson_decimal128_from_string(&cents, "0.0045", 6);
+    errors += !bson_cursor_find(&c, "price") || bson_cursor_type(&c) != bson_type_decimal128;
+    price = bson_cursor_dec128(&c);
+    bson_decimal128_add(&sum, &price, &cents);
+    bson_decimal128_to_string(&sum, text);
+    errors += strcmp(text, "1234.5645") != 0 || bson_decimal128_compare(&sum, &price) <= 0;
+    
+    /* Not a wrapper: stays a subdocument */
+    errors += !bson_cursor_find(&c, "doc") || bson_cursor_type(&c) != bson_type_document;
+    
+    printf("json extended: size=%d errors=%d\n", bson_document_size(d), errors);
     bson_document_destroy(d);
+    
+    return errors;
+}
+
+struct test_json_output
+{
+    char    text[1024];
+    size_t  size;
+    int     chunks;
+};
+
+static int test_json_sink(void* ctx, const char* data, size_t size)
+{
+    struct test_json_output* out = (struct test_json_output *)ctx;
+    if(out->size + size >= sizeof(out->text))
+    {
+        return 1;
+    }
+    memcpy(out->text + out->size, data, size);
+    out->size += size;
+    out->chunks++;
+    return 0;
+}
+
+static inline int test_json_writer()
+{
+    static const char expected[] =
+        "[{\"s\":\"say \\\"hi\\\"\\n\\u0001 and a long enough tail to cross vectors\",\"i\":-7,"
+        "\"l\":{\"$numberLong\":\"9007199254740993\"},\"d\":2.5,\"one\":1.0,"
+        "\"date\":{\"$date\":\"2014-01-01T00:00:00.250Z\"},\"bin\":{\"$binary\":{\"base64\":\"aGVsbG8=\",\"subType\":\"00\"}},"
+        "\"arr\":[true,null,{\"$numberDecimal\":\"1.50\"}]},{}]";
+    
+    bson_decimal128_t dec;
+    bson_decimal128_from_string(&dec, "1.50", 4);
+    bson_array_builder_ref ab = bson_array_builder_create();
+    bson_array_builder_append_b(ab, 1);
+    bson_array_builder_append_null(ab);
+    bson_array_builder_append_dec128(ab, &dec);
+    bson_array_ref arr = bson_array_builder_finalize(ab);
+    
+    bson_document_builder_ref b = bson_document_builder_create();
+    bson_document_builder_append_str(b, "s", "say \"hi\"\n\001 and a long enough tail to cross vectors");
+    bson_document_builder_append_i(b, "i", -7);
+    bson_document_builder_append_l(b, "l", 9007199254740993ll);
+    bson_document_builder_append_d(b, "d", 2.5);
+    bson_document_builder_append_d(b, "one", 1.0);
+    bson_document_builder_append_date(b, "date", 1388534400250ll);
+    bson_document_builder_append_bin(b, "bin", bson_subtype_generic, "hello", 5);
+    bson_document_builder_append_arr(b, "arr", arr);
+    bson_array_destroy(arr);
+    bson_document_ref docs[2] = { bson_document_builder_finalize(b), bson_document_create() };
+    
+    struct test_json_output out = { .size = 0, .chunks = 0 };
+    bson_json_writer_t w;
+    bson_json_writer_init(&w, 64, test_json_sink, &out);
+    int rc = bson_json_writer_documents(&w, docs, 2) || bson_json_writer_flush(&w);
+    bson_json_writer_deinit(&w);
+    
+    int errors = rc || out.size != sizeof(expected) - 1 || memcmp(out.text, expected, out.size) != 0;
+    printf("json writer: bytes=%zu chunks=%d errors=%d\n", out.size, out.chunks, errors);
+    bson_document_destroy(docs[0]);
+    
+    return errors;
+}
+
+struct test_handle_reader
+{
+    bson_handle_ref     handle;
+    int                 sum;
+};
+
+static void* test_handle_read(void* arg)
+{
+    struct test_handle_reader* r = (struct test_handle_reader *)arg;
+    for (int i = 0; i < 10000; ++i)
+    {
+        bson_handle_ref h = bson_handle_retain(r->handle);
+        bson_element_ref e = bson_document_find_key(bson_handle_document(h), "n", 1);
+        r->sum += e ? *(int32_t *)bson_element_value(e) : 0;
+        bson_handle_release(h);
+    }
+    /* Drop the reference given by the spawning thread */
+    bson_handle_release(r->handle);
+    return 0;
+}
+
+static int s_test_handle_destroyed;
+
+static void test_handle_destroy(bson_handle_ref h)
+{
+    s_test_handle_destroyed++;
+}
+
+static inline int test_handle()
+{
+    bson_document_builder_ref b = bson_document_builder_create();
+    bson_document_builder_append_i(b, "n", 1);
+    bson_document_ref doc = bson_document_builder_finalize(b);
+    bson_handle_ref h = bson_handle_create(doc);
+    int errors = !h || bson_handle_document(h) != doc || bson_handle_refs(h) != 1;
+    if(!h)
+    {
+        printf("handle: errors=%d\n", errors);
+        return errors;
+    }
+    
+    /* Readers share the document without copying it */
+    struct test_handle_reader readers[4];
+    pthread_t threads[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        readers[i].handle = bson_handle_retain(h);
+        readers[i].sum = 0;
+        pthread_create(&threads[i], 0, test_handle_read, &readers[i]);
+    }
+    int sum = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        pthread_join(threads[i], 0);
+        sum += readers[i].sum;
+    }
+    errors += sum != 40000 || bson_handle_refs(h) != 1;
+    bson_handle_release(h);
+    
+    /* Embedded handle is destroyed by its callback with the last reference */
+    bson_handle_t embedded;
+    bson_handle_init(&embedded, bson_document_create(), test_handle_destroy);
+    bson_handle_retain(&embedded);
+    bson_handle_release(&embedded);
+    errors += s_test_handle_destroyed != 0;
+    bson_handle_release(&embedded);
+    errors += s_test_handle_destroyed != 1;
+    
+    printf("handle: reads=%d errors=%d\n", sum, errors);
+    
+    return errors;
+}
+
+static inline int test_json_cache()
+{
+    static const char config[] = "{\"name\": \"api\", \"port\": 8080, \"tags\": [\"a\", \"b\"]}";
+    char json[64];
+    int errors = 0;
+    
+    bson_json_cache_ref cache = bson_json_cache_create(1 << 20);
+    bson_handle_ref first = bson_json_cache_get(cache, config, sizeof(config) - 1);
+    bson_handle_ref second = bson_json_cache_get(cache, config, sizeof(config) - 1);
+    bson_document_ref parsed = json2bson(config, sizeof(config) - 1);
+    bson_document_ref doc = bson_handle_document(first);
+    int32_t size = bson_document_size(parsed);
+    errors += !first || first != second || bson_document_size(doc) != size || memcmp(doc->data, parsed->data, size);
+    errors += bson_json_cache_get(cache, "{\"broken\": ", 11) != 0;
+    bson_document_destroy(parsed);
+    bson_handle_release(second);
+    
+    /* Inputs of other stripes and evictions under a small budget */
+    bson_json_cache_ref small = bson_json_cache_create(BSON_JSON_CACHE_STRIPES * 256);
+    for (int i = 0; i < 200; ++i)
+    {
+        int n = sprintf(json, "{\"i\": %d}", i % 100);
+        bson_handle_ref h = bson_json_cache_get(small, json, n);
+        bson_element_ref e = h ? bson_document_find_key(bson_handle_document(h), "i", 1) : 0;
+        errors += !e || *(int32_t *)bson_element_value(e) != i % 100;
+        bson_handle_release(h);
+    }
+    
+    struct bson_json_cache_stats stats, small_stats;
+    bson_json_cache_stats(cache, &stats);
+    bson_json_cache_stats(small, &small_stats);
+    bson_json_cache_destroy(small);
+    bson_json_cache_destroy(cache);
+    
+    /* Still referenced after destruction of the cache */
+    errors += bson_document_size(doc) != size || bson_handle_refs(first) != 1;
+    bson_handle_release(first);
+    
+    errors += stats.hits != 1 || stats.misses != 2 || stats.entries != 1 || small_stats.evictions == 0;
+    printf("json cache: hits=%llu misses=%llu errors=%d\n", (unsigned long long)stats.hits,
+           (unsigned long long)stats.misses, errors);
+    
+    return errors;
+}
+
+static inline int test_hash()
+{
+    /* The same values in different encodings */
+    static const char* const json[] = {
+        "{\"a\": 1, \"b\": {\"c\": [2, -0.0, \"x\"]}}",
+        "{\"a\": {\"$numberLong\": \"1\"}, \"b\": {\"c\": [2.0, 0, \"x\"]}}",
+        "{\"a\": 1.0, \"b\": {\"c\": [{\"$numberLong\": \"2\"}, {\"$numberDouble\": \"0\"}, \"x\"]}}",
+        "{\"a\": 1.5, \"b\": {\"c\": [2, 0, \"y\"]}}",
+        "{\"b\": {\"c\": null}}"
+    };
+    bson_document_ref docs[5];
+    for (int i = 0; i < 5; ++i)
+    {
+        docs[i] = json2bson(json[i], strlen(json[i]));
+    }
+    
+    int errors = 0;
+    uint64_t raw[5], semantic[5], path[5], null_path[5];
+    for (int i = 0; i < 5; ++i)
+    {
+        raw[i] = bson_hash_document(docs[i], bson_hash_raw, BSON_HASH_SEED);
+        semantic[i] = bson_hash_document(docs[i], bson_hash_semantic, BSON_HASH_SEED);
+        int32_t size = bson_document_size(docs[i]);
+        errors += raw[i] != bson_hash_bytes(docs[i]->data, size, BSON_HASH_SEED);
+    }
+    errors += semantic[0] != semantic[1] || semantic[0] != semantic[2] || semantic[0] == semantic[3];
+    errors += raw[0] == raw[1] || raw[0] == raw[2] || raw[1] == raw[2];
+    
+    bson_hash_path(docs, 5, "b.c.1", bson_hash_semantic, BSON_HASH_SEED, path);
+    bson_hash_path(docs, 5, "b.c", bson_hash_semantic, BSON_HASH_SEED, null_path);
+    errors += path[0] != path[1] || path[0] != path[2] || path[0] != path[3];
+    /* Missing field hashes as null */
+    errors += path[4] != null_path[4] || null_path[0] != null_path[1] || null_path[0] == null_path[3];
+    bson_hash_path(docs, 5, "a", bson_hash_raw, BSON_HASH_SEED, path);
+    errors += path[0] == path[1] || path[0] == path[2] || path[4] == path[0];
+    
+    for (int i = 0; i < 5; ++i)
+    {
+        bson_document_destroy(docs[i]);
+    }
+    printf("hash: semantic=%016llx errors=%d\n", (unsigned long long)semantic[0], errors);
+    
+    return errors;
+}
+
+static inline int test_partition()
+{
+    bson_batch_t in = BSON_BATCH_INITIALIZER;
+    for (int i = 0; i < 100; ++i)
+    {
+        char json[64];
+        int n = sprintf(json, "{\"user\": {\"id\": %d}, \"seq\": %d}", i % 10, i);
+        bson_document_ref doc = json2bson(json, n);
+        bson_batch_append(&in, doc);
+        bson_document_destroy(doc);
+    }
+    
+    bson_batch_t out[3] = { BSON_BATCH_INITIALIZER, BSON_BATCH_INITIALIZER, BSON_BATCH_INITIALIZER };
+    bson_scan_pool_ref pool = bson_scan_pool_create(2);
+    int errors = bson_partition(pool, &in, "user.id", 3, out);
+    
+    /* Every key in one partition, documents in input order */
+    int partition_of_key[10] = { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 };
+    size_t count = 0;
+    for (int p = 0; p < 3; ++p)
+    {
+        int last = -1;
+        for (size_t i = 0; i < bson_batch_count(&out[p]); ++i)
+        {
+            bson_element_ref seq = bson_document_find_path(bson_batch_get(&out[p], i), "seq", 3);
+            int v = *(int32_t *)bson_element_value(seq);
+            errors += v <= last || (partition_of_key[v % 10] != -1 && partition_of_key[v % 10] != p);
+            partition_of_key[v % 10] = p;
+            last = v;
+        }
+        count += bson_batch_count(&out[p]);
+    }
+    errors += count != 100;
+    printf("partition: sizes=%zu,%zu,%zu errors=%d\n", bson_batch_count(&out[0]), bson_batch_count(&out[1]),
+           bson_batch_count(&out[2]), errors);
+    
+    bson_scan_pool_destroy(pool);
+    for (int p = 0; p < 3; ++p)
+    {
+        bson_batch_deinit(&out[p]);
+    }
+    bson_batch_deinit(&in);
+    
+    return errors;
+}
+
+static inline int test_oid_chunks()
+{
+    /* A document per second, sizes growing with time */
+    enum { count = 1000 };
+    static bson_oid_t oids[count];
+    static bson_oid_ref refs[count];
+    static uint32_t sizes[count];
+    const uint32_t start = 1388534400;
+    uint64_t total = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        bson_oid_init_sequential(&oids[i]);
+        oids[i].time[0] = (uint8_t)((start + i) >> 24);
+        oids[i].time[1] = (uint8_t)((start + i) >> 16);
+        oids[i].time[2] = (uint8_t)((start + i) >> 8);
+        oids[i].time[3] = (uint8_t)(start + i);
+        refs[i] = &oids[i];
+        sizes[i] = 100 + i;
+        total += sizes[i];
+    }
+    
+    int errors = bson_oid_time(&oids[10]) != start + 10;
+    bson_oid_t lo, hi;
+    bson_oid_init_time_min(&lo, start + 10);
+    bson_oid_init_time_max(&hi, start + 10);
+    errors += bson_oid_compare(&lo, &oids[10]) >= 0 || bson_oid_compare(&hi, &oids[10]) <= 0;
+    errors += bson_oid_compare(&hi, &oids[11]) >= 0 || bson_oid_compare(&lo, &oids[9]) <= 0;
+    
+    bson_oid_chunk_t* by_count;
+    size_t ncount = bson_oid_split(refs, 0, count, 300, &by_count);
+    errors += ncount != 4 || by_count[0].weight != 250 || by_count[3].end != count;
+    
+    bson_oid_chunk_t* by_size;
+    const uint64_t max_size = 64 * 1024;
+    size_t nsize = bson_oid_split(refs, sizes, count, max_size, &by_size);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < nsize; ++i)
+    {
+        errors += by_size[i].weight > max_size + 100 + count || (i && by_size[i].begin != by_size[i - 1].end);
+        errors += bson_oid_compare(&by_size[i].min, &oids[by_size[i].begin]) != 0;
+        sum += by_size[i].weight;
+    }
+    errors += sum != total;
+    
+    /* No limit puts everything into one chunk */
+    bson_oid_chunk_t* unlimited;
+    size_t nunlimited = bson_oid_split(refs, 0, 3, UINT64_MAX, &unlimited);
+    errors += nunlimited != 1 || unlimited[0].begin != 0 || unlimited[0].end != 3 || unlimited[0].weight != 3;
+    free(unlimited);
+    nunlimited = bson_oid_split(refs, sizes, count, UINT64_MAX, &unlimited);
+    errors += nunlimited != 1 || unlimited[0].end != count || unlimited[0].weight != total;
+    free(unlimited);
+    
+    /* Seconds 400..599 are in the second and third chunks only */
+    size_t first;
+    size_t found = bson_oid_chunk_find_time(by_count, ncount, start + 400, start + 599, &first);
+    errors += found != 2 || first != 1;
+    found = bson_oid_chunk_find_time(by_count, ncount, start + count, start + 2 * count, &first);
+    errors += found != 0;
+    
+    printf("oid chunks: by_count=%zu by_size=%zu errors=%d\n", ncount, nsize, errors);
+    free(by_count);
+    free(by_size);
+    
+    return errors;
+}
+
+static inline int test_index()
+{
+    static const char* const json[] = {
+        "{\"n\": 0, \"a\": {\"b\": 7}}",
+        "{\"n\": 1, \"a\": {\"b\": \"seven\"}}",
+        "{\"n\": 2, \"a\": {\"b\": 7.0}}",
+        "{\"n\": 3}",
+        "{\"n\": 4, \"a\": {\"b\": -2.5}}",
+        "{\"n\": 5, \"a\": {\"b\": {\"$numberLong\": \"7\"}}}",
+        "{\"n\": 6, \"a\": {\"b\": null}}"
+    };
+    bson_batch_t b = BSON_BATCH_INITIALIZER;
+    for (int i = 0; i < 7; ++i)
+    {
+        bson_document_ref doc = json2bson(json[i], strlen(json[i]));
+        bson_batch_append(&b, doc);
+        bson_document_destroy(doc);
+    }
+    
+    char name[] = "/tmp/bson_index_XXXXXX";
+    int fd = mkstemp(name);
+    unlink(name);
+    int errors = bson_index_build(fd, bson_batch_data(&b), bson_batch_size(&b), "a.b");
+    bson_index_ref idx = bson_index_open(fd);
+    errors += !idx;
+    if(errors)
+    {
+        printf("index: errors=%d\n", errors);
+        close(fd);
+        bson_batch_deinit(&b);
+        return errors;
+    }
+    
+    /* Documents in key order: null and missing, numbers, then strings */
+    static const int32_t expected[] = { 3, 6, 4, 0, 2, 5, 1 };
+    char order[8] = { 0 };
+    bson_index_cursor_t c;
+    uint64_t offset;
+    int n = 0;
+    bson_index_range(idx, 0, 0, 0, 0, &c);
+    while(bson_index_cursor_next(&c, &offset) && n < 7)
+    {
+        bson_element_ref e = bson_document_find_key((bson_document_ref)(bson_batch_data(&b) + offset), "n", 1);
+        errors += *(int32_t *)bson_element_value(e) != expected[n];
+        order[n++] = '0' + *(int32_t *)bson_element_value(e);
+    }
+    errors += n != 7;
+    
+    /* Numbers equal to 7 of any type */
+    int32_t seven = 7;
+    bson_index_find(idx, bson_type_int, (const char *)&seven, &c);
+    for (n = 0; bson_index_cursor_next(&c, &offset); ++n)
+    {
+    }
+    errors += n != 3 || strcmp(bson_index_path(idx), "a.b") != 0 || bson_index_count(idx) != 7;
+    bson_index_close(idx);
+    
+    /* Empty collection */
+    errors += bson_index_build(fd, "", 0, "a.b") || !(idx = bson_index_open(fd));
+    if(idx)
+    {
+        bson_index_range(idx, 0, 0, 0, 0, &c);
+        errors += bson_index_cursor_next(&c, &offset) != 0;
+        bson_index_close(idx);
+    }
+    close(fd);
+    bson_batch_deinit(&b);
+    printf("index: order=%s errors=%d\n", order, errors);
+    
+    return errors;
+}
+
+struct test_wal_writer
+{
+    bson_wal_ref        wal;
+    int                 id;
+    int                 errors;
+};
+
+static void* test_wal_write(void* arg)
+{
+    struct test_wal_writer* t = (struct test_wal_writer *)arg;
+    char json[64];
+    for (int i = 0; i < 50; ++i)
+    {
+        int n = snprintf(json, sizeof(json), "{\"writer\": %d, \"i\": %d}", t->id, i);
+        bson_document_ref doc = json2bson(json, n);
+        uint64_t lsn = 0;
+        /* Every tenth record is committed, the rest are appended */
+        t->errors += i % 10 == 9 ? bson_wal_commit(t->wal, doc, &lsn) || !lsn : bson_wal_append(t->wal, doc);
+        bson_document_destroy(doc);
+    }
+    t->errors += bson_wal_flush(t->wal);
+    return 0;
+}
+
+struct test_wal_replay
+{
+    uint64_t            count;
+    uint64_t            last_lsn;
+    int                 next[2];    /* Next expected "i" of each writer */
+    int                 errors;
+};
+
+static int test_wal_replay(void* ctx, uint64_t lsn, bson_document_ref doc)
+{
+    struct test_wal_replay* r = (struct test_wal_replay *)ctx;
+    bson_element_ref writer = bson_document_find_key(doc, "writer", 6);
+    bson_element_ref i = bson_document_find_key(doc, "i", 1);
+    if(!writer || !i)
+    {
+        r->errors++;
+        return 0;
+    }
+    const int id = *(int32_t *)bson_element_value(writer) & 1;
+    /* Records of one writer keep their order */
+    r->errors += lsn != r->last_lsn + 1 || *(int32_t *)bson_element_value(i) != r->next[id];
+    r->next[id] = *(int32_t *)bson_element_value(i) + 1;
+    r->last_lsn = lsn;
+    r->count++;
+    return 0;
+}
+
+static inline int test_wal()
+{
+    int errors = bson_crc32c(0, "123456789", 9) != 0xE3069283u ||
+                 bson_crc32c_portable(0, "123456789", 9) != 0xE3069283u ||
+                 bson_crc32c(bson_crc32c(0, "1234", 4), "56789", 5) != 0xE3069283u;
+    
+    char name[] = "/tmp/bson_wal_XXXXXX";
+    int fd = mkstemp(name);
+    unlink(name);
+    bson_wal_ref wal = bson_wal_open(fd, 16, 0, 0);
+    if(!wal)
+    {
+        printf("wal: errors=%d\n", errors + 1);
+        close(fd);
+        return errors + 1;
+    }
+    struct test_wal_writer writers[2] = { { wal, 0, 0 }, { wal, 1, 0 } };
+    pthread_t threads[2];
+    for (int i = 0; i < 2; ++i)
+    {
+        pthread_create(&threads[i], 0, test_wal_write, &writers[i]);
+    }
+    for (int i = 0; i < 2; ++i)
+    {
+        pthread_join(threads[i], 0);
+        errors += writers[i].errors;
+    }
+    struct bson_wal_stats stats;
+    bson_wal_stats(wal, &stats);
+    errors += stats.records != 100 || !stats.batches || stats.batches > stats.records;
+    errors += bson_wal_close(wal);
+    
+    /* Torn tail: a record header without its document */
+    static const char garbage[] = { 30, 0, 0, 0, 1, 2, 3, 4, 101, 0, 0, 0, 0, 0, 0, 0, 30 };
+    const off_t size = lseek(fd, 0, SEEK_END);
+    errors += write(fd, garbage, sizeof(garbage)) != sizeof(garbage);
+    
+    struct test_wal_replay replay = { 0, 0, { 0, 0 }, 0 };
+    uint64_t nrecords, valid;
+    errors += bson_wal_recover(fd, test_wal_replay, &replay, &nrecords, &valid);
+    errors += replay.errors + (replay.count != 100) + (nrecords != 100) + (valid != (uint64_t)size);
+    errors += replay.next[0] != 50 || replay.next[1] != 50;
+    
+    /* Reopening drops the tail and continues numbering */
+    wal = bson_wal_open(fd, 0, 0, 0);
+    errors += !wal;
+    if(wal)
+    {
+        static const char json[] = "{\"writer\": 0, \"i\": 50}";
+        bson_document_ref doc = json2bson(json, sizeof(json) - 1);
+        uint64_t lsn = 0;
+        errors += bson_wal_commit(wal, doc, &lsn) || lsn != 101;
+        bson_document_destroy(doc);
+        errors += bson_wal_close(wal);
+    }
+    errors += lseek(fd, 0, SEEK_END) <= size;
+    close(fd);
+    printf("wal: records=%llu errors=%d\n", (unsigned long long)stats.records, errors);
+    
+    return errors;
+}
+
+static inline int test_lz()
+{
+    /* Repetitive text with a few distinct runs */
+    char raw[4096], restored[4096];
+    for (size_t i = 0; i < sizeof(raw); ++i)
+    {
+        raw[i] = "compressible block of documents "[i % 32] + (char)(i / 1024);
+    }
+    char compressed[bson_lz_compress_bound(sizeof(raw))];
+    const size_t n = bson_lz_compress(raw, sizeof(raw), compressed, sizeof(compressed));
+    int errors = n == 0 || n >= sizeof(raw) / 4;
+    errors += bson_lz_decompress(compressed, n, restored, sizeof(restored)) != 0 ||
+              memcmp(raw, restored, sizeof(raw)) != 0;
+    
+    /* Truncated stream, wrong original size and a match before the start */
+    static const char bad_offset[] = { 0x10, 'A', 5, 0 };
+    errors += bson_lz_decompress(compressed, n - 1, restored, sizeof(restored)) != 1;
+    errors += bson_lz_decompress(compressed, n, restored, sizeof(restored) - 1) != 1;
+    errors += bson_lz_decompress(bad_offset, sizeof(bad_offset), restored, 5) != 1;
+    
+    /* Empty input */
+    errors += bson_lz_decompress(compressed, bson_lz_compress(raw, 0, compressed, sizeof(compressed)),
+                                 restored, 0) != 0;
+    
+    printf("lz: compressed=%zu/%zu errors=%d\n", n, sizeof(raw), errors);
+    return errors;
+}
+
+static inline int test_blockfile()
+{
+    char name[] = "/tmp/bson_blockfile_XXXXXX";
+    int fd = mkstemp(name);
+    unlink(name);
+    
+    /* Documents ordered by the first element, about 10 per block */
+    bson_blockfile_writer_ref w = bson_blockfile_writer_create(fd, 512);
+    int errors = !w;
+    for (int32_t i = 0; w && i < 1000; ++i)
+    {
+        bson_document_builder_ref b = bson_document_builder_create();
+        bson_document_builder_append_i(b, "_id", i);
+        bson_document_builder_append_str(b, "payload", "repeated payload of every document");
+        bson_document_ref doc = bson_document_builder_finalize(b);
+        errors += bson_blockfile_writer_append(w, doc);
+        bson_document_destroy(doc);
+    }
+    errors += w && bson_blockfile_writer_finalize(w);
+    
+    bson_blockfile_reader_ref r = bson_blockfile_reader_open(fd);
+    if(errors || !r)
+    {
+        printf("blockfile: errors=%d\n", errors + !r);
+        close(fd);
+        return errors + !r;
+    }
+    const size_t nblocks = bson_blockfile_reader_nblocks(r);
+    errors += bson_blockfile_reader_ndocs(r) != 1000 || nblocks < 10;
+    
+    /* Random access, then iteration over all blocks */
+    bson_blockfile_block_t block = BSON_BLOCKFILE_BLOCK_INITIALIZER;
+    for (uint64_t n = 0; n < 1000; n += 37)
+    {
+        bson_document_ref doc = bson_blockfile_reader_get(r, n, &block);
+        bson_element_ref e = doc ? bson_document_find_key(doc, "_id", 3) : 0;
+        errors += !e || *(int32_t *)bson_element_value(e) != (int32_t)n;
+    }
+    errors += bson_blockfile_reader_get(r, 1000, &block) != 0;
+    int32_t next = 0;
+    for (size_t i = 0; i < nblocks; ++i)
+    {
+        errors += bson_blockfile_reader_load(r, i, &block);
+        for (uint32_t d = 0; d < block.ndocs; ++d)
+        {
+            bson_element_ref e = bson_document_find_key(bson_blockfile_block_doc(&block, d), "_id", 3);
+            errors += !e || *(int32_t *)bson_element_value(e) != next++;
+        }
+    }
+    errors += next != 1000;
+    
+    /* Blocks by range of _id cover the range and skip the rest */
+    char low[BSON_INDEX_KEY_SIZE], high[BSON_INDEX_KEY_SIZE];
+    int32_t from = 300, to = 399;
+    const size_t nlow = bson_index_key(bson_type_int, (const char *)&from, low);
+    const size_t nhigh = bson_index_key(bson_type_int, (const char *)&to, high);
+    size_t first;
+    size_t found = bson_blockfile_reader_find_range(r, low, nlow, high, nhigh, &first);
+    const struct bson_blockfile_block_info* begin = bson_blockfile_reader_info(r, first);
+    const struct bson_blockfile_block_info* end = bson_blockfile_reader_info(r, first + found - 1);
+    errors += found == 0 || found >= nblocks / 2 || begin->first_doc > 300 || end->first_doc + end->ndocs <= 399;
+    errors += bson_blockfile_reader_find_range(r, 0, 0, 0, 0, &first) != nblocks || first != 0;
+    errors += bson_blockfile_reader_find_range(r, high, nhigh, low, nlow, &first) != 0;
+    bson_blockfile_block_deinit(&block);
+    bson_blockfile_reader_close(r);
+    
+    /* Empty file */
+    errors += ftruncate(fd, 0) != 0 || lseek(fd, 0, SEEK_SET) != 0;
+    w = bson_blockfile_writer_create(fd, 0);
+    errors += !w || bson_blockfile_writer_finalize(w);
+    r = bson_blockfile_reader_open(fd);
+    errors += !r;
+    if(r)
+    {
+        errors += bson_blockfile_reader_nblocks(r) != 0 || bson_blockfile_reader_ndocs(r) != 0;
+        errors += bson_blockfile_reader_get(r, 0, &block) != 0;
+        errors += bson_blockfile_reader_find_range(r, low, nlow, high, nhigh, &first) != 0;
+        bson_blockfile_reader_close(r);
+    }
+    close(fd);
+    
+    printf("blockfile: blocks=%zu range=%zu errors=%d\n", nblocks, found, errors);
+    return errors;
+}
+
+static inline int test_keydict()
+{
+    static const char json[] =
+        "{\"name\": \"a\", \"tags\": [\"x\", \"y\"], \"items\": [{\"name\": \"b\", \"qty\": 1}, "
+        "{\"name\": \"c\", \"qty\": 2}], \"meta\": {\"name\": \"d\", \"empty\": {}}}";
+    bson_document_ref doc = json2bson(json, sizeof(json) - 1);
+    bson_keydict_ref dict = bson_keydict_create();
+    bson_compact_ref c = doc && dict ? bson_keydict_compact(dict, doc) : 0;
+    if(!c)
+    {
+        printf("keydict: errors=1\n");
+        if(dict)
+        {
+            bson_keydict_destroy(dict);
+        }
+        if(doc)
+        {
+            bson_document_destroy(doc);
+        }
+        return 1;
+    }
+    
+    /* Keys are interned once, the expanded document is byte for byte the same */
+    const int32_t size = bson_document_size(doc);
+    int errors = bson_keydict_count(dict) != 6 || bson_compact_size(c) >= size;
+    bson_document_ref expanded = bson_keydict_expand(dict, c);
+    errors += !expanded || bson_document_size(expanded) != size || memcmp(expanded->data, doc->data, size) != 0;
+    if(expanded)
+    {
+        bson_document_destroy(expanded);
+    }
+    
+    /* Dictionary survives saving and loading */
+    bson_array_ref saved = bson_keydict_save(dict);
+    bson_keydict_ref loaded = bson_keydict_load(saved);
+    size_t nkey;
+    errors += !loaded || bson_keydict_lookup(loaded, "qty", 3) != bson_keydict_lookup(dict, "qty", 3) ||
+              strcmp(bson_keydict_key(loaded, bson_keydict_lookup(dict, "meta", 4), &nkey), "meta") || nkey != 4;
+    if(loaded)
+    {
+        expanded = bson_keydict_expand(loaded, c);
+        errors += !expanded || memcmp(expanded->data, doc->data, size) != 0;
+        if(expanded)
+        {
+            bson_document_destroy(expanded);
+        }
+        bson_keydict_destroy(loaded);
+    }
+    bson_array_destroy(saved);
+    
+    /* Iteration resolves keys of documents and indexes of arrays */
+    bson_compact_iterator_t i, child;
+    bson_compact_iterator_init(&i, dict, c);
+    int n = 0;
+    while(bson_compact_iterator_next(&i))
+    {
+        n++;
+        if(bson_compact_iterator_type(&i) == bson_type_array)
+        {
+            bson_compact_iterator_child(&i, &child);
+            errors += !bson_compact_iterator_next(&child) || strcmp(bson_compact_iterator_key(&child, 0), "0");
+        }
+    }
+    errors += n != 4;
+    
+    /* Key IDs longer than 5 bytes and unknown IDs are rejected */
+    static const char overlong[] = { 13, 0, 0, 0, bson_type_null, '\x80', '\x80', '\x80', '\x80', '\x80', 0, 0, 0 };
+    static const char unknown[] = { 8, 0, 0, 0, bson_type_null, '\x7f', 0, 0 };
+    errors += bson_keydict_expand(dict, (bson_compact_ref)overlong) != 0;
+    errors += bson_keydict_expand(dict, (bson_compact_ref)unknown) != 0;
+    bson_compact_iterator_init(&i, dict, (bson_compact_ref)overlong);
+    errors += bson_compact_iterator_next(&i) != 0;
+    
+    printf("keydict: keys=%u size=%d/%d errors=%d\n", bson_keydict_count(dict), bson_compact_size(c), size, errors);
+    bson_compact_destroy(c);
+    bson_keydict_destroy(dict);
+    bson_document_destroy(doc);
+    return errors;
+}
+
+static inline int test_stats()
+{
+#ifdef BSON_ENABLE_STATS
+    static const char json[] = "{\"a\": 1, \"b\": \"text\", \"c\": {\"d\": true}, \"e\": [1.5]}";
+    bson_stats_reset();
+    bson_document_ref doc = json2bson(json, sizeof(json) - 1);
+    int errors = !doc || json2bson("{\"a\": tru}", 10) != 0;
+    
+    struct bson_stats s;
+    bson_stats_snapshot(&s);
+    errors += s.threads == 0;
+    errors += s.counters[BSON_STATS_JSON_DOCUMENTS] != 2 || s.counters[BSON_STATS_JSON_BYTES] != sizeof(json) - 1 + 10;
+    
+    /* Embedded documents are built in the region of the parent, so only the parsed one is finalized */
+    errors += s.counters[BSON_STATS_DOCUMENTS] != 1 ||
+              (doc && s.counters[BSON_STATS_DOCUMENT_BYTES] != (uint64_t)bson_document_size(doc));
+    errors += s.elements[bson_type_int] != 1 || s.elements[bson_type_string] != 1 || s.elements[bson_type_bool] != 1 ||
+              s.elements[bson_type_document] != 1 || s.elements[bson_type_array] != 1 ||
+              s.elements[bson_type_float] != 1;
+    
+    /* Only the successful parse is timed, the failed one is counted as an error */
+    uint64_t sizes = 0, times = 0, failures = 0;
+    for (int i = 0; i < BSON_STATS_HISTOGRAM_BUCKETS; ++i)
+    {
+        sizes += s.document_sizes[i];
+        times += s.parse_times[i];
+    }
+    for (int i = 0; i < BSON_STATS_ERRORS; ++i)
+    {
+        failures += s.errors[i];
+    }
+    errors += sizes != 1 || times != 1 || failures != 1;
+    
+    /* Reset clears the counters */
+    bson_stats_reset();
+    bson_stats_snapshot(&s);
+    errors += s.counters[BSON_STATS_JSON_DOCUMENTS] != 0;
+    if(doc)
+    {
+        bson_document_destroy(doc);
+    }
+    printf("stats: threads=%u errors=%d\n", s.threads, errors);
+    return errors;
+#else
+    struct bson_stats s;
+    bson_stats_snapshot(&s);
+    const int errors = s.counters[BSON_STATS_DOCUMENTS] != 0;
+    printf("stats: disabled errors=%d\n", errors);
+    return errors;
+#endif
+}
+
+/* Entry of the profiler report for the path or 0 */
+static bson_document_ref test_schema_path(bson_document_ref report, const char* path)
+{
+    bson_element_ref paths = bson_document_find_key(report, "paths", 5);
+    if(!paths)
+    {
+        return 0;
+    }
+    bson_iterator_t iter;
+    bson_element_ref el;
+    for (el = bson_iterator_init(&iter, (bson_document_ref)bson_element_value(paths)); !bson_iterator_end(&iter);
+         el = bson_iterator_next(&iter))
+    {
+        bson_document_ref entry = (bson_document_ref)bson_element_value(el);
+        bson_element_ref name = bson_document_find_key(entry, "path", 4);
+        if(name && strcmp(bson_element_value(name) + sizeof(int32_t), path) == 0)
+        {
+            return entry;
+        }
+    }
+    return 0;
+}
+
+/* Integer field of the entry or -1 */
+static int64_t test_schema_long(bson_document_ref entry, const char* path)
+{
+    bson_element_ref e = entry ? bson_document_find_path(entry, path, strlen(path)) : 0;
+    return e && bson_element_type(e) == bson_type_long ? *(int64_t *)bson_element_value(e) : -1;
+}
+
+static inline int test_schema_profiler()
+{
+    bson_schema_profiler_ref all = bson_schema_profiler_create(0);
+    bson_schema_profiler_ref even = bson_schema_profiler_create(0);
+    bson_schema_profiler_ref odd = bson_schema_profiler_create(0);
+    char json[128];
+    int errors = 0;
+    for (int i = 0; i < 1000; ++i)
+    {
+        /* "opt" is an int in every fourth document and a string in the next one */
+        int n = snprintf(json, sizeof(json), "{\"_id\": %d, \"kind\": \"k%d\", \"tags\": [%d, %d]%s}", i, i % 10,
+                         i % 3, i % 7, i % 4 == 0 ? ", \"opt\": 1" : i % 4 == 1 ? ", \"opt\": \"one\"" : "");
+        bson_document_ref doc = json2bson(json, n);
+        if(!doc)
+        {
+            errors++;
+            continue;
+        }
+        bson_schema_profiler_add(all, doc);
+        bson_schema_profiler_add(i % 2 ? odd : even, doc);
+        bson_document_destroy(doc);
+    }
+    errors += bson_schema_profiler_merge(even, odd) || bson_schema_profiler_count(even) != 1000;
+    
+    bson_document_ref report = bson_schema_profiler_report(all);
+    bson_document_ref merged = bson_schema_profiler_report(even);
+    
+    /* Merging partial profiles gives the single pass report, sketches included */
+    errors += !report || !merged || bson_document_size(report) != bson_document_size(merged) ||
+              memcmp(report->data, merged->data, bson_document_size(report)) != 0;
+    if(!report)
+    {
+        printf("schema profiler: errors=%d\n", errors);
+        bson_schema_profiler_destroy(odd);
+        bson_schema_profiler_destroy(even);
+        bson_schema_profiler_destroy(all);
+        return errors;
+    }
+    
+    bson_document_ref id = test_schema_path(report, "_id");
+    bson_document_ref kind = test_schema_path(report, "kind");
+    bson_document_ref tags = test_schema_path(report, "tags");
+    bson_document_ref tag = test_schema_path(report, "tags.$");
+    bson_document_ref opt = test_schema_path(report, "opt");
+    errors += test_schema_long(report, "documents") != 1000 || test_schema_long(report, "dropped") != 0;
+    errors += test_schema_long(id, "count") != 1000 || test_schema_long(id, "types.int") != 1000;
+    errors += test_schema_long(kind, "count") != 1000 || test_schema_long(kind, "types.string") != 1000;
+    errors += test_schema_long(tags, "types.array") != 1000 || test_schema_long(tags, "array.count") != 1000;
+    errors += test_schema_long(tag, "count") != 2000 || test_schema_long(tag, "types.int") != 2000;
+    errors += test_schema_long(opt, "count") != 500 || test_schema_long(opt, "types.int") != 250 ||
+              test_schema_long(opt, "types.string") != 250;
+    
+    /* Cardinality sketches have about 3% error */
+    const int64_t ids = test_schema_long(id, "cardinality");
+    errors += ids < 900 || ids > 1100;
+    errors += test_schema_long(kind, "cardinality") != 10 || test_schema_long(tag, "cardinality") != 7 ||
+              test_schema_long(opt, "cardinality") != 2;
+    
+    printf("schema profiler: cardinality=%lld errors=%d\n", (long long)ids, errors);
+    if(merged)
+    {
+        bson_document_destroy(merged);
+    }
+    bson_document_destroy(report);
+    bson_schema_profiler_destroy(odd);
+    bson_schema_profiler_destroy(even);
+    bson_schema_profiler_destroy(all);
+    return errors;
+}
+
+/* Selects documents with n % 7 == 3 or n % 13 == 0 */
+static int test_scan_filter(void* ctx, size_t index, bson_document_ref doc)
+{
+    bson_element_ref e = bson_document_find_key(doc, "n", 1);
+    const int32_t n = e ? *(int32_t *)bson_element_value(e) : -1;
+    return n % 7 == 3 || n % 13 == 0;
+}
+
+static inline int test_scan()
+{
+    bson_batch_t b = BSON_BATCH_INITIALIZER;
+    for (int32_t i = 0; i < 10007; ++i)
+    {
+        bson_document_builder_ref db = bson_document_builder_create();
+        bson_document_builder_append_i(db, "n", i);
+        bson_document_ref doc = bson_document_builder_finalize(db);
+        bson_batch_append(&b, doc);
+        bson_document_destroy(doc);
+    }
+    
+    bson_document_ref* docs;
+    size_t ndocs;
+    int errors = bson_scan_index_buffer(bson_batch_data(&b), bson_batch_size(&b), &docs, &ndocs);
+    if(errors)
+    {
+        printf("scan: errors=%d\n", errors);
+        bson_batch_deinit(&b);
+        return errors;
+    }
+    errors += ndocs != 10007;
+    
+    /* Serial filter is the reference */
+    size_t* expected = malloc(ndocs * sizeof(size_t));
+    size_t nexpected = 0;
+    for (size_t i = 0; i < ndocs; ++i)
+    {
+        if(test_scan_filter(0, i, docs[i]))
+        {
+            expected[nexpected++] = i;
+        }
+    }
+    
+    /* Small morsels, the last one partial, spread over several workers */
+    bson_scan_pool_ref pool = bson_scan_pool_create(4);
+    struct bson_scan_stats stats[4];
+    static const size_t morsels[] = { 1, 64, 1000, 0 };
+    bson_selection_t sel = { 0, 0 };
+    for (size_t m = 0; m < sizeof(morsels) / sizeof(morsels[0]); ++m)
+    {
+        errors += bson_scan(pool, docs, ndocs, morsels[m], test_scan_filter, 0, &sel, stats);
+        errors += sel.count != nexpected || memcmp(sel.indexes, expected, nexpected * sizeof(size_t)) != 0;
+        
+        size_t scanned = 0, selected = 0;
+        for (unsigned w = 0; w < bson_scan_pool_size(pool); ++w)
+        {
+            scanned += stats[w].documents;
+            selected += stats[w].selected;
+        }
+        errors += scanned != ndocs || selected != nexpected;
+        bson_selection_deinit(&sel);
+    }
+    
+    /* Nothing to scan */
+    errors += bson_scan(pool, docs, 0, 64, test_scan_filter, 0, &sel, 0) || sel.count != 0;
+    bson_selection_deinit(&sel);
+    
+    printf("scan: selected=%zu errors=%d\n", nexpected, errors);
+    bson_scan_pool_destroy(pool);
+    free(expected);
+    free(docs);
+    bson_batch_deinit(&b);
+    return errors;
 }
 
 int main(int argc, char* argv[])
 {
-    test_oid();
+    int errors = test_oid();
+    
+    errors += test_cpl_array();
+    
+    errors += test_builder();
+    
+    errors += test_builder_n();
+    
+    errors += test_sized_builder();
+    
+    errors += test_wire();
+    
+    errors += test_find_key();
+    
+    errors += test_json_extended();
+    
+    errors += test_json_writer();
+    
+    errors += test_handle();
+    
+    errors += test_json_cache();
+    
+    errors += test_hash();
+    
+    errors += test_partition();
+    
+    errors += test_oid_chunks();
+    
+    errors += test_index();
+    
+    errors += test_wal();
+    
+    errors += test_lz();
+    
+    errors += test_blockfile();
+    
+    errors += test_keydict();
+    
+    errors += test_stats();
     
-    test_cpl_array();
+    errors += test_schema_profiler();
     
-    test_builder();
+    errors += test_scan();
     
-    return EXIT_SUCCESS;
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
 }
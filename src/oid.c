@@ -37,7 +37,8 @@ static int32_t s_sequential_inc32 = 0;
 /*********************** Private ObjectID interface ***************************/
 static void bson_oid_generate_machine_and_pid(struct machine_and_pid *__restrict p)
 {
-    *(int64_t *)p = cpl_random_generate_next64();
+    int64_t r = cpl_random_generate_next64();
+    memcpy(p, &r, sizeof(*p));
     pid_t _pid = getpid();
     p->pid ^= (uint16_t)_pid;
     *(uint16_t *)&p->machine_number[1] ^= _pid >> 16;
@@ -71,7 +72,7 @@ void bson_oid_init_with_str(struct bson_oid *__restrict oid, const char *__restr
 
 void bson_oid_init(bson_oid_ref __restrict oid)
 {
-    static struct machine_and_pid machine_and_pid = { 0, 0 };
+    static struct machine_and_pid machine_and_pid = { { 0 }, 0 };
     static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
     if(machine_and_pid.pid == 0)
     {
@@ -0,0 +1,128 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "oidchunk.h"
+
+/*************************** Public interface *********************************/
+size_t bson_oid_split(const bson_oid_ref* __restrict oids, const uint32_t* __restrict sizes, size_t n,
+                      uint64_t max_weight, bson_oid_chunk_t** __restrict chunks)
+{
+    *chunks = 0;
+    if(!n || !max_weight)
+    {
+        return 0;
+    }
+    
+    uint64_t total = n;
+    if(sizes)
+    {
+        total = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            total += sizes[i];
+        }
+        if(!total)
+        {
+            sizes = 0;
+            total = n;
+        }
+    }
+    
+    /* Item goes to the chunk its starting weight falls into. Rounds up
+       without overflow, max_weight may be UINT64_MAX for no limit */
+    const uint64_t nchunks = total / max_weight + (total % max_weight != 0);
+    bson_oid_chunk_t* c = malloc(nchunks * sizeof(bson_oid_chunk_t));
+    if(!c)
+    {
+        return 0;
+    }
+    
+    size_t count = 0;
+    uint64_t prefix = 0;
+    uint64_t boundary = 0;      /* Starting weight of the next chunk */
+    for (size_t i = 0; i < n; ++i)
+    {
+        const uint64_t w = sizes ? sizes[i] : 1;
+        if(prefix >= boundary)
+        {
+            if(count)
+            {
+                c[count - 1].end = i;
+                c[count - 1].max = *oids[i - 1];
+            }
+            const uint64_t k = (unsigned __int128)prefix * nchunks / total;
+            boundary = (uint64_t)(((unsigned __int128)(k + 1) * total + nchunks - 1) / nchunks);
+            c[count].begin = i;
+            c[count].weight = 0;
+            c[count].min = *oids[i];
+            count++;
+        }
+        c[count - 1].weight += w;
+        prefix += w;
+    }
+    c[count - 1].end = n;
+    c[count - 1].max = *oids[n - 1];
+    
+    *chunks = c;
+    return count;
+}
+
+size_t bson_oid_chunk_find_time(const bson_oid_chunk_t* __restrict chunks, size_t nchunks,
+                                uint32_t from, uint32_t to, size_t* __restrict first)
+{
+    bson_oid_t lo, hi;
+    bson_oid_init_time_min(&lo, from);
+    bson_oid_init_time_max(&hi, to);
+    
+    /* First chunk ending at or after lo */
+    size_t l = 0, r = nchunks;
+    while(l < r)
+    {
+        const size_t m = l + (r - l) / 2;
+        if(bson_oid_compare((bson_oid_ref)&chunks[m].max, &lo) < 0)
+        {
+            l = m + 1;
+        }
+        else
+        {
+            r = m;
+        }
+    }
+    *first = l;
+    
+    /* First chunk starting after hi */
+    r = nchunks;
+    while(l < r)
+    {
+        const size_t m = l + (r - l) / 2;
+        if(bson_oid_compare((bson_oid_ref)&chunks[m].min, &hi) <= 0)
+        {
+            l = m + 1;
+        }
+        else
+        {
+            r = m;
+        }
+    }
+    return from > to ? 0 : l - *first;
+}
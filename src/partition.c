@@ -0,0 +1,225 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "partition.h"
+
+#include <string.h>
+#include "hash.h"
+
+/*************************** Private types ************************************/
+struct bson_partition_job
+{
+    bson_document_ref*  docs;
+    size_t              ndocs;
+    const char*         path;
+    unsigned            npartitions;
+    unsigned            nworkers;
+    int                 pass;
+    uint64_t*           parts;      /* Key hash, then partition of every document */
+    size_t*             counts;     /* [worker][partition] documents, then index of the first one */
+    size_t*             bytes;      /* [worker][partition] bytes, then offset of the first document */
+    bson_batch_t*       out;
+};
+
+/*************************** Private interface ********************************/
+static void bson_partition_count(struct bson_partition_job* job, unsigned worker, size_t begin, size_t end)
+{
+    const unsigned np = job->npartitions;
+    size_t* __restrict counts = job->counts + (size_t)worker * np;
+    size_t* __restrict bytes = job->bytes + (size_t)worker * np;
+    uint64_t* __restrict parts = job->parts;
+    
+    bson_hash_path(job->docs + begin, end - begin, job->path, bson_hash_semantic, BSON_HASH_SEED, parts + begin);
+    for (size_t i = begin; i < end; ++i)
+    {
+        const unsigned p = bson_partition_of(parts[i], np);
+        const int32_t size = bson_document_size(job->docs[i]);
+        parts[i] = p;
+        counts[p]++;
+        bytes[p] += size;
+    }
+}
+
+static void bson_partition_scatter(struct bson_partition_job* job, unsigned worker, size_t begin, size_t end)
+{
+    const unsigned np = job->npartitions;
+    size_t* __restrict index = job->counts + (size_t)worker * np;
+    size_t* __restrict offset = job->bytes + (size_t)worker * np;
+    const uint64_t* __restrict parts = job->parts;
+    bson_batch_t* __restrict out = job->out;
+    
+    /*
+     * Small documents are gathered in a cache resident buffer per partition
+     * and flushed to the output in large copies, so P output streams don't
+     * thrash the cache and the TLB. Without the buffers copy directly.
+     */
+    const size_t nbuffer = (BSON_PARTITION_BUFFER_SIZE / np) & ~(size_t)63;
+    char* buffers = 0;
+    size_t* used = 0;
+    if(nbuffer >= 256 && !posix_memalign((void **)&buffers, 64, nbuffer * np))
+    {
+        used = calloc(np, sizeof(size_t));
+        if(!used)
+        {
+            free(buffers);
+            buffers = 0;
+        }
+    }
+    
+    if(!buffers)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const unsigned p = (unsigned)parts[i];
+            const bson_document_ref doc = job->docs[i];
+            const int32_t size = bson_document_size(doc);
+            out[p].offsets[index[p]++] = offset[p];
+            memcpy(out[p].data + offset[p], doc->data, size);
+            offset[p] += size;
+        }
+        return;
+    }
+    
+    for (size_t i = begin; i < end; ++i)
+    {
+        const unsigned p = (unsigned)parts[i];
+        const bson_document_ref doc = job->docs[i];
+        const int32_t size = bson_document_size(doc);
+        char* buffer = buffers + p * nbuffer;
+        out[p].offsets[index[p]++] = offset[p] + used[p];
+        if(used[p] + size > nbuffer)
+        {
+            memcpy(out[p].data + offset[p], buffer, used[p]);
+            offset[p] += used[p];
+            used[p] = 0;
+            if((size_t)size > nbuffer)
+            {
+                memcpy(out[p].data + offset[p], doc->data, size);
+                offset[p] += size;
+                continue;
+            }
+        }
+        memcpy(buffer + used[p], doc->data, size);
+        used[p] += size;
+    }
+    for (unsigned p = 0; p < np; ++p)
+    {
+        if(used[p])
+        {
+            memcpy(out[p].data + offset[p], buffers + p * nbuffer, used[p]);
+        }
+    }
+    free(used);
+    free(buffers);
+}
+
+static void bson_partition_worker(void* arg, unsigned worker)
+{
+    struct bson_partition_job* job = (struct bson_partition_job *)arg;
+    const size_t begin = job->ndocs * worker / job->nworkers;
+    const size_t end = job->ndocs * (worker + 1) / job->nworkers;
+    if(job->pass == 0)
+    {
+        bson_partition_count(job, worker, begin, end);
+    }
+    else
+    {
+        bson_partition_scatter(job, worker, begin, end);
+    }
+}
+
+/*************************** Public interface *********************************/
+int bson_partition(bson_scan_pool_ref __restrict pool, bson_batch_ref __restrict in, const char* __restrict path,
+                   unsigned npartitions, bson_batch_t* __restrict out)
+{
+    if(npartitions == 0 || npartitions > BSON_PARTITION_MAX)
+    {
+        return 1;
+    }
+    for (unsigned p = 0; p < npartitions; ++p)
+    {
+        bson_batch_reset(&out[p]);
+    }
+    if(!bson_batch_count(in))
+    {
+        return 0;
+    }
+    
+    struct bson_partition_job job;
+    job.docs = bson_batch_documents(in);
+    job.ndocs = bson_batch_count(in);
+    job.path = path;
+    job.npartitions = npartitions;
+    job.nworkers = bson_scan_pool_size(pool);
+    job.pass = 0;
+    job.parts = malloc(job.ndocs * sizeof(uint64_t));
+    job.counts = calloc((size_t)job.nworkers * npartitions, sizeof(size_t));
+    job.bytes = calloc((size_t)job.nworkers * npartitions, sizeof(size_t));
+    job.out = out;
+    
+    int rc = 1;
+    if(!job.docs || !job.parts || !job.counts || !job.bytes)
+    {
+        goto done;
+    }
+    
+    bson_scan_pool_run(pool, bson_partition_worker, &job);
+    
+    /* Every worker writes its documents of a partition after those of previous workers */
+    for (unsigned p = 0; p < npartitions; ++p)
+    {
+        size_t count = 0, size = 0;
+        for (unsigned w = 0; w < job.nworkers; ++w)
+        {
+            const size_t i = (size_t)w * npartitions + p;
+            const size_t c = job.counts[i], n = job.bytes[i];
+            job.counts[i] = count;
+            job.bytes[i] = size;
+            count += c;
+            size += n;
+        }
+        if(bson_batch_reserve(&out[p], count, size))
+        {
+            goto done;
+        }
+        out[p].count = count;
+        out[p].size = size;
+    }
+    
+    job.pass = 1;
+    bson_scan_pool_run(pool, bson_partition_worker, &job);
+    rc = 0;
+    
+done:
+    if(rc)
+    {
+        for (unsigned p = 0; p < npartitions; ++p)
+        {
+            bson_batch_reset(&out[p]);
+        }
+    }
+    free(job.bytes);
+    free(job.counts);
+    free(job.parts);
+    return rc;
+}
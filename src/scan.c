@@ -0,0 +1,339 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "scan.h"
+
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "cpl_atomic.h"
+
+/*************************** Private pool types *******************************/
+struct bson_scan_worker
+{
+    bson_scan_pool_ref  pool;
+    unsigned            index;
+    pthread_t           thread;
+};
+
+struct bson_scan_pool
+{
+    pthread_mutex_t     mutex;
+    pthread_cond_t      start;
+    pthread_cond_t      done;
+    unsigned            nthreads;
+    unsigned            pending;        /* Workers which didn't finish the job */
+    unsigned            generation;     /* Incremented for every job */
+    int                 shutdown;
+    void                (*job)(void *, unsigned);
+    void*               arg;
+    struct bson_scan_worker workers[1];
+};
+
+/*************************** Private pool interface ***************************/
+static void* bson_scan_worker_main(void* arg)
+{
+    struct bson_scan_worker* w = (struct bson_scan_worker *)arg;
+    bson_scan_pool_ref pool = w->pool;
+    unsigned seen = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+    for (;;)
+    {
+        while(pool->generation == seen && !pool->shutdown)
+        {
+            pthread_cond_wait(&pool->start, &pool->mutex);
+        }
+
+        if(pool->shutdown)
+        {
+            break;
+        }
+
+        seen = pool->generation;
+        void (*job)(void *, unsigned) = pool->job;
+        void* job_arg = pool->arg;
+        pthread_mutex_unlock(&pool->mutex);
+
+        job(job_arg, w->index);
+
+        pthread_mutex_lock(&pool->mutex);
+        if(--pool->pending == 0)
+        {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return 0;
+}
+
+static inline uint64_t bson_scan_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*************************** Public pool interface ****************************/
+bson_scan_pool_ref bson_scan_pool_create(unsigned nthreads)
+{
+    if(nthreads == 0)
+    {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = ncpu > 0 ? (unsigned)ncpu : 1;
+    }
+
+    bson_scan_pool_ref pool = (bson_scan_pool_ref)malloc(sizeof(struct bson_scan_pool) +
+                                                         (nthreads - 1) * sizeof(struct bson_scan_worker));
+    if(pool)
+    {
+        pthread_mutex_init(&pool->mutex, 0);
+        pthread_cond_init(&pool->start, 0);
+        pthread_cond_init(&pool->done, 0);
+        pool->nthreads = 1;
+        pool->pending = 0;
+        pool->generation = 0;
+        pool->shutdown = 0;
+        pool->job = 0;
+        pool->arg = 0;
+
+        for (unsigned i = 1; i < nthreads; ++i)
+        {
+            struct bson_scan_worker* w = &pool->workers[i];
+            w->pool = pool;
+            w->index = i;
+            if(pthread_create(&w->thread, 0, bson_scan_worker_main, w))
+            {
+                break;
+            }
+            pool->nthreads++;
+        }
+    }
+    return pool;
+}
+
+void bson_scan_pool_destroy(bson_scan_pool_ref pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (unsigned i = 1; i < pool->nthreads; ++i)
+    {
+        pthread_join(pool->workers[i].thread, 0);
+    }
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool);
+}
+
+unsigned bson_scan_pool_size(bson_scan_pool_ref pool)
+{
+    return pool->nthreads;
+}
+
+void bson_scan_pool_run(bson_scan_pool_ref pool, void (*job)(void *, unsigned), void* arg)
+{
+    if(pool->nthreads > 1)
+    {
+        pthread_mutex_lock(&pool->mutex);
+        pool->job = job;
+        pool->arg = arg;
+        pool->pending = pool->nthreads - 1;
+        pool->generation++;
+        pthread_cond_broadcast(&pool->start);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    job(arg, 0);
+
+    if(pool->nthreads > 1)
+    {
+        pthread_mutex_lock(&pool->mutex);
+        while(pool->pending)
+        {
+            pthread_cond_wait(&pool->done, &pool->mutex);
+        }
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+/*************************** Private scan interface ***************************/
+struct bson_scan_job
+{
+    const bson_document_ref*    docs;
+    size_t                      ndocs;
+    size_t                      morsel;
+    int32_t                     nmorsels;
+    int32_t                     next;       /* Next morsel to process */
+    bson_scan_filter_t          filter;
+    void*                       ctx;
+    size_t*                     indexes;
+    size_t*                     counts;     /* Selected documents per morsel */
+    struct bson_scan_stats*     stats;
+};
+
+static void bson_scan_job_run(void* arg, unsigned worker)
+{
+    struct bson_scan_job* job = (struct bson_scan_job *)arg;
+    struct bson_scan_stats local = { 0, 0, 0, 0, 0 };
+    const uint64_t started = bson_scan_now();
+
+    for (;;)
+    {
+        const int32_t m = cpl_atomic_increment(&job->next) - 1;
+        if(m >= job->nmorsels)
+        {
+            break;
+        }
+
+        const size_t begin = (size_t)m * job->morsel;
+        const size_t end = begin + job->morsel < job->ndocs ? begin + job->morsel : job->ndocs;
+        size_t* __restrict out = job->indexes + begin;
+        size_t count = 0;
+
+        for (size_t i = begin; i < end; ++i)
+        {
+            bson_document_ref doc = job->docs[i];
+            local.bytes += bson_document_size(doc);
+            if(job->filter(job->ctx, i, doc))
+            {
+                out[count++] = i;
+            }
+        }
+
+        job->counts[m] = count;
+        local.morsels++;
+        local.documents += end - begin;
+        local.selected += count;
+    }
+
+    local.nanoseconds = bson_scan_now() - started;
+    if(job->stats)
+    {
+        job->stats[worker] = local;
+    }
+}
+
+/*************************** Public scan interface ****************************/
+int bson_scan(bson_scan_pool_ref pool,
+              const bson_document_ref* docs, size_t ndocs, size_t morsel,
+              bson_scan_filter_t filter, void* ctx,
+              bson_selection_t* sel, struct bson_scan_stats* stats)
+{
+    if(morsel == 0)
+    {
+        morsel = BSON_SCAN_MORSEL_SIZE;
+    }
+
+    const size_t nmorsels = (ndocs + morsel - 1) / morsel;
+    if(nmorsels > INT32_MAX)
+    {
+        return 1;
+    }
+
+    sel->count = 0;
+    sel->indexes = (size_t *)malloc((ndocs ? ndocs : 1) * sizeof(size_t));
+    size_t* counts = (size_t *)malloc((nmorsels ? nmorsels : 1) * sizeof(size_t));
+    if(!sel->indexes || !counts)
+    {
+        free(counts);
+        bson_selection_deinit(sel);
+        return 1;
+    }
+
+    struct bson_scan_job job = {
+        .docs = docs,
+        .ndocs = ndocs,
+        .morsel = morsel,
+        .nmorsels = (int32_t)nmorsels,
+        .next = 0,
+        .filter = filter,
+        .ctx = ctx,
+        .indexes = sel->indexes,
+        .counts = counts,
+        .stats = stats
+    };
+
+    bson_scan_pool_run(pool, bson_scan_job_run, &job);
+
+    /* Every morsel wrote its selection at its own offset, compact them in order */
+    size_t count = 0;
+    for (size_t m = 0; m < nmorsels; ++m)
+    {
+        if(count != m * morsel)
+        {
+            memmove(sel->indexes + count, sel->indexes + m * morsel, counts[m] * sizeof(size_t));
+        }
+        count += counts[m];
+    }
+    sel->count = count;
+
+    free(counts);
+    return 0;
+}
+
+int bson_scan_index_buffer(const char* data, size_t size,
+                           bson_document_ref** docs, size_t* ndocs)
+{
+    size_t count = 0;
+    size_t off = 0;
+    while(off < size)
+    {
+        if(size - off < 5)
+        {
+            return 1;
+        }
+
+        int32_t len = *(const int32_t *)(data + off);
+        if(len < 5 || (size_t)len > size - off)
+        {
+            return 1;
+        }
+
+        off += len;
+        count++;
+    }
+
+    bson_document_ref* arr = (bson_document_ref *)malloc((count ? count : 1) * sizeof(bson_document_ref));
+    if(!arr)
+    {
+        return 1;
+    }
+
+    off = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        arr[i] = (bson_document_ref)(data + off);
+        off += *(const int32_t *)(data + off);
+    }
+
+    *docs = arr;
+    *ndocs = count;
+    return 0;
+}
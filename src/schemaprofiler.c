@@ -0,0 +1,425 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "schemaprofiler.h"
+
+#include <math.h>
+#include <string.h>
+#include "documentbuilder.h"
+#include "hash.h"
+#include "iterator.h"
+
+/*********************** Private profiler types *******************************/
+#define BSON_SCHEMA_HLL_REGISTERS           (1 << BSON_SCHEMA_PROFILER_HLL_BITS)
+#define BSON_SCHEMA_NTYPES                  32
+
+struct bson_schema_path
+{
+    char*       path;
+    size_t      length;
+    uint64_t    hash;
+    uint64_t    count;
+    uint64_t    types[BSON_SCHEMA_NTYPES];
+    uint32_t    min_size;
+    uint32_t    max_size;
+    uint64_t    total_size;
+    uint64_t    arrays;             /* Number of arrays seen at the path */
+    uint32_t    min_length;
+    uint32_t    max_length;
+    uint64_t    total_length;
+    uint8_t     hll[BSON_SCHEMA_HLL_REGISTERS];
+};
+
+struct bson_schema_profiler
+{
+    struct bson_schema_path**   slots;      /* Open addressing hash table */
+    size_t                      mask;
+    size_t                      npaths;
+    size_t                      max_paths;
+    uint64_t                    documents;
+    uint64_t                    dropped;    /* Fields which didn't fit into limits */
+};
+
+static const char* const s_type_names[BSON_SCHEMA_NTYPES] = {
+    "minKey", "double", "string", "object", "array", "binData", "undefined",
+    "objectId", "bool", "date", "null", "regex", "dbPointer", "javascript",
+    "symbol", "javascriptWithScope", "int", "timestamp", "long",
+    "decimal", 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, "unknown", "maxKey"
+};
+
+/*********************** Private profiler interface ***************************/
+static inline unsigned bson_schema_type_index(bson_type_t type)
+{
+    unsigned char t = (unsigned char)type;
+    if(t == (unsigned char)bson_type_minkey)
+    {
+        return 0;
+    }
+    if(t == bson_type_maxkey)
+    {
+        return BSON_SCHEMA_NTYPES - 1;
+    }
+    if(t >= BSON_SCHEMA_NTYPES - 2 || !s_type_names[t])
+    {
+        return BSON_SCHEMA_NTYPES - 2;
+    }
+    return t;
+}
+
+static struct bson_schema_path* bson_schema_profiler_lookup(bson_schema_profiler_ref __restrict p,
+                                                            const char* path, size_t length,
+                                                            uint64_t hash)
+{
+    size_t slot = hash & p->mask;
+    for (;;)
+    {
+        struct bson_schema_path* e = p->slots[slot];
+        if(!e)
+        {
+            break;
+        }
+        if(e->hash == hash && e->length == length && memcmp(e->path, path, length) == 0)
+        {
+            return e;
+        }
+        slot = (slot + 1) & p->mask;
+    }
+
+    if(p->npaths == p->max_paths)
+    {
+        return 0;
+    }
+
+    struct bson_schema_path* e = (struct bson_schema_path *)calloc(1, sizeof(struct bson_schema_path));
+    if(!e)
+    {
+        return 0;
+    }
+
+    e->path = (char *)malloc(length + 1);
+    if(!e->path)
+    {
+        free(e);
+        return 0;
+    }
+    memcpy(e->path, path, length);
+    e->path[length] = '\0';
+    e->length = length;
+    e->hash = hash;
+    e->min_size = UINT32_MAX;
+    e->min_length = UINT32_MAX;
+
+    p->slots[slot] = e;
+    p->npaths++;
+    return e;
+}
+
+static inline void bson_schema_hll_add(uint8_t* __restrict hll, uint64_t hash)
+{
+    const unsigned idx = (unsigned)(hash >> (64 - BSON_SCHEMA_PROFILER_HLL_BITS));
+    const uint64_t rest = (hash << BSON_SCHEMA_PROFILER_HLL_BITS) | (1ull << (BSON_SCHEMA_PROFILER_HLL_BITS - 1));
+    const uint8_t rank = (uint8_t)__builtin_clzll(rest) + 1;
+    if(hll[idx] < rank)
+    {
+        hll[idx] = rank;
+    }
+}
+
+static double bson_schema_hll_estimate(const uint8_t* __restrict hll)
+{
+    const double m = BSON_SCHEMA_HLL_REGISTERS;
+    double sum = 0;
+    unsigned zeros = 0;
+    for (unsigned i = 0; i < BSON_SCHEMA_HLL_REGISTERS; ++i)
+    {
+        sum += ldexp(1.0, -hll[i]);
+        zeros += hll[i] == 0;
+    }
+
+    double estimate = (0.7213 / (1 + 1.079 / m)) * m * m / sum;
+    if(estimate <= 2.5 * m && zeros)
+    {
+        estimate = m * log(m / zeros);
+    }
+    return estimate;
+}
+
+/* Returns number of elements in the document */
+static uint32_t bson_schema_profiler_walk(bson_schema_profiler_ref __restrict p,
+                                          bson_document_ref doc, int is_array,
+                                          char* path, size_t length)
+{
+    uint32_t nelements = 0;
+    bson_iterator_t iter;
+    bson_element_ref el;
+    for (el = bson_iterator_init(&iter, doc); !bson_iterator_end(&iter); el = bson_iterator_next(&iter))
+    {
+        nelements++;
+
+        const char* key = is_array ? "$" : bson_element_fieldname(el);
+        const size_t nkey = strlen(key);
+        const size_t sublength = length ? length + 1 + nkey : nkey;
+        if(sublength >= BSON_SCHEMA_PROFILER_MAX_PATH_LEN)
+        {
+            p->dropped++;
+            continue;
+        }
+
+        if(length)
+        {
+            path[length] = '.';
+        }
+        memcpy(path + sublength - nkey, key, nkey);
+
+        const bson_type_t type = bson_element_type(el);
+        const size_t size = bson_element_value_size(el);
+
+        struct bson_schema_path* e = bson_schema_profiler_lookup(p, path, sublength,
+                                                                 bson_hash_bytes(path, sublength, BSON_HASH_SEED));
+        if(e)
+        {
+            e->count++;
+            e->types[bson_schema_type_index(type)]++;
+            e->total_size += size;
+            if(size < e->min_size)
+            {
+                e->min_size = (uint32_t)size;
+            }
+            if(size > e->max_size)
+            {
+                e->max_size = (uint32_t)size;
+            }
+        }
+        else
+        {
+            p->dropped++;
+        }
+
+        if(type == bson_type_document || type == bson_type_array)
+        {
+            bson_document_ref sub = (bson_document_ref)bson_element_value(el);
+            uint32_t n = bson_schema_profiler_walk(p, sub, type == bson_type_array, path, sublength);
+            if(e && type == bson_type_array)
+            {
+                e->arrays++;
+                e->total_length += n;
+                if(n < e->min_length)
+                {
+                    e->min_length = n;
+                }
+                if(n > e->max_length)
+                {
+                    e->max_length = n;
+                }
+            }
+        }
+        else if(e)
+        {
+            /* Type is a part of the value, so 1 and 1.0 are distinct */
+            const uint64_t hash = bson_hash_bytes(bson_element_value(el), size, BSON_HASH_SEED + (unsigned char)type);
+            bson_schema_hll_add(e->hll, hash);
+        }
+    }
+    return nelements;
+}
+
+static int bson_schema_path_compare(const void* l, const void* r)
+{
+    const struct bson_schema_path* pl = *(const struct bson_schema_path **)l;
+    const struct bson_schema_path* pr = *(const struct bson_schema_path **)r;
+    return strcmp(pl->path, pr->path);
+}
+
+static bson_document_ref bson_schema_path_report(const struct bson_schema_path* __restrict e)
+{
+    bson_document_builder_ref b = bson_document_builder_create();
+    bson_document_builder_append_str(b, "path", e->path);
+    bson_document_builder_append_l(b, "count", (int64_t)e->count);
+
+    bson_document_builder_ref tb = bson_document_builder_create();
+    for (unsigned t = 0; t < BSON_SCHEMA_NTYPES; ++t)
+    {
+        if(e->types[t])
+        {
+            bson_document_builder_append_l(tb, s_type_names[t], (int64_t)e->types[t]);
+        }
+    }
+    bson_document_ref types = bson_document_builder_finalize(tb);
+    bson_document_builder_append_doc(b, "types", types);
+    bson_document_destroy(types);
+
+    bson_document_builder_append_i(b, "minSize", (int32_t)e->min_size);
+    bson_document_builder_append_i(b, "maxSize", (int32_t)e->max_size);
+    bson_document_builder_append_d(b, "avgSize", (double)e->total_size / e->count);
+    bson_document_builder_append_l(b, "cardinality", (int64_t)llround(bson_schema_hll_estimate(e->hll)));
+
+    if(e->arrays)
+    {
+        bson_document_builder_ref ab = bson_document_builder_create();
+        bson_document_builder_append_l(ab, "count", (int64_t)e->arrays);
+        bson_document_builder_append_i(ab, "minLength", (int32_t)e->min_length);
+        bson_document_builder_append_i(ab, "maxLength", (int32_t)e->max_length);
+        bson_document_builder_append_d(ab, "avgLength", (double)e->total_length / e->arrays);
+        bson_document_ref arr = bson_document_builder_finalize(ab);
+        bson_document_builder_append_doc(b, "array", arr);
+        bson_document_destroy(arr);
+    }
+
+    return bson_document_builder_finalize(b);
+}
+
+/*********************** Public profiler interface ****************************/
+bson_schema_profiler_ref bson_schema_profiler_create(size_t max_paths)
+{
+    if(max_paths == 0)
+    {
+        max_paths = BSON_SCHEMA_PROFILER_MAX_PATHS;
+    }
+
+    size_t nslots = 16;
+    while(nslots < max_paths * 2)
+    {
+        nslots <<= 1;
+    }
+
+    bson_schema_profiler_ref p = (bson_schema_profiler_ref)calloc(1, sizeof(struct bson_schema_profiler));
+    if(p)
+    {
+        p->slots = (struct bson_schema_path **)calloc(nslots, sizeof(struct bson_schema_path *));
+        if(!p->slots)
+        {
+            free(p);
+            return 0;
+        }
+        p->mask = nslots - 1;
+        p->max_paths = max_paths;
+    }
+    return p;
+}
+
+void bson_schema_profiler_destroy(bson_schema_profiler_ref p)
+{
+    for (size_t i = 0; i <= p->mask; ++i)
+    {
+        if(p->slots[i])
+        {
+            free(p->slots[i]->path);
+            free(p->slots[i]);
+        }
+    }
+    free(p->slots);
+    free(p);
+}
+
+void bson_schema_profiler_add(bson_schema_profiler_ref __restrict p, bson_document_ref doc)
+{
+    char path[BSON_SCHEMA_PROFILER_MAX_PATH_LEN];
+    p->documents++;
+    bson_schema_profiler_walk(p, doc, 0, path, 0);
+}
+
+int bson_schema_profiler_merge(bson_schema_profiler_ref __restrict dst,
+                               bson_schema_profiler_ref __restrict src)
+{
+    dst->documents += src->documents;
+    dst->dropped += src->dropped;
+
+    for (size_t i = 0; i <= src->mask; ++i)
+    {
+        const struct bson_schema_path* s = src->slots[i];
+        if(!s)
+        {
+            continue;
+        }
+
+        struct bson_schema_path* d = bson_schema_profiler_lookup(dst, s->path, s->length, s->hash);
+        if(!d)
+        {
+            dst->dropped += s->count;
+            continue;
+        }
+
+        d->count += s->count;
+        for (unsigned t = 0; t < BSON_SCHEMA_NTYPES; ++t)
+        {
+            d->types[t] += s->types[t];
+        }
+        d->total_size += s->total_size;
+        d->min_size = s->min_size < d->min_size ? s->min_size : d->min_size;
+        d->max_size = s->max_size > d->max_size ? s->max_size : d->max_size;
+
+        d->arrays += s->arrays;
+        d->total_length += s->total_length;
+        d->min_length = s->min_length < d->min_length ? s->min_length : d->min_length;
+        d->max_length = s->max_length > d->max_length ? s->max_length : d->max_length;
+
+        for (unsigned r = 0; r < BSON_SCHEMA_HLL_REGISTERS; ++r)
+        {
+            d->hll[r] = s->hll[r] > d->hll[r] ? s->hll[r] : d->hll[r];
+        }
+    }
+
+    return 0;
+}
+
+uint64_t bson_schema_profiler_count(bson_schema_profiler_ref p)
+{
+    return p->documents;
+}
+
+bson_document_ref bson_schema_profiler_report(bson_schema_profiler_ref p)
+{
+    struct bson_schema_path** entries = (struct bson_schema_path **)malloc((p->npaths + 1) * sizeof(struct bson_schema_path *));
+    if(!entries)
+    {
+        return 0;
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i <= p->mask; ++i)
+    {
+        if(p->slots[i] && p->slots[i]->count)
+        {
+            entries[n++] = p->slots[i];
+        }
+    }
+    qsort(entries, n, sizeof(struct bson_schema_path *), bson_schema_path_compare);
+
+    bson_array_builder_ref ab = bson_array_builder_create();
+    for (size_t i = 0; i < n; ++i)
+    {
+        bson_document_ref d = bson_schema_path_report(entries[i]);
+        bson_array_builder_append_doc(ab, d);
+        bson_document_destroy(d);
+    }
+    free(entries);
+    bson_array_ref paths = bson_array_builder_finalize(ab);
+
+    bson_document_builder_ref b = bson_document_builder_create();
+    bson_document_builder_append_l(b, "documents", (int64_t)p->documents);
+    bson_document_builder_append_l(b, "dropped", (int64_t)p->dropped);
+    bson_document_builder_append_arr(b, "paths", paths);
+    bson_array_destroy(paths);
+
+    return bson_document_builder_finalize(b);
+}
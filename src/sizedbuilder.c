@@ -0,0 +1,87 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sizedbuilder.h"
+
+#include <stdlib.h>
+
+/*********************** Private sized builder interface **********************/
+static void bson_sized_builder_pass(bson_sized_builder_ref __restrict b, char* data, size_t size,
+                                    bson_sized_builder_emit_t emit, void* ctx)
+{
+    b->data = data;
+    b->end = size;
+    b->offset = 0;
+    b->depth = 0;
+    b->error = 0;
+
+    bson_sized_builder_open(b, bson_type_document, 0);
+    emit(b, ctx);
+    bson_sized_builder_close(b);
+    if(b->depth != 0)
+    {
+        b->error = 1;
+    }
+}
+
+/*********************** Public sized builder interface ***********************/
+size_t bson_sized_builder_measure(bson_sized_builder_emit_t emit, void* ctx)
+{
+    struct bson_sized_builder b;
+    bson_sized_builder_pass(&b, 0, 0, emit, ctx);
+    return b.error ? 0 : b.offset;
+}
+
+int bson_sized_builder_write(bson_sized_builder_emit_t emit, void* ctx, char* data, size_t size)
+{
+    struct bson_sized_builder b;
+    bson_sized_builder_pass(&b, data, size, emit, ctx);
+    return b.error || b.offset != size;
+}
+
+bson_document_ref bson_sized_builder_build(bson_sized_builder_emit_t emit, void* ctx)
+{
+    struct bson_sized_builder b;
+    bson_sized_builder_pass(&b, 0, 0, emit, ctx);
+    if(b.error || b.offset > INT32_MAX)
+    {
+        return 0;
+    }
+
+    const size_t size = b.offset;
+    char* data = (char *)malloc(size);
+    if(!data)
+    {
+        return 0;
+    }
+    BSON_STATS_INC(BSON_STATS_ALLOCATIONS);
+
+    if(bson_sized_builder_write(emit, ctx, data, size))
+    {
+        free(data);
+        return 0;
+    }
+
+    BSON_STATS_DOCUMENT(size);
+    return (bson_document_ref)data;
+}
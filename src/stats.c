@@ -0,0 +1,193 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stats.h"
+
+#include <stddef.h>
+#include <string.h>
+
+static const char* const s_counter_names[BSON_STATS_COUNTERS] =
+{
+    "allocations",
+    "documents",
+    "documentBytes",
+    "regionGrowths",
+    "jsonDocuments",
+    "jsonBytes",
+    "jsonCopies",
+    "jsonCopyBytes"
+};
+
+static const char* const s_error_names[BSON_STATS_ERRORS] =
+{
+    "char",
+    "string",
+    "number",
+    "literal",
+    "oid",
+    "structure"
+};
+
+const char* bson_stats_counter_name(int counter)
+{
+    return counter >= 0 && counter < BSON_STATS_COUNTERS ? s_counter_names[counter] : 0;
+}
+
+const char* bson_stats_error_name(int error)
+{
+    return error >= 0 && error < BSON_STATS_ERRORS ? s_error_names[error] : 0;
+}
+
+#ifdef BSON_ENABLE_STATS
+
+#include <pthread.h>
+#include <time.h>
+
+/*
+ * Counters of a thread. Finished threads add their counters to s_retired.
+ */
+struct bson_stats_thread
+{
+    struct bson_stats           stats;
+    struct bson_stats_thread*   next;
+    struct bson_stats_thread*   prev;
+};
+
+__thread struct bson_stats* bson_stats_tls;
+
+extern inline struct bson_stats* bson_stats_local();
+extern inline void bson_stats_histogram_add(uint64_t* __restrict h, uint64_t value);
+
+static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t s_once = PTHREAD_ONCE_INIT;
+static pthread_key_t s_key;
+static struct bson_stats_thread* s_threads;
+static struct bson_stats s_retired;
+
+/*********************** Private statistics interface *************************/
+static void bson_stats_sum(struct bson_stats* __restrict dst, const struct bson_stats* __restrict src)
+{
+    const volatile uint64_t* from = (const volatile uint64_t *)src;
+    uint64_t* to = (uint64_t *)dst;
+    for (size_t i = 0; i < offsetof(struct bson_stats, threads) / sizeof(uint64_t); ++i)
+    {
+        to[i] += from[i];
+    }
+}
+
+static void bson_stats_thread_exit(void* p)
+{
+    struct bson_stats_thread* t = (struct bson_stats_thread *)p;
+    pthread_mutex_lock(&s_mutex);
+    bson_stats_sum(&s_retired, &t->stats);
+    if(t->prev)
+    {
+        t->prev->next = t->next;
+    }
+    else
+    {
+        s_threads = t->next;
+    }
+    if(t->next)
+    {
+        t->next->prev = t->prev;
+    }
+    pthread_mutex_unlock(&s_mutex);
+    free(t);
+}
+
+static void bson_stats_init_key()
+{
+    pthread_key_create(&s_key, bson_stats_thread_exit);
+}
+
+/************************ Public statistics interface *************************/
+struct bson_stats* bson_stats_register()
+{
+    static struct bson_stats s_fallback;
+    struct bson_stats_thread* t = (struct bson_stats_thread *)calloc(1, sizeof(struct bson_stats_thread));
+    if(!t)
+    {
+        /* Counted, but not reported */
+        return &s_fallback;
+    }
+
+    pthread_once(&s_once, bson_stats_init_key);
+    pthread_setspecific(s_key, t);
+
+    pthread_mutex_lock(&s_mutex);
+    t->next = s_threads;
+    if(s_threads)
+    {
+        s_threads->prev = t;
+    }
+    s_threads = t;
+    pthread_mutex_unlock(&s_mutex);
+
+    bson_stats_tls = &t->stats;
+    return &t->stats;
+}
+
+uint64_t bson_stats_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void bson_stats_snapshot(struct bson_stats* __restrict s)
+{
+    memset(s, 0, sizeof(*s));
+    pthread_mutex_lock(&s_mutex);
+    bson_stats_sum(s, &s_retired);
+    for (struct bson_stats_thread* t = s_threads; t; t = t->next)
+    {
+        bson_stats_sum(s, &t->stats);
+        ++s->threads;
+    }
+    pthread_mutex_unlock(&s_mutex);
+}
+
+void bson_stats_reset()
+{
+    pthread_mutex_lock(&s_mutex);
+    memset(&s_retired, 0, sizeof(s_retired));
+    for (struct bson_stats_thread* t = s_threads; t; t = t->next)
+    {
+        memset(&t->stats, 0, offsetof(struct bson_stats, threads));
+    }
+    pthread_mutex_unlock(&s_mutex);
+}
+
+#else
+
+void bson_stats_snapshot(struct bson_stats* __restrict s)
+{
+    memset(s, 0, sizeof(*s));
+}
+
+void bson_stats_reset()
+{
+}
+
+#endif // BSON_ENABLE_STATS
@@ -0,0 +1,491 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "wal.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "crc32c.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX                 1024
+#endif
+
+/*************************** Private types ************************************/
+static const char s_wal_magic[8] = { 'B', 'S', 'O', 'N', 'W', 'A', 'L', '1' };
+
+/*
+ * Queued record. The document follows the node, right after the header,
+ * so the record is written with one iovec. Nodes without document are
+ * flush markers.
+ */
+struct bson_wal_node
+{
+    struct bson_wal_node*   next;
+    int                     waited;     /* Freed by the waiting producer */
+    volatile int            done;
+    int                     status;
+    int                     reserved;
+    struct bson_wal_record  header;
+};
+
+typedef char bson_wal_node_layout_check[
+    offsetof(struct bson_wal_node, header) + sizeof(struct bson_wal_record) == sizeof(struct bson_wal_node) ? 1 : -1];
+
+struct bson_wal
+{
+    int                     fd;
+    size_t                  max_batch;
+    pthread_t               thread;
+    pthread_mutex_t         mutex;
+    pthread_cond_t          wake;       /* Committer waits for records */
+    pthread_cond_t          committed;  /* Producers wait for commits */
+    struct bson_wal_node*   head;       /* Producers push here */
+    struct bson_wal_node*   tail;       /* Committer pops here */
+    struct bson_wal_node    stub;
+    int                     idle;       /* Committer sleeps or is about to */
+    int                     shutdown;
+    int                     failed;
+    uint64_t                next_lsn;
+    struct bson_wal_stats   stats;
+    struct bson_wal_node*   batch[BSON_WAL_MAX_BATCH];
+    struct iovec            iov[BSON_WAL_MAX_BATCH];
+};
+
+/*************************** Private queue interface **************************/
+/*
+ * Intrusive MPSC queue of Dmitry Vyukov: producers swap the head and then
+ * link the previous head, the single consumer follows next links.
+ */
+static void bson_wal_push(bson_wal_ref __restrict w, struct bson_wal_node* __restrict n)
+{
+    n->next = 0;
+    struct bson_wal_node* prev = __atomic_exchange_n(&w->head, n, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&prev->next, n, __ATOMIC_RELEASE);
+}
+
+/* Returns 0 if the queue is empty or a producer is between the swap and the link */
+static struct bson_wal_node* bson_wal_pop(bson_wal_ref w)
+{
+    struct bson_wal_node* tail = w->tail;
+    struct bson_wal_node* next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if(tail == &w->stub)
+    {
+        if(!next)
+        {
+            return 0;
+        }
+        w->tail = next;
+        tail = next;
+        next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    }
+    if(next)
+    {
+        w->tail = next;
+        return tail;
+    }
+    if(tail != __atomic_load_n(&w->head, __ATOMIC_SEQ_CST))
+    {
+        return 0;
+    }
+    bson_wal_push(w, &w->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if(next)
+    {
+        w->tail = next;
+        return tail;
+    }
+    return 0;
+}
+
+static int bson_wal_empty(bson_wal_ref w)
+{
+    struct bson_wal_node* tail = w->tail;
+    return !__atomic_load_n(&tail->next, __ATOMIC_ACQUIRE) && tail == __atomic_load_n(&w->head, __ATOMIC_SEQ_CST);
+}
+
+/*************************** Private interface ********************************/
+static int bson_wal_writev(int fd, struct iovec* iov, size_t niov)
+{
+    while(niov)
+    {
+        const int n = niov < IOV_MAX ? (int)niov : IOV_MAX;
+        ssize_t written = writev(fd, iov, n);
+        if(written < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return 1;
+        }
+        /* Skip what's written, including a part of an iovec */
+        while(niov && (size_t)written >= iov->iov_len)
+        {
+            written -= iov->iov_len;
+            iov++;
+            niov--;
+        }
+        if(niov)
+        {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return 0;
+}
+
+static void bson_wal_commit_batch(bson_wal_ref w, size_t n)
+{
+    size_t niov = 0;
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        struct bson_wal_record* h = &w->batch[i]->header;
+        if(h->size)
+        {
+            h->lsn = w->next_lsn++;
+            h->crc = bson_crc32c(h->crc, &h->lsn, sizeof(h->lsn));
+            w->iov[niov].iov_base = h;
+            w->iov[niov].iov_len = sizeof(*h) + h->size;
+            bytes += w->iov[niov].iov_len;
+            niov++;
+        }
+    }
+    
+    int status = w->failed;
+    if(!status && niov)
+    {
+        status = bson_wal_writev(w->fd, w->iov, niov) || fdatasync(w->fd);
+    }
+    
+    pthread_mutex_lock(&w->mutex);
+    w->failed = status;
+    if(niov)
+    {
+        w->stats.records += niov;
+        w->stats.batches++;
+        w->stats.bytes += bytes;
+    }
+    for (size_t i = 0; i < n; ++i)
+    {
+        struct bson_wal_node* node = w->batch[i];
+        node->status = status;
+        if(node->waited)
+        {
+            node->done = 1;
+        }
+        else
+        {
+            free(node);
+        }
+    }
+    pthread_cond_broadcast(&w->committed);
+    pthread_mutex_unlock(&w->mutex);
+}
+
+static void* bson_wal_main(void* arg)
+{
+    bson_wal_ref w = (bson_wal_ref)arg;
+    for (;;)
+    {
+        size_t n = 0;
+        while(n < w->max_batch)
+        {
+            struct bson_wal_node* node = bson_wal_pop(w);
+            if(!node)
+            {
+                break;
+            }
+            w->batch[n++] = node;
+        }
+        if(n)
+        {
+            bson_wal_commit_batch(w, n);
+            continue;
+        }
+        
+        if(!bson_wal_empty(w))
+        {
+            /* A producer is linking its record */
+            sched_yield();
+            continue;
+        }
+        
+        pthread_mutex_lock(&w->mutex);
+        __atomic_store_n(&w->idle, 1, __ATOMIC_SEQ_CST);
+        while(bson_wal_empty(w) && !w->shutdown)
+        {
+            pthread_cond_wait(&w->wake, &w->mutex);
+        }
+        __atomic_store_n(&w->idle, 0, __ATOMIC_SEQ_CST);
+        const int stop = w->shutdown && bson_wal_empty(w);
+        pthread_mutex_unlock(&w->mutex);
+        if(stop)
+        {
+            break;
+        }
+    }
+    return 0;
+}
+
+static struct bson_wal_node* bson_wal_node_create(bson_document_ref doc, int waited)
+{
+    const uint32_t size = doc ? (uint32_t)bson_document_size(doc) : 0;
+    struct bson_wal_node* node = malloc(sizeof(*node) + size);
+    if(!node)
+    {
+        return 0;
+    }
+    node->waited = waited;
+    node->done = 0;
+    node->status = 0;
+    node->header.size = size;
+    node->header.lsn = 0;
+    if(size)
+    {
+        /* CRC of the document is computed by the producer, the LSN is added on commit */
+        memcpy(node + 1, doc->data, size);
+        node->header.crc = bson_crc32c(0, doc->data, size);
+    }
+    return node;
+}
+
+static void bson_wal_enqueue(bson_wal_ref __restrict w, struct bson_wal_node* __restrict node)
+{
+    bson_wal_push(w, node);
+    if(__atomic_load_n(&w->idle, __ATOMIC_SEQ_CST))
+    {
+        pthread_mutex_lock(&w->mutex);
+        pthread_cond_signal(&w->wake);
+        pthread_mutex_unlock(&w->mutex);
+    }
+}
+
+static int bson_wal_wait(bson_wal_ref __restrict w, struct bson_wal_node* __restrict node, uint64_t* __restrict lsn)
+{
+    pthread_mutex_lock(&w->mutex);
+    while(!node->done)
+    {
+        pthread_cond_wait(&w->committed, &w->mutex);
+    }
+    pthread_mutex_unlock(&w->mutex);
+    
+    const int status = node->status;
+    if(lsn)
+    {
+        *lsn = node->header.lsn;
+    }
+    free(node);
+    return status;
+}
+
+/*************************** Public interface *********************************/
+int bson_wal_recover(int fd, bson_wal_replay_t replay, void* ctx, uint64_t* __restrict nrecords,
+                     uint64_t* __restrict size)
+{
+    *nrecords = 0;
+    *size = 0;
+    struct stat st;
+    if(fstat(fd, &st))
+    {
+        return 1;
+    }
+    if(st.st_size == 0)
+    {
+        return 0;
+    }
+    if((size_t)st.st_size < sizeof(s_wal_magic))
+    {
+        return 1;
+    }
+    
+    const size_t length = (size_t)st.st_size;
+    const char* map = mmap(0, length, PROT_READ, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED)
+    {
+        return 1;
+    }
+    if(memcmp(map, s_wal_magic, sizeof(s_wal_magic)) != 0)
+    {
+        munmap((void *)map, length);
+        return 1;
+    }
+    
+    int rc = 0;
+    size_t offset = sizeof(s_wal_magic);
+    uint64_t lsn = 1;
+    while(length - offset >= sizeof(struct bson_wal_record))
+    {
+        struct bson_wal_record h;
+        memcpy(&h, map + offset, sizeof(h));
+        const char* doc = map + offset + sizeof(h);
+        int32_t doc_size;
+        if(h.size < 5 || h.size > length - offset - sizeof(h) || h.lsn != lsn)
+        {
+            break;
+        }
+        memcpy(&doc_size, doc, sizeof(doc_size));
+        if((uint32_t)doc_size != h.size || doc[h.size - 1] != 0 ||
+           bson_crc32c(bson_crc32c(0, doc, h.size), &h.lsn, sizeof(h.lsn)) != h.crc)
+        {
+            break;
+        }
+        if(replay && replay(ctx, lsn, (bson_document_ref)doc))
+        {
+            rc = 1;
+            break;
+        }
+        offset += sizeof(h) + h.size;
+        lsn++;
+    }
+    munmap((void *)map, length);
+    
+    *nrecords = lsn - 1;
+    *size = offset;
+    return rc;
+}
+
+bson_wal_ref bson_wal_open(int fd, size_t max_batch, bson_wal_replay_t replay, void* ctx)
+{
+    uint64_t nrecords, size;
+    if(bson_wal_recover(fd, replay, ctx, &nrecords, &size))
+    {
+        return 0;
+    }
+    
+    struct stat st;
+    if(fstat(fd, &st))
+    {
+        return 0;
+    }
+    if(size == 0)
+    {
+        /* New log */
+        if(pwrite(fd, s_wal_magic, sizeof(s_wal_magic), 0) != sizeof(s_wal_magic))
+        {
+            return 0;
+        }
+        size = sizeof(s_wal_magic);
+    }
+    if((uint64_t)st.st_size != size && (ftruncate(fd, (off_t)size) || fdatasync(fd)))
+    {
+        return 0;
+    }
+    if(lseek(fd, (off_t)size, SEEK_SET) < 0)
+    {
+        return 0;
+    }
+    
+    bson_wal_ref w = calloc(1, sizeof(*w));
+    if(!w)
+    {
+        return 0;
+    }
+    w->fd = fd;
+    w->max_batch = max_batch && max_batch < BSON_WAL_MAX_BATCH ? max_batch : BSON_WAL_MAX_BATCH;
+    w->head = &w->stub;
+    w->tail = &w->stub;
+    w->next_lsn = nrecords + 1;
+    pthread_mutex_init(&w->mutex, 0);
+    pthread_cond_init(&w->wake, 0);
+    pthread_cond_init(&w->committed, 0);
+    if(pthread_create(&w->thread, 0, bson_wal_main, w))
+    {
+        pthread_cond_destroy(&w->committed);
+        pthread_cond_destroy(&w->wake);
+        pthread_mutex_destroy(&w->mutex);
+        free(w);
+        return 0;
+    }
+    return w;
+}
+
+int bson_wal_close(bson_wal_ref w)
+{
+    pthread_mutex_lock(&w->mutex);
+    w->shutdown = 1;
+    pthread_cond_signal(&w->wake);
+    pthread_mutex_unlock(&w->mutex);
+    pthread_join(w->thread, 0);
+    
+    const int rc = w->failed;
+    pthread_cond_destroy(&w->committed);
+    pthread_cond_destroy(&w->wake);
+    pthread_mutex_destroy(&w->mutex);
+    free(w);
+    return rc;
+}
+
+int bson_wal_append(bson_wal_ref __restrict w, bson_document_ref doc)
+{
+    if(!doc || __atomic_load_n(&w->failed, __ATOMIC_RELAXED))
+    {
+        return 1;
+    }
+    struct bson_wal_node* node = bson_wal_node_create(doc, 0);
+    if(!node)
+    {
+        return 1;
+    }
+    bson_wal_enqueue(w, node);
+    return 0;
+}
+
+int bson_wal_commit(bson_wal_ref __restrict w, bson_document_ref doc, uint64_t* __restrict lsn)
+{
+    struct bson_wal_node* node = doc ? bson_wal_node_create(doc, 1) : 0;
+    if(!node)
+    {
+        return 1;
+    }
+    bson_wal_enqueue(w, node);
+    return bson_wal_wait(w, node, lsn);
+}
+
+int bson_wal_flush(bson_wal_ref w)
+{
+    /* The queue is FIFO, so the marker is committed after earlier records of this thread */
+    struct bson_wal_node* node = bson_wal_node_create(0, 1);
+    if(!node)
+    {
+        return 1;
+    }
+    bson_wal_enqueue(w, node);
+    return bson_wal_wait(w, node, 0);
+}
+
+void bson_wal_stats(bson_wal_ref __restrict w, struct bson_wal_stats* __restrict stats)
+{
+    pthread_mutex_lock(&w->mutex);
+    *stats = w->stats;
+    pthread_mutex_unlock(&w->mutex);
+}
@@ -0,0 +1,318 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Alexey Komnin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "wire.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX                             1024
+#endif
+
+/*************************** Private wire interface ***************************/
+static int bson_wire_frame_reserve(bson_wire_frame_ref __restrict f, size_t n)
+{
+    if(f->niov + n <= f->max_iov && f->max_iov)
+    {
+        return 0;
+    }
+
+    size_t max_iov = f->max_iov ? f->max_iov : 16;
+    while(max_iov < f->niov + n + 1)
+    {
+        max_iov *= 2;
+    }
+    struct iovec* iov = (struct iovec *)realloc(f->iov, max_iov * sizeof(struct iovec));
+    if(!iov)
+    {
+        return 1;
+    }
+    f->iov = iov;
+    f->max_iov = max_iov;
+    if(!f->niov)
+    {
+        /* The header */
+        f->niov = 1;
+    }
+    return 0;
+}
+
+/* Checks that the body consists of whole documents */
+static int bson_wire_check_body(const char* body, size_t size)
+{
+    size_t offset = 0;
+    while(offset < size)
+    {
+        int32_t n;
+        if(size - offset < 5)
+        {
+            return 1;
+        }
+        memcpy(&n, body + offset, sizeof(n));
+        if(n < 5 || (size_t)n > size - offset || body[offset + n - 1] != '\0')
+        {
+            return 1;
+        }
+        offset += n;
+    }
+    return 0;
+}
+
+/*************************** Public frame interface ***************************/
+void bson_wire_frame_init(bson_wire_frame_ref __restrict f, int32_t request_id, int32_t response_to,
+                          int32_t opcode)
+{
+    f->iov = 0;
+    f->niov = 0;
+    f->max_iov = 0;
+    bson_wire_frame_reset(f, request_id, response_to, opcode);
+}
+
+void bson_wire_frame_deinit(bson_wire_frame_ref f)
+{
+    free(f->iov);
+    f->iov = 0;
+    f->niov = 0;
+    f->max_iov = 0;
+}
+
+void bson_wire_frame_reset(bson_wire_frame_ref __restrict f, int32_t request_id, int32_t response_to,
+                           int32_t opcode)
+{
+    f->header.length = sizeof(struct bson_wire_header);
+    f->header.request_id = request_id;
+    f->header.response_to = response_to;
+    f->header.opcode = opcode;
+    f->niov = f->iov ? 1 : 0;
+}
+
+int bson_wire_frame_add(bson_wire_frame_ref __restrict f, bson_document_ref doc)
+{
+    return bson_wire_frame_add_data(f, doc->data, bson_document_size(doc));
+}
+
+int bson_wire_frame_add_data(bson_wire_frame_ref __restrict f, const char* data, size_t size)
+{
+    if(size > (size_t)(BSON_WIRE_MAX_MESSAGE_SIZE - f->header.length) || bson_wire_frame_reserve(f, 1))
+    {
+        return 1;
+    }
+    f->iov[f->niov].iov_base = (void *)data;
+    f->iov[f->niov].iov_len = size;
+    ++f->niov;
+    f->header.length += (int32_t)size;
+    return 0;
+}
+
+const struct iovec* bson_wire_frame_iov(bson_wire_frame_ref __restrict f, size_t* __restrict niov)
+{
+    if(bson_wire_frame_reserve(f, 0))
+    {
+        return 0;
+    }
+    f->iov[0].iov_base = &f->header;
+    f->iov[0].iov_len = sizeof(f->header);
+    *niov = f->niov;
+    return f->iov;
+}
+
+int bson_wire_frame_send(int fd, bson_wire_frame_ref f)
+{
+    size_t n;
+    if(!bson_wire_frame_iov(f, &n))
+    {
+        errno = ENOMEM;
+        return 1;
+    }
+
+    struct iovec* iov = f->iov;
+    size_t i = 0;
+    size_t skip = 0;    /* Bytes of iov[i] already written */
+    while(i < n)
+    {
+        const struct iovec saved = iov[i];
+        iov[i].iov_base = (char *)iov[i].iov_base + skip;
+        iov[i].iov_len -= skip;
+        ssize_t rc = writev(fd, iov + i, n - i < IOV_MAX ? (int)(n - i) : IOV_MAX);
+        iov[i] = saved;
+        if(rc < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return 1;
+        }
+
+        size_t written = rc;
+        while(i < n && written >= iov[i].iov_len - skip)
+        {
+            written -= iov[i].iov_len - skip;
+            skip = 0;
+            ++i;
+        }
+        skip += written;
+    }
+    return 0;
+}
+
+/************************** Public message interface **************************/
+bson_document_ref bson_wire_message_next(bson_wire_message_ref __restrict msg, size_t* __restrict offset)
+{
+    if(*offset >= msg->size)
+    {
+        return 0;
+    }
+
+    bson_document_ref doc = (bson_document_ref)(msg->body + *offset);
+    *offset += bson_document_size(doc);
+    return doc;
+}
+
+/**************************** Public ring interface ***************************/
+int bson_wire_ring_init(bson_wire_ring_ref __restrict r, size_t capacity)
+{
+    memset(r, 0, sizeof(*r));
+    r->data = (char *)malloc(capacity);
+    if(!r->data)
+    {
+        return 1;
+    }
+    r->capacity = capacity;
+    r->need = sizeof(struct bson_wire_header);
+    return 0;
+}
+
+void bson_wire_ring_deinit(bson_wire_ring_ref r)
+{
+    free(r->data);
+    memset(r, 0, sizeof(*r));
+}
+
+ssize_t bson_wire_ring_recv(bson_wire_ring_ref __restrict r, int fd)
+{
+    if(r->need > r->capacity)
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    if(!r->wrap && r->parse + r->need > r->capacity)
+    {
+        /* The next message does not fit at the end: move its beginning to the start */
+        const size_t partial = r->write - r->parse;
+        if(r->release == r->parse)
+        {
+            memmove(r->data, r->data + r->parse, partial);
+            r->release = 0;
+        }
+        else if(r->need <= r->release)
+        {
+            memmove(r->data, r->data + r->parse, partial);
+            r->wrap = r->parse;
+        }
+        else
+        {
+            errno = ENOBUFS;
+            return -1;
+        }
+        r->parse = 0;
+        r->write = partial;
+    }
+
+    const size_t limit = r->wrap ? r->release : r->capacity;
+    if(r->write == limit || (r->wrap && r->parse + r->need > limit))
+    {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    ssize_t n;
+    do
+    {
+        n = read(fd, r->data + r->write, limit - r->write);
+    } while(n < 0 && errno == EINTR);
+
+    if(n > 0)
+    {
+        r->write += n;
+    }
+    return n;
+}
+
+int bson_wire_ring_next(bson_wire_ring_ref __restrict r, bson_wire_message_ref __restrict msg)
+{
+    const size_t avail = r->write - r->parse;
+    const char* p = r->data + r->parse;
+    if(avail < sizeof(struct bson_wire_header))
+    {
+        r->need = sizeof(struct bson_wire_header);
+        return 0;
+    }
+
+    memcpy(&msg->header, p, sizeof(msg->header));
+    const int32_t length = msg->header.length;
+    if(length < (int32_t)sizeof(struct bson_wire_header) || length > BSON_WIRE_MAX_MESSAGE_SIZE)
+    {
+        return -1;
+    }
+    if(avail < (size_t)length)
+    {
+        r->need = length;
+        return 0;
+    }
+
+    msg->body = p + sizeof(struct bson_wire_header);
+    msg->size = length - sizeof(struct bson_wire_header);
+    if(bson_wire_check_body(msg->body, msg->size))
+    {
+        return -1;
+    }
+
+    r->parse += length;
+    r->need = sizeof(struct bson_wire_header);
+    return 1;
+}
+
+void bson_wire_ring_release(bson_wire_ring_ref r)
+{
+    int32_t length;
+    memcpy(&length, r->data + r->release, sizeof(length));
+    r->release += length;
+    if(r->wrap && r->release == r->wrap)
+    {
+        /* Older messages are all released */
+        r->wrap = 0;
+        r->release = 0;
+    }
+    else if(!r->wrap && r->release == r->write)
+    {
+        /* Buffer is empty */
+        r->release = 0;
+        r->parse = 0;
+        r->write = 0;
+    }
+}